@@ -0,0 +1,160 @@
+#include "batch_runner.hpp"
+#include "interpreter_semantic_error.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace {
+
+const char *const SCRIPT_SUFFIX = ".slp";
+
+// Appends the scripts under directory, recursively, in no particular order
+void collectScripts(const std::string &directory, std::vector<std::string> &scripts)
+{
+    DIR *listing = opendir(directory.c_str());
+    if (!listing) {
+        return;
+    }
+    std::vector<std::string> subdirectories;
+    while (dirent *item = readdir(listing)) {
+        std::string name = item->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        std::string path = directory + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            continue;
+        }
+        std::size_t suffix = std::char_traits<char>::length(SCRIPT_SUFFIX);
+        if (S_ISDIR(info.st_mode)) {
+            subdirectories.push_back(path);
+        } else if (name.size() > suffix && name.compare(name.size() - suffix, suffix, SCRIPT_SUFFIX) == 0) {
+            scripts.push_back(path);
+        }
+    }
+    closedir(listing);
+    for (const auto &subdirectory : subdirectories) {
+        collectScripts(subdirectory, scripts);
+    }
+}
+
+// Evaluates one script in interpreter, which the caller has reset
+void runScript(Interpreter &interpreter, BatchResult &result)
+{
+    std::ifstream file(result.script);
+    if (!file) {
+        result.output = "Unable to open file " + result.script;
+        return;
+    }
+    if (!interpreter.parse(file)) {
+        result.output = interpreter.parse_error().empty() ? "Invalid expression in file"
+                                                          : "Invalid expression in file: " + interpreter.parse_error();
+        return;
+    }
+    try {
+        appendExpression(interpreter.eval(), result.output);
+        result.ok = true;
+    } catch (const InterpreterSemanticError &e) {
+        result.output = e.what();
+    } catch (const std::exception &e) {
+        // such as std::bad_alloc: this script fails, the batch goes on
+        result.output = std::string("Evaluation failed: ") + e.what();
+    } catch (...) {
+        result.output = "Evaluation failed";
+    }
+}
+
+}
+
+/* Lists the scripts in a directory tree or a list file */
+bool listBatchScripts(const std::string &source, std::vector<std::string> &scripts)
+{
+    struct stat info;
+    if (stat(source.c_str(), &info) != 0) {
+        return false;
+    }
+    if (S_ISDIR(info.st_mode)) {
+        std::string directory = source;
+        while (directory.size() > 1 && directory.back() == '/') {
+            directory.pop_back();
+        }
+        std::size_t first = scripts.size();
+        collectScripts(directory, scripts);
+        std::sort(scripts.begin() + first, scripts.end());
+        return true;
+    }
+    std::ifstream list(source);
+    if (!list) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.find_first_not_of(" \t") != std::string::npos) {
+            scripts.push_back(line);
+        }
+    }
+    return true;
+}
+
+/* Evaluates scripts on a set of threads, reporting the results in order.
+   Threads take the next unclaimed script, so a slow script holds up only the reports after it;
+   finished results wait in completed until every earlier one has been reported. */
+BatchSummary runBatch(const std::vector<std::string> &scripts, std::size_t jobs,
+                      const std::function<void(Interpreter &)> &configure,
+                      const std::function<void(const BatchResult &)> &report)
+{
+    if (jobs == 0) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    jobs = std::max<std::size_t>(1, std::min(jobs, scripts.size()));
+
+    std::atomic<std::size_t> next_script(0);
+    std::mutex report_mutex;
+    std::map<std::size_t, BatchResult> completed;
+    std::size_t next_report = 0;
+    BatchSummary summary;
+    summary.scripts = scripts.size();
+
+    auto work = [&]() {
+        std::unique_ptr<Interpreter> interpreter(new Interpreter);
+        configure(*interpreter);
+        for (std::size_t i = next_script++; i < scripts.size(); i = next_script++) {
+            BatchResult result;
+            result.script = scripts[i];
+            interpreter->reset();
+            runScript(*interpreter, result);
+
+            std::lock_guard<std::mutex> lock(report_mutex);
+            completed.emplace(i, std::move(result));
+            for (auto ready = completed.begin(); ready != completed.end() && ready->first == next_report;
+                 ready = completed.erase(ready), ++next_report) {
+                if (!ready->second.ok) {
+                    ++summary.failed;
+                }
+                report(ready->second);
+            }
+        }
+    };
+
+    // the calling thread is one of the workers
+    std::vector<std::thread> threads;
+    for (std::size_t t = 1; t < jobs; ++t) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    return summary;
+}
@@ -0,0 +1,37 @@
+#ifndef BATCH_RUNNER_HPP
+#define BATCH_RUNNER_HPP
+
+#include "interpreter.hpp"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Outcome of one script of a batch
+struct BatchResult {
+    std::string script; // the path as listed
+    bool ok = false;
+    std::string output; // the printed value, or the error message
+};
+
+// Totals of a batch
+struct BatchSummary {
+    std::size_t scripts = 0;
+    std::size_t failed = 0;
+};
+
+// Lists the scripts of a batch into scripts: the .slp files under source, searched
+// recursively and sorted, if it is a directory, else the paths source lists one per line,
+// blank lines skipped. False if source cannot be read.
+bool listBatchScripts(const std::string &source, std::vector<std::string> &scripts);
+
+// Evaluates each script as slisp would a file, on jobs threads (0 selects the hardware
+// concurrency) with one Interpreter per thread, reset between scripts so none sees
+// another's globals. configure sets up each thread's interpreter once. report is called
+// once per script, in the order listed and never concurrently, as soon as the script
+// and every script before it have finished.
+BatchSummary runBatch(const std::vector<std::string> &scripts, std::size_t jobs,
+                      const std::function<void(Interpreter &)> &configure,
+                      const std::function<void(const BatchResult &)> &report);
+
+#endif
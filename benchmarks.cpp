@@ -0,0 +1,782 @@
+// Benchmarks are hidden test cases; run them with: ./unittests "[benchmark]"
+#include "catch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "session.hpp"
+#include "batch_runner.hpp"
+#include "server.hpp"
+#include "result_writer.hpp"
+#include "number_format.hpp"
+#include "form_scanner.hpp"
+#include "test_config.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+// Returns the best wall time in milliseconds over reps runs of fn
+template <typename Fn>
+static double bestOfMs(int reps, Fn fn) {
+    double best = 0;
+    for (int i = 0; i < reps; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (i == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+// Builds (+ (* 1 2) (* 1 2) ...) with n terms
+static std::string wideArithmeticProgram(int n) {
+    std::string program = "(+";
+    for (int i = 0; i < n; ++i) {
+        program += " (* 1 2)";
+    }
+    return program + ")";
+}
+
+TEST_CASE("Benchmark budget check overhead", "[.][benchmark]") {
+    std::istringstream iss(wideArithmeticProgram(50000));
+    Interpreter unlimited;
+    REQUIRE(unlimited.parse(iss));
+
+    iss.clear();
+    iss.seekg(0);
+    Interpreter limited;
+    EvalLimits limits;
+    limits.max_steps = 1ull << 40;
+    limits.max_nodes = 1ull << 40;
+    limits.max_bytes = 1ull << 50;
+    limits.max_time_ms = 1ull << 30;
+    limited.set_limits(limits);
+    REQUIRE(limited.parse(iss));
+
+    // interleave the two configurations so both see the same machine noise
+    double plain = 0;
+    double budgeted = 0;
+    for (int round = 0; round < 10; ++round) {
+        double a = bestOfMs(2, [&]() { unlimited.eval(); });
+        double b = bestOfMs(2, [&]() { limited.eval(); });
+        plain = (round == 0 || a < plain) ? a : plain;
+        budgeted = (round == 0 || b < budgeted) ? b : budgeted;
+    }
+
+    std::cout << "budget overhead: unlimited " << plain << " ms, all budgets " << budgeted
+              << " ms (" << (budgeted / plain - 1.0) * 100.0 << "%)" << std::endl;
+}
+
+// Parses and evaluates program once with a fresh interpreter
+static void parseAndEval(const std::string &program) {
+    std::istringstream iss(program);
+    Interpreter interpreter;
+    REQUIRE(interpreter.parse(iss));
+    interpreter.eval();
+}
+
+TEST_CASE("Benchmark recursive shape generator vs expanded script", "[.][benchmark]") {
+    const int n = 20000;
+
+    std::string recursive =
+        "(begin"
+        " (define row (lambda (i n) (if (< i n) (begin (draw (point i (* 2 i))) (row (+ i 1) n)) n)))"
+        " (row 0 " + std::to_string(n) + "))";
+
+    std::string expanded = "(begin";
+    for (int i = 0; i < n; ++i) {
+        expanded += " (draw (point " + std::to_string(i) + " (* 2 " + std::to_string(i) + ")))";
+    }
+    expanded += ")";
+
+    double recursive_ms = bestOfMs(5, [&]() { parseAndEval(recursive); });
+    double expanded_ms = bestOfMs(5, [&]() { parseAndEval(expanded); });
+
+    std::cout << "recursive generator: " << recursive.size() << " bytes, " << recursive_ms << " ms; "
+              << "expanded script: " << expanded.size() << " bytes, " << expanded_ms << " ms" << std::endl;
+}
+
+TEST_CASE("Benchmark 1M points from a for loop vs expanded literals", "[.][benchmark]") {
+    const int width = 1000;
+    const int height = 1000;
+
+    std::string loop = "(for y 0 " + std::to_string(height) + " 1 (for x 0 " + std::to_string(width) +
+                       " 1 (draw (point x y))))";
+
+    std::string expanded = "(begin";
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            expanded += " (draw (point " + std::to_string(x) + " " + std::to_string(y) + "))";
+        }
+    }
+    expanded += ")";
+
+    double loop_ms = bestOfMs(3, [&]() { parseAndEval(loop); });
+    double expanded_ms = bestOfMs(1, [&]() { parseAndEval(expanded); });
+
+    std::cout << "1M points: for loop " << loop.size() << " bytes, " << loop_ms << " ms; "
+              << "expanded literals " << expanded.size() << " bytes, " << expanded_ms << " ms" << std::endl;
+}
+
+TEST_CASE("Benchmark element-wise list arithmetic vs a scalar loop", "[.][benchmark]") {
+    const std::string n = "1000000";
+
+    // the same polynomial over 1M values, once per element in a loop and once over a list
+    std::string scalar = "(for x 0 " + n + " 1 (+ (* x x 3) (* x 2) 1))";
+    std::string vectorized = "(begin (define x (range " + n + ")) (sum (+ (* x x 3) (* x 2) 1)))";
+
+    double scalar_ms = bestOfMs(3, [&]() { parseAndEval(scalar); });
+    double list_ms = bestOfMs(3, [&]() { parseAndEval(vectorized); });
+
+    std::cout << "1M-element polynomial: scalar loop " << scalar_ms << " ms; list " << list_ms << " ms ("
+              << scalar_ms / list_ms << "x)" << std::endl;
+}
+
+TEST_CASE("Benchmark pmap scaling over threads", "[.][benchmark]") {
+    // trig-heavy per-element work: each element sums an arc of 200 sine samples
+    std::string program =
+        "(pmap (lambda (a) (sum (sin (+ a (* (range 200) 0.01))))) (range 20000))";
+
+    std::size_t hardware = std::thread::hardware_concurrency();
+    double single_ms = 0;
+    for (std::size_t threads = 1; threads <= (hardware > 1 ? hardware : 2); threads *= 2) {
+        Interpreter interpreter;
+        interpreter.set_threads(threads);
+        std::istringstream iss(program);
+        REQUIRE(interpreter.parse(iss));
+        double ms = bestOfMs(3, [&]() { interpreter.eval(); });
+        if (threads == 1) {
+            single_ms = ms;
+        }
+        std::cout << "pmap over 20000 elements, " << threads << " threads: " << ms << " ms ("
+                  << single_ms / ms << "x)" << std::endl;
+    }
+}
+
+TEST_CASE("Benchmark concurrent evaluation of pure arguments", "[.][benchmark]") {
+    const std::string fib = "(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))";
+    std::string heavy = "(+ (fib 21) (fib 21) (fib 21) (fib 21))";
+    std::string small = "(for i 0 50000 1 (+ (* i 2) (* i 3)))";
+
+    std::size_t hardware = std::thread::hardware_concurrency();
+    std::size_t threads = hardware > 1 ? hardware : 4;
+    for (const std::string *program : {&heavy, &small}) {
+        double sequential_ms = 0;
+        double concurrent_ms = 0;
+        for (std::size_t count : {static_cast<std::size_t>(1), threads}) {
+            Interpreter interpreter;
+            interpreter.set_threads(count);
+            std::istringstream setup(fib);
+            REQUIRE(interpreter.parse(setup));
+            interpreter.eval();
+            std::istringstream iss(*program);
+            REQUIRE(interpreter.parse(iss));
+            (count == 1 ? sequential_ms : concurrent_ms) = bestOfMs(3, [&]() { interpreter.eval(); });
+        }
+        std::cout << (program == &heavy ? "4 recursive arguments" : "200k small calls") << ": 1 thread "
+                  << sequential_ms << " ms, " << threads << " threads " << concurrent_ms << " ms" << std::endl;
+    }
+}
+
+// Builds a begin block with wide fan-out: width expensive defines reading one seed, then
+// width cheap defines each combining two of them, then their sum
+static std::string fanOutProgram(int width) {
+    std::string program = "(begin (define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))) (define seed 16)";
+    for (int i = 0; i < width; ++i) {
+        program += " (define v" + std::to_string(i) + " (fib (+ seed " + std::to_string(i % 3) + ")))";
+    }
+    for (int i = 0; i < width; ++i) {
+        program += " (define w" + std::to_string(i) + " (+ v" + std::to_string(i) + " v" +
+                   std::to_string((i + 1) % width) + "))";
+    }
+    program += " (+";
+    for (int i = 0; i < width; ++i) {
+        program += " w" + std::to_string(i);
+    }
+    return program + "))";
+}
+
+TEST_CASE("Benchmark dataflow scheduling of a wide begin block", "[.][benchmark]") {
+    std::string program = fanOutProgram(64);
+    std::size_t hardware = std::thread::hardware_concurrency();
+    std::size_t threads = hardware > 1 ? hardware : 4;
+
+    Expression expected;
+    double sequential_ms = 0;
+    double dataflow_ms = 0;
+    for (bool dataflow : {false, true}) {
+        double best = 0;
+        for (int rep = 0; rep < 3; ++rep) {
+            Interpreter interpreter;
+            interpreter.set_threads(threads);
+            interpreter.set_dataflow(dataflow);
+            std::istringstream iss(program);
+            REQUIRE(interpreter.parse(iss));
+            Expression result;
+            double ms = bestOfMs(1, [&]() { result = interpreter.eval(); });
+            best = (rep == 0 || ms < best) ? ms : best;
+            if (!dataflow) {
+                expected = result;
+            } else {
+                REQUIRE(result == expected);
+            }
+        }
+        (dataflow ? dataflow_ms : sequential_ms) = best;
+    }
+    std::cout << "64-wide begin block, " << threads << " threads: sequential " << sequential_ms
+              << " ms, dataflow " << dataflow_ms << " ms (" << sequential_ms / dataflow_ms << "x)" << std::endl;
+}
+
+TEST_CASE("Benchmark memo cache on repeated pure calls", "[.][benchmark]") {
+    // a generated script recomputing the same shapes and angles on every iteration
+    std::string setup =
+        "(define spoke (lambda (k) (line (point 0 0) (point (* 100 (cos (* k (/ pi 8)))) (* 100 (sin (* k (/ pi 8))))))))";
+    std::string program = "(for i 0 20000 1 (begin (spoke 3) (arc (point -50 10) (point 10 0) (/ pi 4)) (sin (/ pi 8))))";
+
+    double times[2] = {0, 0};
+    for (std::size_t capacity : {std::size_t(0), std::size_t(1024)}) {
+        Interpreter interpreter;
+        interpreter.set_memo_capacity(capacity);
+        std::istringstream define(setup);
+        REQUIRE(interpreter.parse(define));
+        interpreter.eval();
+        std::istringstream iss(program);
+        REQUIRE(interpreter.parse(iss));
+        times[capacity != 0] = bestOfMs(5, [&]() { interpreter.eval(); });
+        if (capacity != 0) {
+            REQUIRE(interpreter.memo_stats().hits > 0);
+        }
+    }
+    std::cout << "repeated pure calls: memo off " << times[0] << " ms, memo on " << times[1]
+              << " ms (" << times[0] / times[1] << "x)" << std::endl;
+}
+
+TEST_CASE("Benchmark fast math mode on trig-heavy layouts", "[.][benchmark]") {
+    // points and spokes around a circle, then the same angles as one list
+    std::string setup =
+        "(begin (define l (range 0 400 0.001)) (define spot (lambda (a) (begin"
+        " (line (point (* 50 (cos a)) (* 50 (sin a))) (point (* 80 (cos a)) (* 80 (sin a))))"
+        " (arctan (sin a) (cos a)) (pow (cos a) 2)))))";
+    const char *programs[2] = {"(for i 0 20000 1 (spot (* i 0.01)))", "(sum (+ (pow (sin l) 2) (pow (cos l) 2)))"};
+
+    for (int p = 0; p < 2; ++p) {
+        double times[2] = {0, 0};
+        for (MathMode mode : {MathMode::Precise, MathMode::Fast}) {
+            Interpreter interpreter;
+            interpreter.set_math_mode(mode);
+            std::istringstream define(setup);
+            REQUIRE(interpreter.parse(define));
+            interpreter.eval();
+            std::istringstream iss(programs[p]);
+            REQUIRE(interpreter.parse(iss));
+            times[mode == MathMode::Fast] = bestOfMs(5, [&]() { interpreter.eval(); });
+        }
+        std::cout << (p == 0 ? "scalar" : "list") << " layout: precise " << times[0]
+                  << " ms, fast " << times[1] << " ms (" << times[0] / times[1] << "x)" << std::endl;
+    }
+}
+
+// Error of got in units in the last place of the exact result want
+static double ulpsFrom(double got, long double want) {
+    double rounded = static_cast<double>(want);
+    if (got == rounded || (std::isnan(got) && std::isnan(rounded))) {
+        return 0;
+    }
+    double ulp = std::nextafter(std::fabs(rounded), HUGE_VAL) - std::fabs(rounded);
+    return static_cast<double>(std::fabs(static_cast<long double>(got) - want) / ulp);
+}
+
+TEST_CASE("Report fast math accuracy over the double range", "[.][benchmark]") {
+    // magnitudes log-uniform over all exponents, both signs, against long double references
+    std::mt19937_64 rng(34);
+    std::uniform_real_distribution<double> mantissa(1, 2);
+    std::uniform_int_distribution<int> exponent(-1074, 1023);
+    auto sample = [&]() {
+        double x = std::ldexp(mantissa(rng), exponent(rng));
+        return (rng() & 1) ? -x : x;
+    };
+    const Number special[] = {0.0, -0.0, HUGE_VAL, -HUGE_VAL, NAN, 4.9e-324, FAST_MIN_NORMAL, FAST_MAX_FINITE,
+                              1.0, -1.0, 0.5, 2.0, 3.14159265358979311600, FAST_TRIG_LIMIT};
+
+    double sin_cos = 0, atan2 = 0, log10 = 0, pow = 0;
+    auto measure = [&](double x, double y) {
+        sin_cos = std::max(sin_cos, std::max(ulpsFrom(fastSin(x), sinl(x)), ulpsFrom(fastCos(x), cosl(x))));
+        atan2 = std::max(atan2, ulpsFrom(fastAtan2(x, y), atan2l(x, y)));
+        log10 = std::max(log10, ulpsFrom(fastLog10(std::fabs(x)), log10l(std::fabs(x))));
+        for (double e : {2.0, 3.0, 0.5, -1.0, -2.0, 1.7}) {
+            double p = fastPow(std::fabs(x), e);
+            if (std::isfinite(p) && p != 0) {
+                pow = std::max(pow, ulpsFrom(p, powl(std::fabs(x), e)));
+            }
+        }
+    };
+    for (Number x : special) {
+        for (Number y : special) {
+            measure(x, y);
+        }
+    }
+    for (int i = 0; i < 500000; ++i) {
+        measure(sample(), sample());
+        // the range the trig kernels reduce themselves
+        double angle = std::ldexp(mantissa(rng), exponent(rng) % 20);
+        sin_cos = std::max(sin_cos, std::max(ulpsFrom(fastSin(angle), sinl(angle)), ulpsFrom(fastCos(-angle), cosl(-angle))));
+    }
+    std::cout << "max ulp: sin/cos " << sin_cos << " (bound " << FAST_SIN_COS_MAX_ULP << "), atan2 " << atan2
+              << " (bound " << FAST_ATAN2_MAX_ULP << "), log10 " << log10 << " (bound " << FAST_LOG10_MAX_ULP
+              << "), pow " << pow << " (bound " << FAST_POW_MAX_ULP << ")" << std::endl;
+    REQUIRE(sin_cos <= FAST_SIN_COS_MAX_ULP);
+    REQUIRE(atan2 <= FAST_ATAN2_MAX_ULP);
+    REQUIRE(log10 <= FAST_LOG10_MAX_ULP);
+    REQUIRE(pow <= FAST_POW_MAX_ULP);
+}
+
+TEST_CASE("Benchmark live redefinition vs a full rerun of a 50k-shape scene", "[.][benchmark]") {
+    // 500 rows of 100 points, of which only the first reads the parameter
+    auto scene = [](int width) {
+        std::string script = "(begin (define width " + std::to_string(width) + ")";
+        script += " (for i 0 width 1 (draw (point i -1)))";
+        for (int row = 0; row < 500; ++row) {
+            script += " (for i 0 100 1 (draw (point i " + std::to_string(row) + ")))";
+        }
+        return script + ")";
+    };
+
+    double rerun = bestOfMs(3, [&]() {
+        Interpreter interpreter;
+        std::istringstream iss(scene(120));
+        REQUIRE(interpreter.parse(iss));
+        interpreter.eval();
+    });
+
+    Interpreter interpreter;
+    interpreter.set_live(true);
+    std::istringstream iss(scene(100));
+    REQUIRE(interpreter.parse(iss));
+    interpreter.eval();
+    int width = 100;
+    double live = bestOfMs(3, [&]() {
+        std::istringstream edit("(define width " + std::to_string(++width) + ")");
+        REQUIRE(interpreter.parse(edit));
+        interpreter.eval();
+    });
+    REQUIRE(interpreter.reevaluated_forms() == 1);
+    std::cout << "edit one parameter of a 50k-shape scene: full rerun " << rerun << " ms, live " << live
+              << " ms (" << rerun / live << "x)" << std::endl;
+}
+
+TEST_CASE("Benchmark type-checked vs inferred shape construction", "[.][benchmark]") {
+    std::string program =
+        "(begin (define r (rect 0 0 10 10))"
+        " (for i 0 50000 1 (list (line (point i 0) (point 0 i)) (arc (point i i) (point 0 0) 1)"
+        " (fill_rect r (+ i 1) (* i 2) (- i 3)) (ellipse r) (< i (/ i 2)))))";
+
+    double times[2];
+    for (int infer = 0; infer < 2; ++infer) {
+        times[infer] = bestOfMs(3, [&]() {
+            Interpreter interpreter;
+            interpreter.set_type_inference(infer != 0);
+            std::istringstream iss(program);
+            REQUIRE(interpreter.parse(iss));
+            interpreter.eval();
+        });
+    }
+    std::cout << "50k iterations of shape construction: checked " << times[0] << " ms, inferred " << times[1]
+              << " ms (" << times[0] / times[1] << "x)" << std::endl;
+}
+
+TEST_CASE("Benchmark embedded calls vs spawning slisp", "[.][benchmark]") {
+    const int calls = 2000;
+    std::vector<std::string> programs;
+    for (int i = 0; i < calls; ++i) {
+        programs.push_back("(begin (define p" + std::to_string(i) + " (point " + std::to_string(i) +
+                           " 1)) (draw (line p" + std::to_string(i) + " (point 0 0))) (* " + std::to_string(i) + " 2))");
+    }
+
+    double single = bestOfMs(3, [&]() {
+        Session fresh;
+        for (const auto &program : programs) {
+            REQUIRE(fresh.eval(program).ok);
+        }
+    });
+    double batched = bestOfMs(3, [&]() {
+        Session fresh;
+        REQUIRE(fresh.eval_batch(programs).back().ok);
+    });
+    std::cout << calls << " programs in process: eval " << calls / single * 1000 << " calls/s, eval_batch "
+              << calls / batched * 1000 << " calls/s" << std::endl;
+
+    if (access(SLISP_BINARY.c_str(), X_OK) != 0) {
+        WARN("slisp is not built at " << SLISP_BINARY << "; skipping the spawned comparison");
+        return;
+    }
+    const int spawns = 100;
+    double spawned = bestOfMs(1, [&]() {
+        for (int i = 0; i < spawns; ++i) {
+            std::string command = SLISP_BINARY + " --no-cache -e '" + programs[i] + "' > /dev/null";
+            FILE *process = popen(command.c_str(), "r");
+            REQUIRE(process != nullptr);
+            REQUIRE(pclose(process) == 0);
+        }
+    });
+    std::cout << spawns << " spawns of slisp -e: " << spawns / spawned * 1000 << " calls/s (eval is "
+              << (calls / single) / (spawns / spawned) << "x faster)" << std::endl;
+}
+
+TEST_CASE("Benchmark independent interpreters scaling over threads", "[.][benchmark]") {
+    std::string program =
+        "(begin (define f (lambda (x) (+ (* x x) (sin x))))"
+        " (define r (rect 0 0 4 4))"
+        " (for i 0 20000 1 (draw (fill_rect r (f i) (cos i) 0.5))))";
+    const unsigned max_threads = std::max(2u, std::thread::hardware_concurrency());
+    const int per_thread = 8;
+
+    std::vector<unsigned> counts;
+    for (unsigned threads = 1; threads < max_threads; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(max_threads);
+
+    double single = 0;
+    for (unsigned threads : counts) {
+        double ms = bestOfMs(3, [&]() {
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads; ++t) {
+                workers.emplace_back([&]() {
+                    for (int i = 0; i < per_thread; ++i) {
+                        Interpreter interpreter;
+                        std::istringstream iss(program);
+                        interpreter.parse(iss);
+                        interpreter.eval();
+                    }
+                });
+            }
+            for (auto &worker : workers) {
+                worker.join();
+            }
+        });
+        double rate = threads * per_thread / ms * 1000;
+        if (threads == 1) {
+            single = rate;
+        }
+        std::cout << threads << " threads: " << rate << " evals/s (" << rate / single << "x, efficiency "
+                  << rate / single / threads << ")" << std::endl;
+    }
+}
+
+TEST_CASE("Benchmark batch mode over jobs vs a process per script", "[.][benchmark]") {
+    char name[] = "/tmp/slisp-batch-XXXXXX";
+    REQUIRE(mkdtemp(name) != nullptr);
+    std::string dir = name;
+    std::vector<std::string> scripts;
+    for (int i = 0; i < 400; ++i) {
+        scripts.push_back(dir + "/script" + std::to_string(i) + ".slp");
+        std::ofstream(scripts.back()) << "(begin (define r (rect 0 0 " << i << " 1))"
+                                      << " (for j 0 300 1 (draw (fill_rect r (sin j) (cos j) 0.5))) (* " << i << " 2))";
+    }
+
+    const unsigned max_jobs = std::max(2u, std::thread::hardware_concurrency());
+    std::vector<unsigned> counts;
+    for (unsigned jobs = 1; jobs < max_jobs; jobs *= 2) {
+        counts.push_back(jobs);
+    }
+    counts.push_back(max_jobs);
+
+    double single = 0;
+    for (unsigned jobs : counts) {
+        double ms = bestOfMs(3, [&]() {
+            BatchSummary summary = runBatch(scripts, jobs, [](Interpreter &) {}, [](const BatchResult &) {});
+            REQUIRE(summary.failed == 0);
+        });
+        double rate = scripts.size() / ms * 1000;
+        if (jobs == 1) {
+            single = rate;
+        }
+        std::cout << "batch of " << scripts.size() << " scripts, " << jobs << " jobs: " << rate << " scripts/s ("
+                  << rate / single << "x)" << std::endl;
+    }
+
+    if (access(SLISP_BINARY.c_str(), X_OK) == 0) {
+        const std::size_t spawns = 50;
+        double spawned = bestOfMs(1, [&]() {
+            for (std::size_t i = 0; i < spawns; ++i) {
+                std::string command = SLISP_BINARY + " --no-cache " + scripts[i] + " > /dev/null";
+                REQUIRE(std::system(command.c_str()) == 0);
+            }
+        });
+        std::cout << "a slisp process per script: " << spawns / spawned * 1000 << " scripts/s" << std::endl;
+    }
+
+    for (const auto &script : scripts) {
+        unlink(script.c_str());
+    }
+    rmdir(dir.c_str());
+}
+
+TEST_CASE("Benchmark requests to slisp --serve vs spawning slisp", "[.][benchmark]") {
+    char name[] = "/tmp/slisp-serve-XXXXXX";
+    REQUIRE(mkdtemp(name) != nullptr);
+    std::string socket = std::string(name) + "/slisp.sock";
+    const int requests = 5000;
+    {
+        Server server(socket, 0, [](Interpreter &) {});
+        REQUIRE(server.listen());
+        std::thread serving([&]() { server.run(); });
+        for (int sessions : {1, 8}) {
+            double ms = bestOfMs(3, [&]() {
+                int fd = connectServer(socket);
+                REQUIRE(fd >= 0);
+                std::string frames;
+                for (int i = 0; i < requests; ++i) {
+                    Request request;
+                    request.session = "s" + std::to_string(i % sessions);
+                    request.body = "(begin (draw (line (point " + std::to_string(i) + " 1) (point 0 0))) (* " +
+                                   std::to_string(i) + " 2))";
+                    frames += encodeRequest(request);
+                }
+                REQUIRE(writeAll(fd, frames));
+                std::string payload;
+                for (int i = 0; i < requests; ++i) {
+                    REQUIRE(readFrame(fd, payload));
+                }
+                close(fd);
+            });
+            std::cout << requests << " pipelined requests over " << sessions << " sessions: " << requests / ms * 1000
+                      << " requests/s" << std::endl;
+        }
+        server.stop();
+        serving.join();
+    }
+    rmdir(name);
+
+    if (access(SLISP_BINARY.c_str(), X_OK) == 0) {
+        const int spawns = 100;
+        double spawned = bestOfMs(1, [&]() {
+            for (int i = 0; i < spawns; ++i) {
+                REQUIRE(std::system((SLISP_BINARY + " --no-cache -e '(* 2 3)' > /dev/null").c_str()) == 0);
+            }
+        });
+        std::cout << "slisp -e per request: " << spawns / spawned * 1000 << " requests/s" << std::endl;
+    }
+}
+
+TEST_CASE("Benchmark piping forms to slisp --stdin vs the REPL", "[.][benchmark]") {
+    if (access(SLISP_BINARY.c_str(), X_OK) != 0) {
+        WARN("slisp is not built at " << SLISP_BINARY << "; skipping");
+        return;
+    }
+    char name[] = "/tmp/slisp-stdin-XXXXXX";
+    REQUIRE(mkdtemp(name) != nullptr);
+    std::string input = std::string(name) + "/forms.slp";
+    const int forms = 200000;
+    {
+        std::ofstream file(input);
+        file << "(define x 1)\n";
+        for (int i = 1; i < forms; ++i) {
+            file << "(+ x " << i << " (* 2 " << i << "))\n";
+        }
+    }
+
+    for (std::string mode : {"--stdin", ""}) {
+        double ms = bestOfMs(3, [&]() {
+            std::string command = SLISP_BINARY + " --no-cache " + mode + " < " + input + " > /dev/null 2>&1";
+            REQUIRE(std::system(command.c_str()) == 0);
+        });
+        std::cout << forms << " forms through " << (mode.empty() ? "the REPL" : "slisp --stdin") << ": "
+                  << forms / ms * 1000 << " forms/s" << std::endl;
+    }
+
+    unlink(input.c_str());
+    rmdir(name);
+}
+
+TEST_CASE("Benchmark writing a shape list as text, NDJSON and binary", "[.][benchmark]") {
+    const int count = 200000;
+    std::shared_ptr<List> shapes = std::make_shared<List>();
+    shapes->numeric = false;
+    std::mt19937 random(3);
+    std::uniform_real_distribution<double> coordinate(-1000, 1000);
+    for (int i = 0; i < count; ++i) {
+        Atom shape;
+        shape.type = LineType;
+        shape.value.line_value = Line{Point{coordinate(random), coordinate(random)},
+                                      Point{coordinate(random), coordinate(random)}};
+        shapes->items.push_back(shape);
+    }
+    Atom list;
+    list.type = ListType;
+    list.value.list_value = shapes;
+    Expression result(list);
+
+    const std::pair<OutputFormat, const char *> formats[] = {
+        {OutputFormat::Text, "text"}, {OutputFormat::Ndjson, "ndjson"}, {OutputFormat::Binary, "binary"}};
+    for (const auto &format : formats) {
+        std::string out;
+        double ms = bestOfMs(3, [&]() {
+            out.clear();
+            appendResult(format.first, result, out);
+        });
+        std::cout << count << " lines as " << format.second << ": " << count / ms * 1000 << " shapes/s, "
+                  << out.size() / ms / 1000 << " MB/s" << std::endl;
+    }
+}
+
+TEST_CASE("Benchmark formatting 10M numbers", "[.][benchmark]") {
+    const std::size_t count = 10000000;
+    std::vector<double> values(count);
+    std::mt19937_64 random(11);
+    std::uniform_real_distribution<double> coordinate(-1000, 1000);
+    for (std::size_t i = 0; i < count; ++i) {
+        // half whole coordinates, half computed ones with 16-17 digits
+        values[i] = i % 2 == 0 ? std::floor(coordinate(random)) : coordinate(random);
+    }
+    std::string out;
+    out.reserve(count * MAX_NUMBER_CHARS);
+    auto report = [&](const char *name, double ms) {
+        std::cout << name << ": " << count / ms / 1000 << " M numbers/s (" << out.size() / count << " bytes each)"
+                  << std::endl;
+    };
+
+    report("shortest round-trip", bestOfMs(3, [&]() {
+        out.clear();
+        char text[MAX_NUMBER_CHARS];
+        for (double value : values) {
+            out.append(text, formatNumber(value, text));
+            out += ' ';
+        }
+    }));
+    report("printf %.17g", bestOfMs(1, [&]() {
+        out.clear();
+        char text[MAX_NUMBER_CHARS];
+        for (double value : values) {
+            out.append(text, std::snprintf(text, sizeof(text), "%.17g", value));
+            out += ' ';
+        }
+    }));
+    report("ostream, 6 digits", bestOfMs(1, [&]() {
+        std::ostringstream stream;
+        for (double value : values) {
+            stream << value << ' ';
+        }
+        out = stream.str();
+    }));
+
+    // whole expressions: a list of lines, printed through operator<< in each style
+    std::shared_ptr<List> shapes = std::make_shared<List>();
+    shapes->numeric = false;
+    for (std::size_t i = 0; i + 4 <= 400000; i += 4) {
+        Atom line;
+        line.type = LineType;
+        line.value.line_value = Line{Point{values[i], values[i + 1]}, Point{values[i + 2], values[i + 3]}};
+        shapes->items.push_back(line);
+    }
+    Atom list;
+    list.type = ListType;
+    list.value.list_value = shapes;
+    for (NumberStyle style : {NumberStyle::Shortest, NumberStyle::Compatible}) {
+        setNumberStyle(style);
+        double ms = bestOfMs(3, [&]() {
+            std::ostringstream stream;
+            stream << Expression(list);
+        });
+        std::cout << shapes->items.size() << " lines through operator<<, "
+                  << (style == NumberStyle::Shortest ? "shortest" : "compatible") << " numbers: "
+                  << shapes->items.size() / ms * 1000 << " shapes/s" << std::endl;
+    }
+    setNumberStyle(NumberStyle::Shortest);
+}
+
+TEST_CASE("Benchmark pasting a multi-line form into the REPL", "[.][benchmark]") {
+    for (int lines : {500, 1000, 10000, 100000}) {
+        std::vector<std::string> input = {"(begin\n"};
+        for (int i = 1; i < lines; ++i) {
+            input.push_back("  (define v" + std::to_string(i) + " (+ " + std::to_string(i) + " 1))\n");
+        }
+        input.push_back(")\n");
+
+        // the scanner looks at each line once
+        double scanned = bestOfMs(3, [&]() {
+            FormScanner scanner;
+            const char *form;
+            std::size_t size;
+            std::size_t forms = 0;
+            for (const auto &line : input) {
+                scanner.append(line.data(), line.size());
+                while (scanner.next(form, size)) {
+                    ++forms;
+                }
+            }
+            REQUIRE(forms == 1);
+        });
+        std::cout << lines << " lines through FormScanner: " << scanned << " ms" << std::endl;
+
+        // accumulating the lines and retrying the parse tokenizes everything again on every line
+        if (lines <= 1000) {
+            double retried = bestOfMs(1, [&]() {
+                std::string accumulated;
+                Interpreter interpreter;
+                for (const auto &line : input) {
+                    accumulated += line;
+                    std::istringstream iss(accumulated);
+                    if (interpreter.parse(iss)) {
+                        accumulated.clear();
+                    }
+                }
+                REQUIRE(accumulated.empty());
+            });
+            std::cout << lines << " lines accumulated and re-parsed: " << retried << " ms" << std::endl;
+        }
+    }
+}
+
+TEST_CASE("Benchmark startup with a prelude evaluated vs loaded from a snapshot", "[.][benchmark]") {
+    std::string path = "/tmp/slisp-bench-" + std::to_string(getpid()) + ".snap";
+    for (int defines : {1000, 10000, 100000}) {
+        std::string prelude = "(begin";
+        for (int i = 0; i < defines; ++i) {
+            std::string n = std::to_string(i);
+            prelude += i % 2 ? " (define c" + n + " (point " + n + " (* " + n + " 2)))"
+                             : " (define f" + n + " (lambda (x) (+ x " + n + ")))";
+        }
+        prelude += ")";
+        auto startup = [&](Interpreter &interpreter) {
+            std::istringstream iss("(begin (draw c1) (f0 1))");
+            REQUIRE(interpreter.parse(iss));
+            REQUIRE(interpreter.eval() == Expression(1.0));
+        };
+
+        double evaluated = bestOfMs(3, [&]() {
+            Interpreter interpreter;
+            std::istringstream iss(prelude);
+            REQUIRE(interpreter.parse(iss));
+            interpreter.eval();
+            startup(interpreter);
+        });
+        Interpreter maker;
+        std::istringstream iss(prelude);
+        REQUIRE(maker.parse(iss));
+        maker.eval();
+        std::string error;
+        REQUIRE(maker.save_snapshot(path, error));
+
+        double loaded = bestOfMs(3, [&]() {
+            Interpreter interpreter;
+            interpreter.set_prelude(Snapshot::open(path, error));
+            startup(interpreter);
+        });
+        std::cout << defines << " defines: prelude evaluated " << evaluated << " ms, snapshot loaded "
+                  << loaded << " ms" << std::endl;
+    }
+    std::remove(path.c_str());
+}
@@ -1,4 +1,6 @@
 #include "builtin_procedures.hpp"
+#include "list_procedures.hpp"
+#include "fast_math.hpp"
 #include <cmath>
 
 
@@ -56,6 +58,10 @@ void procAdd(const std::vector<Atom>& params, Expression& output) {
     output.head.value.num_value = 0;
     for (const auto& param : params) {
         if (param.type != NumberType) {
+            if (hasListArgument(params)) {
+                listArithmetic(KernelOp::Add, "+", params, output);
+                return;
+            }
             throw InterpreterSemanticError("+ expects numeric arguments");
         }
         output.head.value.num_value += param.value.num_value;
@@ -65,6 +71,10 @@ void procAdd(const std::vector<Atom>& params, Expression& output) {
 /* A m-ary procedure that subs incoming number values */
 void procSubtract(const std::vector<Atom>& params, Expression& output) {
     if (params.empty() || params[0].type != NumberType) {
+        if (hasListArgument(params)) {
+            listArithmetic(KernelOp::Subtract, "-", params, output);
+            return;
+        }
         throw InterpreterSemanticError("- expects at least one numeric argument");
     }
     output.head.type = NumberType;
@@ -80,6 +90,13 @@ void procSubtract(const std::vector<Atom>& params, Expression& output) {
 
     }
     
+    if (params[1].type != NumberType) {
+        if (hasListArgument(params)) {
+            listArithmetic(KernelOp::Subtract, "-", params, output);
+            return;
+        }
+        throw InterpreterSemanticError("- expects numeric arguments");
+    }
     output.head.value.num_value -= params[1].value.num_value;
 }
 
@@ -93,6 +110,10 @@ void procMultiply(const std::vector<Atom>& params, Expression& output) {
     output.head.value.num_value = 1;
     for (const auto& param : params) {
         if (param.type != NumberType) {
+            if (hasListArgument(params)) {
+                listArithmetic(KernelOp::Multiply, "*", params, output);
+                return;
+            }
             throw InterpreterSemanticError("* expects numeric arguments");
         }
         output.head.value.num_value *= param.value.num_value;
@@ -103,6 +124,10 @@ void procMultiply(const std::vector<Atom>& params, Expression& output) {
 /* A binary-ary procedure that divides two incoming number values */
 void procDivide(const std::vector<Atom>& params, Expression& output) {
     if (params.size() != 2 || params[0].type != NumberType || params[1].type != NumberType) {
+        if (hasListArgument(params)) {
+            listArithmetic(KernelOp::Divide, "/", params, output);
+            return;
+        }
         throw InterpreterSemanticError("/ expects two numeric arguments");
     }
     if (params[1].value.num_value == 0) {
@@ -116,6 +141,10 @@ void procDivide(const std::vector<Atom>& params, Expression& output) {
 /* A uniary procedure that performs log base 10 on a incoming number value */
 void procLog10(const std::vector<Atom>& params, Expression& output) {
     if (params.size() != 1 || params[0].type != NumberType) {
+        if (hasListArgument(params)) {
+            listUnary(KernelUnary::Log10, "log10", params, output);
+            return;
+        }
         throw InterpreterSemanticError("log10 expects one numeric argument");
     }
     output.head.type = NumberType;
@@ -126,6 +155,10 @@ void procLog10(const std::vector<Atom>& params, Expression& output) {
 /* A binary procedure that performs pow on two incoming number values */
 void procPow(const std::vector<Atom>& params, Expression& output) {
     if (params.size() != 2 || params[0].type != NumberType || params[1].type != NumberType) {
+        if (hasListArgument(params)) {
+            listArithmetic(KernelOp::Pow, "pow", params, output);
+            return;
+        }
         throw InterpreterSemanticError("pow expects two numeric arguments");
     }
     output.head.type = NumberType;
@@ -135,6 +168,10 @@ void procPow(const std::vector<Atom>& params, Expression& output) {
 /* A binary procedure that compares two incoming number values whether they are less than */
 void procLessThan(const std::vector<Atom>& params, Expression& output) {
     if (params.size() != 2 || params[0].type != NumberType || params[1].type != NumberType) {
+        if (hasListArgument(params)) {
+            listCompare("<", params, output);
+            return;
+        }
         throw InterpreterSemanticError("< expects two numeric arguments");
     }
     output.head.type = BooleanType;
@@ -145,6 +182,10 @@ void procLessThan(const std::vector<Atom>& params, Expression& output) {
 /* A binary procedure that compares two incoming number values whether they are less than or equal */
 void procLessThanOrEqual(const std::vector<Atom>& params, Expression& output) {
     if (params.size() != 2 || params[0].type != NumberType || params[1].type != NumberType) {
+        if (hasListArgument(params)) {
+            listCompare("<=", params, output);
+            return;
+        }
         throw InterpreterSemanticError("<= expects two numeric arguments");
     }
     output.head.type = BooleanType;
@@ -155,6 +196,10 @@ void procLessThanOrEqual(const std::vector<Atom>& params, Expression& output) {
 /* A binary procedure that compares two incoming number values whether they are greater than */
 void procGreaterThan(const std::vector<Atom>& params, Expression& output) {
     if (params.size() != 2 || params[0].type != NumberType || params[1].type != NumberType) {
+        if (hasListArgument(params)) {
+            listCompare(">", params, output);
+            return;
+        }
         throw InterpreterSemanticError("> expects two numeric arguments");
     }
 
@@ -167,6 +212,10 @@ void procGreaterThan(const std::vector<Atom>& params, Expression& output) {
 /* A binary procedure that compares two incoming number values whether they are greater than or equal to */
 void procGreaterThanOrEqual(const std::vector<Atom>& params, Expression& output) {
     if (params.size() != 2 || params[0].type != NumberType || params[1].type != NumberType) {
+        if (hasListArgument(params)) {
+            listCompare(">=", params, output);
+            return;
+        }
         throw InterpreterSemanticError(">= expects two numeric arguments");
     }
     output.head.type = BooleanType;
@@ -177,6 +226,10 @@ void procGreaterThanOrEqual(const std::vector<Atom>& params, Expression& output)
 /* A binary procedure that compares two incoming number values whether they are equal */
 void procEqual(const std::vector<Atom>& params, Expression& output) {
     if (params.size() != 2 || params[0].type != NumberType || params[1].type != NumberType) {
+        if (hasListArgument(params)) {
+            listCompare("=", params, output);
+            return;
+        }
         throw InterpreterSemanticError("= expects two numeric arguments");
     }
     output.head.type = BooleanType;
@@ -189,6 +242,10 @@ void procPoint(const std::vector<Atom>& params, Expression& output)
 {
     if (params.size() != 2 || params[0].type != NumberType || params[1].type != NumberType)
     {
+        if (hasListArgument(params)) {
+            listBroadcast(procPoint, params, output);
+            return;
+        }
         throw InterpreterSemanticError("point expects two numeric arguments");
     }
 
@@ -200,6 +257,10 @@ void procLine(const std::vector<Atom>& params, Expression& output)
 {
     if (params.size() != 2 || params[0].type != PointType || params[1].type != PointType)
     {
+        if (hasListArgument(params)) {
+            listBroadcast(procLine, params, output);
+            return;
+        }
         throw InterpreterSemanticError("line expects two point arguments");
     }
 
@@ -212,6 +273,10 @@ void procArc(const std::vector<Atom>& params, Expression& output)
 {
     if (params.size() != 3 || params[0].type != PointType || params[1].type != PointType || params[2].type != NumberType)
     {
+        if (hasListArgument(params)) {
+            listBroadcast(procArc, params, output);
+            return;
+        }
         throw InterpreterSemanticError("arc expects two point arguments and a number argument");
     }
 
@@ -229,6 +294,10 @@ void procRect(const std::vector<Atom>& params, Expression& output)
         params[2].type != NumberType || 
         params[3].type != NumberType)
     {
+        if (hasListArgument(params)) {
+            listBroadcast(procRect, params, output);
+            return;
+        }
         throw InterpreterSemanticError("rect expects four point arguments");
     }
 
@@ -245,6 +314,10 @@ void procFillRect(const std::vector<Atom>& params, Expression& output)
         params[2].type != NumberType || 
         params[3].type != NumberType)
     {
+        if (hasListArgument(params)) {
+            listBroadcast(procFillRect, params, output);
+            return;
+        }
         throw InterpreterSemanticError("arc expects one rect argument and three number arguments");
     }
 
@@ -258,6 +331,10 @@ void procEllipse(const std::vector<Atom>& params, Expression& output)
     if (params.size() != 1 ||
         params[0].type != RectType)
     {
+        if (hasListArgument(params)) {
+            listBroadcast(procEllipse, params, output);
+            return;
+        }
         throw InterpreterSemanticError("ellipse expects one rect argument");
     }
 
@@ -272,6 +349,10 @@ void procSine(const std::vector<Atom>& params, Expression& output)
 {
     if (params.size() != 1 || params[0].type != NumberType)
     {
+        if (hasListArgument(params)) {
+            listUnary(KernelUnary::Sine, "sin", params, output);
+            return;
+        }
         throw InterpreterSemanticError("sin expects one numeric arguments");
     }
 
@@ -285,6 +366,10 @@ void procCosine(const std::vector<Atom>& params, Expression& output)
 {
     if (params.size() != 1 || params[0].type != NumberType)
     {
+        if (hasListArgument(params)) {
+            listUnary(KernelUnary::Cosine, "cos", params, output);
+            return;
+        }
         throw InterpreterSemanticError("cos expects one numeric arguments");
     }
 
@@ -298,9 +383,244 @@ void procArctan(const std::vector<Atom>& params, Expression& output)
 {
     if (params.size() != 2 || params[0].type != NumberType || params[1].type != NumberType)
     {
+        if (hasListArgument(params)) {
+            listArithmetic(KernelOp::Arctan, "arctan", params, output);
+            return;
+        }
+        throw InterpreterSemanticError("arctan expects two numeric arguments");
+    }
+
+    output.head.type = NumberType;
+    output.head.value.num_value = std::atan2(params[0].value.num_value, params[1].value.num_value);
+}
+
+
+/* sin with the fast kernel */
+void procFastSine(const std::vector<Atom>& params, Expression& output)
+{
+    if (params.size() != 1 || params[0].type != NumberType)
+    {
+        if (hasListArgument(params)) {
+            listUnary(KernelUnary::FastSine, "sin", params, output);
+            return;
+        }
+        throw InterpreterSemanticError("sin expects one numeric arguments");
+    }
+
+    output.head.type = NumberType;
+    output.head.value.num_value = fastSin(params[0].value.num_value);
+}
+
+
+/* cos with the fast kernel */
+void procFastCosine(const std::vector<Atom>& params, Expression& output)
+{
+    if (params.size() != 1 || params[0].type != NumberType)
+    {
+        if (hasListArgument(params)) {
+            listUnary(KernelUnary::FastCosine, "cos", params, output);
+            return;
+        }
+        throw InterpreterSemanticError("cos expects one numeric arguments");
+    }
+
+    output.head.type = NumberType;
+    output.head.value.num_value = fastCos(params[0].value.num_value);
+}
+
+
+/* arctan with the fast kernel */
+void procFastArctan(const std::vector<Atom>& params, Expression& output)
+{
+    if (params.size() != 2 || params[0].type != NumberType || params[1].type != NumberType)
+    {
+        if (hasListArgument(params)) {
+            listArithmetic(KernelOp::FastArctan, "arctan", params, output);
+            return;
+        }
         throw InterpreterSemanticError("arctan expects two numeric arguments");
     }
 
+    output.head.type = NumberType;
+    output.head.value.num_value = fastAtan2(params[0].value.num_value, params[1].value.num_value);
+}
+
+
+/* log10 with the fast kernel */
+void procFastLog10(const std::vector<Atom>& params, Expression& output) {
+    if (params.size() != 1 || params[0].type != NumberType) {
+        if (hasListArgument(params)) {
+            listUnary(KernelUnary::FastLog10, "log10", params, output);
+            return;
+        }
+        throw InterpreterSemanticError("log10 expects one numeric argument");
+    }
+    output.head.type = NumberType;
+    output.head.value.num_value = fastLog10(params[0].value.num_value);
+}
+
+
+/* pow with the fast kernel */
+void procFastPow(const std::vector<Atom>& params, Expression& output) {
+    if (params.size() != 2 || params[0].type != NumberType || params[1].type != NumberType) {
+        if (hasListArgument(params)) {
+            listArithmetic(KernelOp::FastPow, "pow", params, output);
+            return;
+        }
+        throw InterpreterSemanticError("pow expects two numeric arguments");
+    }
+    output.head.type = NumberType;
+    output.head.value.num_value = fastPow(params[0].value.num_value, params[1].value.num_value);
+}
+
+
+// ------------------------------- Unchecked variants -------------------------------
+// Each assumes the argument count and types its checked procedure requires.
+
+void procNotUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = BooleanType;
+    output.head.value.bool_value = !params[0].value.bool_value;
+}
+
+void procAndUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = BooleanType;
+    output.head.value.bool_value = true;
+    for (const auto& param : params) {
+        if (!param.value.bool_value) {
+            output.head.value.bool_value = false;
+            return;
+        }
+    }
+}
+
+void procOrUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = BooleanType;
+    output.head.value.bool_value = false;
+    for (const auto& param : params) {
+        if (param.value.bool_value) {
+            output.head.value.bool_value = true;
+            return;
+        }
+    }
+}
+
+void procLessThanUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = BooleanType;
+    output.head.value.bool_value = params[0].value.num_value < params[1].value.num_value;
+}
+
+void procLessThanOrEqualUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = BooleanType;
+    output.head.value.bool_value = params[0].value.num_value <= params[1].value.num_value;
+}
+
+void procGreaterThanUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = BooleanType;
+    output.head.value.bool_value = params[0].value.num_value > params[1].value.num_value;
+}
+
+void procGreaterThanOrEqualUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = BooleanType;
+    output.head.value.bool_value = params[0].value.num_value >= params[1].value.num_value;
+}
+
+void procEqualUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = BooleanType;
+    output.head.value.bool_value = params[0].value.num_value == params[1].value.num_value;
+}
+
+void procAddUnchecked(const std::vector<Atom>& params, Expression& output) {
+    Number sum = 0;
+    for (const auto& param : params) {
+        sum += param.value.num_value;
+    }
+    output.head.type = NumberType;
+    output.head.value.num_value = sum;
+}
+
+void procSubtractUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = NumberType;
+    output.head.value.num_value = params.size() == 1 ? -params[0].value.num_value
+                                                     : params[0].value.num_value - params[1].value.num_value;
+}
+
+void procMultiplyUnchecked(const std::vector<Atom>& params, Expression& output) {
+    Number product = 1;
+    for (const auto& param : params) {
+        product *= param.value.num_value;
+    }
+    output.head.type = NumberType;
+    output.head.value.num_value = product;
+}
+
+/* Still rejects a zero divisor, which no type rules out */
+void procDivideUnchecked(const std::vector<Atom>& params, Expression& output) {
+    if (params[1].value.num_value == 0) {
+        throw InterpreterSemanticError("Division by zero");
+    }
+    output.head.type = NumberType;
+    output.head.value.num_value = params[0].value.num_value / params[1].value.num_value;
+}
+
+void procLog10Unchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = NumberType;
+    output.head.value.num_value = std::log10(params[0].value.num_value);
+}
+
+void procPowUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = NumberType;
+    output.head.value.num_value = std::pow(params[0].value.num_value, params[1].value.num_value);
+}
+
+void procPointUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = PointType;
+    output.head.value.point_value.x = params[0].value.num_value;
+    output.head.value.point_value.y = params[1].value.num_value;
+}
+
+void procLineUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = LineType;
+    output.head.value.line_value.first = params[0].value.point_value;
+    output.head.value.line_value.second = params[1].value.point_value;
+}
+
+void procArcUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = ArcType;
+    output.head.value.arc_value.center = params[0].value.point_value;
+    output.head.value.arc_value.start = params[1].value.point_value;
+    output.head.value.arc_value.span = params[2].value.num_value;
+}
+
+void procRectUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = RectType;
+    output.head.value.rect_value = {params[0].value.num_value, params[1].value.num_value,
+                                    params[2].value.num_value, params[3].value.num_value};
+}
+
+void procFillRectUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = FillRectType;
+    output.head.value.fillRect_value.rect = params[0].value.rect_value;
+    output.head.value.fillRect_value.r = params[1].value.num_value;
+    output.head.value.fillRect_value.g = params[2].value.num_value;
+    output.head.value.fillRect_value.b = params[3].value.num_value;
+}
+
+void procEllipseUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = EllipseType;
+    output.head.value.ellipse_value.rect = params[0].value.rect_value;
+}
+
+void procSineUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = NumberType;
+    output.head.value.num_value = std::sin(params[0].value.num_value);
+}
+
+void procCosineUnchecked(const std::vector<Atom>& params, Expression& output) {
+    output.head.type = NumberType;
+    output.head.value.num_value = std::cos(params[0].value.num_value);
+}
+
+void procArctanUnchecked(const std::vector<Atom>& params, Expression& output) {
     output.head.type = NumberType;
     output.head.value.num_value = std::atan2(params[0].value.num_value, params[1].value.num_value);
-}
\ No newline at end of file
+}
@@ -37,4 +37,37 @@ void procSine(const std::vector<Atom>& params, Expression& output);
 void procCosine(const std::vector<Atom>& params, Expression& output);
 void procArctan(const std::vector<Atom>& params, Expression& output);
 
+// Math procedures of MathMode::Fast, registered under the same names by Interpreter::set_math_mode
+void procFastSine(const std::vector<Atom>& params, Expression& output);
+void procFastCosine(const std::vector<Atom>& params, Expression& output);
+void procFastArctan(const std::vector<Atom>& params, Expression& output);
+void procFastLog10(const std::vector<Atom>& params, Expression& output);
+void procFastPow(const std::vector<Atom>& params, Expression& output);
+
+// Variants that skip the argument checks, for the calls type inference proved well-typed
+// (see type_inference.hpp); registered with Environment::add_unchecked_procedure
+void procNotUnchecked(const std::vector<Atom>& params, Expression& output);
+void procAndUnchecked(const std::vector<Atom>& params, Expression& output);
+void procOrUnchecked(const std::vector<Atom>& params, Expression& output);
+void procLessThanUnchecked(const std::vector<Atom>& params, Expression& output);
+void procLessThanOrEqualUnchecked(const std::vector<Atom>& params, Expression& output);
+void procGreaterThanUnchecked(const std::vector<Atom>& params, Expression& output);
+void procGreaterThanOrEqualUnchecked(const std::vector<Atom>& params, Expression& output);
+void procEqualUnchecked(const std::vector<Atom>& params, Expression& output);
+void procAddUnchecked(const std::vector<Atom>& params, Expression& output);
+void procSubtractUnchecked(const std::vector<Atom>& params, Expression& output);
+void procMultiplyUnchecked(const std::vector<Atom>& params, Expression& output);
+void procDivideUnchecked(const std::vector<Atom>& params, Expression& output);
+void procLog10Unchecked(const std::vector<Atom>& params, Expression& output);
+void procPowUnchecked(const std::vector<Atom>& params, Expression& output);
+void procPointUnchecked(const std::vector<Atom>& params, Expression& output);
+void procLineUnchecked(const std::vector<Atom>& params, Expression& output);
+void procArcUnchecked(const std::vector<Atom>& params, Expression& output);
+void procRectUnchecked(const std::vector<Atom>& params, Expression& output);
+void procFillRectUnchecked(const std::vector<Atom>& params, Expression& output);
+void procEllipseUnchecked(const std::vector<Atom>& params, Expression& output);
+void procSineUnchecked(const std::vector<Atom>& params, Expression& output);
+void procCosineUnchecked(const std::vector<Atom>& params, Expression& output);
+void procArctanUnchecked(const std::vector<Atom>& params, Expression& output);
+
 #endif // BUILTIN_PROCEDURES_HPP
\ No newline at end of file
@@ -22,6 +22,12 @@ void CanvasWidget::addGraphic(QGraphicsItem *item) {
     scene->addItem(item);
 }
 
+/* Removes a QGraphicsItem from the current scene and deletes it */
+void CanvasWidget::removeGraphic(QGraphicsItem *item) {
+    scene->removeItem(item);
+    delete item;
+}
+
 
 /* Resizes the drawing canvas as appropiate */
 void CanvasWidget::resizeEvent(QResizeEvent* event)
@@ -17,6 +17,8 @@ public:
 public slots:
 
     void addGraphic(QGraphicsItem *item);
+
+    void removeGraphic(QGraphicsItem *item);
 protected:
     void resizeEvent(QResizeEvent* event) override;
 private:
@@ -0,0 +1,38 @@
+#ifndef COMMAND_LINE_HPP
+#define COMMAND_LINE_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include "fast_math.hpp"
+
+// Option parsing shared by the slisp and sldraw command lines
+
+// Parses a non-negative integer option value, exiting with usage on failure
+inline std::uint64_t parseCount(const std::string &flag, const char *value) {
+    try {
+        std::size_t pos = 0;
+        unsigned long long count = std::stoull(value, &pos);
+        if (pos == std::string(value).size() && value[0] != '-') {
+            return count;
+        }
+    } catch (const std::exception &) {
+    }
+    std::cerr << "Error: " << flag << " expects a non-negative integer" << std::endl;
+    std::exit(EXIT_FAILURE);
+}
+
+// Parses the value of --math, exiting with usage on failure
+inline MathMode parseMathMode(const std::string &value) {
+    if (value == "precise") {
+        return MathMode::Precise;
+    } else if (value == "fast") {
+        return MathMode::Fast;
+    }
+    std::cerr << "Error: --math expects precise or fast" << std::endl;
+    std::exit(EXIT_FAILURE);
+}
+
+#endif
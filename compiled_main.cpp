@@ -0,0 +1,20 @@
+#include <cstdlib>
+#include <iostream>
+#include "compiled_program.hpp"
+
+// Runs the scripts translated by slisp --emit-cpp that are linked in, printing each result
+// (or error) as slisp prints it for the script
+int main() {
+    for (const auto &script : compiledScripts()) {
+        std::vector<Expression> graphics;
+        CompiledRun run(graphics);
+        try {
+            Expression result = script.run(run);
+            std::cout << result << std::endl;
+        } catch (const InterpreterSemanticError &e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#include "compiled_program.hpp"
+
+namespace {
+
+// Storage for compiledScripts(), created on first use so registrations in any order work
+std::vector<CompiledScript> &registry()
+{
+    static std::vector<CompiledScript> scripts;
+    return scripts;
+}
+
+}
+
+/* Binds a global for define; as in Interpreter::define_symbol a name is bound at most once */
+const Expression &CompiledRun::define(CompiledGlobal &global, const Expression &value)
+{
+    if (global.defined) {
+        throw InterpreterSemanticError(global.name + " already defined");
+    }
+    global.value = value;
+    global.defined = true;
+    return global.value;
+}
+
+/* A define of a name the interpreter never lets a script bind */
+Expression CompiledRun::redefine(const Symbol &name, const Expression &)
+{
+    throw InterpreterSemanticError(name + " already defined");
+}
+
+/* Draws a shape, or each shape of a list, rejecting anything else before drawing */
+void CompiledRun::draw(const Expression &elem)
+{
+    if (elem.head.type == ListType) {
+        const List &list = *elem.head.value.list_value;
+        for (std::size_t i = 0; i < list.size(); ++i) {
+            Atom shape = list.at(i);
+            if (shape.type < PointType || shape.type > EllipseType) {
+                throw InterpreterSemanticError("Invalid expression for drawing");
+            }
+        }
+        for (std::size_t i = 0; i < list.size(); ++i) {
+            graphics.push_back(Expression(list.at(i)));
+        }
+        return;
+    }
+    if (elem.head.type < PointType || elem.head.type > EllipseType) {
+        throw InterpreterSemanticError("Invalid expression for drawing");
+    }
+    graphics.push_back(elem);
+}
+
+/* The truth value of an if condition */
+bool CompiledRun::condition(const Expression &value)
+{
+    if (value.head.type != BooleanType) {
+        throw InterpreterSemanticError("if condition must be a boolean");
+    }
+    return value.head.value.bool_value;
+}
+
+/* The number a loop bound evaluated to */
+Number CompiledRun::bound(const Expression &value, const char *what)
+{
+    if (value.head.type != NumberType) {
+        throw InterpreterSemanticError(std::string(what) + " expects numeric bounds");
+    }
+    return value.head.value.num_value;
+}
+
+/* Throws an evaluation error; returns an Expression only so it can stand in for one */
+Expression CompiledRun::fail(const std::string &message)
+{
+    throw InterpreterSemanticError(message);
+}
+
+/* The translated scripts registered so far */
+const std::vector<CompiledScript> &compiledScripts()
+{
+    return registry();
+}
+
+CompiledScriptRegistration::CompiledScriptRegistration(const char *source, CompiledScriptFunction run)
+{
+    registry().push_back(CompiledScript{source, run});
+}
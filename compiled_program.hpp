@@ -0,0 +1,96 @@
+#ifndef COMPILED_PROGRAM_HPP
+#define COMPILED_PROGRAM_HPP
+
+#include "expression.hpp"
+#include "builtin_procedures.hpp"
+#include "list_procedures.hpp"
+#include "interpreter_semantic_error.hpp"
+#include <string>
+#include <vector>
+
+// Runtime support for the C++ that slisp --emit-cpp writes (see cpp_emitter.hpp). A translated
+// script evaluates to the result Interpreter::eval would return, appending the same graphics,
+// and throws the same InterpreterSemanticError where the interpreter would.
+
+// Signature shared by the builtins, which translated scripts call directly
+typedef void (*CompiledBuiltin)(const std::vector<Atom> &, Expression &);
+
+// A global a translated script may define; unbound until its define runs
+struct CompiledGlobal {
+    explicit CompiledGlobal(const Symbol &name) : name(name), defined(false) {}
+
+    Symbol name;
+    bool defined;
+    Expression value;
+};
+
+// The state one run of a translated script works on
+class CompiledRun {
+public:
+    explicit CompiledRun(std::vector<Expression> &graphics) : graphics(graphics) {}
+
+    // Binds a global for define, returning its value
+    const Expression &define(CompiledGlobal &global, const Expression &value);
+
+    // A define of a special form, builtin or constant, which always fails
+    Expression redefine(const Symbol &name, const Expression &value);
+
+    // Draws one argument of draw: a shape, or a list of shapes
+    void draw(const Expression &elem);
+
+    // Clears a call's argument buffer
+    static std::vector<Atom> &start(std::vector<Atom> &args)
+    {
+        args.clear();
+        return args;
+    }
+
+    // Appends an evaluated argument of a call to name, which may not be None
+    static std::vector<Atom> &arg(std::vector<Atom> &args, const Expression &value, const char *name)
+    {
+        if (value.head.type == NoneType) {
+            throw InterpreterSemanticError(std::string("Invalid argument for procedure: ") + name);
+        }
+        args.push_back(value.head);
+        return args;
+    }
+
+    // Calls a builtin on the arguments collected in args
+    static Expression call(CompiledBuiltin proc, const std::vector<Atom> &args)
+    {
+        Expression result;
+        proc(args, result);
+        return result;
+    }
+
+    // The value of an if condition, which must be a boolean
+    static bool condition(const Expression &value);
+
+    // A loop bound, step or count, which must be a number
+    static Number bound(const Expression &value, const char *what);
+
+    // Throws the error a malformed form or unknown symbol raises when evaluated
+    [[noreturn]] static Expression fail(const std::string &message);
+
+private:
+    std::vector<Expression> &graphics;
+};
+
+// Entry point of a translated script
+typedef Expression (*CompiledScriptFunction)(CompiledRun &run);
+
+// A translated script and the name of the file it was translated from
+struct CompiledScript {
+    std::string source;
+    CompiledScriptFunction run;
+};
+
+// The scripts linked into this program, in registration order
+const std::vector<CompiledScript> &compiledScripts();
+
+// Registers a translated script with compiledScripts(); each translation unit defines one
+struct CompiledScriptRegistration {
+    CompiledScriptRegistration(const char *source, CompiledScriptFunction run);
+};
+
+#endif
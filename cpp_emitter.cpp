@@ -0,0 +1,377 @@
+#include "cpp_emitter.hpp"
+#include "compiled_program.hpp"
+#include "environment.hpp"
+#include "type_inference.hpp"
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <utility>
+
+namespace {
+
+// A builtin as a translated script calls it: the name of its C++ function, and that of the
+// variant without argument checks if it has one
+struct EmittedBuiltin {
+    const char *name;
+    const char *proc;
+    const char *unchecked;
+    CompiledBuiltin fn;
+};
+
+// The procedures Interpreter::Interpreter registers, in the same order
+const EmittedBuiltin BUILTINS[] = {
+    {"not", "procNot", "procNotUnchecked", procNot},
+    {"and", "procAnd", "procAndUnchecked", procAnd},
+    {"or", "procOr", "procOrUnchecked", procOr},
+    {"+", "procAdd", "procAddUnchecked", procAdd},
+    {"-", "procSubtract", "procSubtractUnchecked", procSubtract},
+    {"*", "procMultiply", "procMultiplyUnchecked", procMultiply},
+    {"/", "procDivide", "procDivideUnchecked", procDivide},
+    {"log10", "procLog10", "procLog10Unchecked", procLog10},
+    {"pow", "procPow", "procPowUnchecked", procPow},
+    {"<", "procLessThan", "procLessThanUnchecked", procLessThan},
+    {"<=", "procLessThanOrEqual", "procLessThanOrEqualUnchecked", procLessThanOrEqual},
+    {">", "procGreaterThan", "procGreaterThanUnchecked", procGreaterThan},
+    {">=", "procGreaterThanOrEqual", "procGreaterThanOrEqualUnchecked", procGreaterThanOrEqual},
+    {"=", "procEqual", "procEqualUnchecked", procEqual},
+    {"point", "procPoint", "procPointUnchecked", procPoint},
+    {"line", "procLine", "procLineUnchecked", procLine},
+    {"arc", "procArc", "procArcUnchecked", procArc},
+    {"rect", "procRect", "procRectUnchecked", procRect},
+    {"fill_rect", "procFillRect", "procFillRectUnchecked", procFillRect},
+    {"ellipse", "procEllipse", "procEllipseUnchecked", procEllipse},
+    {"sin", "procSine", "procSineUnchecked", procSine},
+    {"cos", "procCosine", "procCosineUnchecked", procCosine},
+    {"arctan", "procArctan", "procArctanUnchecked", procArctan},
+    {"list", "procList", nullptr, procList},
+    {"range", "procRange", nullptr, procRange},
+    {"length", "procLength", nullptr, procLength},
+    {"nth", "procNth", nullptr, procNth},
+    {"sum", "procSum", nullptr, procSum},
+    {"min", "procMin", nullptr, procMin},
+    {"max", "procMax", nullptr, procMax},
+};
+
+// The builtins Interpreter::set_math_mode replaces in MathMode::Fast, for checked and proven calls alike
+const EmittedBuiltin FAST_BUILTINS[] = {
+    {"sin", "procFastSine", "procFastSine", procFastSine},
+    {"cos", "procFastCosine", "procFastCosine", procFastCosine},
+    {"arctan", "procFastArctan", "procFastArctan", procFastArctan},
+    {"log10", "procFastLog10", "procFastLog10", procFastLog10},
+    {"pow", "procFastPow", "procFastPow", procFastPow},
+};
+
+// Names that cannot be defined, as in the interpreter
+bool isSpecialForm(const Symbol &sym)
+{
+    return sym == "if" || sym == "begin" || sym == "define" || sym == "lambda" ||
+           sym == "for" || sym == "repeat" || sym == "pmap" || sym == "parallel-map";
+}
+
+// A C++ string literal spelling text
+std::string cppString(const std::string &text)
+{
+    std::string quoted = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += static_cast<char>(c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            char escape[5];
+            std::snprintf(escape, sizeof(escape), "\\%03o", c);
+            quoted += escape;
+        } else {
+            quoted += static_cast<char>(c);
+        }
+    }
+    return quoted + "\"";
+}
+
+// A C++ literal of the same double; 17 significant digits always read back exactly
+std::string cppNumber(Number value)
+{
+    char digits[32];
+    std::snprintf(digits, sizeof(digits), "%.17g", value);
+    std::string text = digits;
+    if (text.find_first_of(".e") == std::string::npos) {
+        text += ".0";
+    }
+    return text;
+}
+
+// One translation of a script
+class CppEmitter {
+public:
+    explicit CppEmitter(MathMode math);
+
+    void emit(const Expression &ast, const std::string &source, std::ostream &out);
+
+private:
+    std::map<Symbol, const EmittedBuiltin *> builtins;
+    Environment env; // the builtins and constants, for type inference
+
+    // Constants, globals and argument buffers the translation declares, by index
+    std::vector<std::string> constants;
+    std::map<std::string, std::size_t> constant_index;
+    std::map<Symbol, std::size_t> global_index;
+    std::vector<Symbol> globals;
+    std::size_t arg_buffers = 0;
+
+    // for variables in scope, innermost last, and the number of loops translated
+    std::vector<std::pair<Symbol, std::string>> scope;
+    std::size_t loops = 0;
+
+    // Gives every name a define can bind a global slot
+    void collectGlobals(const Expression &expr);
+
+    // The C++ expression evaluating expr; nested lines start at indent
+    std::string translate(const Expression &expr, const std::string &indent);
+    std::string translateFor(const Expression &expr, const std::string &indent);
+    std::string translateRepeat(const Expression &expr, const std::string &indent);
+    std::string translateCall(const Expression &expr, const Symbol &name, const std::string &indent);
+
+    // The constant holding value
+    std::string constant(const std::string &value);
+};
+
+CppEmitter::CppEmitter(MathMode math)
+{
+    for (const auto &builtin : BUILTINS) {
+        builtins[builtin.name] = &builtin;
+    }
+    if (math == MathMode::Fast) {
+        for (const auto &builtin : FAST_BUILTINS) {
+            builtins[builtin.name] = &builtin;
+        }
+    }
+    for (const auto &entry : builtins) {
+        env.add_procedure(entry.first, entry.second->fn, true);
+    }
+    env.add("pi", std::atan2(0, -1));
+}
+
+void CppEmitter::collectGlobals(const Expression &expr)
+{
+    if (expr.head.type == SymbolType && expr.head.value.sym_value == "define" && expr.tail.size() == 2 &&
+        expr.tail[0].head.type == SymbolType) {
+        const Symbol &name = expr.tail[0].head.value.sym_value;
+        if (!isSpecialForm(name) && !builtins.count(name) && !env.is_symbol_defined(name) && !global_index.count(name)) {
+            global_index[name] = globals.size();
+            globals.push_back(name);
+        }
+    }
+    for (const auto &sub_expr : expr.tail) {
+        collectGlobals(sub_expr);
+    }
+}
+
+std::string CppEmitter::constant(const std::string &value)
+{
+    auto found = constant_index.find(value);
+    if (found == constant_index.end()) {
+        found = constant_index.emplace(value, constants.size()).first;
+        constants.push_back(value);
+    }
+    return "k" + std::to_string(found->second);
+}
+
+std::string CppEmitter::translate(const Expression &expr, const std::string &indent)
+{
+    if (expr.head.type == NumberType) {
+        return constant(cppNumber(expr.head.value.num_value)); // atoms evaluate to themselves
+    } else if (expr.head.type == BooleanType) {
+        return constant(expr.head.value.bool_value ? "true" : "false");
+    } else if (expr.head.type != SymbolType) {
+        throw InterpreterSemanticError("Invalid expression");
+    }
+
+    const Symbol &name = expr.head.value.sym_value;
+    const std::vector<Expression> &tail = expr.tail;
+    std::string inner = indent + "    ";
+    if (name == "begin") {
+        if (tail.empty()) {
+            return "CompiledRun::fail(\"begin requires at least one expression\")";
+        }
+        std::string code = "(";
+        for (std::size_t i = 0; i + 1 < tail.size(); ++i) {
+            code += "(void)" + translate(tail[i], inner) + ",\n" + inner;
+        }
+        return code + translate(tail.back(), inner) + ")";
+    } else if (name == "define") {
+        if (tail.size() != 2 || tail[0].head.type != SymbolType) {
+            return "CompiledRun::fail(\"define requires a symbol and an expression\")";
+        }
+        const Symbol &defined = tail[0].head.value.sym_value;
+        std::string value = translate(tail[1], indent);
+        auto global = global_index.find(defined);
+        if (global == global_index.end()) {
+            return "run.redefine(" + cppString(defined) + ", " + value + ")";
+        }
+        return "run.define(g" + std::to_string(global->second) + ", " + value + ")";
+    } else if (name == "if") {
+        if (tail.size() != 3) {
+            return "CompiledRun::fail(\"if requires three expressions\")";
+        }
+        return "(CompiledRun::condition(" + translate(tail[0], inner) + ")\n" + inner + "? Expression(" +
+               translate(tail[1], inner) + ")\n" + inner + ": Expression(" + translate(tail[2], inner) + "))";
+    } else if (name == "for") {
+        return translateFor(expr, indent);
+    } else if (name == "repeat") {
+        return translateRepeat(expr, indent);
+    } else if (name == "lambda" || name == "pmap" || name == "parallel-map") {
+        throw InterpreterSemanticError("--emit-cpp does not translate " + name);
+    }
+
+    // Variables come first, as in Interpreter::eval_expression; they are never procedures
+    // here, so a call of one evaluates to its value
+    for (auto it = scope.rbegin(); it != scope.rend(); ++it) {
+        if (it->first == name) {
+            return it->second;
+        }
+    }
+    auto global = global_index.find(name);
+    if (global != global_index.end()) {
+        std::string slot = "g" + std::to_string(global->second);
+        return "(" + slot + ".defined ? " + slot + ".value : Expression(" + translateCall(expr, name, indent) + "))";
+    }
+    if (const Expression *value = env.find(name)) {
+        return constant(cppNumber(value->head.value.num_value));
+    }
+    return translateCall(expr, name, indent);
+}
+
+std::string CppEmitter::translateCall(const Expression &expr, const Symbol &name, const std::string &indent)
+{
+    auto builtin = builtins.find(name);
+    if (builtin != builtins.end()) {
+        bool proven = expr.head.unchecked;
+        std::string args = "a" + std::to_string(arg_buffers++);
+        std::string code = "CompiledRun::call(" +
+                           std::string(proven ? builtin->second->unchecked : builtin->second->proc) +
+                           ", (CompiledRun::start(" + args + ")";
+        for (const auto &arg : expr.tail) {
+            code += ", CompiledRun::arg(" + args + ", " + translate(arg, indent) + ", " + cppString(name) + ")";
+        }
+        return code + "))";
+    } else if (name == "draw") {
+        if (expr.tail.empty()) {
+            return "CompiledRun::fail(\"Draw expects at least one expression\")";
+        }
+        std::string code = "(";
+        for (const auto &arg : expr.tail) {
+            code += "run.draw(" + translate(arg, indent) + "), ";
+        }
+        return code + "Expression())";
+    }
+    return "CompiledRun::fail(" + cppString("Unknown symbol: " + name) + ")";
+}
+
+std::string CppEmitter::translateFor(const Expression &expr, const std::string &indent)
+{
+    const std::vector<Expression> &tail = expr.tail;
+    if (tail.size() < 5 || tail[0].head.type != SymbolType || !tail[0].tail.empty()) {
+        return "CompiledRun::fail(\"for requires a variable, start, end, step and a body\")";
+    }
+    const Symbol &var = tail[0].head.value.sym_value;
+    if (isSpecialForm(var)) {
+        return "CompiledRun::fail(" + cppString("for variable cannot be " + var) + ")";
+    }
+
+    std::string n = std::to_string(loops++);
+    std::string inner = indent + "    ";
+    std::string body = inner + "    ";
+    std::string code = "[&]() -> Expression {\n";
+    code += inner + "Number start" + n + " = CompiledRun::bound(" + translate(tail[1], inner) + ", \"for\");\n";
+    code += inner + "Number end" + n + " = CompiledRun::bound(" + translate(tail[2], inner) + ", \"for\");\n";
+    code += inner + "Number step" + n + " = CompiledRun::bound(" + translate(tail[3], inner) + ", \"for\");\n";
+    code += inner + "if (step" + n + " == 0 || std::isnan(step" + n + ")) {\n";
+    code += body + "return CompiledRun::fail(\"for step must be non-zero\");\n";
+    code += inner + "}\n";
+    code += inner + "Expression v" + n + "(start" + n + ");\n";
+    code += inner + "Expression result" + n + ";\n";
+    code += inner + "for (std::size_t i" + n + " = 0;; ++i" + n + ") {\n";
+    code += body + "Number value" + n + " = start" + n + " + static_cast<Number>(i" + n + ") * step" + n + ";\n";
+    code += body + "if (step" + n + " > 0 ? !(value" + n + " < end" + n + ") : !(value" + n + " > end" + n + ")) {\n";
+    code += body + "    break;\n";
+    code += body + "}\n";
+    code += body + "v" + n + ".head.value.num_value = value" + n + ";\n";
+    scope.emplace_back(var, "v" + n);
+    for (std::size_t i = 4; i < tail.size(); ++i) {
+        code += body + "result" + n + " = " + translate(tail[i], body) + ";\n";
+    }
+    scope.pop_back();
+    code += inner + "}\n";
+    code += inner + "return result" + n + ";\n";
+    return code + indent + "}()";
+}
+
+std::string CppEmitter::translateRepeat(const Expression &expr, const std::string &indent)
+{
+    const std::vector<Expression> &tail = expr.tail;
+    if (tail.size() < 2) {
+        return "CompiledRun::fail(\"repeat requires a count and a body\")";
+    }
+
+    std::string n = std::to_string(loops++);
+    std::string inner = indent + "    ";
+    std::string body = inner + "    ";
+    std::string code = "[&]() -> Expression {\n";
+    code += inner + "Number count" + n + " = CompiledRun::bound(" + translate(tail[0], inner) + ", \"repeat\");\n";
+    code += inner + "if (count" + n + " < 0 || std::isnan(count" + n + ")) {\n";
+    code += body + "return CompiledRun::fail(\"repeat count must be non-negative\");\n";
+    code += inner + "}\n";
+    code += inner + "Expression result" + n + ";\n";
+    code += inner + "for (Number i" + n + " = 0; i" + n + " + 1 <= count" + n + "; ++i" + n + ") {\n";
+    for (std::size_t i = 1; i < tail.size(); ++i) {
+        code += body + "result" + n + " = " + translate(tail[i], body) + ";\n";
+    }
+    code += inner + "}\n";
+    code += inner + "return result" + n + ";\n";
+    return code + indent + "}()";
+}
+
+void CppEmitter::emit(const Expression &ast, const std::string &source, std::ostream &out)
+{
+    // the interpreter reports type errors certain to happen before anything runs, and so does the translation
+    Expression typed = ast;
+    std::string body;
+    try {
+        inferTypes(typed, env, true);
+    } catch (const InterpreterSemanticError &e) {
+        body = "CompiledRun::fail(" + cppString(e.what()) + ")";
+    }
+    if (body.empty()) {
+        collectGlobals(typed);
+        body = translate(typed, "    ");
+    }
+
+    out << "// Translated from " << source << " by slisp --emit-cpp; link with compiled_main.cpp\n";
+    out << "// (or another driver of compiledScripts()) and the interpreter sources\n";
+    out << "#include \"compiled_program.hpp\"\n";
+    out << "#include <cmath>\n\n";
+    out << "namespace {\n\n";
+    out << "Expression script(CompiledRun &run)\n{\n";
+    for (std::size_t i = 0; i < constants.size(); ++i) {
+        out << "    const Expression k" << i << "(" << constants[i] << ");\n";
+    }
+    for (std::size_t i = 0; i < globals.size(); ++i) {
+        out << "    CompiledGlobal g" << i << "(" << cppString(globals[i]) << ");\n";
+    }
+    for (std::size_t i = 0; i < arg_buffers; ++i) {
+        out << "    std::vector<Atom> a" << i << ";\n";
+    }
+    out << "    (void)run;\n";
+    out << "    return " << body << ";\n}\n\n";
+    out << "const CompiledScriptRegistration registration(" << cppString(source) << ", script);\n\n";
+    out << "}\n";
+}
+
+}
+
+/* Writes the C++ translation of ast, a script parsed from source */
+void emitCpp(const Expression &ast, const std::string &source, MathMode math, std::ostream &out)
+{
+    CppEmitter emitter(math);
+    emitter.emit(ast, source, out);
+}
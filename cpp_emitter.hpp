@@ -0,0 +1,22 @@
+#ifndef CPP_EMITTER_HPP
+#define CPP_EMITTER_HPP
+
+#include "expression.hpp"
+#include "fast_math.hpp"
+#include <ostream>
+#include <string>
+
+// Translates a parsed script into a C++ translation unit, for slisp --emit-cpp.
+//
+// The translation calls builtins directly (the unchecked variants where type inference proves
+// the arguments), keeps literals as constants, globals in fixed slots and for variables in
+// locals, and registers the script with compiledScripts() under the name source (see
+// compiled_program.hpp). Built with compiled_main.cpp and the interpreter sources, it prints
+// what slisp prints for the script and draws what Interpreter::eval draws, including the
+// errors, under the default settings and the given math mode; evaluation budgets, the memo
+// cache and the parallel modes do not apply.
+//
+// Throws InterpreterSemanticError if the script uses lambda or pmap, which are not translated.
+void emitCpp(const Expression &ast, const std::string &source, MathMode math, std::ostream &out);
+
+#endif
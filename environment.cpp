@@ -1,8 +1,23 @@
 #include "environment.hpp"
 #include "interpreter_semantic_error.hpp"
 #include "builtin_procedures.hpp"
+#include "snapshot.hpp"
 
 #include <math.h>
+#include <atomic>
+
+// An attached snapshot and its values decoded so far, one pointer per symbol, null until
+// whichever thread looks the symbol up first decodes it
+struct Environment::Prelude {
+    std::shared_ptr<const Snapshot> snapshot;
+    std::unique_ptr<std::atomic<const Expression *>[]> values;
+
+    ~Prelude() {
+        for (std::size_t i = 0; i < snapshot->size(); ++i) {
+            delete values[i].load(std::memory_order_relaxed);
+        }
+    }
+};
 
 // Constructor: Initializes the environment with built-in procedures and constants
 Environment::Environment() {
@@ -14,6 +29,13 @@ void Environment::reset()
 {
     symbol_table.clear();
     procedure_table.clear();
+    prelude.reset();
+}
+
+/* Removes every symbol, keeping the procedures */
+void Environment::clear_symbols()
+{
+    symbol_table.clear();
 }
 
 // Adds a symbol-value pair to the environment
@@ -21,35 +43,123 @@ void Environment::add(const std::string &symbol, const Expression &value) {
     symbol_table[symbol] = value; // Store or update the symbol in the environment
 }
 
-// Adds a procedure to the environment
-void Environment::add_procedure(const std::string &symbol, std::function<void(const std::vector<Atom>&, Expression&)> proc) {
-    procedure_table[symbol] = proc; // Store the procedure in the procedure table
+// Removes a symbol from the environment, if present
+void Environment::remove(const std::string &symbol) {
+    symbol_table.erase(symbol);
+}
+
+// Adds a procedure to the environment, marked pure if its calls may be memoized
+void Environment::add_procedure(const std::string &symbol, BuiltinProcedure proc, bool pure,
+                                BuiltinLength length) {
+    Builtin &entry = procedure_table[symbol]; // Store the procedure in the procedure table
+    entry.proc = std::move(proc);
+    entry.pure = pure;
+    entry.length = length;
+}
+
+// Sets the variant of a procedure called where type inference proved its arguments' types
+void Environment::add_unchecked_procedure(const std::string &symbol, BuiltinProcedure proc) {
+    procedure_table[symbol].unchecked = std::move(proc);
+}
+
+/* Looks symbols up in snapshot once the symbol table lacks them */
+void Environment::attach(std::shared_ptr<const Snapshot> snapshot)
+{
+    if (!snapshot) {
+        prelude.reset();
+        return;
+    }
+    prelude = std::make_shared<Prelude>();
+    prelude->values.reset(new std::atomic<const Expression *>[snapshot->size()]());
+    prelude->snapshot = std::move(snapshot);
+}
+
+/* Every symbol with its value, the symbol table's taking precedence over the snapshot's */
+std::map<std::string, Expression> Environment::symbols() const
+{
+    std::map<std::string, Expression> all = symbol_table;
+    if (prelude) {
+        for (std::size_t i = 0; i < prelude->snapshot->size(); ++i) {
+            std::string symbol = prelude->snapshot->name(i);
+            if (all.find(symbol) == all.end()) {
+                all[symbol] = *find_in_prelude(symbol);
+            }
+        }
+    }
+    return all;
+}
+
+/* Decodes the snapshot's value of a symbol on its first lookup */
+const Expression *Environment::find_in_prelude(const std::string &symbol) const
+{
+    std::size_t index = prelude ? prelude->snapshot->find(symbol) : Snapshot::npos;
+    if (index == Snapshot::npos) {
+        return nullptr;
+    }
+    std::atomic<const Expression *> &slot = prelude->values[index];
+    const Expression *value = slot.load(std::memory_order_acquire);
+    if (value) {
+        return value;
+    }
+    std::unique_ptr<Expression> decoded(new Expression());
+    if (!prelude->snapshot->decode(index, *decoded)) {
+        throw InterpreterSemanticError("The snapshot's value of '" + symbol + "' is damaged");
+    }
+    // another thread may have decoded it meanwhile, in which case its copy is kept
+    if (slot.compare_exchange_strong(value, decoded.get(), std::memory_order_acq_rel)) {
+        return decoded.release();
+    }
+    return value;
+}
+
+// Returns the value bound to a symbol, or nullptr if it is not defined
+const Expression *Environment::find(const std::string &symbol) const {
+    auto it = symbol_table.find(symbol);
+    return it != symbol_table.end() ? &it->second : find_in_prelude(symbol);
 }
 
 // Retrieves the value associated with a symbol
 Expression Environment::get(const std::string &symbol) const {
-    auto it = symbol_table.find(symbol);
-    if (it != symbol_table.end()) {
-        return it->second; // Return the symbol value if found
+    if (const Expression *value = find(symbol)) {
+        return *value; // Return the symbol value if found
     }
     throw InterpreterSemanticError("Symbol '" + symbol + "' not found in environment");
 }
 
 // Retrieves the procedure associated with a symbol
-std::function<void(const std::vector<Atom>&, Expression&)> Environment::get_procedure(const std::string &symbol) const {
+BuiltinProcedure Environment::get_procedure(const std::string &symbol) const {
     auto it = procedure_table.find(symbol);
     if (it != procedure_table.end()) {
-        return it->second; // Return the procedure if found
+        return it->second.proc; // Return the procedure if found
     }
     throw InterpreterSemanticError("Procedure '" + symbol + "' not found in environment");
 }
 
+// Returns the procedure bound to a symbol, or nullptr if it is not defined
+const Builtin *Environment::find_procedure(const std::string &symbol) const {
+    auto it = procedure_table.find(symbol);
+    return it != procedure_table.end() ? &it->second : nullptr;
+}
+
 // Checks if a symbol is defined in the environment
 bool Environment::is_symbol_defined(const std::string &symbol) const {
-    return symbol_table.find(symbol) != symbol_table.end();
+    return symbol_table.find(symbol) != symbol_table.end() ||
+           (prelude && prelude->snapshot->find(symbol) != Snapshot::npos);
 }
 
 // Checks if a procedure is defined in the environment
 bool Environment::is_procedure_defined(const std::string &symbol) const {
     return procedure_table.find(symbol) != procedure_table.end();
 }
+
+// Finds a symbol in this frame or its parents; returns nullptr if not bound locally
+const Atom *Frame::find(const Symbol &symbol) const {
+    for (const Frame *frame = this; frame != nullptr; frame = frame->parent.get()) {
+        for (std::size_t i = 0; i < frame->names.size(); ++i) {
+            if (frame->names[i] == symbol) {
+                return &frame->values[i];
+            }
+        }
+    }
+    return nullptr;
+}
@@ -4,9 +4,55 @@
 #include <map>
 #include <string>
 #include <functional>
+#include <memory>
+#include <vector>
+#include <cstdint>
 #include "expression.hpp"
 #include "builtin_procedures.hpp"
 
+class Snapshot;
+
+// A local scope holding the parameters of one lambda call.
+// Frames are chained through parent to the scope the lambda was created in.
+struct Frame {
+    std::vector<Symbol> names;
+    std::vector<Atom> values;
+    std::shared_ptr<Frame> parent;
+    const Lambda *owner = nullptr; // lambda whose call created this frame
+
+    // Finds a symbol in this frame or its parents; returns nullptr if not bound locally
+    const Atom *find(const Symbol &symbol) const;
+};
+
+// A user-defined procedure: parameter names, a body and the scope it closes over
+struct Lambda {
+    std::vector<Symbol> params;
+    Expression body;
+    std::shared_ptr<Frame> closure;
+
+    // Whether calls may be memoized, as decided in the memo generation noted (0: not yet decided)
+    mutable std::uint64_t memo_generation = 0;
+    mutable bool memo_pure = false;
+};
+
+// Signature of a built-in procedure: evaluated arguments in, result out
+typedef std::function<void(const std::vector<Atom>&, Expression&)> BuiltinProcedure;
+
+// Number of elements the list a built-in procedure would return for these arguments, so the
+// allocation can be charged against the budgets before it is made
+typedef std::size_t (*BuiltinLength)(const std::vector<Atom>&);
+
+// A built-in procedure and whether it is pure, i.e. its result depends only on its
+// arguments and calling it has no side effects, so calls may be memoized. Procedures that
+// build lists from their arguments' values rather than their sizes also give the length.
+// Some have a variant without argument checks, called where type inference proved them.
+struct Builtin {
+    BuiltinProcedure proc;
+    bool pure = false;
+    BuiltinLength length = nullptr;
+    BuiltinProcedure unchecked;
+};
+
 // Environment class manages symbols and procedures
 class Environment {
 public:
@@ -16,14 +62,27 @@ public:
     // Adds a symbol-value pair to the environment
     void add(const std::string &symbol, const Expression &value);
 
-    // Adds a procedure to the environment
-    void add_procedure(const std::string &symbol, std::function<void(const std::vector<Atom>&, Expression&)> proc);
+    // Removes a symbol from the environment, if present
+    void remove(const std::string &symbol);
+
+    // Adds a procedure to the environment, marked pure if its calls may be memoized
+    void add_procedure(const std::string &symbol, BuiltinProcedure proc, bool pure = false,
+                       BuiltinLength length = nullptr);
+
+    // Sets the variant of a procedure called where type inference proved its arguments' types
+    void add_unchecked_procedure(const std::string &symbol, BuiltinProcedure proc);
+
+    // Returns the value bound to a symbol, or nullptr if it is not defined
+    const Expression *find(const std::string &symbol) const;
 
     // Retrieves the value associated with a symbol
     Expression get(const std::string &symbol) const;
 
     // Retrieves the procedure associated with a symbol
-    std::function<void(const std::vector<Atom>&, Expression&)> get_procedure(const std::string &symbol) const;
+    BuiltinProcedure get_procedure(const std::string &symbol) const;
+
+    // Returns the procedure bound to a symbol, or nullptr if it is not defined
+    const Builtin *find_procedure(const std::string &symbol) const;
 
     // Checks if a symbol is defined in the environment
     bool is_symbol_defined(const std::string &symbol) const;
@@ -33,12 +92,30 @@ public:
 
     void reset();
 
+    // Removes every symbol, keeping the procedures and the attached snapshot
+    void clear_symbols();
+
+    // Falls back on snapshot for symbols missing from the symbol table, decoding each value
+    // on its first lookup; copies of this environment share the decoded values
+    void attach(std::shared_ptr<const Snapshot> snapshot);
+
+    // Every symbol with its value, including those of the attached snapshot not shadowed
+    std::map<std::string, Expression> symbols() const;
+
 private:
+    struct Prelude;
+
+    // Returns the snapshot's value of a symbol, or nullptr if the snapshot lacks it
+    const Expression *find_in_prelude(const std::string &symbol) const;
+
     // Symbol table to store variables and constants
     std::map<std::string, Expression> symbol_table;
 
     // Procedure table to store built-in procedures
-    std::map<std::string, std::function<void(const std::vector<Atom>&, Expression&)>> procedure_table;
+    std::map<std::string, Builtin> procedure_table;
+
+    // Snapshot attached with attach(), if any
+    std::shared_ptr<Prelude> prelude;
 };
 
 #endif
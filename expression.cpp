@@ -1,4 +1,5 @@
 #include "expression.hpp"
+#include "number_format.hpp"
 #include <cctype>
 #include <sstream>
 #include <stdexcept>
@@ -87,6 +88,39 @@ Expression::Expression(std::tuple<double, double, double, double> rect, double r
     head.value.fillRect_value.b = b;
 }
 
+// Constructor for ListType expression
+Expression::Expression(std::shared_ptr<const List> list)
+{
+    head.type = ListType;
+    head.value.list_value = std::move(list);
+}
+
+// Returns element i of a list as an Atom
+Atom List::at(std::size_t i) const
+{
+    if (!numeric) {
+        return items[i];
+    }
+    Atom atom = Atom();
+    atom.type = NumberType;
+    atom.value.num_value = numbers[i];
+    return atom;
+}
+
+// Compares two lists element by element
+static bool listsEqual(const List &a, const List &b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if (!(Expression(a.at(i)) == Expression(b.at(i)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // Equality operator for comparing two expressions
 bool Expression::operator==(const Expression & exp) const noexcept {
 
@@ -102,6 +136,8 @@ bool Expression::operator==(const Expression & exp) const noexcept {
             return true; // NoneType expressions are always equal
         case BooleanType:
             return head.value.bool_value == exp.head.value.bool_value;
+        case ListType:
+            return listsEqual(*head.value.list_value, *exp.head.value.list_value);
         case NumberType:
             return compareNumbers(head.value.num_value, exp.head.value.num_value);//std::fabs(head.value.num_value - exp.head.value.num_value) < EPSILON;
         case SymbolType:
@@ -124,6 +160,8 @@ bool Expression::operator==(const Expression & exp) const noexcept {
                     (compareNumbers(head.value.fillRect_value.b, exp.head.value.fillRect_value.b)));
         case EllipseType:
             return ((head.value.ellipse_value.rect == exp.head.value.ellipse_value.rect));
+        case ProcedureType:
+            return head.value.proc_value == exp.head.value.proc_value;
     }
 
     return false;
@@ -192,67 +230,112 @@ bool token_to_atom(const std::string & token, Atom & atom) {
     return true;
 }
 // Overload the << operator for printing an expression
-std::ostream & operator<<(std::ostream & out, const Expression & exp) {
-    out << '(';
-    switch (exp.head.type) {
+// Appends a number as printed expressions write it
+static void appendNumber(Number value, std::string &out) {
+    char text[MAX_NUMBER_CHARS];
+    out.append(text, formatPrinted(value, text));
+}
+
+// Appends "x,y"
+static void appendPair(Number x, Number y, std::string &out) {
+    appendNumber(x, out);
+    out += ',';
+    appendNumber(y, out);
+}
+
+// Appends "x1,y1,x2,y2"
+static void appendRect(const Rect &rect, std::string &out) {
+    appendPair(rect.x1, rect.y1, out);
+    out += ',';
+    appendPair(rect.x2, rect.y2, out);
+}
+
+// Appends the printed form of an atom, elements of a list included
+static void appendAtom(const Atom &atom, std::string &out) {
+    const Value &value = atom.value;
+    out += '(';
+    switch (atom.type) {
         case NoneType:
-            out << "None";
+            out += "None";
             break;
         case BooleanType:
-            out << (exp.head.value.bool_value ? "True" : "False");
+            out += value.bool_value ? "True" : "False";
             break;
         case NumberType:
-            out << exp.head.value.num_value;
+            appendNumber(value.num_value, out);
+            break;
+        case ListType: {
+            const List &list = *value.list_value;
+            for (std::size_t i = 0; i < list.size(); ++i) {
+                if (i != 0) {
+                    out += ' ';
+                }
+                if (list.numeric) {
+                    out += '(';
+                    appendNumber(list.numbers[i], out);
+                    out += ')';
+                } else {
+                    appendAtom(list.items[i], out);
+                }
+            }
             break;
+        }
         case SymbolType:
-            out << exp.head.value.sym_value;
+            out += value.sym_value;
             break;
         case PointType:
-            out << exp.head.value.point_value.x << ',' << exp.head.value.point_value.y;
+            appendPair(value.point_value.x, value.point_value.y, out);
             break;
         case LineType:
-            out << '(' << 
-            exp.head.value.line_value.first.x << ',' << exp.head.value.line_value.first.y << "),(" << 
-            exp.head.value.line_value.second.x << ',' << exp.head.value.line_value.second.y << ')';
+            out += '(';
+            appendPair(value.line_value.first.x, value.line_value.first.y, out);
+            out += "),(";
+            appendPair(value.line_value.second.x, value.line_value.second.y, out);
+            out += ')';
             break;
         case ArcType:
-            out << '(' <<
-            exp.head.value.arc_value.center.x << ',' <<
-            exp.head.value.arc_value.center.y << "),(" <<
-            exp.head.value.arc_value.start.x << ',' <<
-            exp.head.value.arc_value.start.y << ") " <<
-            exp.head.value.arc_value.span << ')';
+            out += '(';
+            appendPair(value.arc_value.center.x, value.arc_value.center.y, out);
+            out += "),(";
+            appendPair(value.arc_value.start.x, value.arc_value.start.y, out);
+            out += ") ";
+            appendNumber(value.arc_value.span, out);
+            out += ')';
             break;
         case RectType:
-            out << 
-            exp.head.value.rect_value.x1 << ',' <<
-            exp.head.value.rect_value.y1 << ',' <<
-            exp.head.value.rect_value.x2 << ',' <<
-            exp.head.value.rect_value.y2;
+            appendRect(value.rect_value, out);
             break;
         case FillRectType:
-            out << '(' << 
-            exp.head.value.fillRect_value.rect.x1 << ',' <<
-            exp.head.value.fillRect_value.rect.y1 << ',' <<
-            exp.head.value.fillRect_value.rect.x2 << ',' <<
-            exp.head.value.fillRect_value.rect.y2 << ")," <<
-            exp.head.value.fillRect_value.r << ',' <<
-            exp.head.value.fillRect_value.g << ',' <<
-            exp.head.value.fillRect_value.b;
+            out += '(';
+            appendRect(value.fillRect_value.rect, out);
+            out += "),";
+            appendNumber(value.fillRect_value.r, out);
+            out += ',';
+            appendPair(value.fillRect_value.g, value.fillRect_value.b, out);
             break;
         case EllipseType:
-            out <<
-            exp.head.value.fillRect_value.rect.x1 << ',' <<
-            exp.head.value.fillRect_value.rect.y1 << ',' <<
-            exp.head.value.fillRect_value.rect.x2 << ',' <<
-            exp.head.value.fillRect_value.rect.y2 << ')';
+            appendRect(value.ellipse_value.rect, out);
+            out += ')';
+            break;
+        case ProcedureType:
+            out += "lambda";
             break;
         default:
-            out << "Unknown";
+            out += "Unknown";
             break;
     }
-    out << ')';
-    return out;
+    out += ')';
+}
+
+/* Prints without going through iostreams */
+void appendExpression(const Expression & exp, std::string & out) {
+    appendAtom(exp.head, out);
+}
+
+std::ostream & operator<<(std::ostream & out, const Expression & exp) {
+    std::string printed;
+    appendExpression(exp, printed);
+    return out.write(printed.data(), printed.size());
 }
 
 
@@ -7,12 +7,14 @@
 #include <cmath>
 #include <limits>
 #include <tuple>
+#include <memory>
 
 #include "common_functions.hpp"
 // Enumeration of possible expression types
 enum Type {
     NoneType, BooleanType, NumberType, ListType, SymbolType,
-    PointType, LineType, ArcType, RectType, FillRectType, EllipseType
+    PointType, LineType, ArcType, RectType, FillRectType, EllipseType,
+    ProcedureType
 };
 
 // Define Boolean as an alias for bool
@@ -98,12 +100,18 @@ struct Ellipse {
     Rect rect;
 };
 
+// A user-defined procedure created by lambda (defined in environment.hpp)
+struct Lambda;
+
+// A list value (defined below, once Atom is complete)
+struct List;
+
 // A Value is a boolean, number, or symbol
 // cannot use a union because symbol is non-POD
 // this wastes space but is simple 
 struct Value {
-    Boolean bool_value;
-    Number num_value;
+    Boolean bool_value = false;
+    Number num_value = 0;
     Symbol sym_value;
     Point point_value;
     Line line_value;
@@ -111,14 +119,34 @@ struct Value {
     Rect rect_value;
     FillRect fillRect_value;
     Ellipse ellipse_value;
+    std::shared_ptr<Lambda> proc_value;
+    std::shared_ptr<const List> list_value;
 };
 
 // An Atom has a type and value
 struct Atom {
     Type type;
+    // Set by type inference (see type_inference.hpp) on the head of a builtin call whose
+    // argument types it proved, which then calls the builtin's unchecked variant
+    bool unchecked = false;
     Value value;
 };
 
+// A List is an immutable sequence stored contiguously. Lists of numbers keep
+// plain doubles in numbers so element-wise operations run over unboxed memory;
+// any other list keeps its elements as Atoms in items.
+struct List {
+    bool numeric = true;
+    std::vector<Number> numbers;
+    std::vector<Atom> items;
+
+    // Number of elements
+    std::size_t size() const { return numeric ? numbers.size() : items.size(); }
+
+    // Element i as an Atom
+    Atom at(std::size_t i) const;
+};
+
 // Structure representing an Expression
 struct Expression {
   Atom head;                  // Head of the expression (an Atom)
@@ -168,6 +196,9 @@ struct Expression {
     // with a bounding box rectangle
    Expression(std::tuple<double, double, double, double> rect);
 
+    // Construct an Expression with a single List atom
+   explicit Expression(std::shared_ptr<const List> list);
+
   // Equality operator for comparing two expressions
   bool operator==(const Expression & exp) const noexcept;
 };
@@ -175,9 +206,12 @@ struct Expression {
 // Procedure type: function pointer that takes a vector of Atoms and returns an Expression
 typedef Expression (*Procedure)(const std::vector<Atom> & args);
 
-// Overloaded operator<< to print an Expression
+// Overloaded operator<< to print an Expression; numbers follow numberStyle()
 std::ostream & operator<<(std::ostream & out, const Expression & exp);
 
+// Appends the text operator<< prints for an Expression to out
+void appendExpression(const Expression & exp, std::string & out);
+
 // Converts a token to an Atom
 bool token_to_atom(const std::string & token, Atom & atom);
 
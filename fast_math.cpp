@@ -0,0 +1,182 @@
+#include "fast_math.hpp"
+#include "fast_math_kernels.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// The polynomial coefficients are those of the FreeBSD (originally Sun fdlibm) kernels; sin
+// and cos share theirs with the list kernels through fast_math_kernels.hpp. The speed comes
+// from what is left out: Payne-Hanek reduction of huge arguments, the slow correctly-rounded
+// paths of libm, and for log10 the extra-precision recombination.
+
+namespace {
+
+const Number ATAN_HI[] = {4.63647609000806093515e-01, 7.85398163397448278999e-01,
+                          9.82793723247329054082e-01, 1.57079632679489655800e+00};
+const Number ATAN_LO[] = {2.26987774529616870924e-17, 3.06161699786838301793e-17,
+                          1.39033110312309984516e-17, 6.12323399573676603587e-17};
+const Number AT[] = {3.33333333333329318027e-01, -1.99999999998764832476e-01, 1.42857142725034663711e-01,
+                     -1.11111104054623557880e-01, 9.09088713343650656196e-02, -7.69187620504482999495e-02,
+                     6.66107313738753120669e-02, -5.83357013379057348645e-02, 4.97687799461593236017e-02,
+                     -3.65315727442169155270e-02, 1.62858201153657823623e-02};
+const Number PI_HI = 3.1415926535897931160e+00;
+const Number PI_LO = 1.2246467991473531772e-16;
+
+const Number LG1 = 6.666666666666735130e-01;
+const Number LG2 = 3.999999999940941908e-01;
+const Number LG3 = 2.857142874366239149e-01;
+const Number LG4 = 2.222219843214978396e-01;
+const Number LG5 = 1.818357216161805012e-01;
+const Number LG6 = 1.531383769920937332e-01;
+const Number LG7 = 1.479819860511658591e-01;
+const Number SQRT2 = 1.41421356237309514547e+00;
+const Number LN2_HI = 6.93147180369123816490e-01;
+const Number LN2_LO = 1.90821492927058770002e-10;
+const Number INV_LN10 = 4.34294481903251816668e-01;
+
+std::uint64_t toBits(Number x)
+{
+    std::uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+Number fromBits(std::uint64_t bits)
+{
+    Number x;
+    std::memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+// Quadrant k mod 4 of the multiple k of pi/2 fastReduce takes off x
+inline int reduce(Number x, Number &r, Number &rr)
+{
+    return static_cast<int>(static_cast<long long>(fastReduce(x, r, rr)) & 3);
+}
+
+// atan(x) for finite x
+Number atanFinite(Number x)
+{
+    Number ax = std::fabs(x);
+    int id;
+    if (ax < 0.4375) {
+        id = -1;
+    } else if (ax < 0.6875) {
+        id = 0;
+        ax = (2.0 * ax - 1.0) / (2.0 + ax);
+    } else if (ax < 1.1875) {
+        id = 1;
+        ax = (ax - 1.0) / (ax + 1.0);
+    } else if (ax < 2.4375) {
+        id = 2;
+        ax = (ax - 1.5) / (1.0 + 1.5 * ax);
+    } else {
+        id = 3;
+        ax = -1.0 / ax;
+    }
+    Number z = ax * ax;
+    Number w = z * z;
+    Number s1 = z * (AT[0] + w * (AT[2] + w * (AT[4] + w * (AT[6] + w * (AT[8] + w * AT[10])))));
+    Number s2 = w * (AT[1] + w * (AT[3] + w * (AT[5] + w * (AT[7] + w * AT[9]))));
+    Number result = id < 0 ? ax - ax * (s1 + s2) : ATAN_HI[id] - ((ax * (s1 + s2) - ATAN_LO[id]) - ax);
+    return x < 0 ? -result : result;
+}
+
+// ln(x) for positive normal x: x = 2^k (1 + f) with 1 + f in [sqrt(2)/2, sqrt(2)),
+// ln(1 + f) = 2 atanh(s) with s = f / (2 + f), as in FreeBSD's k_log.h
+inline Number logNormal(Number x)
+{
+    std::uint64_t bits = toBits(x);
+    Number k = static_cast<Number>(static_cast<int>(bits >> 52) - 1023);
+    Number m = fromBits((bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL);
+    if (m > SQRT2) {
+        m *= 0.5;
+        k += 1.0;
+    }
+    Number f = m - 1.0;
+    Number hfsq = 0.5 * f * f;
+    Number s = f / (2.0 + f);
+    Number z = s * s;
+    Number w = z * z;
+    Number t1 = w * (LG2 + w * (LG4 + w * LG6));
+    Number t2 = z * (LG1 + w * (LG3 + w * (LG5 + w * LG7)));
+    return k * LN2_HI - ((hfsq - (s * (hfsq + t2 + t1) + k * LN2_LO)) - f);
+}
+
+}
+
+/* sin(x), evaluating whichever kernel the quadrant needs; zero, huge and non-finite x use libm */
+Number fastSin(Number x)
+{
+    if (!(std::fabs(x) <= FAST_TRIG_LIMIT) || x == 0) {
+        return std::sin(x);
+    }
+    Number r;
+    Number rr;
+    switch (reduce(x, r, rr)) {
+        case 0: return fastKernelSin(r, rr);
+        case 1: return fastKernelCos(r, rr);
+        case 2: return -fastKernelSin(r, rr);
+        default: return -fastKernelCos(r, rr);
+    }
+}
+
+/* cos(x), as fastSin */
+Number fastCos(Number x)
+{
+    if (!(std::fabs(x) <= FAST_TRIG_LIMIT) || x == 0) {
+        return std::cos(x);
+    }
+    Number r;
+    Number rr;
+    switch (reduce(x, r, rr)) {
+        case 0: return fastKernelCos(r, rr);
+        case 1: return -fastKernelSin(r, rr);
+        case 2: return -fastKernelCos(r, rr);
+        default: return fastKernelSin(r, rr);
+    }
+}
+
+/* atan2(y, x) from atan(|y / x|) placed in the right quadrant; zeros and non-finite arguments use libm */
+Number fastAtan2(Number y, Number x)
+{
+    if (!std::isfinite(x) || !std::isfinite(y) || x == 0 || y == 0) {
+        return std::atan2(y, x);
+    }
+    Number t = atanFinite(std::fabs(y / x));
+    Number result = x > 0 ? t : PI_HI - (t - PI_LO);
+    return y < 0 ? -result : result;
+}
+
+/* log10(x) as ln(x) / ln(10); libm outside the normal positives */
+Number fastLog10(Number x)
+{
+    if (!(x >= FAST_MIN_NORMAL) || !(x <= FAST_MAX_FINITE)) {
+        return std::log10(x);
+    }
+    return logNormal(x) * INV_LN10;
+}
+
+/* pow(x, y) for the small exponents drawing code uses (squares, cubes, reciprocals and square
+   roots) by multiplication and division. Squares, square roots and reciprocals round once and
+   are correctly rounded; cubes and inverse squares round twice, which FAST_POW_MAX_ULP bounds.
+   libm for every other exponent. */
+Number fastPow(Number x, Number y)
+{
+    // within these bounds no product below overflows or loses precision to underflow
+    if (!(x >= 1e-100) || !(x <= 1e100)) {
+        return std::pow(x, y);
+    }
+    if (y == 2) {
+        return x * x;
+    } else if (y == 0.5) {
+        return std::sqrt(x);
+    } else if (y == 3) {
+        return x * x * x;
+    } else if (y == -1) {
+        return 1.0 / x;
+    } else if (y == -2) {
+        return 1.0 / (x * x);
+    }
+    return std::pow(x, y);
+}
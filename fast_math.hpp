@@ -0,0 +1,35 @@
+#ifndef FAST_MATH_HPP
+#define FAST_MATH_HPP
+
+#include "expression.hpp"
+
+// How the transcendental builtins (sin, cos, arctan, pow, log10) are computed.
+// Precise calls the C library, so results are bit-identical to std::sin and friends.
+// Fast uses the kernels below, which trade libm's last half ULP and its slow paths for
+// short polynomial kernels, bit-reproducible across platforms with IEEE doubles as long as
+// fast_math.cpp and vector_kernels.cpp are built without FMA contraction (see CMakeLists.txt).
+enum class MathMode { Precise, Fast };
+
+// Error bounds of the fast kernels, in units in the last place of the exact result,
+// measured over the whole input range by the accuracy report in benchmarks.cpp
+const double FAST_SIN_COS_MAX_ULP = 1.0;
+const double FAST_ATAN2_MAX_ULP = 2.0;
+const double FAST_LOG10_MAX_ULP = 2.0;
+const double FAST_POW_MAX_ULP = 1.5;
+
+// Scalar kernels. Arguments they have no fast path for (non-finite, huge or subnormal
+// ones, and exponents other than 2, 3, 0.5, -1 and -2 for pow) go to libm.
+Number fastSin(Number x);
+Number fastCos(Number x);
+Number fastAtan2(Number y, Number x);
+Number fastLog10(Number x);
+Number fastPow(Number x, Number y);
+
+// sin and cos reduce x by a multiple k of pi/2 with pi/2 split in exact 33-bit pieces,
+// which stay exact products for |k| < 2^20
+const Number FAST_TRIG_LIMIT = 524288.0; // 2^19
+
+const Number FAST_MIN_NORMAL = 2.2250738585072014e-308;
+const Number FAST_MAX_FINITE = 1.7976931348623157e+308;
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef FAST_MATH_KERNELS_HPP
+#define FAST_MATH_KERNELS_HPP
+
+#include "expression.hpp"
+
+// The range reduction and polynomials behind fastSin and fastCos, written once over a number
+// type T so that the scalar kernels (T = Number) and the list kernels in vector_kernels.cpp
+// (T = a SIMD register of Numbers) evaluate the same operations in the same order, and so
+// give the same bits. T needs +, - and * with itself and with Number. The coefficients are
+// those of the FreeBSD (originally Sun fdlibm) kernels.
+
+// pi/2 in 33-bit pieces, so that k * piece is exact for |k| < 2^20
+const Number FAST_PIO2_1 = 1.57079632673412561417e+00;
+const Number FAST_PIO2_2 = 6.07710050630396597660e-11;
+const Number FAST_PIO2_3 = 2.02226624871116645580e-21;
+const Number FAST_PIO2_3T = 8.47842766036889956997e-32;
+const Number FAST_TWO_OVER_PI = 6.36619772367581382433e-01;
+
+// Adding then subtracting this rounds a double of magnitude below 2^51 to an integer
+const Number FAST_ROUNDING_SHIFT = 6755399441055744.0; // 1.5 * 2^52
+
+const Number FAST_S1 = -1.66666666666666324348e-01;
+const Number FAST_S2 = 8.33333333332248946124e-03;
+const Number FAST_S3 = -1.98412698298579493134e-04;
+const Number FAST_S4 = 2.75573137070700676789e-06;
+const Number FAST_S5 = -2.50507602534068634195e-08;
+const Number FAST_S6 = 1.58969099521155010221e-10;
+
+const Number FAST_C1 = 4.16666666666666019037e-02;
+const Number FAST_C2 = -1.38888888888741095749e-03;
+const Number FAST_C3 = 2.48015872894767294178e-05;
+const Number FAST_C4 = -2.75573143513906633035e-07;
+const Number FAST_C5 = 2.08757232129817482790e-09;
+const Number FAST_C6 = -1.13596475577881948265e-11;
+
+// sin(x + y) for |x| <= pi/4, y a tail below ulp(x)
+template <typename T>
+inline T fastKernelSin(T x, T y)
+{
+    T z = x * x;
+    T w = z * z;
+    T r = FAST_S2 + z * (FAST_S3 + z * FAST_S4) + z * w * (FAST_S5 + z * FAST_S6);
+    T v = z * x;
+    return x - ((z * (0.5 * y - v * r) - y) - v * FAST_S1);
+}
+
+// cos(x + y) for |x| <= pi/4, y a tail below ulp(x)
+template <typename T>
+inline T fastKernelCos(T x, T y)
+{
+    T z = x * x;
+    T w = z * z;
+    T r = z * (FAST_C1 + z * (FAST_C2 + z * FAST_C3)) + w * w * (FAST_C4 + z * (FAST_C5 + z * FAST_C6));
+    T hz = 0.5 * z;
+    T v = 1.0 - hz;
+    return v + (((1.0 - v) - hz) + (z * r - x * y));
+}
+
+// Reduces nonzero |x| <= FAST_TRIG_LIMIT to x = r + rr + k pi/2 with |r| <= pi/4, returning
+// the integer k; sin and cos of x are those of r + rr turned by k mod 4 quarter turns
+template <typename T>
+inline T fastReduce(T x, T &r, T &rr)
+{
+    T k = (x * FAST_TWO_OVER_PI + FAST_ROUNDING_SHIFT) - FAST_ROUNDING_SHIFT;
+    T a = x - k * FAST_PIO2_1; // exact
+    T b = k * FAST_PIO2_2;     // exact
+    // two-sum of a - b, then the remaining pieces of pi/2 into the tail
+    T t = a - b;
+    T bv = a - t;
+    T lo = ((a - (t + bv)) + (bv - b)) - (k * FAST_PIO2_3 + k * FAST_PIO2_3T);
+    r = t + lo;
+    rr = lo - (r - t);
+    return k;
+}
+
+#endif
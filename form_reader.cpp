@@ -0,0 +1,52 @@
+#include "form_reader.hpp"
+
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+
+FormReader::FormReader(int fd, std::function<void()> before_wait) : fd(fd), before_wait(std::move(before_wait))
+{
+}
+
+/* Reads more input whenever the text read so far holds no complete form */
+bool FormReader::next(const char *&form, std::size_t &size)
+{
+    while (!scanner.next(form, size)) {
+        if (!fill()) {
+            return scanner.finish(form, size);
+        }
+    }
+    return true;
+}
+
+/* Bytes read so far */
+std::uint64_t FormReader::bytes_read() const noexcept
+{
+    return total;
+}
+
+/* Reads a block straight into the scanner's buffer */
+bool FormReader::fill()
+{
+    if (at_eof) {
+        return false;
+    }
+    if (before_wait) {
+        pollfd ready = {fd, POLLIN, 0};
+        if (poll(&ready, 1, 0) == 0) {
+            before_wait();
+        }
+    }
+    char *space = scanner.reserve(BLOCK_BYTES);
+    ssize_t n;
+    do {
+        n = read(fd, space, BLOCK_BYTES);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        at_eof = true;
+        return false;
+    }
+    scanner.commit(static_cast<std::size_t>(n));
+    total += static_cast<std::uint64_t>(n);
+    return true;
+}
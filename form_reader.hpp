@@ -0,0 +1,38 @@
+#ifndef FORM_READER_HPP
+#define FORM_READER_HPP
+
+#include "form_scanner.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Splits the text read from a file descriptor into top-level forms, reading it in large
+// blocks; a form may span any number of lines and blocks.
+class FormReader {
+public:
+    // Bytes requested from the descriptor per read
+    static const std::size_t BLOCK_BYTES = 1 << 20;
+
+    // Reads from fd; before_wait, if set, runs whenever the next read would block
+    explicit FormReader(int fd, std::function<void()> before_wait = nullptr);
+
+    // Finds the next form, false at the end of input. The form's text stays valid until the
+    // next call. Forms are split as FormScanner splits them, and an unclosed form at the end
+    // of input is returned as it is, which parse() rejects.
+    bool next(const char *&form, std::size_t &size);
+
+    // Bytes read from the descriptor so far
+    std::uint64_t bytes_read() const noexcept;
+
+private:
+    int fd;
+    std::function<void()> before_wait;
+    FormScanner scanner;
+    bool at_eof = false;
+    std::uint64_t total = 0;
+
+    // Reads the next block into the scanner; false at the end of input
+    bool fill();
+};
+
+#endif
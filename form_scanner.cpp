@@ -0,0 +1,122 @@
+#include "form_scanner.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+void FormScanner::append(const char *text, std::size_t size)
+{
+    std::memcpy(reserve(size), text, size);
+    commit(size);
+}
+
+/* Returned text is dropped from the front only once it outweighs the text kept, so a form
+   that spans many chunks is not copied once per chunk */
+char *FormScanner::reserve(std::size_t size)
+{
+    if (begin > 0 && begin >= end - begin) {
+        std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+        scanned -= begin;
+        end -= begin;
+        begin = 0;
+    }
+    if (buffer.size() < end + size) {
+        buffer.resize(std::max(end + size, buffer.size() * 2));
+    }
+    return buffer.data() + end;
+}
+
+void FormScanner::commit(std::size_t size)
+{
+    end += size;
+}
+
+/* Whitespace and comments between forms are skipped by moving begin past them */
+bool FormScanner::next(const char *&form, std::size_t &size)
+{
+    while (scanned < end) {
+        char c = buffer[scanned];
+        bool space = std::isspace(static_cast<unsigned char>(c)) != 0;
+        if (state == State::InComment) {
+            ++scanned;
+            if (c == '\n') {
+                state = State::Start;
+                if (!in_form) {
+                    begin = scanned;
+                }
+            }
+            continue;
+        }
+        if (state == State::InToken) {
+            if (!space && c != '(' && c != ')') {
+                ++scanned;
+                continue;
+            }
+            state = State::Start;
+            if (depth == 0) {
+                // a stray token ends here
+                take(form, size);
+                return true;
+            }
+        }
+        // at the start of a token
+        if (space) {
+            ++scanned;
+            if (!in_form) {
+                begin = scanned;
+            }
+        } else if (c == ';') {
+            state = State::InComment;
+            ++scanned;
+        } else if (c == '(') {
+            in_form = true;
+            ++depth;
+            ++scanned;
+        } else if (c == ')') {
+            ++scanned;
+            if (depth <= 1) {
+                // the form closes, or a stray ')' stands alone
+                take(form, size);
+                return true;
+            }
+            --depth;
+        } else {
+            in_form = true;
+            state = State::InToken;
+            ++scanned;
+        }
+    }
+    return false;
+}
+
+bool FormScanner::finish(const char *&form, std::size_t &size)
+{
+    if (!in_form) {
+        return false;
+    }
+    take(form, size);
+    return true;
+}
+
+bool FormScanner::pending() const noexcept
+{
+    return in_form;
+}
+
+void FormScanner::clear() noexcept
+{
+    begin = scanned = end = 0;
+    state = State::Start;
+    depth = 0;
+    in_form = false;
+}
+
+void FormScanner::take(const char *&form, std::size_t &size)
+{
+    form = buffer.data() + begin;
+    size = scanned - begin;
+    begin = scanned;
+    state = State::Start;
+    depth = 0;
+    in_form = false;
+}
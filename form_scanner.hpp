@@ -0,0 +1,53 @@
+#ifndef FORM_SCANNER_HPP
+#define FORM_SCANNER_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Splits text that arrives in chunks into top-level forms. The scanner keeps its state, the
+// paren depth and any partial token or form between chunks, so each chunk is scanned once
+// however many chunks a form spans. Tokens and comments are delimited as tokenize() delimits
+// them.
+class FormScanner {
+public:
+    // Adds text after what was added before
+    void append(const char *text, std::size_t size);
+
+    // Room for size more bytes after the text, to read into directly; commit adds the first
+    // size of them to the text
+    char *reserve(std::size_t size);
+    void commit(std::size_t size);
+
+    // Finds the next complete form, false if the text added so far ends before one closes.
+    // The form's text stays valid until the next call that is not const. A token outside any
+    // parentheses, once delimited, or an unmatched ')' is returned as a form of its own,
+    // which parse() rejects.
+    bool next(const char *&form, std::size_t &size);
+
+    // Takes the unfinished form the text ends in, as at the end of input; false if none
+    bool finish(const char *&form, std::size_t &size);
+
+    // True when next() last stopped inside a form or a token
+    bool pending() const noexcept;
+
+    // Forgets all text, including any unfinished form
+    void clear() noexcept;
+
+private:
+    enum class State { Start, InToken, InComment };
+
+    std::vector<char> buffer;
+    std::size_t begin = 0;   // start of the unreturned text in buffer
+    std::size_t scanned = 0; // text in [begin, scanned) has been scanned
+    std::size_t end = 0;     // end of the text in buffer
+
+    // Scanner state at scanned
+    State state = State::Start;
+    std::size_t depth = 0;
+    bool in_form = false; // scanning a form (or a stray token) that started at begin
+
+    // Returns [begin, scanned) as a form and starts looking for the next one
+    void take(const char *&form, std::size_t &size);
+};
+
+#endif
@@ -3,42 +3,83 @@
 #include "expression.hpp"
 #include "environment.hpp"
 #include "interpreter_semantic_error.hpp"
+#include "list_procedures.hpp"
+#include "type_inference.hpp"
 #include <stack>
+#include <cmath>
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include <sstream>
 #include <deque>
+#include <exception>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
 
 /* Constructor that builds the enviornment to have appropiate procedures and symbols */
-Interpreter::Interpreter()
+Interpreter::Interpreter() : cancel_requested(false), thread_count(std::max(1u, std::thread::hardware_concurrency()))
 {
     // Add built-in procedures to the procedure table
-    env.add_procedure("not", procNot);
-    env.add_procedure("and", procAnd);
-    env.add_procedure("or", procOr);
-    env.add_procedure("+", procAdd);
-    env.add_procedure("-", procSubtract);
-    env.add_procedure("*", procMultiply);
-    env.add_procedure("/", procDivide);
-    env.add_procedure("log10", procLog10);
-    env.add_procedure("pow", procPow);
-    env.add_procedure("<", procLessThan);
-    env.add_procedure("<=", procLessThanOrEqual);
-    env.add_procedure(">", procGreaterThan);
-    env.add_procedure(">=", procGreaterThanOrEqual);
-    env.add_procedure("=", procEqual);
-
-    env.add_procedure("point", procPoint);
-    env.add_procedure("line", procLine);
-    env.add_procedure("arc", procArc);
-    env.add_procedure("rect", procRect);
-    env.add_procedure("fill_rect", procFillRect);
-    env.add_procedure("ellipse", procEllipse);
-
-    env.add_procedure("sin", procSine);
-    env.add_procedure("cos", procCosine);
-    env.add_procedure("arctan", procArctan);
-    
+    env.add_procedure("not", procNot, true);
+    env.add_procedure("and", procAnd, true);
+    env.add_procedure("or", procOr, true);
+    env.add_procedure("+", procAdd, true);
+    env.add_procedure("-", procSubtract, true);
+    env.add_procedure("*", procMultiply, true);
+    env.add_procedure("/", procDivide, true);
+    env.add_procedure("log10", procLog10, true);
+    env.add_procedure("pow", procPow, true);
+    env.add_procedure("<", procLessThan, true);
+    env.add_procedure("<=", procLessThanOrEqual, true);
+    env.add_procedure(">", procGreaterThan, true);
+    env.add_procedure(">=", procGreaterThanOrEqual, true);
+    env.add_procedure("=", procEqual, true);
+
+    env.add_procedure("point", procPoint, true);
+    env.add_procedure("line", procLine, true);
+    env.add_procedure("arc", procArc, true);
+    env.add_procedure("rect", procRect, true);
+    env.add_procedure("fill_rect", procFillRect, true);
+    env.add_procedure("ellipse", procEllipse, true);
+
+    env.add_procedure("sin", procSine, true);
+    env.add_procedure("cos", procCosine, true);
+    env.add_procedure("arctan", procArctan, true);
+
+    env.add_procedure("list", procList, true);
+    env.add_procedure("range", procRange, true, rangeLength);
+    env.add_procedure("length", procLength, true);
+    env.add_procedure("nth", procNth, true);
+    env.add_procedure("sum", procSum, true);
+    env.add_procedure("min", procMin, true);
+    env.add_procedure("max", procMax, true);
+
+    // Variants without argument checks, called where type inference proved the arguments
+    env.add_unchecked_procedure("not", procNotUnchecked);
+    env.add_unchecked_procedure("and", procAndUnchecked);
+    env.add_unchecked_procedure("or", procOrUnchecked);
+    env.add_unchecked_procedure("<", procLessThanUnchecked);
+    env.add_unchecked_procedure("<=", procLessThanOrEqualUnchecked);
+    env.add_unchecked_procedure(">", procGreaterThanUnchecked);
+    env.add_unchecked_procedure(">=", procGreaterThanOrEqualUnchecked);
+    env.add_unchecked_procedure("=", procEqualUnchecked);
+    env.add_unchecked_procedure("+", procAddUnchecked);
+    env.add_unchecked_procedure("-", procSubtractUnchecked);
+    env.add_unchecked_procedure("*", procMultiplyUnchecked);
+    env.add_unchecked_procedure("/", procDivideUnchecked);
+    env.add_unchecked_procedure("log10", procLog10Unchecked);
+    env.add_unchecked_procedure("pow", procPowUnchecked);
+    env.add_unchecked_procedure("point", procPointUnchecked);
+    env.add_unchecked_procedure("line", procLineUnchecked);
+    env.add_unchecked_procedure("arc", procArcUnchecked);
+    env.add_unchecked_procedure("rect", procRectUnchecked);
+    env.add_unchecked_procedure("fill_rect", procFillRectUnchecked);
+    env.add_unchecked_procedure("ellipse", procEllipseUnchecked);
+    env.add_unchecked_procedure("sin", procSineUnchecked);
+    env.add_unchecked_procedure("cos", procCosineUnchecked);
+    env.add_unchecked_procedure("arctan", procArctanUnchecked);
 
     // Add the constant pi to the symbol table
     env.add("pi", std::atan2(0, -1));
@@ -86,6 +127,7 @@ Expression Interpreter::parse_expression(std::deque<std::string>::iterator &curr
 
 
 bool Interpreter::parse(std::istream &expression) noexcept {
+    parse_message.clear();
     try {
         auto tokens = tokenize(expression);
         if (tokens.empty()) {
@@ -104,100 +146,1459 @@ bool Interpreter::parse(std::istream &expression) noexcept {
             return false; // Extra tokens after valid expression
         }
     } catch (const InterpreterSemanticError &e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+        // kept for the caller rather than printed, so instances on other threads do not share a stream
+        parse_message = e.what();
         return false;
     }
 
     return true;
 }
 
+/* Why the last parse() failed */
+const std::string &Interpreter::parse_error() const noexcept
+{
+    return parse_message;
+}
+
+/* Forgets everything earlier programs did, keeping the settings */
+void Interpreter::reset()
+{
+    ast = Expression();
+    parse_message.clear();
+    env.clear_symbols();
+    env.add("pi", std::atan2(0, -1));
+    graphics.clear();
+    defined_this_eval.clear();
+    current_frame.reset();
+    parallel_plans.clear();
+    eval_usage = EvalUsage();
+    cancel_requested = false;
+
+    memo.clear();
+    renew_memo_generation();
+
+    live_forms.clear();
+    live_owner.clear();
+    live_defined.clear();
+    live_edits.clear();
+    live_reevaluated = 0;
+}
+
+
+/* The parsed expression eval() evaluates */
+const Expression &Interpreter::syntax_tree() const noexcept
+{
+    return ast;
+}
 
 /* Top-level eval function for the recursive eval_expression */
 Expression Interpreter::eval() {
     if (ast.head.type == NoneType) {
         throw InterpreterSemanticError("Empty AST");
     }
-    return eval_expression(ast);
+
+    // type errors certain to happen are reported before anything is drawn; with live mode
+    // rebinding globals, their types are not relied on
+    if (infer_types) {
+        inferTypes(ast, env, !live_enabled);
+    }
+
+    start_budget();
+    parallel_plans.clear();
+    if (live_enabled) {
+        // a form that runs out of budget drops only its own graphics; the forms before it stay
+        return eval_live();
+    }
+    std::size_t graphics_size = graphics.size();
+    try {
+        return result_cache && !dataflow_enabled ? eval_cached() : eval_expression(ast);
+    } catch (const InterpreterLimitError &) {
+        rollback(graphics_size);
+        throw;
+    }
+}
+
+/* Sets the budgets enforced by eval() */
+void Interpreter::set_limits(const EvalLimits &new_limits)
+{
+    eval_limits = new_limits;
+}
+
+/* Returns the budgets enforced by eval() */
+const EvalLimits &Interpreter::limits() const noexcept
+{
+    return eval_limits;
+}
+
+/* Returns the resources consumed by the most recent eval() */
+const EvalUsage &Interpreter::usage() const noexcept
+{
+    return eval_usage;
+}
+
+/* Flags the evaluation for cancellation; picked up at the next budget check */
+void Interpreter::cancel() noexcept
+{
+    cancel_requested.store(true, std::memory_order_relaxed);
+}
+
+/* Sets the number of threads pmap may use; 0 selects the hardware concurrency */
+void Interpreter::set_threads(std::size_t count)
+{
+    thread_count = count != 0 ? count : std::max(1u, std::thread::hardware_concurrency());
+}
+
+/* Enables scheduling independent defines of a begin block concurrently */
+void Interpreter::set_dataflow(bool enabled)
+{
+    dataflow_enabled = enabled;
+}
+
+/* True if independent defines of a begin block may run concurrently */
+bool Interpreter::dataflow() const noexcept
+{
+    return dataflow_enabled;
+}
+
+/* Sets the number of results the memo cache holds, discarding those it held */
+void Interpreter::set_memo_capacity(std::size_t entries)
+{
+    memo.set_capacity(entries);
+    renew_memo_generation();
+}
+
+/* Returns the hit, miss and eviction counts of the memo cache */
+MemoStats Interpreter::memo_stats() const
+{
+    return memo.stats();
+}
+
+/* Registers the libm or the fast versions of the transcendental builtins */
+void Interpreter::set_math_mode(MathMode mode)
+{
+    bool fast = mode == MathMode::Fast;
+    env.add_procedure("sin", fast ? procFastSine : procSine, true);
+    env.add_procedure("cos", fast ? procFastCosine : procCosine, true);
+    env.add_procedure("arctan", fast ? procFastArctan : procArctan, true);
+    env.add_procedure("log10", fast ? procFastLog10 : procLog10, true);
+    env.add_procedure("pow", fast ? procFastPow : procPow, true);
+    // the fast kernels have no unchecked variants; proven calls use the checked ones
+    env.add_unchecked_procedure("sin", fast ? procFastSine : procSineUnchecked);
+    env.add_unchecked_procedure("cos", fast ? procFastCosine : procCosineUnchecked);
+    env.add_unchecked_procedure("arctan", fast ? procFastArctan : procArctanUnchecked);
+    env.add_unchecked_procedure("log10", fast ? procFastLog10 : procLog10Unchecked);
+    env.add_unchecked_procedure("pow", fast ? procFastPow : procPowUnchecked);
+    math = mode;
+    // cached results are keyed on the table entries, which now hold other procedures
+    memo.clear();
+}
+
+/* Returns the math mode in use */
+MathMode Interpreter::math_mode() const noexcept
+{
+    return math;
+}
+
+/* Enables the type inference pass run at the start of eval() */
+void Interpreter::set_type_inference(bool enabled)
+{
+    infer_types = enabled;
+}
+
+/* Shares a result cache, or disables it with nullptr */
+void Interpreter::set_result_cache(std::shared_ptr<ResultCache> cache)
+{
+    result_cache = std::move(cache);
+}
+
+/* Falls back on the snapshot's globals for symbols no program defined */
+void Interpreter::set_prelude(std::shared_ptr<const Snapshot> snapshot)
+{
+    env.attach(std::move(snapshot));
+}
+
+/* Writes the globals, as seen by the next program, to a snapshot */
+bool Interpreter::save_snapshot(const std::string &path, std::string &error) const
+{
+    return writeSnapshot(path, env.symbols(), error);
+}
+
+/* Enables rebinding globals with define, re-evaluating the forms that depend on them */
+void Interpreter::set_live(bool enabled)
+{
+    // calls in lambda bodies may have been proven while globals could not be rebound
+    if (enabled && !live_enabled) {
+        clearProvenLambdas(env);
+    }
+    live_enabled = enabled;
+}
+
+/* True if live mode is enabled */
+bool Interpreter::live() const noexcept
+{
+    return live_enabled;
+}
+
+/* The changes the last live eval() made to graphics */
+const std::vector<GraphicsEdit> &Interpreter::graphics_edits() const noexcept
+{
+    return live_edits;
+}
+
+/* Number of earlier forms the last live eval() re-evaluated */
+std::size_t Interpreter::reevaluated_forms() const noexcept
+{
+    return live_reevaluated;
+}
+
+/* Returns the number of threads pmap may use */
+std::size_t Interpreter::threads() const noexcept
+{
+    return thread_count;
+}
+
+/* Resets the usage counters and computes the deadline for a new eval() */
+void Interpreter::start_budget()
+{
+    eval_usage = EvalUsage();
+    defined_this_eval.clear();
+    if (eval_limits.max_time_ms != 0) {
+        deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(eval_limits.max_time_ms);
+    }
+    next_budget_check = 0;
+}
+
+/* Checks the step, time and cancel budgets and schedules the next check */
+void Interpreter::check_budget()
+{
+    const std::uint64_t steps = eval_usage.steps;
+    if (eval_limits.max_steps != 0 && steps > eval_limits.max_steps) {
+        throw InterpreterLimitError(LimitKind::Steps, eval_limits.max_steps, steps,
+                                    "Evaluation step limit exceeded (" + std::to_string(eval_limits.max_steps) + " steps)");
+    }
+    if (cancel_requested.exchange(false, std::memory_order_relaxed) ||
+        (parent_cancel && parent_cancel->load(std::memory_order_relaxed))) {
+        throw InterpreterLimitError(LimitKind::Cancelled, 0, steps, "Evaluation cancelled");
+    }
+    if (eval_limits.max_time_ms != 0 && std::chrono::steady_clock::now() > deadline) {
+        throw InterpreterLimitError(LimitKind::Time, eval_limits.max_time_ms, steps,
+                                    "Evaluation time limit exceeded (" + std::to_string(eval_limits.max_time_ms) + " ms)");
+    }
+
+    next_budget_check = steps + BUDGET_CHECK_INTERVAL;
+    if (eval_limits.max_steps != 0 && next_budget_check > eval_limits.max_steps + 1) {
+        next_budget_check = eval_limits.max_steps + 1;
+    }
+}
+
+/* Counts a value produced during evaluation against the node and byte budgets */
+void Interpreter::charge_alloc(std::uint64_t nodes, std::uint64_t bytes)
+{
+    eval_usage.nodes += nodes;
+    eval_usage.bytes += bytes;
+    if (eval_limits.max_nodes != 0 && eval_usage.nodes > eval_limits.max_nodes) {
+        throw InterpreterLimitError(LimitKind::Nodes, eval_limits.max_nodes, eval_usage.nodes,
+                                    "Evaluation node limit exceeded (" + std::to_string(eval_limits.max_nodes) + " nodes)");
+    }
+    if (eval_limits.max_bytes != 0 && eval_usage.bytes > eval_limits.max_bytes) {
+        throw InterpreterLimitError(LimitKind::Bytes, eval_limits.max_bytes, eval_usage.bytes,
+                                    "Evaluation memory limit exceeded (" + std::to_string(eval_limits.max_bytes) + " bytes)");
+    }
+}
+
+/* Removes everything the interrupted eval() defined or drew so the environment is unchanged */
+void Interpreter::rollback(std::size_t graphics_size)
+{
+    for (const auto &sym : defined_this_eval) {
+        env.remove(sym);
+    }
+    defined_this_eval.clear();
+    if (graphics.size() > graphics_size) {
+        graphics.resize(graphics_size);
+    }
+    // results computed with the removed globals must not outlive them
+    if (memo.capacity() != 0) {
+        memo.clear();
+        renew_memo_generation();
+    }
+}
+
+namespace {
+
+// Restores the caller's frame and nesting depth when an eval_expression invocation exits
+class CallScope {
+public:
+    CallScope(std::shared_ptr<Frame> &frame, std::size_t &depth) : current(frame), depth(depth) {
+        ++depth;
+    }
+
+    ~CallScope() {
+        if (switched) {
+            current = std::move(saved);
+        }
+        --depth;
+    }
+
+    // Makes frame current, remembering the caller's frame the first time
+    void enter(std::shared_ptr<Frame> frame) {
+        if (!switched) {
+            saved = std::move(current);
+            switched = true;
+        }
+        current = std::move(frame);
+    }
+
+    // True once this invocation owns the current frame, so it may be reused by a tail call
+    bool owns_frame() const { return switched; }
+
+private:
+    std::shared_ptr<Frame> &current;
+    std::shared_ptr<Frame> saved;
+    std::size_t &depth;
+    bool switched = false;
+};
+
+// Names that cannot be defined or used as parameters
+bool isSpecialForm(const Symbol &sym) {
+    return sym == "if" || sym == "begin" || sym == "define" || sym == "lambda" ||
+           sym == "for" || sym == "repeat" || sym == "pmap" || sym == "parallel-map";
+}
+
+}
+
+/* Builds a procedure value from (lambda (params...) body), closing over the current frame */
+Expression Interpreter::make_lambda(const Expression &expr)
+{
+    if (expr.tail.size() != 2 || expr.tail[0].head.type != SymbolType) {
+        throw InterpreterSemanticError("lambda requires a parameter list and a body");
+    }
+
+    std::shared_ptr<Lambda> lambda = std::make_shared<Lambda>();
+    const Expression &param_list = expr.tail[0];
+    lambda->params.push_back(param_list.head.value.sym_value);
+    for (const auto &param : param_list.tail) {
+        if (param.head.type != SymbolType || !param.tail.empty()) {
+            throw InterpreterSemanticError("lambda parameters must be symbols");
+        }
+        lambda->params.push_back(param.head.value.sym_value);
+    }
+    for (std::size_t i = 0; i < lambda->params.size(); ++i) {
+        if (isSpecialForm(lambda->params[i])) {
+            throw InterpreterSemanticError("lambda parameter cannot be " + lambda->params[i]);
+        }
+        for (std::size_t j = 0; j < i; ++j) {
+            if (lambda->params[i] == lambda->params[j]) {
+                throw InterpreterSemanticError("duplicate lambda parameter " + lambda->params[i]);
+            }
+        }
+    }
+    lambda->body = expr.tail[1];
+    lambda->closure = current_frame;
+    charge_alloc(1, sizeof(Lambda));
+
+    Expression result;
+    result.head.type = ProcedureType;
+    result.head.value.proc_value = lambda;
+    return result;
+}
+
+/* Evaluates a loop bound or step, which must be a number */
+Number Interpreter::eval_loop_bound(const Expression &expr, const char *what)
+{
+    Expression value = eval_expression(expr);
+    if (value.head.type != NumberType) {
+        throw InterpreterSemanticError(std::string(what) + " expects numeric bounds");
+    }
+    return value.head.value.num_value;
+}
+
+/* Reserves graphics up front when the loop body draws, so bulk drawing does not regrow the vector */
+void Interpreter::reserve_loop_graphics(const Expression &expr, std::size_t first_body, double iterations)
+{
+    std::size_t shapes = 0;
+    for (std::size_t i = first_body; i < expr.tail.size(); ++i) {
+        const Expression &form = expr.tail[i];
+        if (form.head.type == SymbolType && form.head.value.sym_value == "draw") {
+            shapes += form.tail.size();
+        }
+    }
+    // reserve at most a modest head start, and no more than the byte budget leaves room for;
+    // a loop drawing more grows the vector geometrically as it goes
+    double max_reserve = MAX_LOOP_RESERVE;
+    if (eval_limits.max_bytes != 0) {
+        std::uint64_t left = eval_limits.max_bytes > eval_usage.bytes ? eval_limits.max_bytes - eval_usage.bytes : 0;
+        max_reserve = std::min(max_reserve, static_cast<double>(left / sizeof(Expression)));
+    }
+    double wanted = iterations * static_cast<double>(shapes);
+    if (shapes != 0 && wanted > 0) {
+        std::size_t needed = graphics.size() + static_cast<std::size_t>(wanted < max_reserve ? wanted : max_reserve);
+        // grow at least geometrically so inner loops reserving repeatedly stay amortized O(1)
+        if (needed > graphics.capacity()) {
+            graphics.reserve(std::max(needed, 2 * graphics.capacity()));
+        }
+    }
+}
+
+/* Evaluates (for var start end step body...): var runs from start towards end (exclusive) by step.
+   The loop variable lives in one frame that is updated in place, so iterations do not allocate
+   unless the body captures the frame in a closure, in which case the next iteration gets a fresh one. */
+Expression Interpreter::eval_for(const Expression &expr)
+{
+    if (expr.tail.size() < 5 || expr.tail[0].head.type != SymbolType || !expr.tail[0].tail.empty()) {
+        throw InterpreterSemanticError("for requires a variable, start, end, step and a body");
+    }
+    const Symbol &var = expr.tail[0].head.value.sym_value;
+    if (isSpecialForm(var)) {
+        throw InterpreterSemanticError("for variable cannot be " + var);
+    }
+
+    Number start = eval_loop_bound(expr.tail[1], "for");
+    Number end = eval_loop_bound(expr.tail[2], "for");
+    Number step = eval_loop_bound(expr.tail[3], "for");
+    if (step == 0 || std::isnan(step)) {
+        throw InterpreterSemanticError("for step must be non-zero");
+    }
+    reserve_loop_graphics(expr, 4, std::ceil((end - start) / step));
+
+    std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+    frame->names.push_back(var);
+    frame->values.push_back(Expression(start).head);
+    frame->parent = current_frame;
+    charge_alloc(1, sizeof(Frame));
+
+    std::shared_ptr<Frame> saved = current_frame;
+    Expression result;
+    try {
+        for (std::size_t i = 0;; ++i) {
+            Number value = start + static_cast<Number>(i) * step;
+            if (step > 0 ? !(value < end) : !(value > end)) {
+                break;
+            }
+            if (frame.use_count() > 1) {
+                // the previous iteration captured the frame; keep its binding intact
+                std::shared_ptr<Frame> fresh = std::make_shared<Frame>(*frame);
+                frame = std::move(fresh);
+                charge_alloc(1, sizeof(Frame));
+            }
+            frame->values[0].value.num_value = value;
+            current_frame = frame;
+            for (std::size_t b = 4; b < expr.tail.size(); ++b) {
+                result = eval_expression(expr.tail[b]);
+            }
+            current_frame = saved;
+        }
+    } catch (...) {
+        current_frame = saved;
+        throw;
+    }
+    return result;
+}
+
+/* Evaluates (repeat count body...), running the body forms count times */
+Expression Interpreter::eval_repeat(const Expression &expr)
+{
+    if (expr.tail.size() < 2) {
+        throw InterpreterSemanticError("repeat requires a count and a body");
+    }
+    Number count = eval_loop_bound(expr.tail[0], "repeat");
+    if (count < 0 || std::isnan(count)) {
+        throw InterpreterSemanticError("repeat count must be non-negative");
+    }
+    reserve_loop_graphics(expr, 1, std::floor(count));
+
+    Expression result;
+    for (Number i = 0; i + 1 <= count; ++i) {
+        for (std::size_t b = 1; b < expr.tail.size(); ++b) {
+            result = eval_expression(expr.tail[b]);
+        }
+    }
+    return result;
+}
+
+// Estimated steps and the first side-effecting form found, with the per-call estimate of each
+// procedure visited (negative while its body is being estimated, i.e. it recursed)
+struct Interpreter::CostEstimate {
+    const char *impure = nullptr;
+    std::map<const Lambda *, double> calls;
+};
+
+// A lambda to apply, or failing that the builtin named directly in the pmap form
+struct Interpreter::MappedProcedure {
+    std::shared_ptr<Lambda> lambda;
+    std::function<void(const std::vector<Atom>&, Expression&)> builtin;
+};
+
+/* Applies a mapped procedure to one set of elements */
+Atom Interpreter::apply_mapped(const MappedProcedure &proc, const std::vector<Atom> &args)
+{
+    if (!proc.lambda) {
+        Expression result;
+        proc.builtin(args, result);
+        charge_alloc(1, sizeof(Expression));
+        return result.head;
+    }
+
+    const Lambda &callee = *proc.lambda;
+    if (args.size() != callee.params.size()) {
+        throw InterpreterSemanticError("pmap procedure expects " + std::to_string(callee.params.size()) + " arguments");
+    }
+    std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+    frame->names = callee.params;
+    frame->values = args;
+    frame->parent = callee.closure;
+    frame->owner = &callee;
+    charge_alloc(1, sizeof(Frame));
+
+    std::shared_ptr<Frame> saved = std::move(current_frame);
+    current_frame = std::move(frame);
+    try {
+        Atom result = eval_expression(callee.body).head;
+        current_frame = std::move(saved);
+        return result;
+    } catch (...) {
+        current_frame = std::move(saved);
+        throw;
+    }
 }
 
-// Helper function to evaluate parsed expressions
-Expression Interpreter::eval_expression(const Expression &expr) {
-    if (expr.head.type == NumberType || expr.head.type == BooleanType) {
-        return expr; // Atoms evaluate to themselves
+/* Estimated steps of one call to lambda, memoized per analysis; recursive procedures are assumed expensive */
+double Interpreter::estimate_call(const Lambda &lambda, CostEstimate &estimate) const
+{
+    auto known = estimate.calls.find(&lambda);
+    if (known != estimate.calls.end()) {
+        return known->second < 0 ? RECURSIVE_CALL_STEPS : known->second;
     }
+    estimate.calls[&lambda] = -1;
+    double steps = 1 + estimate_cost(lambda.body, lambda.closure.get(), estimate);
+    estimate.calls[&lambda] = steps;
+    return steps;
+}
 
+/* Estimated steps to evaluate expr, noting in estimate any define or draw it can reach.
+   Names are resolved in scope and then the globals, following procedures into their bodies. */
+double Interpreter::estimate_cost(const Expression &expr, const Frame *scope, CostEstimate &estimate) const
+{
+    double steps = 1;
+    double iterations = 1;
     if (expr.head.type == SymbolType) {
-        std::string op = expr.head.value.sym_value;
+        const Symbol &sym = expr.head.value.sym_value;
+        if (sym == "define" || sym == "draw") {
+            if (!estimate.impure) {
+                estimate.impure = sym == "define" ? "define" : "draw";
+            }
+        } else if (sym == "for" || sym == "repeat" || sym == "pmap" || sym == "parallel-map") {
+            iterations = DEFAULT_LOOP_ITERATIONS;
+            std::size_t bounds = sym == "for" ? 4 : sym == "repeat" ? 1 : 0;
+            bool literal = bounds != 0 && expr.tail.size() > bounds;
+            for (std::size_t i = (sym == "for" ? 1 : 0); literal && i < bounds; ++i) {
+                literal = expr.tail[i].head.type == NumberType;
+            }
+            if (literal && sym == "for" && expr.tail[3].head.value.num_value != 0) {
+                iterations = std::ceil((expr.tail[2].head.value.num_value - expr.tail[1].head.value.num_value) /
+                                       expr.tail[3].head.value.num_value);
+            } else if (literal && sym == "repeat") {
+                iterations = expr.tail[0].head.value.num_value;
+            }
+            iterations = iterations > 1 ? iterations : 1;
+        } else if (sym == "range" && !expr.tail.empty() && expr.tail.back().head.type == NumberType) {
+            steps += std::fabs(expr.tail.size() == 1 ? expr.tail[0].head.value.num_value : 0);
+        }
+
+        const Atom *value = scope ? scope->find(sym) : nullptr;
+        const Expression *global = value ? nullptr : env.find(sym);
+        if (global) {
+            value = &global->head;
+        }
+        if (value && value->type == ProcedureType) {
+            steps += estimate_call(*value->value.proc_value, estimate);
+        }
+    }
+    double body = 0;
+    for (const auto &sub_expr : expr.tail) {
+        body += estimate_cost(sub_expr, scope, estimate);
+    }
+    return steps + iterations * body;
+}
+
+/* Throws unless lambda, and every procedure it can reach by name, is free of define and draw */
+void Interpreter::check_pure(const Lambda &lambda, CostEstimate &estimate) const
+{
+    estimate_call(lambda, estimate);
+    if (estimate.impure) {
+        throw InterpreterSemanticError(std::string("pmap requires a pure procedure, but it uses ") + estimate.impure);
+    }
+}
+
+/* True if calls to lambda may be memoized, deciding once per memo generation */
+bool Interpreter::memoizable(const Lambda &lambda)
+{
+    if (lambda.memo_generation != memo_generation) {
+        CostEstimate estimate;
+        estimate_call(lambda, estimate);
+        lambda.memo_pure = estimate.impure == nullptr;
+        lambda.memo_generation = memo_generation;
+    }
+    return lambda.memo_pure;
+}
+
+/* Takes a generation number no interpreter has used, so every lambda's verdict is stale */
+void Interpreter::renew_memo_generation()
+{
+    static std::atomic<std::uint64_t> next_generation(1);
+    memo_generation = next_generation.fetch_add(1);
+}
+
+/* Gives a pmap worker this interpreter's globals and the budget remaining */
+void Interpreter::prepare_worker(Interpreter &worker) const
+{
+    worker.env = env;
+    worker.thread_count = 1; // nested pmap runs sequentially on the worker
+    worker.pure_only = true;
+    worker.parent_cancel = parent_cancel ? parent_cancel : &cancel_requested;
+    worker.max_stack_bytes = MAX_WORKER_STACK_BYTES;
+
+    worker.eval_limits = eval_limits;
+    if (eval_limits.max_steps != 0) {
+        worker.eval_limits.max_steps = eval_limits.max_steps > eval_usage.steps ? eval_limits.max_steps - eval_usage.steps : 1;
+    }
+    if (eval_limits.max_nodes != 0) {
+        worker.eval_limits.max_nodes = eval_limits.max_nodes > eval_usage.nodes ? eval_limits.max_nodes - eval_usage.nodes : 1;
+    }
+    if (eval_limits.max_bytes != 0) {
+        worker.eval_limits.max_bytes = eval_limits.max_bytes > eval_usage.bytes ? eval_limits.max_bytes - eval_usage.bytes : 1;
+    }
+    worker.deadline = deadline;
+    worker.eval_usage = EvalUsage();
+    worker.next_budget_check = 0;
+    worker.current_frame = current_frame;
+}
+
+/* Runs task(worker, i) for every i in [0, count) across the pool, each pool worker evaluating with
+   its own interpreter. Worker usage is added to this interpreter's budgets. If any task fails, the
+   error of the lowest failing index is rethrown, whatever order the tasks ran in. */
+void Interpreter::run_on_workers(std::size_t count, const std::function<Atom(Interpreter &, std::size_t)> &task,
+                                 std::vector<Atom> &results)
+{
+    if (!pool || pool->size() != thread_count) {
+        pool.reset(new ThreadPool(thread_count));
+    }
+    while (pmap_workers.size() < pool->size()) {
+        pmap_workers.emplace_back(new Interpreter());
+    }
+    for (std::size_t w = 0; w < pool->size(); ++w) {
+        prepare_worker(*pmap_workers[w]);
+    }
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    std::atomic<std::size_t> error_index(count);
+    results.resize(count);
+
+    pool->run(count, [&](std::size_t worker, std::size_t i) {
+        if (i > error_index.load(std::memory_order_relaxed)) {
+            return;
+        }
+        try {
+            results[i] = task(*pmap_workers[worker], i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (i < error_index.load()) {
+                error_index.store(i);
+                error = std::current_exception();
+            }
+        }
+    });
+
+    EvalUsage worker_usage;
+    for (std::size_t w = 0; w < pool->size(); ++w) {
+        Interpreter &worker = *pmap_workers[w];
+        worker_usage.steps += worker.eval_usage.steps;
+        worker_usage.nodes += worker.eval_usage.nodes;
+        worker_usage.bytes += worker.eval_usage.bytes;
+        worker.current_frame.reset();
+        worker.env.reset();
+    }
 
-        if (op == "begin") {
-            if (expr.tail.empty()) {
-                throw InterpreterSemanticError("begin requires at least one expression");
+    if (error) {
+        try {
+            std::rethrow_exception(error);
+        } catch (const InterpreterLimitError &e) {
+            if (e.kind() == LimitKind::Cancelled && !parent_cancel) {
+                cancel_requested.store(false, std::memory_order_relaxed);
             }
-            Expression result;
-            for (const auto &sub_expr : expr.tail) {
-                result = eval_expression(sub_expr);
+            throw;
+        }
+    }
+    eval_usage.steps += worker_usage.steps;
+    if (eval_usage.steps >= next_budget_check) {
+        check_budget();
+    }
+    charge_alloc(worker_usage.nodes, worker_usage.bytes);
+}
+
+/* Evaluates (pmap proc list...): proc is applied to the i-th element of every list, and the
+   results are returned as a list in element order. proc must not define or draw, which is
+   checked before anything runs; elements are then spread across the thread pool, each worker
+   evaluating with its own interpreter state over a copy of the globals. */
+Expression Interpreter::eval_pmap(const Expression &expr)
+{
+    if (expr.tail.size() < 2) {
+        throw InterpreterSemanticError("pmap requires a procedure and at least one list");
+    }
+
+    MappedProcedure proc;
+    const Expression &proc_expr = expr.tail[0];
+    const Symbol &proc_name = proc_expr.head.value.sym_value;
+    if (proc_expr.head.type == SymbolType && proc_expr.tail.empty() &&
+        !(current_frame && current_frame->find(proc_name)) && !env.find(proc_name) &&
+        env.is_procedure_defined(proc_name)) {
+        proc.builtin = env.get_procedure(proc_name);
+    } else {
+        Expression value = eval_expression(proc_expr);
+        if (value.head.type != ProcedureType) {
+            throw InterpreterSemanticError("pmap expects a procedure");
+        }
+        proc.lambda = value.head.value.proc_value;
+    }
+
+    std::vector<std::shared_ptr<const List>> lists;
+    for (std::size_t i = 1; i < expr.tail.size(); ++i) {
+        Expression value = eval_expression(expr.tail[i]);
+        if (value.head.type != ListType) {
+            throw InterpreterSemanticError("pmap expects list arguments");
+        }
+        if (!lists.empty() && value.head.value.list_value->size() != lists[0]->size()) {
+            throw InterpreterSemanticError("pmap expects lists of equal length");
+        }
+        lists.push_back(value.head.value.list_value);
+    }
+
+    // procedures passed as elements may be called by proc, so they must be pure too
+    CostEstimate estimate;
+    if (proc.lambda) {
+        check_pure(*proc.lambda, estimate);
+    }
+    for (const auto &list : lists) {
+        for (const auto &item : list->items) {
+            if (item.type == ProcedureType) {
+                check_pure(*item.value.proc_value, estimate);
             }
-            return result;
-        } else if (op == "define") {
-            if (expr.tail.size() != 2 || expr.tail[0].head.type != SymbolType) {
-                throw InterpreterSemanticError("define requires a symbol and an expression");
+        }
+    }
+
+    std::size_t count = lists[0]->size();
+    std::vector<Atom> results(count);
+
+    if (thread_count <= 1 || count < 2) {
+        bool was_pure = pure_only;
+        pure_only = true;
+        try {
+            std::vector<Atom> args(lists.size());
+            for (std::size_t i = 0; i < count; ++i) {
+                for (std::size_t l = 0; l < lists.size(); ++l) {
+                    args[l] = lists[l]->at(i);
+                }
+                results[i] = apply_mapped(proc, args);
             }
-            Expression value = eval_expression(expr.tail[1]);
-            const Symbol& sym_value = expr.tail[0].head.value.sym_value;
+        } catch (...) {
+            pure_only = was_pure;
+            throw;
+        }
+        pure_only = was_pure;
+    } else {
+        run_on_workers(count, [&](Interpreter &worker, std::size_t i) {
+            std::vector<Atom> args(lists.size());
+            for (std::size_t l = 0; l < lists.size(); ++l) {
+                args[l] = lists[l]->at(i);
+            }
+            return worker.apply_mapped(proc, args);
+        }, results);
+    }
 
-            if (sym_value == "if" || sym_value == "begin" || sym_value == "define" || env.is_symbol_defined(sym_value) || env.is_procedure_defined(sym_value))
-            {
-                throw InterpreterSemanticError(sym_value + " already defined");
+    std::shared_ptr<List> list = std::make_shared<List>();
+    for (const auto &result : results) {
+        if (result.type != NumberType) {
+            list->numeric = false;
+            break;
+        }
+    }
+    if (list->numeric) {
+        list->numbers.reserve(count);
+        for (const auto &result : results) {
+            list->numbers.push_back(result.value.num_value);
+        }
+    } else {
+        list->items = std::move(results);
+    }
+    charge_alloc(count, list->numbers.size() * sizeof(Number) + list->items.size() * sizeof(Atom));
+    return Expression(std::shared_ptr<const List>(std::move(list)));
+}
+
+/* Binds a global for define, which may not rebind a special form, a builtin or, outside live mode, an existing name */
+void Interpreter::define_symbol(const Symbol &sym_value, const Expression &value)
+{
+    bool rebind = live_enabled && env.is_symbol_defined(sym_value);
+    if (isSpecialForm(sym_value) || (!rebind && env.is_symbol_defined(sym_value)) || env.is_procedure_defined(sym_value))
+    {
+        throw InterpreterSemanticError(sym_value + " already defined");
+    }
+    charge_alloc(1, sizeof(Expression) + sym_value.size());
+    env.add(sym_value, value);
+    if (!rebind) {
+        defined_this_eval.push_back(sym_value); // a rollback removes only names that did not exist
+    }
+    if (live_enabled) {
+        live_defined.push_back(sym_value);
+    }
+    if (memo.capacity() != 0) {
+        if (rebind) {
+            memo.clear(); // cached results may have read the old value
+        }
+        renew_memo_generation();
+    }
+}
+
+namespace {
+
+// Adds every symbol appearing in expr to symbols
+void collectSymbols(const Expression &expr, std::vector<Symbol> &symbols)
+{
+    if (expr.head.type == SymbolType) {
+        symbols.push_back(expr.head.value.sym_value);
+    }
+    for (const auto &sub_expr : expr.tail) {
+        collectSymbols(sub_expr, symbols);
+    }
+}
+
+// The name a form defines, or nullptr if it is not a well-formed define
+const Symbol *definedName(const Expression &form)
+{
+    if (form.head.type == SymbolType && form.head.value.sym_value == "define" && form.tail.size() == 2 &&
+        form.tail[0].head.type == SymbolType && form.tail[0].tail.empty()) {
+        return &form.tail[0].head.value.sym_value;
+    }
+    return nullptr;
+}
+
+}
+
+/* Evaluates each form of the parsed expression, or of its top-level begin, as a live form. A plain
+   (define name ...) of a name an earlier form bound replaces that form; any other form is added
+   after the others. Either way the forms that read what it bound are then re-evaluated. */
+Expression Interpreter::eval_live()
+{
+    live_edits.clear();
+    live_reevaluated = 0;
+
+    std::vector<const Expression *> forms;
+    if (ast.head.type == SymbolType && ast.head.value.sym_value == "begin" && !ast.tail.empty()) {
+        for (const auto &form : ast.tail) {
+            forms.push_back(&form);
+        }
+    } else {
+        forms.push_back(&ast);
+    }
+
+    Expression result;
+    for (const Expression *form : forms) {
+        const Symbol *name = definedName(*form);
+        auto owner = name ? live_owner.find(*name) : live_owner.end();
+        std::size_t index;
+        std::vector<Symbol> changed;
+        if (owner != live_owner.end()) {
+            index = owner->second;
+            changed = live_forms[index].defines;
+        } else {
+            index = live_forms.size();
+            live_forms.push_back(LiveForm());
+            live_forms[index].first_graphic = graphics.size();
+        }
+        LiveForm &live_form = live_forms[index];
+        live_form.form = *form;
+        live_form.reads.clear();
+        collectSymbols(*form, live_form.reads);
+        std::sort(live_form.reads.begin(), live_form.reads.end());
+        live_form.reads.erase(std::unique(live_form.reads.begin(), live_form.reads.end()), live_form.reads.end());
+
+        // the forms reading what the form bound before or binds now must see the new values
+        result = eval_live_form(index);
+        changed.insert(changed.end(), live_forms[index].defines.begin(), live_forms[index].defines.end());
+        reevaluate_dependents(changed, index);
+    }
+    return result;
+}
+
+/* Evaluates a live form, moving the graphics it draws to where its previous graphics were */
+Expression Interpreter::eval_live_form(std::size_t index)
+{
+    LiveForm &form = live_forms[index];
+    std::size_t first = form.first_graphic;
+    std::size_t removed = form.graphic_count;
+    graphics.erase(graphics.begin() + first, graphics.begin() + first + removed);
+    std::size_t appended = graphics.size();
+
+    Expression result;
+    live_defined.clear();
+    try {
+        result = eval_expression(form.form);
+    } catch (...) {
+        graphics.resize(appended);
+        form.graphic_count = 0;
+        for (std::size_t i = index + 1; i < live_forms.size(); ++i) {
+            live_forms[i].first_graphic -= removed;
+        }
+        live_edits.push_back(GraphicsEdit{first, removed, 0});
+        throw;
+    }
+
+    std::rotate(graphics.begin() + first, graphics.begin() + appended, graphics.end());
+    std::size_t inserted = graphics.size() - appended;
+    form.graphic_count = inserted;
+    for (std::size_t i = index + 1; i < live_forms.size(); ++i) {
+        live_forms[i].first_graphic = live_forms[i].first_graphic - removed + inserted;
+    }
+    if (removed != 0 || inserted != 0) {
+        live_edits.push_back(GraphicsEdit{first, removed, inserted});
+    }
+
+    std::sort(live_defined.begin(), live_defined.end());
+    live_defined.erase(std::unique(live_defined.begin(), live_defined.end()), live_defined.end());
+    form.defines = live_defined;
+    for (const auto &sym : form.defines) {
+        live_owner[sym] = index;
+    }
+    return result;
+}
+
+/* Re-evaluates the live forms reading changed symbols, then those reading what they rebound, until none
+   is left. A form that fails drops its graphics without stopping the others; the first error is rethrown. */
+void Interpreter::reevaluate_dependents(const std::vector<Symbol> &changed, std::size_t skip)
+{
+    std::exception_ptr first_error;
+    std::set<Symbol> dirty(changed.begin(), changed.end());
+    std::vector<char> done(live_forms.size(), 0);
+    done[skip] = 1;
+    bool progress = !dirty.empty();
+    while (progress) {
+        progress = false;
+        for (std::size_t i = 0; i < live_forms.size(); ++i) {
+            if (done[i]) {
+                continue;
             }
-            env.add(sym_value, value);
-            return value;
-        } else if (op == "if") {
-            if (expr.tail.size() != 3) {
-                throw InterpreterSemanticError("if requires three expressions");
+            const std::vector<Symbol> &reads = live_forms[i].reads;
+            bool stale = std::any_of(reads.begin(), reads.end(), [&](const Symbol &sym) { return dirty.count(sym) != 0; });
+            if (!stale) {
+                continue;
             }
-            Expression condition = eval_expression(expr.tail[0]);
-            if (condition.head.type != BooleanType) {
-                throw InterpreterSemanticError("if condition must be a boolean");
+            done[i] = 1;
+            ++live_reevaluated;
+            progress = true;
+            try {
+                eval_live_form(i);
+            } catch (const InterpreterLimitError &) {
+                throw;
+            } catch (...) {
+                if (!first_error) {
+                    first_error = std::current_exception();
+                }
+                continue;
             }
-            return condition.head.value.bool_value ? eval_expression(expr.tail[1]) : eval_expression(expr.tail[2]);
-        } 
-        
-        // Check if the symbol is a variable
-        else if (env.is_symbol_defined(op)) {
-            return env.get(op);
-        } 
-        
-        // Check if the symbol is a procedure
-        else if (env.is_procedure_defined(op)) {
-            // Retrieve the procedure function
-            auto procedure = env.get_procedure(op);
-            
-            // Evaluate arguments recursively
-            std::vector<Atom> evaluated_args;
-            for (const auto &arg_expr : expr.tail) {
-                Expression evaluated_expr = eval_expression(arg_expr);
+            dirty.insert(live_forms[i].defines.begin(), live_forms[i].defines.end());
+        }
+    }
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+}
+
+namespace {
+
+// Appends the encoding of expr to out
+void encodeForm(const Expression &expr, std::string &out)
+{
+    if (!encodeAtom(expr.head, out)) {
+        out += static_cast<char>(ProcedureType); // no literal procedures in parsed expressions
+    }
+    std::uint64_t count = expr.tail.size();
+    out.append(reinterpret_cast<const char *>(&count), sizeof(count));
+    for (const auto &sub_expr : expr.tail) {
+        encodeForm(sub_expr, out);
+    }
+}
+
+}
+
+/* Evaluates each form of the parsed expression, or of its top-level begin, through the result cache */
+Expression Interpreter::eval_cached()
+{
+    if (ast.head.type != SymbolType || ast.head.value.sym_value != "begin" || ast.tail.empty()) {
+        return eval_cached_form(ast);
+    }
+    Expression result;
+    for (const auto &form : ast.tail) {
+        result = eval_cached_form(form);
+    }
+    return result;
+}
+
+/* Evaluates an expensive form once per distinct key, replaying what it did on later evaluations */
+Expression Interpreter::eval_cached_form(const Expression &form)
+{
+    CostEstimate estimate;
+    std::string key;
+    if (estimate_cost(form, nullptr, estimate) < RESULT_CACHE_MIN_STEPS || !result_cache_key(form, key)) {
+        return eval_expression(form);
+    }
+
+    CachedForm cached;
+    if (result_cache->find(key, cached)) {
+        for (const auto &binding : cached.defines) {
+            define_symbol(binding.first, binding.second);
+        }
+        charge_alloc(cached.graphics.size(), cached.graphics.size() * sizeof(Expression));
+        graphics.insert(graphics.end(), cached.graphics.begin(), cached.graphics.end());
+        return cached.result;
+    }
 
-                if (evaluated_expr.head.type == NoneType) {
-                    throw InterpreterSemanticError("Invalid argument for procedure: " + op);
+    std::size_t first_define = defined_this_eval.size();
+    std::size_t first_graphic = graphics.size();
+    cached.result = eval_expression(form);
+    for (std::size_t i = first_define; i < defined_this_eval.size(); ++i) {
+        cached.defines.emplace_back(defined_this_eval[i], *env.find(defined_this_eval[i]));
+    }
+    cached.graphics.assign(graphics.begin() + first_graphic, graphics.end());
+    result_cache->insert(key, cached);
+    return cached.result;
+}
+
+/* The math mode, the form, and every symbol it or a procedure it reaches mentions with a hash of its
+   global value, or the mark of an unbound name. Builtins cannot be rebound, so they need no entry. */
+bool Interpreter::result_cache_key(const Expression &form, std::string &key) const
+{
+    key = math == MathMode::Fast ? "fast;" : "precise;";
+    encodeForm(form, key);
+
+    std::vector<Symbol> mentioned;
+    collectSymbols(form, mentioned);
+    std::set<Symbol> reads;
+    while (!mentioned.empty()) {
+        Symbol sym = std::move(mentioned.back());
+        mentioned.pop_back();
+        if (!reads.insert(sym).second) {
+            continue;
+        }
+        const Expression *value = env.find(sym);
+        if (value && value->head.type == ProcedureType) {
+            const Lambda &lambda = *value->head.value.proc_value;
+            if (lambda.closure) {
+                return false; // its captured frame is not keyed
+            }
+            collectSymbols(lambda.body, mentioned);
+        }
+    }
+
+    for (const auto &sym : reads) {
+        const Expression *value = env.find(sym);
+        std::string encoded;
+        if (!value) {
+            encoded = "unbound";
+        } else if (value->head.type == ProcedureType) {
+            const Lambda &lambda = *value->head.value.proc_value;
+            for (const auto &param : lambda.params) {
+                encoded += param + ' ';
+            }
+            encodeForm(lambda.body, encoded);
+        } else if (!encodeAtom(value->head, encoded)) {
+            return false;
+        }
+        std::uint64_t hash = hashBytes(encoded);
+        key += ';' + std::to_string(sym.size()) + ':' + sym;
+        key.append(reinterpret_cast<const char *>(&hash), sizeof(hash));
+    }
+    return true;
+}
+
+/* Evaluates every form of (begin ...) but the last. Each run of consecutive defines whose values
+   cannot define or draw is scheduled by dependency: a define waits only for the earlier defines of
+   the symbols it reads, directly or through the procedures those hold, and defines whose
+   dependencies are met run together, the expensive ones on the pool. Every other form is a barrier
+   evaluated in order, so draws and the final result are unchanged. */
+void Interpreter::eval_begin_dataflow(const Expression &expr)
+{
+    std::size_t last = expr.tail.size() - 1;
+    std::size_t i = 0;
+    while (i < last) {
+        std::size_t end = i;
+        while (end < last && definedName(expr.tail[end])) {
+            CostEstimate estimate;
+            estimate_cost(expr.tail[end].tail[1], current_frame.get(), estimate);
+            if (estimate.impure) {
+                break;
+            }
+            ++end;
+        }
+        if (end - i < 2) {
+            eval_expression(expr.tail[i]);
+            ++i;
+        } else {
+            eval_define_run(expr, i, end);
+            i = end;
+        }
+    }
+}
+
+/* Evaluates the pure defines tail[first, end) of a begin in dependency waves, committing each wave
+   in form order. If anything fails, the run's bindings are removed and it is evaluated again in
+   order, so the error reported is the one sequential evaluation would give. */
+void Interpreter::eval_define_run(const Expression &expr, std::size_t first, std::size_t end)
+{
+    std::size_t count = end - first;
+    std::map<Symbol, std::size_t> defined_at;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (!defined_at.insert(std::make_pair(*definedName(expr.tail[first + i]), i)).second) {
+            // a repeated define fails in order anyway
+            for (std::size_t j = first; j < end; ++j) {
+                eval_expression(expr.tail[j]);
+            }
+            return;
+        }
+    }
+
+    std::vector<std::vector<Symbol>> reads(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        collectSymbols(expr.tail[first + i].tail[1], reads[i]);
+    }
+
+    // wave of each define: one past the latest wave among the earlier defines it reads, transitively
+    // through the bodies of the procedures it reads, whether defined in this run or before it
+    std::vector<std::size_t> wave(count, 0);
+    std::size_t waves = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        std::vector<char> seen(count, 0);
+        std::vector<const Lambda *> seen_globals;
+        std::vector<Symbol> pending = reads[i];
+        while (!pending.empty()) {
+            Symbol sym = std::move(pending.back());
+            pending.pop_back();
+            auto dep = defined_at.find(sym);
+            if (dep == defined_at.end()) {
+                const Expression *global = env.find(sym);
+                if (global && global->head.type == ProcedureType &&
+                    std::find(seen_globals.begin(), seen_globals.end(), global->head.value.proc_value.get()) == seen_globals.end()) {
+                    seen_globals.push_back(global->head.value.proc_value.get());
+                    collectSymbols(global->head.value.proc_value->body, pending);
+                }
+                continue;
+            }
+            if (dep->second >= i || seen[dep->second]) {
+                continue;
+            }
+            seen[dep->second] = 1;
+            wave[i] = std::max(wave[i], wave[dep->second] + 1);
+            pending.insert(pending.end(), reads[dep->second].begin(), reads[dep->second].end());
+        }
+        waves = std::max(waves, wave[i] + 1);
+    }
+
+    std::size_t defined_before = defined_this_eval.size();
+    bool was_pure = pure_only;
+    try {
+        for (std::size_t w = 0; w < waves; ++w) {
+            std::vector<std::size_t> members;
+            std::vector<std::size_t> heavy;
+            for (std::size_t i = 0; i < count; ++i) {
+                if (wave[i] != w) {
+                    continue;
+                }
+                members.push_back(i);
+                CostEstimate estimate;
+                if (estimate_cost(expr.tail[first + i].tail[1], current_frame.get(), estimate) >= PARALLEL_ARGUMENT_STEPS) {
+                    heavy.push_back(i);
+                }
+            }
+
+            std::vector<Atom> values(count);
+            if (heavy.size() >= 2) {
+                std::vector<Atom> results;
+                run_on_workers(heavy.size(), [&](Interpreter &worker, std::size_t h) {
+                    return worker.eval_expression(expr.tail[first + heavy[h]].tail[1]).head;
+                }, results);
+                for (std::size_t h = 0; h < heavy.size(); ++h) {
+                    values[heavy[h]] = results[h];
                 }
+            } else {
+                heavy.clear();
+            }
+
+            pure_only = true;
+            for (std::size_t i : members) {
+                if (std::find(heavy.begin(), heavy.end(), i) == heavy.end()) {
+                    values[i] = eval_expression(expr.tail[first + i].tail[1]).head;
+                }
+            }
+            pure_only = was_pure;
+
+            for (std::size_t i : members) {
+                define_symbol(*definedName(expr.tail[first + i]), Expression(values[i]));
+            }
+        }
+    } catch (const InterpreterLimitError &) {
+        pure_only = was_pure;
+        throw;
+    } catch (...) {
+        pure_only = was_pure;
+        while (defined_this_eval.size() > defined_before) {
+            env.remove(defined_this_eval.back());
+            defined_this_eval.pop_back();
+        }
+        for (std::size_t j = first; j < end; ++j) {
+            eval_expression(expr.tail[j]);
+        }
+    }
+}
+
+/* Arguments of a call that are pure and estimated above PARALLEL_ARGUMENT_STEPS, if at least two are */
+const std::vector<std::size_t> &Interpreter::parallel_plan(const Expression &expr)
+{
+    auto known = parallel_plans.find(&expr);
+    if (known != parallel_plans.end()) {
+        return known->second;
+    }
+    std::vector<std::size_t> &plan = parallel_plans[&expr];
+    for (std::size_t i = 0; i < expr.tail.size(); ++i) {
+        CostEstimate estimate;
+        double steps = estimate_cost(expr.tail[i], current_frame.get(), estimate);
+        if (!estimate.impure && steps >= PARALLEL_ARGUMENT_STEPS) {
+            plan.push_back(i);
+        }
+    }
+    if (plan.size() < 2) {
+        plan.clear();
+    }
+    return plan;
+}
+
+/* Evaluates the planned arguments of a call on the pool. Since they are pure, evaluating them
+   ahead of the others is unobservable; if any fails, running out of budget included, nothing is
+   kept and the caller evaluates every argument in order, so the leftmost error is reported
+   exactly as before. Only a cancellation, which is no argument's error, is rethrown. */
+const std::vector<std::size_t> *Interpreter::eval_concurrently(const Expression &expr, std::vector<Atom> &values)
+{
+    const std::vector<std::size_t> &plan = parallel_plan(expr);
+    if (plan.empty() || plan.back() >= expr.tail.size()) {
+        return nullptr;
+    }
+    try {
+        run_on_workers(plan.size(), [&](Interpreter &worker, std::size_t i) {
+            return worker.eval_expression(expr.tail[plan[i]]).head;
+        }, values);
+    } catch (const InterpreterLimitError &e) {
+        if (e.kind() == LimitKind::Cancelled) {
+            throw;
+        }
+        return nullptr;
+    } catch (...) {
+        return nullptr;
+    }
+    return &plan;
+}
+
+/* Evaluates the arguments of a call into the buffer for the current nesting level */
+std::vector<Atom> &Interpreter::eval_arguments(const Expression &expr)
+{
+    std::vector<Atom> early;
+    const std::vector<std::size_t> *plan = may_eval_concurrently(expr) ? eval_concurrently(expr, early) : nullptr;
+
+    if (arg_pool.size() < eval_depth) {
+        arg_pool.resize(eval_depth);
+    }
+    std::vector<Atom> &args = arg_pool[eval_depth - 1];
+    args.clear();
+    std::size_t next_early = 0;
+    for (std::size_t i = 0; i < expr.tail.size(); ++i) {
+        bool is_early = plan && next_early < plan->size() && (*plan)[next_early] == i;
+        Expression evaluated_expr = is_early ? Expression(early[next_early++]) : eval_expression(expr.tail[i]);
+
+        if (evaluated_expr.head.type == NoneType) {
+            throw InterpreterSemanticError("Invalid argument for procedure: " + expr.head.value.sym_value);
+        }
+
+        args.push_back(evaluated_expr.head);
+    }
+    return args;
+}
+
+// Helper function to evaluate parsed expressions.
+// Expressions in tail position (if branches, the last form of begin and lambda bodies)
+// are evaluated by looping rather than recursing, so tail calls use constant native stack.
+Expression Interpreter::eval_expression(const Expression &start) {
+    CallScope scope(current_frame, eval_depth);
+    std::uintptr_t here = reinterpret_cast<std::uintptr_t>(&scope);
+    if (eval_depth == 1) {
+        stack_base = here;
+    } else if ((here < stack_base ? stack_base - here : here - stack_base) > max_stack_bytes) {
+        throw InterpreterSemanticError("Maximum recursion depth exceeded");
+    }
+
+    const Expression *expr = &start;
+    std::shared_ptr<Lambda> active; // keeps the body being evaluated alive across tail calls
+
+    // A memoizable call missed the cache: its key, and the result to store once this invocation returns it
+    bool memo_pending = false;
+    std::shared_ptr<Lambda> memo_callee;
+    std::vector<Atom> memo_args;
+    Expression result;
+
+    while (true) {
+        charge_step();
+
+        if (expr->head.type == NumberType || expr->head.type == BooleanType || expr->head.type == ProcedureType) {
+            result = *expr; // Atoms evaluate to themselves
+            break;
+        }
 
-                evaluated_args.push_back(evaluated_expr.head);
+        if (expr->head.type == SymbolType) {
+            const std::string &op = expr->head.value.sym_value;
+
+            if (op == "begin") {
+                if (expr->tail.empty()) {
+                    throw InterpreterSemanticError("begin requires at least one expression");
+                }
+                if (dataflow_enabled && thread_count > 1 && !pure_only) {
+                    eval_begin_dataflow(*expr);
+                } else {
+                    for (std::size_t i = 0; i + 1 < expr->tail.size(); ++i) {
+                        eval_expression(expr->tail[i]);
+                    }
+                }
+                expr = &expr->tail.back();
+                continue;
+            } else if (op == "define") {
+                if (expr->tail.size() != 2 || expr->tail[0].head.type != SymbolType) {
+                    throw InterpreterSemanticError("define requires a symbol and an expression");
+                }
+                if (pure_only) {
+                    throw InterpreterSemanticError("pmap requires a pure procedure, but it uses define");
+                }
+                result = eval_expression(expr->tail[1]);
+                define_symbol(expr->tail[0].head.value.sym_value, result);
+                break;
+            } else if (op == "if") {
+                if (expr->tail.size() != 3) {
+                    throw InterpreterSemanticError("if requires three expressions");
+                }
+                Expression condition = eval_expression(expr->tail[0]);
+                if (condition.head.type != BooleanType) {
+                    throw InterpreterSemanticError("if condition must be a boolean");
+                }
+                expr = condition.head.value.bool_value ? &expr->tail[1] : &expr->tail[2];
+                continue;
+            } else if (op == "lambda") {
+                result = make_lambda(*expr);
+                break;
+            } else if (op == "for") {
+                result = eval_for(*expr);
+                break;
+            } else if (op == "repeat") {
+                result = eval_repeat(*expr);
+                break;
+            } else if (op == "pmap" || op == "parallel-map") {
+                result = eval_pmap(*expr);
+                break;
             }
 
-            // Create an Expression to hold the result
+            // Check if the symbol is a variable, first in the lambda frames and then globally
+            const Atom *local = current_frame ? current_frame->find(op) : nullptr;
+            const Expression *global = local ? nullptr : env.find(op);
+            if (local || global) {
+                const Atom &value = local ? *local : global->head;
+                if (value.type != ProcedureType || expr->tail.empty()) {
+                    result = Expression(value);
+                    break;
+                }
+
+                // Apply a user-defined procedure; the callee is held before the frame holding it can change
+                std::shared_ptr<Lambda> callee = value.value.proc_value;
+                std::vector<Atom> &args = eval_arguments(*expr);
+                if (args.size() != callee->params.size()) {
+                    throw InterpreterSemanticError(op + " expects " + std::to_string(callee->params.size()) + " arguments");
+                }
 
-            Expression result;
-            procedure(evaluated_args, result); // Call the procedure with evaluated arguments
+                // Only the first call of an invocation is memoized, as only its result is the invocation's result
+                if (!scope.owns_frame() && memo.capacity() != 0 && memoizable(*callee) && MemoCache::cacheable(args)) {
+                    if (const Expression *cached = memo.find(callee.get(), args)) {
+                        result = *cached;
+                        break;
+                    }
+                    memo_pending = true;
+                    memo_callee = callee;
+                    memo_args.assign(args.begin(), args.end());
+                }
 
-            return result;
-        } 
+                if (scope.owns_frame() && current_frame.use_count() == 1 && current_frame->owner == callee.get()) {
+                    // self tail call: rebind the parameters in place
+                    for (std::size_t i = 0; i < args.size(); ++i) {
+                        current_frame->values[i] = args[i];
+                    }
+                } else {
+                    std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+                    frame->names = callee->params;
+                    frame->values.assign(args.begin(), args.end());
+                    frame->parent = callee->closure;
+                    frame->owner = callee.get();
+                    charge_alloc(1, sizeof(Frame));
+                    scope.enter(std::move(frame));
+                }
+                active = std::move(callee);
+                expr = &active->body;
+                continue;
+            } 
         
-        else {
-            return eval_misc(expr);
+            // Check if the symbol is a procedure
+            else if (const Builtin *procedure = env.find_procedure(op)) {
+                // Evaluate arguments recursively
+                std::vector<Atom> &evaluated_args = eval_arguments(*expr);
+
+                // Call the procedure with evaluated arguments, or reuse the result of an identical call
+                const Expression *cached = nullptr;
+                bool memoize = procedure->pure && memo.capacity() != 0 && MemoCache::cacheable(evaluated_args);
+                if (memoize && (cached = memo.find(procedure, evaluated_args)) != nullptr) {
+                    result = *cached;
+                } else {
+                    if (procedure->length) {
+                        // charged before the call so a budget stops the list before it is allocated
+                        std::size_t length = procedure->length(evaluated_args);
+                        charge_alloc(length, length * sizeof(Number));
+                    }
+                    const BuiltinProcedure &proc =
+                        expr->head.unchecked && procedure->unchecked ? procedure->unchecked : procedure->proc;
+                    proc(evaluated_args, result);
+                    if (memoize) {
+                        memo.insert(procedure, nullptr, evaluated_args, result);
+                    }
+                }
+                charge_alloc(1, sizeof(Expression));
+                if (result.head.type == ListType && (cached || !procedure->length)) {
+                    const List& list = *result.head.value.list_value;
+                    charge_alloc(list.size(), list.numbers.size() * sizeof(Number) + list.items.size() * sizeof(Atom));
+                }
+                break;
+            } 
+        
+            else {
+                result = eval_misc(*expr);
+                break;
+            }
         }
+
+        throw InterpreterSemanticError("Invalid expression");
     }
 
-    throw InterpreterSemanticError("Invalid expression");
+    if (memo_pending) {
+        memo.insert(memo_callee.get(), memo_callee, memo_args, result);
+    }
+    return result;
 }
 
 /* Evalulation function for draw */
@@ -210,10 +1611,49 @@ Expression Interpreter::eval_misc(const Expression& expr)
 
         if (op == "draw")
         {
+            if (pure_only)
+            {
+                throw InterpreterSemanticError("pmap requires a pure procedure, but it uses draw");
+            }
             if (tail.empty())
             {
                 throw InterpreterSemanticError("Draw expects at least one expression");
             }
+
+            // large pure arguments, such as generated lists of shapes, may be evaluated concurrently
+            std::vector<Atom> early;
+            const std::vector<std::size_t> *plan = may_eval_concurrently(expr) ? eval_concurrently(expr, early) : nullptr;
+            std::size_t next_early = 0;
+            for (std::size_t i = 0; i < tail.size(); ++i)
+            {
+                bool is_early = plan && next_early < plan->size() && (*plan)[next_early] == i;
+                Expression elem = is_early ? Expression(early[next_early++]) : eval_expression(tail[i]);
+                if (elem.head.type == ListType)
+                {
+                    // A list of shapes draws each of its elements
+                    const List& list = *elem.head.value.list_value;
+                    for (std::size_t i = 0; i < list.size(); ++i)
+                    {
+                        Atom shape = list.at(i);
+                        if (shape.type < PointType || shape.type > EllipseType)
+                        {
+                            throw InterpreterSemanticError("Invalid expression for drawing");
+                        }
+                    }
+                    charge_alloc(list.size(), list.size() * sizeof(Expression));
+                    for (std::size_t i = 0; i < list.size(); ++i)
+                    {
+                        graphics.push_back(Expression(list.at(i)));
+                    }
+                    continue;
+                }
+                if (elem.head.type < PointType || elem.head.type > EllipseType)
+                {
+                    throw InterpreterSemanticError("Invalid expression for drawing");
+                }
+                charge_alloc(1, sizeof(Expression));
+                graphics.push_back(elem);
+            }
         }
         else
         {
@@ -226,4 +1666,4 @@ Expression Interpreter::eval_misc(const Expression& expr)
     }
     
     return Expression();
-}
\ No newline at end of file
+}
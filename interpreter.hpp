@@ -3,11 +3,48 @@
 
 #include "expression.hpp"
 #include "environment.hpp"
+#include "thread_pool.hpp"
+#include "memo_cache.hpp"
+#include "fast_math.hpp"
+#include "result_cache.hpp"
+#include "snapshot.hpp"
 #include <istream>
 #include <deque>
 #include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
 
-// Interpreter class to parse and evaluate expressions
+// Budgets applied to every call to eval(); a value of zero means unlimited
+struct EvalLimits {
+    std::uint64_t max_steps = 0;   // eval_expression invocations
+    std::uint64_t max_nodes = 0;   // values produced by procedures and defines
+    std::uint64_t max_bytes = 0;   // approximate bytes held by those values
+    std::uint64_t max_time_ms = 0; // wall-clock time
+};
+
+// Resources consumed by the most recent call to eval()
+struct EvalUsage {
+    std::uint64_t steps = 0;
+    std::uint64_t nodes = 0;
+    std::uint64_t bytes = 0;
+};
+
+// A change eval() made to the drawn graphics in live mode: the removed graphics starting at
+// first were replaced by inserted ones, which now occupy [first, first + inserted)
+struct GraphicsEdit {
+    std::size_t first;
+    std::size_t removed;
+    std::size_t inserted;
+};
+
+// Interpreter class to parse and evaluate expressions.
+// Separate instances share no mutable state, so each may run on its own thread with no
+// locking; the exceptions, a shared ResultCache and the memo generation counter, are
+// synchronized and off the per-step path. A single instance is not thread-safe, apart from
+// cancel(), and must be used by one thread at a time.
 class Interpreter {
 public:
     // Default constructor
@@ -16,8 +53,91 @@ public:
     // Parses an expression from the input stream
     bool parse(std::istream &expression) noexcept;
 
+    // Why the last parse() failed, if it failed on a malformed expression; empty otherwise
+    const std::string &parse_error() const noexcept;
+
+    // Returns the expression the last successful parse() produced
+    const Expression &syntax_tree() const noexcept;
+
     // Evaluates the parsed expression and returns the result
     Expression eval();
+
+    // Returns to the state of a new interpreter, forgetting the globals, graphics, parsed
+    // expression and memoized results, while keeping the settings made through the setters
+    // and the threads already started, so one instance can run many unrelated programs
+    void reset();
+
+    // Sets the budgets enforced by eval()
+    void set_limits(const EvalLimits &new_limits);
+
+    // Returns the budgets enforced by eval()
+    const EvalLimits &limits() const noexcept;
+
+    // Returns the resources consumed by the most recent eval()
+    const EvalUsage &usage() const noexcept;
+
+    // Requests that the running evaluation stops (or the next one, if none is running).
+    // Safe to call from any thread.
+    void cancel() noexcept;
+
+    // Sets the number of threads pmap may use; 0 selects the hardware concurrency
+    void set_threads(std::size_t count);
+
+    // Returns the number of threads pmap may use
+    std::size_t threads() const noexcept;
+
+    // Enables dataflow mode: independent defines in a begin block run concurrently on the pool
+    void set_dataflow(bool enabled);
+
+    // True if dataflow mode is enabled
+    bool dataflow() const noexcept;
+
+    // Caches the results of up to entries calls to pure builtins and procedures; 0 disables the cache
+    void set_memo_capacity(std::size_t entries);
+
+    // Returns the hit, miss and eviction counts of the memo cache
+    MemoStats memo_stats() const;
+
+    // Selects how sin, cos, arctan, pow and log10 are computed; Precise (libm) by default
+    void set_math_mode(MathMode mode);
+
+    // Returns the math mode in use
+    MathMode math_mode() const noexcept;
+
+    // Enables the type inference pass eval() runs first (on by default), which reports calls
+    // certain to fail before anything runs and lets proven builtin calls skip their checks
+    void set_type_inference(bool enabled);
+
+    // Enables live mode: define may rebind a global, and eval() then re-evaluates the
+    // top-level forms that read it, directly or through other definitions, replacing
+    // the graphics they drew. Each form of a top-level begin counts as a separate form.
+    void set_live(bool enabled);
+
+    // True if live mode is enabled
+    bool live() const noexcept;
+
+    // The changes the last eval() made to the graphics in live mode, in order; each edit's
+    // positions account for the edits before it
+    const std::vector<GraphicsEdit> &graphics_edits() const noexcept;
+
+    // Number of earlier forms the last eval() re-evaluated in live mode
+    std::size_t reevaluated_forms() const noexcept;
+
+    // Shares a persistent result cache with this interpreter; nullptr (the default) disables it.
+    // eval() then looks up each top-level form (each form of a top-level begin) estimated to be
+    // expensive, keyed on its syntax tree, the values of the globals it can read, directly or
+    // through the procedures it calls, and the math mode. A hit replays the defines, graphics
+    // and value the form produced instead of evaluating it. Not used in live or dataflow mode.
+    void set_result_cache(std::shared_ptr<ResultCache> cache);
+
+    // Makes the globals saved in snapshot visible to every program, as if a prelude defining
+    // them had run first; programs may not redefine them outside live mode. reset() keeps
+    // them. nullptr (the default) detaches the snapshot.
+    void set_prelude(std::shared_ptr<const Snapshot> snapshot);
+
+    // Saves every global, those of an attached snapshot included, to a snapshot at path;
+    // false with error set on failure
+    bool save_snapshot(const std::string &path, std::string &error) const;
 protected:
     virtual Expression eval_misc(const Expression& expr);
     Expression eval_expression(const Expression &expr);
@@ -25,13 +145,234 @@ protected:
     std::vector<Expression> graphics;
 private:
     Expression ast;  // Abstract Syntax Tree (AST) representing the parsed expression
+    std::string parse_message; // reported by parse_error()
     Environment env; // Environment to store symbols and procedures
 
+    // Number of steps between checks of the cancel flag and the wall clock
+    static const std::uint64_t BUDGET_CHECK_INTERVAL = 1024;
+
+    EvalLimits eval_limits;
+    EvalUsage eval_usage;
+    std::uint64_t next_budget_check = 0;
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<bool> cancel_requested;
+
+    // Symbols defined by the current eval(), undone if a budget trips
+    std::vector<Symbol> defined_this_eval;
+
+    // Native stack that non-tail nesting of eval_expression may use before giving up,
+    // half of the usual 8 MB main-thread stack
+    static const std::size_t MAX_EVAL_STACK_BYTES = 4 * 1024 * 1024;
+
+    // Native stack the pmap worker threads may use, which can be smaller than the main thread's
+    static const std::size_t MAX_WORKER_STACK_BYTES = 1024 * 1024;
+
+    // Native stack this interpreter's evaluation may use
+    std::size_t max_stack_bytes = MAX_EVAL_STACK_BYTES;
+
+    // Address of a local in the outermost eval_expression invocation
+    std::uintptr_t stack_base = 0;
+
+    // Frame of the lambda call being evaluated; null at top level
+    std::shared_ptr<Frame> current_frame;
+
+    // Current nesting of eval_expression
+    std::size_t eval_depth = 0;
+
+    // Argument buffers reused across calls, one per nesting level, so calls do not allocate
+    std::deque<std::vector<Atom>> arg_pool;
+
+    // Threads pmap may use, the pool that runs them and one evaluator per pool worker,
+    // the latter two created on the first parallel pmap
+    std::size_t thread_count;
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<std::unique_ptr<Interpreter>> pmap_workers;
+
+    // Set while applying a procedure mapped by pmap, where define and draw are rejected
+    bool pure_only = false;
+
+    // Dataflow mode for begin blocks, off by default
+    bool dataflow_enabled = false;
+
+    // Type inference before each eval()
+    bool infer_types = true;
+
+    // Libm or the fast kernels for the transcendental builtins
+    MathMode math = MathMode::Precise;
+
+    // Results of pure calls, disabled by default; pool workers never enable theirs
+    MemoCache memo;
+
+    // Renewed whenever the globals change while the memo cache is enabled, so the
+    // verdicts of memoizable() computed against the old globals are recomputed
+    std::uint64_t memo_generation = 0;
+
+    // A top-level form remembered in live mode, with the graphics its last evaluation drew
+    struct LiveForm {
+        Expression form;
+        std::vector<Symbol> reads;   // every symbol the form mentions
+        std::vector<Symbol> defines; // globals its last evaluation bound
+        std::size_t first_graphic = 0;
+        std::size_t graphic_count = 0;
+    };
+
+    // Live mode, off by default, and the forms evaluated in it so far, in order
+    bool live_enabled = false;
+    std::vector<LiveForm> live_forms;
+
+    // The form that last bound each global, in live mode
+    std::unordered_map<Symbol, std::size_t> live_owner;
+
+    // Globals bound by define since the current live form started
+    std::vector<Symbol> live_defined;
+
+    std::vector<GraphicsEdit> live_edits;
+    std::size_t live_reevaluated = 0;
+
+    // Persistent results of top-level forms, if enabled
+    std::shared_ptr<ResultCache> result_cache;
+
+    // Cancel flag of the interpreter this one is a pmap worker for, checked with its own
+    const std::atomic<bool> *parent_cancel = nullptr;
+
+    // The procedure pmap applies: a lambda, or a builtin named directly
+    struct MappedProcedure;
+
+    // Estimated steps and side effects of an expression
+    struct CostEstimate;
+
+    // Arguments estimated below this many steps are not worth handing to another thread
+    static constexpr double PARALLEL_ARGUMENT_STEPS = 10000;
+
+    // Steps assumed for a call to a recursive procedure and iterations for a loop with non-literal bounds
+    static constexpr double RECURSIVE_CALL_STEPS = PARALLEL_ARGUMENT_STEPS;
+    static constexpr double DEFAULT_LOOP_ITERATIONS = 1000;
+
+    // Top-level forms estimated below this many steps are evaluated rather than looked up in the
+    // result cache, as reading or writing an entry costs more
+    static constexpr double RESULT_CACHE_MIN_STEPS = 10000;
+
+    // Only calls within this many levels of nesting are considered for concurrent arguments,
+    // so small calls deep in the tree skip the analysis altogether
+    static const std::size_t MAX_PARALLEL_DEPTH = 4;
+
+    // Arguments worth evaluating concurrently, by call site; rebuilt on every eval()
+    std::unordered_map<const Expression *, std::vector<std::size_t>> parallel_plans;
+
     // Parses an expression from a deque of tokens
     Expression parse_expression(std::deque<std::string>::iterator &current, const std::deque<std::string>::iterator &end);
 
+    // Counts one evaluation step, checking the budgets every BUDGET_CHECK_INTERVAL steps
+    void charge_step()
+    {
+        if (++eval_usage.steps >= next_budget_check) {
+            check_budget();
+        }
+    }
+
+    // Counts a value produced during evaluation against the node and byte budgets
+    void charge_alloc(std::uint64_t nodes, std::uint64_t bytes);
+
+    // Slow path of charge_step: checks every budget and schedules the next check
+    void check_budget();
+
+    // Resets the usage counters and deadline at the start of eval()
+    void start_budget();
+
+    // Builds a procedure value from (lambda (params...) body)
+    Expression make_lambda(const Expression &expr);
+
+    // Evaluates (for var start end step body...), rebinding var in place each iteration
+    Expression eval_for(const Expression &expr);
+
+    // Evaluates (repeat count body...)
+    Expression eval_repeat(const Expression &expr);
+
+    // Evaluates a loop expression that must produce a number
+    Number eval_loop_bound(const Expression &expr, const char *what);
+
+    // Most graphics a loop reserves before it runs
+    static constexpr double MAX_LOOP_RESERVE = 1 << 16;
+
+    // Reserves graphics for the draw forms a loop body will run iterations times
+    void reserve_loop_graphics(const Expression &expr, std::size_t first_body, double iterations);
+
+    // Evaluates the arguments of a call into the buffer for the current nesting level
+    std::vector<Atom> &eval_arguments(const Expression &expr);
+
+    // Undoes the defines and graphics of an eval() that ran out of budget
+    void rollback(std::size_t graphics_size);
+
+    // Evaluates (pmap proc list...), applying proc to corresponding elements across the pool
+    Expression eval_pmap(const Expression &expr);
+
+    // Applies a mapped procedure to one set of elements
+    Atom apply_mapped(const MappedProcedure &proc, const std::vector<Atom> &args);
+
+    // Estimated steps to evaluate expr, or to call lambda, noting any define or draw reached
+    double estimate_cost(const Expression &expr, const Frame *scope, CostEstimate &estimate) const;
+    double estimate_call(const Lambda &lambda, CostEstimate &estimate) const;
+
+    // Throws unless lambda, and every procedure it can reach by name, is free of define and draw
+    void check_pure(const Lambda &lambda, CostEstimate &estimate) const;
+
+    // True if calls to lambda may be memoized: it and every procedure it can reach by name are pure
+    bool memoizable(const Lambda &lambda);
+
+    // Invalidates the memoizable() verdicts after the globals change
+    void renew_memo_generation();
+
+    // Gives a pool worker this interpreter's globals, current frame and the budget remaining
+    void prepare_worker(Interpreter &worker) const;
+
+    // Runs task on a worker interpreter for each index across the pool, rethrowing the leftmost error
+    void run_on_workers(std::size_t count, const std::function<Atom(Interpreter &, std::size_t)> &task,
+                        std::vector<Atom> &results);
+
+    // Binds a global for define
+    void define_symbol(const Symbol &sym_value, const Expression &value);
+
+    // Evaluates the parsed forms in live mode, replacing the form that defined a redefined
+    // symbol and re-evaluating the forms that depend on it
+    Expression eval_live();
+
+    // Evaluates live_forms[index], splicing the graphics it draws in place of those it drew before
+    Expression eval_live_form(std::size_t index);
+
+    // Re-evaluates, in order, every live form except skip that reads a changed symbol or
+    // a symbol bound by a form re-evaluated this way
+    void reevaluate_dependents(const std::vector<Symbol> &changed, std::size_t skip);
+
+    // Evaluates the parsed forms through the result cache
+    Expression eval_cached();
+
+    // Evaluates a top-level form, or replays its cached results
+    Expression eval_cached_form(const Expression &form);
+
+    // Builds the result cache key of a top-level form; false if something it reads cannot be keyed
+    bool result_cache_key(const Expression &form, std::string &key) const;
+
+    // Evaluates all but the last form of a begin block, scheduling runs of pure defines by dependency
+    void eval_begin_dataflow(const Expression &expr);
+
+    // Evaluates the pure defines tail[first, end) of a begin block in dependency waves
+    void eval_define_run(const Expression &expr, std::size_t first, std::size_t end);
+
+    // Arguments of a call worth evaluating concurrently, computed once per call site
+    const std::vector<std::size_t> &parallel_plan(const Expression &expr);
+
+    // Evaluates the planned arguments of a call on the pool into values; returns the plan,
+    // or nullptr to evaluate every argument in order as usual
+    const std::vector<std::size_t> *eval_concurrently(const Expression &expr, std::vector<Atom> &values);
+
+    // True if a call is a candidate for concurrent argument evaluation
+    bool may_eval_concurrently(const Expression &expr) const
+    {
+        return thread_count > 1 && !pure_only && eval_depth <= MAX_PARALLEL_DEPTH && expr.tail.size() >= 2;
+    }
+
     // Evaluates a given expression
-    
+
 };
 
 #endif
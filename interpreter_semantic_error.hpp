@@ -3,11 +3,32 @@
 
 #include <exception>
 #include <stdexcept>
+#include <string>
+#include <cstdint>
 
 class InterpreterSemanticError : public std::runtime_error {
 public:
     InterpreterSemanticError(const std::string &message) : std::runtime_error(message) {};
 };
 
-#endif
+// Which evaluation budget was exhausted
+enum class LimitKind { Steps, Nodes, Bytes, Time, Cancelled };
+
+// Thrown when an evaluation budget trips or the evaluation is cancelled.
+// Derives from InterpreterSemanticError so existing handlers still report it.
+class InterpreterLimitError : public InterpreterSemanticError {
+public:
+    InterpreterLimitError(LimitKind kind, std::uint64_t limit, std::uint64_t used, const std::string &message)
+        : InterpreterSemanticError(message), limit_kind(kind), limit_value(limit), used_value(used) {};
+
+    LimitKind kind() const noexcept { return limit_kind; }
+    std::uint64_t limit() const noexcept { return limit_value; }
+    std::uint64_t used() const noexcept { return used_value; }
 
+private:
+    LimitKind limit_kind;
+    std::uint64_t limit_value;
+    std::uint64_t used_value;
+};
+
+#endif
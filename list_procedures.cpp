@@ -0,0 +1,313 @@
+#include "list_procedures.hpp"
+#include <cmath>
+#include <memory>
+#include <string>
+
+namespace {
+
+// Number of elements shared by the list arguments; throws if their lengths differ
+std::size_t commonLength(const std::vector<Atom>& params, const char* name)
+{
+    bool found = false;
+    std::size_t length = 0;
+    for (const auto& param : params) {
+        if (param.type != ListType) {
+            continue;
+        }
+        std::size_t size = param.value.list_value->size();
+        if (found && size != length) {
+            throw InterpreterSemanticError(std::string(name) + " expects lists of equal length");
+        }
+        length = size;
+        found = true;
+    }
+    return length;
+}
+
+// Contiguous doubles of a numeric argument: a numeric list's storage or the scalar itself
+const Number* numericData(const Atom& param, const char* name)
+{
+    if (param.type == NumberType) {
+        return &param.value.num_value;
+    }
+    if (param.type == ListType && param.value.list_value->numeric) {
+        return param.value.list_value->numbers.data();
+    }
+    throw InterpreterSemanticError(std::string(name) + " expects numeric arguments");
+}
+
+// Wraps numbers in a numeric list expression
+Expression numericList(std::vector<Number>&& numbers)
+{
+    std::shared_ptr<List> list = std::make_shared<List>();
+    list->numbers = std::move(numbers);
+    return Expression(std::shared_ptr<const List>(std::move(list)));
+}
+
+// The numeric list passed as the only argument to a reduction, or nullptr if called with numbers
+const List* reductionList(const std::vector<Atom>& params, const char* name)
+{
+    if (params.size() == 1 && params[0].type == ListType) {
+        if (!params[0].value.list_value->numeric) {
+            throw InterpreterSemanticError(std::string(name) + " expects a numeric list");
+        }
+        return params[0].value.list_value.get();
+    }
+    if (params.empty()) {
+        throw InterpreterSemanticError(std::string(name) + " expects a numeric list or numbers");
+    }
+    for (const auto& param : params) {
+        if (param.type != NumberType) {
+            throw InterpreterSemanticError(std::string(name) + " expects a numeric list or numbers");
+        }
+    }
+    return nullptr;
+}
+
+}
+
+/* A m-ary procedure that builds a list from its arguments; numeric lists are stored unboxed */
+void procList(const std::vector<Atom>& params, Expression& output)
+{
+    std::shared_ptr<List> list = std::make_shared<List>();
+    for (const auto& param : params) {
+        if (param.type != NumberType) {
+            list->numeric = false;
+            break;
+        }
+    }
+    if (list->numeric) {
+        list->numbers.reserve(params.size());
+        for (const auto& param : params) {
+            list->numbers.push_back(param.value.num_value);
+        }
+    } else {
+        list->items = params;
+    }
+    output = Expression(std::shared_ptr<const List>(std::move(list)));
+}
+
+/* A 1 to 3-ary procedure that builds the numeric list start, start + step, ... below end */
+std::size_t rangeLength(const std::vector<Atom>& params)
+{
+    if (params.empty() || params.size() > 3) {
+        throw InterpreterSemanticError("range expects one to three numeric arguments");
+    }
+    for (const auto& param : params) {
+        if (param.type != NumberType) {
+            throw InterpreterSemanticError("range expects one to three numeric arguments");
+        }
+    }
+    Number start = params.size() == 1 ? 0 : params[0].value.num_value;
+    Number end = params.size() == 1 ? params[0].value.num_value : params[1].value.num_value;
+    Number step = params.size() == 3 ? params[2].value.num_value : 1;
+    if (step == 0 || std::isnan(step)) {
+        throw InterpreterSemanticError("range step must be non-zero");
+    }
+
+    Number count = std::ceil((end - start) / step);
+    if (!std::isfinite(count)) {
+        throw InterpreterSemanticError("range must be finite");
+    }
+    if (count > static_cast<Number>(MAX_RANGE_LENGTH)) {
+        throw InterpreterSemanticError("range is too long");
+    }
+    return count > 0 ? static_cast<std::size_t>(count) : 0;
+}
+
+void procRange(const std::vector<Atom>& params, Expression& output)
+{
+    std::size_t count = rangeLength(params);
+    Number start = params.size() == 1 ? 0 : params[0].value.num_value;
+    Number step = params.size() == 3 ? params[2].value.num_value : 1;
+    std::vector<Number> numbers(count);
+    for (std::size_t i = 0; i < numbers.size(); ++i) {
+        numbers[i] = start + static_cast<Number>(i) * step;
+    }
+    output = numericList(std::move(numbers));
+}
+
+/* A uniary procedure that returns the number of elements in a list */
+void procLength(const std::vector<Atom>& params, Expression& output)
+{
+    if (params.size() != 1 || params[0].type != ListType) {
+        throw InterpreterSemanticError("length expects one list argument");
+    }
+    output = Expression(static_cast<Number>(params[0].value.list_value->size()));
+}
+
+/* A binary procedure that returns element index (from zero) of a list */
+void procNth(const std::vector<Atom>& params, Expression& output)
+{
+    if (params.size() != 2 || params[0].type != ListType || params[1].type != NumberType) {
+        throw InterpreterSemanticError("nth expects a list and an index");
+    }
+    const List& list = *params[0].value.list_value;
+    Number index = params[1].value.num_value;
+    if (index < 0 || index != std::floor(index) || index >= static_cast<Number>(list.size())) {
+        throw InterpreterSemanticError("nth index out of range");
+    }
+    output = Expression(list.at(static_cast<std::size_t>(index)));
+}
+
+/* Sums a numeric list, or its numeric arguments */
+void procSum(const std::vector<Atom>& params, Expression& output)
+{
+    const List* list = reductionList(params, "sum");
+    if (list) {
+        output = Expression(list->numbers.empty() ? 0.0 : kernelSum(list->numbers.data(), list->numbers.size()));
+        return;
+    }
+    Number total = 0;
+    for (const auto& param : params) {
+        total += param.value.num_value;
+    }
+    output = Expression(total);
+}
+
+/* Smallest element of a non-empty numeric list, or of its numeric arguments */
+void procMin(const std::vector<Atom>& params, Expression& output)
+{
+    const List* list = reductionList(params, "min");
+    if (list) {
+        if (list->numbers.empty()) {
+            throw InterpreterSemanticError("min of an empty list");
+        }
+        output = Expression(kernelMin(list->numbers.data(), list->numbers.size()));
+        return;
+    }
+    Number best = params[0].value.num_value;
+    for (const auto& param : params) {
+        best = param.value.num_value < best ? param.value.num_value : best;
+    }
+    output = Expression(best);
+}
+
+/* Largest element of a non-empty numeric list, or of its numeric arguments */
+void procMax(const std::vector<Atom>& params, Expression& output)
+{
+    const List* list = reductionList(params, "max");
+    if (list) {
+        if (list->numbers.empty()) {
+            throw InterpreterSemanticError("max of an empty list");
+        }
+        output = Expression(kernelMax(list->numbers.data(), list->numbers.size()));
+        return;
+    }
+    Number best = params[0].value.num_value;
+    for (const auto& param : params) {
+        best = param.value.num_value > best ? param.value.num_value : best;
+    }
+    output = Expression(best);
+}
+
+/* True if any parameter is a list */
+bool hasListArgument(const std::vector<Atom>& params)
+{
+    for (const auto& param : params) {
+        if (param.type == ListType) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Element-wise + - * / pow and arctan, folding left over the arguments */
+void listArithmetic(KernelOp op, const char* name, const std::vector<Atom>& params, Expression& output)
+{
+    if (params.empty()) {
+        throw InterpreterSemanticError(std::string(name) + " expects at least one numeric argument");
+    }
+    bool binary_only = op == KernelOp::Divide || op == KernelOp::Pow || op == KernelOp::Arctan;
+    if ((binary_only && params.size() != 2) || (op == KernelOp::Subtract && params.size() > 2)) {
+        throw InterpreterSemanticError(std::string(name) + " expects two numeric arguments");
+    }
+
+    std::size_t n = commonLength(params, name);
+    std::vector<Number> result(n);
+    const Number* first = numericData(params[0], name);
+
+    if (op == KernelOp::Subtract && params.size() == 1) {
+        kernelUnary(KernelUnary::Negate, first, result.data(), n);
+        output = numericList(std::move(result));
+        return;
+    }
+
+    for (std::size_t i = 0; i < n; ++i) {
+        result[i] = params[0].type == ListType ? first[i] : *first;
+    }
+    for (std::size_t p = 1; p < params.size(); ++p) {
+        const Number* operand = numericData(params[p], name);
+        bool is_list = params[p].type == ListType;
+        if (op == KernelOp::Divide) {
+            for (std::size_t i = 0; i < (is_list ? n : 1); ++i) {
+                if (operand[i] == 0) {
+                    throw InterpreterSemanticError("Division by zero");
+                }
+            }
+        }
+        kernelBinary(op, result.data(), true, operand, is_list, result.data(), n);
+    }
+    output = numericList(std::move(result));
+}
+
+/* Element-wise sin, cos and log10 of a numeric list */
+void listUnary(KernelUnary op, const char* name, const std::vector<Atom>& params, Expression& output)
+{
+    if (params.size() != 1 || params[0].type != ListType) {
+        throw InterpreterSemanticError(std::string(name) + " expects one numeric argument");
+    }
+    const Number* input = numericData(params[0], name);
+    std::vector<Number> result(params[0].value.list_value->size());
+    kernelUnary(op, input, result.data(), result.size());
+    output = numericList(std::move(result));
+}
+
+/* Element-wise < <= > >= and =, producing a list of booleans */
+void listCompare(const char* name, const std::vector<Atom>& params, Expression& output)
+{
+    if (params.size() != 2) {
+        throw InterpreterSemanticError(std::string(name) + " expects two numeric arguments");
+    }
+    std::size_t n = commonLength(params, name);
+    const Number* a = numericData(params[0], name);
+    const Number* b = numericData(params[1], name);
+    std::size_t a_step = params[0].type == ListType ? 1 : 0;
+    std::size_t b_step = params[1].type == ListType ? 1 : 0;
+    const std::string op = name;
+
+    std::shared_ptr<List> list = std::make_shared<List>();
+    list->numeric = false;
+    list->items.resize(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        Number x = a[i * a_step];
+        Number y = b[i * b_step];
+        bool value = op == "<" ? x < y : op == "<=" ? x <= y : op == ">" ? x > y : op == ">=" ? x >= y : x == y;
+        list->items[i].type = BooleanType;
+        list->items[i].value.bool_value = value;
+    }
+    output = Expression(std::shared_ptr<const List>(std::move(list)));
+}
+
+/* Applies a scalar builtin to corresponding list elements, broadcasting non-list arguments */
+void listBroadcast(void (*proc)(const std::vector<Atom>&, Expression&),
+                   const std::vector<Atom>& params, Expression& output)
+{
+    std::size_t n = commonLength(params, "procedure");
+    std::shared_ptr<List> list = std::make_shared<List>();
+    list->numeric = false;
+    list->items.reserve(n);
+
+    std::vector<Atom> element_params(params);
+    Expression element;
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t p = 0; p < params.size(); ++p) {
+            if (params[p].type == ListType) {
+                element_params[p] = params[p].value.list_value->at(i);
+            }
+        }
+        proc(element_params, element);
+        list->items.push_back(element.head);
+    }
+    output = Expression(std::shared_ptr<const List>(std::move(list)));
+}
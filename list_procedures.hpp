@@ -0,0 +1,42 @@
+#ifndef LIST_PROCEDURES_HPP
+#define LIST_PROCEDURES_HPP
+
+#include "expression.hpp"
+#include "interpreter_semantic_error.hpp"
+#include "vector_kernels.hpp"
+#include <vector>
+
+// Longest list range may build
+const std::size_t MAX_RANGE_LENGTH = std::size_t(1) << 32;
+
+// Number of elements range would build from params; throws if they are invalid or the
+// range is not finite or longer than MAX_RANGE_LENGTH
+std::size_t rangeLength(const std::vector<Atom>& params);
+
+// List constructors
+void procList(const std::vector<Atom>& params, Expression& output);
+void procRange(const std::vector<Atom>& params, Expression& output);
+
+// List accessors
+void procLength(const std::vector<Atom>& params, Expression& output);
+void procNth(const std::vector<Atom>& params, Expression& output);
+
+// Reductions
+void procSum(const std::vector<Atom>& params, Expression& output);
+void procMin(const std::vector<Atom>& params, Expression& output);
+void procMax(const std::vector<Atom>& params, Expression& output);
+
+// True if any parameter is a list, i.e. the call should be applied element-wise
+bool hasListArgument(const std::vector<Atom>& params);
+
+// Element-wise forms of the numeric builtins, used when an argument is a list.
+// Scalars are broadcast; all list arguments must have the same length.
+void listArithmetic(KernelOp op, const char* name, const std::vector<Atom>& params, Expression& output);
+void listUnary(KernelUnary op, const char* name, const std::vector<Atom>& params, Expression& output);
+void listCompare(const char* name, const std::vector<Atom>& params, Expression& output);
+
+// Element-wise form of a scalar builtin such as point or rect, producing a list of its results
+void listBroadcast(void (*proc)(const std::vector<Atom>&, Expression&),
+                   const std::vector<Atom>& params, Expression& output);
+
+#endif // LIST_PROCEDURES_HPP
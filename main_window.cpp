@@ -40,12 +40,50 @@ MainWindow::MainWindow(std::string filename, QWidget *parent) : QWidget(parent)
 
 
 
-    QObject::connect(repl, &REPLWidget::lineEntered, &interp, &QtInterpreter::parseAndEvaluate);
+    QObject::connect(repl, &REPLWidget::lineEntered, &interp, &QtInterpreter::evaluateLine);
+    QObject::connect(&interp, &QtInterpreter::continuing, repl, &REPLWidget::setContinuing);
     QObject::connect(&interp, &QtInterpreter::info, message, &MessageWidget::info);
     QObject::connect(&interp, &QtInterpreter::drawGraphic, canvas, &CanvasWidget::addGraphic);
+    QObject::connect(&interp, &QtInterpreter::removeGraphic, canvas, &CanvasWidget::removeGraphic);
     QObject::connect(&interp, &QtInterpreter::error, message, &MessageWidget::error);
 }
 
+/* Forwards the evaluation budgets to the interpreter so a runaway script cannot hang the GUI forever */
+void MainWindow::setEvalLimits(const EvalLimits& limits)
+{
+    interp.set_limits(limits);
+}
+
+/* Sets how many threads pmap may use; 0 selects the hardware concurrency */
+void MainWindow::setThreads(std::size_t threads)
+{
+    interp.set_threads(threads);
+}
+
+/* Reuses the results and graphics of expensive forms evaluated before, here or by another process */
+void MainWindow::setResultCache(std::shared_ptr<ResultCache> cache)
+{
+    interp.set_result_cache(std::move(cache));
+}
+
+/* Starts every program with the globals saved in a snapshot */
+void MainWindow::setPrelude(std::shared_ptr<const Snapshot> snapshot)
+{
+    interp.set_prelude(std::move(snapshot));
+}
+
+/* Lets entries redefine symbols, redrawing only what depends on them */
+void MainWindow::setLive(bool enabled)
+{
+    interp.set_live(enabled);
+}
+
+/* Selects libm or the fast kernels for sin, cos, arctan, pow and log10 */
+void MainWindow::setMathMode(MathMode mode)
+{
+    interp.set_math_mode(mode);
+}
+
 /* Event used to read inputted file and display when canvas is ready */
 void MainWindow::showEvent(QShowEvent* event)
 {
@@ -21,6 +21,14 @@ public:
     MainWindow(QWidget *parent = nullptr);
 
     MainWindow(std::string filename, QWidget *parent = nullptr);
+
+    // Sets the evaluation budgets used for every entry and the startup file
+    void setEvalLimits(const EvalLimits& limits);
+    void setThreads(std::size_t threads);
+    void setMathMode(MathMode mode);
+    void setLive(bool enabled);
+    void setResultCache(std::shared_ptr<ResultCache> cache);
+    void setPrelude(std::shared_ptr<const Snapshot> snapshot);
 protected:
     void showEvent(QShowEvent* event) override;
 private:
@@ -0,0 +1,280 @@
+#include "memo_cache.hpp"
+#include <cstring>
+#include <functional>
+
+namespace {
+
+// Mixes value into a running hash
+void hashCombine(std::size_t &hash, std::size_t value)
+{
+    hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+}
+
+// Hashes the bits of a number, so numbers match exactly as keys
+std::size_t hashNumber(Number value)
+{
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return std::hash<std::uint64_t>()(bits);
+}
+
+// True if two numbers have the same bits
+bool sameNumber(Number a, Number b)
+{
+    return std::memcmp(&a, &b, sizeof(Number)) == 0;
+}
+
+// The numbers that make up a shape atom, in a fixed order; returns how many were written
+std::size_t shapeNumbers(const Atom &atom, Number out[7])
+{
+    const Value &v = atom.value;
+    switch (atom.type) {
+        case PointType:
+            out[0] = v.point_value.x; out[1] = v.point_value.y;
+            return 2;
+        case LineType:
+            out[0] = v.line_value.first.x; out[1] = v.line_value.first.y;
+            out[2] = v.line_value.second.x; out[3] = v.line_value.second.y;
+            return 4;
+        case ArcType:
+            out[0] = v.arc_value.center.x; out[1] = v.arc_value.center.y;
+            out[2] = v.arc_value.start.x; out[3] = v.arc_value.start.y;
+            out[4] = v.arc_value.span;
+            return 5;
+        case RectType:
+            out[0] = v.rect_value.x1; out[1] = v.rect_value.y1; out[2] = v.rect_value.x2; out[3] = v.rect_value.y2;
+            return 4;
+        case FillRectType:
+            out[0] = v.fillRect_value.rect.x1; out[1] = v.fillRect_value.rect.y1;
+            out[2] = v.fillRect_value.rect.x2; out[3] = v.fillRect_value.rect.y2;
+            out[4] = v.fillRect_value.r; out[5] = v.fillRect_value.g; out[6] = v.fillRect_value.b;
+            return 7;
+        case EllipseType:
+            out[0] = v.ellipse_value.rect.x1; out[1] = v.ellipse_value.rect.y1;
+            out[2] = v.ellipse_value.rect.x2; out[3] = v.ellipse_value.rect.y2;
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+// Hashes an argument consistently with sameAtom
+std::size_t hashAtom(const Atom &atom)
+{
+    std::size_t hash = static_cast<std::size_t>(atom.type);
+    switch (atom.type) {
+        case NoneType:
+            break;
+        case BooleanType:
+            hashCombine(hash, atom.value.bool_value ? 1 : 0);
+            break;
+        case NumberType:
+            hashCombine(hash, hashNumber(atom.value.num_value));
+            break;
+        case SymbolType:
+            hashCombine(hash, std::hash<std::string>()(atom.value.sym_value));
+            break;
+        case ListType:
+            hashCombine(hash, std::hash<const void *>()(atom.value.list_value.get()));
+            break;
+        case ProcedureType:
+            hashCombine(hash, std::hash<const void *>()(atom.value.proc_value.get()));
+            break;
+        default: {
+            Number numbers[7];
+            std::size_t count = shapeNumbers(atom, numbers);
+            for (std::size_t i = 0; i < count; ++i) {
+                hashCombine(hash, hashNumber(numbers[i]));
+            }
+            break;
+        }
+    }
+    return hash;
+}
+
+// True if two arguments are interchangeable as keys
+bool sameAtom(const Atom &a, const Atom &b)
+{
+    if (a.type != b.type) {
+        return false;
+    }
+    switch (a.type) {
+        case NoneType:
+            return true;
+        case BooleanType:
+            return a.value.bool_value == b.value.bool_value;
+        case NumberType:
+            return sameNumber(a.value.num_value, b.value.num_value);
+        case SymbolType:
+            return a.value.sym_value == b.value.sym_value;
+        case ListType:
+            return a.value.list_value == b.value.list_value;
+        case ProcedureType:
+            return a.value.proc_value == b.value.proc_value;
+        default: {
+            Number first[7];
+            Number second[7];
+            std::size_t count = shapeNumbers(a, first);
+            shapeNumbers(b, second);
+            for (std::size_t i = 0; i < count; ++i) {
+                if (!sameNumber(first[i], second[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+}
+
+// Hashes a procedure and its arguments
+std::size_t hashKey(const void *proc, const std::vector<Atom> &args)
+{
+    std::size_t hash = std::hash<const void *>()(proc);
+    for (const auto &arg : args) {
+        hashCombine(hash, hashAtom(arg));
+    }
+    return hash;
+}
+
+// True if a list holds a procedure, directly or in a nested list
+bool holdsProcedure(const List &list)
+{
+    for (const auto &item : list.items) {
+        if (item.type == ProcedureType || (item.type == ListType && holdsProcedure(*item.value.list_value))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+/* Creates a cache holding up to capacity results */
+MemoCache::MemoCache(std::size_t capacity) : max_entries(capacity)
+{
+}
+
+/* Changes the number of results held, discarding every entry */
+void MemoCache::set_capacity(std::size_t capacity)
+{
+    max_entries = capacity;
+    clear();
+    slots.shrink_to_fit();
+}
+
+/* Number of results held when full */
+std::size_t MemoCache::capacity() const noexcept
+{
+    return max_entries;
+}
+
+/* Returns the cached result of applying proc to args, or nullptr */
+const Expression *MemoCache::find(const void *proc, const std::vector<Atom> &args)
+{
+    std::size_t slot = lookup(hashKey(proc, args), proc, args);
+    if (slot == slots.size()) {
+        ++counters.misses;
+        return nullptr;
+    }
+    ++counters.hits;
+    slots[slot].referenced = true;
+    return &slots[slot].result;
+}
+
+/* Caches a result, overwriting the entry the clock hand picks once the cache is full */
+void MemoCache::insert(const void *proc, std::shared_ptr<const void> owner, const std::vector<Atom> &args,
+                       const Expression &result)
+{
+    if (max_entries == 0) {
+        return;
+    }
+    std::size_t hash = hashKey(proc, args);
+    if (lookup(hash, proc, args) != slots.size()) {
+        return; // a nested call with the same key finished first
+    }
+
+    std::size_t slot;
+    if (slots.size() < max_entries) {
+        slot = slots.size();
+        slots.push_back(Slot());
+    } else {
+        slot = evict();
+    }
+    Slot &entry = slots[slot];
+    entry.proc = proc;
+    entry.owner = std::move(owner);
+    entry.args.assign(args.begin(), args.end());
+    entry.hash = hash;
+    entry.result = result;
+    entry.referenced = false;
+    index.emplace(hash, slot);
+}
+
+/* Discards every entry */
+void MemoCache::clear()
+{
+    slots.clear();
+    index.clear();
+    hand = 0;
+}
+
+/* Hit, miss and eviction counts, with the current size */
+MemoStats MemoCache::stats() const
+{
+    MemoStats result = counters;
+    result.entries = slots.size();
+    result.capacity = max_entries;
+    return result;
+}
+
+/* True if args hold no procedure */
+bool MemoCache::cacheable(const std::vector<Atom> &args)
+{
+    for (const auto &arg : args) {
+        if (arg.type == ProcedureType || (arg.type == ListType && holdsProcedure(*arg.value.list_value))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Finds the slot holding the key, or returns slots.size() */
+std::size_t MemoCache::lookup(std::size_t hash, const void *proc, const std::vector<Atom> &args) const
+{
+    auto range = index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Slot &candidate = slots[it->second];
+        if (candidate.proc != proc || candidate.args.size() != args.size()) {
+            continue;
+        }
+        bool same = true;
+        for (std::size_t i = 0; same && i < args.size(); ++i) {
+            same = sameAtom(candidate.args[i], args[i]);
+        }
+        if (same) {
+            return it->second;
+        }
+    }
+    return slots.size();
+}
+
+/* Advances the clock hand past referenced slots, clearing their marks, and unlinks the first unmarked one */
+std::size_t MemoCache::evict()
+{
+    while (slots[hand].referenced) {
+        slots[hand].referenced = false;
+        hand = (hand + 1) % slots.size();
+    }
+    std::size_t slot = hand;
+    hand = (hand + 1) % slots.size();
+
+    auto range = index.equal_range(slots[slot].hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == slot) {
+            index.erase(it);
+            break;
+        }
+    }
+    ++counters.evictions;
+    return slot;
+}
@@ -0,0 +1,75 @@
+#ifndef MEMO_CACHE_HPP
+#define MEMO_CACHE_HPP
+
+#include "expression.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Counters of a MemoCache
+struct MemoStats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+    std::size_t entries = 0;
+    std::size_t capacity = 0;
+};
+
+// A bounded cache of procedure results keyed on the procedure and its argument Atoms.
+// Arguments match exactly: numbers and shape coordinates bit for bit, lists and
+// procedures by identity. When full, an entry is evicted with the clock algorithm:
+// the hand sweeps the slots, sparing (and clearing the mark of) any entry hit since
+// it last passed.
+class MemoCache {
+public:
+    // Creates a cache holding up to capacity results; 0 disables it
+    explicit MemoCache(std::size_t capacity = 0);
+
+    // Changes the number of results held, discarding every entry
+    void set_capacity(std::size_t capacity);
+
+    // Number of results held when full; 0 if disabled
+    std::size_t capacity() const noexcept;
+
+    // Returns the cached result of applying proc to args, or nullptr, counting a hit or a miss
+    const Expression *find(const void *proc, const std::vector<Atom> &args);
+
+    // Caches the result of applying proc to args; owner, if any, keeps proc alive while cached
+    void insert(const void *proc, std::shared_ptr<const void> owner, const std::vector<Atom> &args,
+                const Expression &result);
+
+    // Discards every entry, keeping the counters
+    void clear();
+
+    // Hit, miss and eviction counts since the cache was created
+    MemoStats stats() const;
+
+    // True if args can form a key, i.e. hold no procedure, which may not be pure
+    static bool cacheable(const std::vector<Atom> &args);
+
+private:
+    struct Slot {
+        const void *proc;
+        std::shared_ptr<const void> owner;
+        std::vector<Atom> args;
+        std::size_t hash;
+        Expression result;
+        bool referenced;
+    };
+
+    std::size_t max_entries;
+    std::vector<Slot> slots;
+    std::unordered_multimap<std::size_t, std::size_t> index; // key hash to slot
+    std::size_t hand = 0;
+    MemoStats counters;
+
+    // Finds the slot holding the key, or returns slots.size()
+    std::size_t lookup(std::size_t hash, const void *proc, const std::vector<Atom> &args) const;
+
+    // Picks the slot to overwrite with the clock algorithm and unlinks it from the index
+    std::size_t evict();
+};
+
+#endif
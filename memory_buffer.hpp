@@ -0,0 +1,17 @@
+#ifndef MEMORY_BUFFER_HPP
+#define MEMORY_BUFFER_HPP
+
+#include <cstddef>
+#include <streambuf>
+
+// Stream buffer reading bytes held elsewhere in place, so they can be parsed without a copy
+class MemoryBuffer : public std::streambuf {
+public:
+    MemoryBuffer(const char *data, std::size_t size)
+    {
+        char *begin = const_cast<char *>(data);
+        setg(begin, begin, begin + size);
+    }
+};
+
+#endif
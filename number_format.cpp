@@ -0,0 +1,299 @@
+#include "number_format.hpp"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// A floating-point number f * 2^e with a 64-bit significand
+struct DiyFp {
+    std::uint64_t f;
+    int e;
+};
+
+const std::uint64_t SIGNIFICAND_MASK = 0x000FFFFFFFFFFFFFULL;
+const std::uint64_t HIDDEN_BIT = 0x0010000000000000ULL;
+const int EXPONENT_BIAS = 0x3FF + 52;
+
+// Normalized powers of ten from 10^-348 to 10^340 in steps of 8, rounded to nearest
+const std::uint64_t CACHED_SIGNIFICANDS[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+const std::int16_t CACHED_EXPONENTS[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+const std::uint64_t POWERS_OF_TEN[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+DiyFp multiply(const DiyFp &x, const DiyFp &y)
+{
+    const std::uint64_t low = 0xFFFFFFFFULL;
+    std::uint64_t a = x.f >> 32, b = x.f & low, c = y.f >> 32, d = y.f & low;
+    std::uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    std::uint64_t middle = (bd >> 32) + (ad & low) + (bc & low) + (1ULL << 31); // rounds the low half
+    return DiyFp{ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64};
+}
+
+DiyFp normalize(DiyFp x)
+{
+    while ((x.f & (1ULL << 63)) == 0) {
+        x.f <<= 1;
+        --x.e;
+    }
+    return x;
+}
+
+// The significand and exponent of a positive finite double
+DiyFp decompose(double value)
+{
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    int biased = static_cast<int>(bits >> 52);
+    std::uint64_t significand = bits & SIGNIFICAND_MASK;
+    if (biased != 0) {
+        return DiyFp{significand + HIDDEN_BIT, biased - EXPONENT_BIAS};
+    }
+    return DiyFp{significand, 1 - EXPONENT_BIAS};
+}
+
+// The boundaries halfway to the neighbouring doubles, normalized to the same exponent
+void boundaries(const DiyFp &v, DiyFp &minus, DiyFp &plus)
+{
+    plus = normalize(DiyFp{(v.f << 1) + 1, v.e - 1});
+    minus = v.f == HIDDEN_BIT ? DiyFp{(v.f << 2) - 1, v.e - 2} : DiyFp{(v.f << 1) - 1, v.e - 1};
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+}
+
+// A cached power 10^-k that brings a number with binary exponent e into [2^-60, 2^-32) * 2^64
+DiyFp cachedPower(int e, int &k)
+{
+    double estimate = (-61 - e) * 0.30102999566398114 + 347;
+    int rounded = static_cast<int>(estimate);
+    if (estimate - rounded > 0.0) {
+        ++rounded;
+    }
+    unsigned index = static_cast<unsigned>((rounded >> 3) + 1);
+    k = -(-348 + static_cast<int>(index << 3));
+    return DiyFp{CACHED_SIGNIFICANDS[index], CACHED_EXPONENTS[index]};
+}
+
+// Moves the last digit towards the true value while the result stays within the boundaries
+void roundWeed(char *digits, int length, std::uint64_t delta, std::uint64_t rest, std::uint64_t ten_kappa,
+               std::uint64_t distance)
+{
+    while (rest < distance && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < distance || distance - rest > rest + ten_kappa - distance)) {
+        --digits[length - 1];
+        rest += ten_kappa;
+    }
+}
+
+int countDigits(std::uint32_t n)
+{
+    int count = 1;
+    while (count < 10 && n >= POWERS_OF_TEN[count]) {
+        ++count;
+    }
+    return count;
+}
+
+// Generates the digits of the number in (low, high), as few as the interval allows
+void generateDigits(const DiyFp &w, const DiyFp &high, std::uint64_t delta, char *digits, int &length, int &k)
+{
+    const DiyFp one{1ULL << -high.e, high.e};
+    const std::uint64_t distance = high.f - w.f;
+    std::uint32_t integral = static_cast<std::uint32_t>(high.f >> -one.e);
+    std::uint64_t fraction = high.f & (one.f - 1);
+    int kappa = countDigits(integral);
+    length = 0;
+
+    while (kappa > 0) {
+        std::uint32_t divisor = static_cast<std::uint32_t>(POWERS_OF_TEN[kappa - 1]);
+        std::uint32_t digit = integral / divisor;
+        integral %= divisor;
+        if (digit != 0 || length != 0) {
+            digits[length++] = static_cast<char>('0' + digit);
+        }
+        --kappa;
+        std::uint64_t rest = (static_cast<std::uint64_t>(integral) << -one.e) + fraction;
+        if (rest <= delta) {
+            k += kappa;
+            roundWeed(digits, length, delta, rest, POWERS_OF_TEN[kappa] << -one.e, distance);
+            return;
+        }
+    }
+    for (;;) {
+        fraction *= 10;
+        delta *= 10;
+        char digit = static_cast<char>(fraction >> -one.e);
+        if (digit != 0 || length != 0) {
+            digits[length++] = static_cast<char>('0' + digit);
+        }
+        fraction &= one.f - 1;
+        --kappa;
+        if (fraction < delta) {
+            k += kappa;
+            roundWeed(digits, length, delta, fraction, one.f, -kappa < 20 ? distance * POWERS_OF_TEN[-kappa] : 0);
+            return;
+        }
+    }
+}
+
+// The digits of a positive finite value and k such that value is about digits * 10^k
+void grisu2(double value, char *digits, int &length, int &k)
+{
+    DiyFp v = decompose(value);
+    DiyFp minus, plus;
+    boundaries(v, minus, plus);
+    DiyFp power = cachedPower(plus.e, k);
+    DiyFp w = multiply(normalize(v), power);
+    DiyFp high = multiply(plus, power);
+    DiyFp low = multiply(minus, power);
+    ++low.f;
+    --high.f;
+    generateDigits(w, high, high.f - low.f, digits, length, k);
+}
+
+std::atomic<NumberStyle> selected_style(NumberStyle::Shortest);
+
+char *writeExponent(int exponent, char *out)
+{
+    *out++ = 'e';
+    if (exponent < 0) {
+        *out++ = '-';
+        exponent = -exponent;
+    } else {
+        *out++ = '+';
+    }
+    if (exponent >= 100) {
+        *out++ = static_cast<char>('0' + exponent / 100);
+        exponent %= 100;
+        *out++ = static_cast<char>('0' + exponent / 10);
+    } else if (exponent >= 10) {
+        *out++ = static_cast<char>('0' + exponent / 10);
+    }
+    *out++ = static_cast<char>('0' + exponent % 10);
+    return out;
+}
+
+}
+
+/* Places the decimal point in the digits Grisu2 generates */
+char *formatNumber(double value, char *out)
+{
+    if (std::isnan(value)) {
+        std::memcpy(out, "nan", 3);
+        return out + 3;
+    }
+    if (std::signbit(value)) {
+        *out++ = '-';
+        value = -value;
+    }
+    if (std::isinf(value)) {
+        std::memcpy(out, "inf", 3);
+        return out + 3;
+    }
+    if (value == 0) {
+        *out++ = '0';
+        return out;
+    }
+
+    char digits[20];
+    int length, k;
+    grisu2(value, digits, length, k);
+    int point = length + k; // value is 0.digits * 10^point
+
+    if (length <= point && point <= 21) {
+        // an integer: the digits then zeros
+        std::memcpy(out, digits, length);
+        out += length;
+        std::memset(out, '0', point - length);
+        return out + (point - length);
+    }
+    if (0 < point && point <= 21) {
+        std::memcpy(out, digits, point);
+        out += point;
+        *out++ = '.';
+        std::memcpy(out, digits + point, length - point);
+        return out + (length - point);
+    }
+    if (-6 < point && point <= 0) {
+        *out++ = '0';
+        *out++ = '.';
+        std::memset(out, '0', -point);
+        out += -point;
+        std::memcpy(out, digits, length);
+        return out + length;
+    }
+    *out++ = digits[0];
+    if (length > 1) {
+        *out++ = '.';
+        std::memcpy(out, digits + 1, length - 1);
+        out += length - 1;
+    }
+    return writeExponent(point - 1, out);
+}
+
+void setNumberStyle(NumberStyle style) noexcept
+{
+    selected_style.store(style, std::memory_order_relaxed);
+}
+
+NumberStyle numberStyle() noexcept
+{
+    return selected_style.load(std::memory_order_relaxed);
+}
+
+/* The compatible style goes through printf's %g, which is what iostreams use */
+char *formatPrinted(double value, char *out)
+{
+    if (selected_style.load(std::memory_order_relaxed) == NumberStyle::Shortest) {
+        return formatNumber(value, out);
+    }
+    int length = std::snprintf(out, MAX_NUMBER_CHARS, "%g", value);
+    return out + length;
+}
@@ -0,0 +1,29 @@
+#ifndef NUMBER_FORMAT_HPP
+#define NUMBER_FORMAT_HPP
+
+#include <cstddef>
+
+// Most characters formatNumber writes
+const std::size_t MAX_NUMBER_CHARS = 32;
+
+// Writes the decimal text of value to out and returns the end of the text, which is not
+// terminated. The digits are found with Grisu2: they always read back as exactly value and
+// are the shortest that do for all but a few doubles. Integers print without a fraction
+// ("2"), values from 1e-6 up to 1e21 in plain notation ("0.001"), others with an exponent
+// ("1e+21"); -0 prints as "-0", non-finite values as "inf", "-inf" and "nan".
+char *formatNumber(double value, char *out);
+
+// How printed expressions write numbers
+enum class NumberStyle {
+    Shortest,  // as formatNumber writes them
+    Compatible // six significant digits, as iostreams print a double by default
+};
+
+// Selects the style for every thread; set it before evaluating anything. Shortest by default.
+void setNumberStyle(NumberStyle style) noexcept;
+NumberStyle numberStyle() noexcept;
+
+// Writes value in the selected style, like formatNumber
+char *formatPrinted(double value, char *out);
+
+#endif
@@ -37,23 +37,74 @@ void QtInterpreter::parseAndEvaluate(QString entry) {
     {
         out_stream << eval();
     }
+    catch (const InterpreterLimitError &e)
+    {
+        applyGraphicsEdits();
+        emit error(QString::fromStdString(e.what()));
+
+        return;
+    }
     catch (...)
     {
+        applyGraphicsEdits();
         emit error("Test");
 
         return;
     }
 
-    for (const auto& expr : graphics)
+    if (live())
     {
-        draw(expr);
+        applyGraphicsEdits();
+    }
+    else
+    {
+        for (const auto& expr : graphics)
+        {
+            draw(expr);
+        }
     }
 
     emit info(QString::fromStdString(out_stream.str()));
 }
 
+/* Scans only the new line, so pasting a long script costs time linear in its length */
+void QtInterpreter::evaluateLine(QString line) {
+    std::string text = line.toStdString();
+    text += '\n';
+    repl_input.append(text.data(), text.size());
+    const char* form;
+    std::size_t size;
+    while (repl_input.next(form, size)) {
+        parseAndEvaluate(QString::fromUtf8(form, static_cast<int>(size)));
+    }
+    emit continuing(repl_input.pending());
+}
+
+/* In live mode, removes the items of the graphics the last evaluation replaced and draws their replacements */
+void QtInterpreter::applyGraphicsEdits()
+{
+    if (!live())
+    {
+        return;
+    }
+    for (const GraphicsEdit& edit : graphics_edits())
+    {
+        for (std::size_t i = 0; i < edit.removed; ++i)
+        {
+            emit removeGraphic(items[edit.first + i]);
+        }
+        std::vector<QGraphicsItem*> drawn;
+        for (std::size_t i = 0; i < edit.inserted; ++i)
+        {
+            drawn.push_back(draw(graphics[edit.first + i]));
+        }
+        items.erase(items.begin() + edit.first, items.begin() + edit.first + edit.removed);
+        items.insert(items.begin() + edit.first, drawn.begin(), drawn.end());
+    }
+}
+
 /* Draw function that creates a QGraphicsItem based on the Expression given, and sends a signal to the canvas with this item */
-void QtInterpreter::draw(const Expression& expr)
+QGraphicsItem* QtInterpreter::draw(const Expression& expr)
 {
     QGraphicsItem* obj = nullptr;
     switch (expr.head.type)
@@ -132,39 +183,5 @@ void QtInterpreter::draw(const Expression& expr)
 
 
     emit drawGraphic(obj);
+    return obj;
 }
-
-/* Overloaded eval_misc function to handle draw */
-Expression QtInterpreter::eval_misc(const Expression& expr)
-{
-    graphics.empty();
-    if (expr.head.type == SymbolType)
-    {
-        std::string op = expr.head.value.sym_value;
-        const std::vector<Expression>& tail = expr.tail;
-
-        if (op == "draw")
-        {
-            if (tail.empty())
-            {
-                throw InterpreterSemanticError("Draw expects at least one expression");
-            }
-
-            for (const auto &sub_expr : tail)
-            {
-                Expression elem = eval_expression(sub_expr);
-                graphics.push_back(elem);
-                //draw(elem);
-            }
-        }
-        else
-        {
-            throw InterpreterSemanticError("Unknown symbol: " + expr.head.value.sym_value);
-        }
-    }
-    else
-    {
-        throw InterpreterSemanticError("Unknown symbol: " + expr.head.value.sym_value);
-    }
-    return Expression();
-}
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define QT_INTERPRETER_HPP
 
 #include <string>
+#include <vector>
 
 #include <QObject>
 #include <QString>
@@ -9,6 +10,7 @@
 
 
 #include "interpreter.hpp"
+#include "form_scanner.hpp"
 
 class QtInterpreter : public QObject, private Interpreter {
 Q_OBJECT
@@ -16,22 +18,43 @@ Q_OBJECT
 public:
 
     QtInterpreter(QObject *parent = nullptr);
+
+    using Interpreter::set_limits;
+    using Interpreter::cancel;
+    using Interpreter::set_threads;
+    using Interpreter::set_math_mode;
+    using Interpreter::set_live;
+    using Interpreter::set_result_cache;
+    using Interpreter::set_prelude;
 private:
-    Expression eval_misc(const Expression& expr) override;
+    // Items drawn for graphics, index for index, kept in live mode to remove replaced graphics
+    std::vector<QGraphicsItem*> items;
+
+    // Lines entered so far, split into forms as they close
+    FormScanner repl_input;
 
-    void draw(const Expression& expr);
+    QGraphicsItem* draw(const Expression& expr);
+    void applyGraphicsEdits();
 signals:
 
     void drawGraphic(QGraphicsItem *item);
 
+    void removeGraphic(QGraphicsItem *item);
+
     void info(QString message);
 
     void error(QString message);
 
+    // Whether the lines entered so far end inside an unfinished form
+    void continuing(bool pending);
+
 
 public slots:
 
     void parseAndEvaluate(QString entry);
+
+    // Adds a line typed into the REPL, evaluating each form it closes
+    void evaluateLine(QString line);
 };
 
 #endif
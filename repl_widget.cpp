@@ -34,3 +34,8 @@ void REPLWidget::changed() {
     emit lineEntered(userEntry->text());
     userEntry->clear();
 }
+
+/* Switches the prompt between a new form and the rest of an open one */
+void REPLWidget::setContinuing(bool pending) {
+    userTitle->setText(pending ? "...>" : "slisp>");
+}
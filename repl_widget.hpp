@@ -19,6 +19,11 @@ signals:
 
     void lineEntered(QString entry);
 
+public slots:
+
+    // Shows the continuation prompt while a form spans lines
+    void setContinuing(bool pending);
+
 private slots:
     void changed();
 };
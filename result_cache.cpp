@@ -0,0 +1,613 @@
+#include "result_cache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+namespace {
+
+// Start of every entry file; bump the digit when the format or the meaning of keys changes
+const char MAGIC[] = {'S', 'L', 'C', '2'};
+
+const char *const ENTRY_SUFFIX = ".slc";
+
+// Numbers the temporary files of this process, so threads storing the same key concurrently
+// each write a file of their own
+std::atomic<std::uint64_t> temporary_files(0);
+
+// Values are stored in the host's byte order: the cache is local to one machine
+template <typename T>
+void putRaw(std::string &out, const T &value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool getRaw(const char *&pos, const char *end, T &value)
+{
+    if (static_cast<std::size_t>(end - pos) < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&value, pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+void putString(std::string &out, const std::string &text)
+{
+    putRaw(out, static_cast<std::uint64_t>(text.size()));
+    out += text;
+}
+
+bool getString(const char *&pos, const char *end, std::string &text)
+{
+    std::uint64_t size;
+    if (!getRaw(pos, end, size) || size > static_cast<std::uint64_t>(end - pos)) {
+        return false;
+    }
+    text.assign(pos, static_cast<std::size_t>(size));
+    pos += size;
+    return true;
+}
+
+void putPoint(std::string &out, const Point &point)
+{
+    putRaw(out, point.x);
+    putRaw(out, point.y);
+}
+
+bool getPoint(const char *&pos, const char *end, Point &point)
+{
+    return getRaw(pos, end, point.x) && getRaw(pos, end, point.y);
+}
+
+void putRect(std::string &out, const Rect &rect)
+{
+    putRaw(out, rect.x1);
+    putRaw(out, rect.y1);
+    putRaw(out, rect.x2);
+    putRaw(out, rect.y2);
+}
+
+bool getRect(const char *&pos, const char *end, Rect &rect)
+{
+    return getRaw(pos, end, rect.x1) && getRaw(pos, end, rect.y1) && getRaw(pos, end, rect.x2) &&
+           getRaw(pos, end, rect.y2);
+}
+
+// How a list's elements follow its count
+enum ListLayout : char {
+    ItemLayout = 0,   // each element encoded in turn
+    NumberLayout = 1, // the numbers, packed
+    ShapeLayout = 2   // the shape type, then each of its fields for every element in turn
+};
+
+// Number of fields a shape of type has, 0 if type is not a shape
+std::size_t shapeWidth(Type type)
+{
+    switch (type) {
+        case PointType:
+            return 2;
+        case LineType:
+        case RectType:
+        case EllipseType:
+            return 4;
+        case ArcType:
+            return 5;
+        case FillRectType:
+            return 7;
+        default:
+            return 0;
+    }
+}
+
+// Copies the fields of a shape to fields; the number of fields, 0 if value is not a shape
+std::size_t shapeFields(const Atom &value, Number *fields)
+{
+    const Value &v = value.value;
+    switch (value.type) {
+        case PointType:
+            fields[0] = v.point_value.x;
+            fields[1] = v.point_value.y;
+            return 2;
+        case LineType:
+            fields[0] = v.line_value.first.x;
+            fields[1] = v.line_value.first.y;
+            fields[2] = v.line_value.second.x;
+            fields[3] = v.line_value.second.y;
+            return 4;
+        case ArcType:
+            fields[0] = v.arc_value.center.x;
+            fields[1] = v.arc_value.center.y;
+            fields[2] = v.arc_value.start.x;
+            fields[3] = v.arc_value.start.y;
+            fields[4] = v.arc_value.span;
+            return 5;
+        case RectType:
+        case EllipseType: {
+            const Rect &rect = value.type == RectType ? v.rect_value : v.ellipse_value.rect;
+            fields[0] = rect.x1;
+            fields[1] = rect.y1;
+            fields[2] = rect.x2;
+            fields[3] = rect.y2;
+            return 4;
+        }
+        case FillRectType:
+            fields[0] = v.fillRect_value.rect.x1;
+            fields[1] = v.fillRect_value.rect.y1;
+            fields[2] = v.fillRect_value.rect.x2;
+            fields[3] = v.fillRect_value.rect.y2;
+            fields[4] = v.fillRect_value.r;
+            fields[5] = v.fillRect_value.g;
+            fields[6] = v.fillRect_value.b;
+            return 7;
+        default:
+            return 0;
+    }
+}
+
+// Sets the fields of a shape of value's type from fields, as shapeFields reads them
+void setShapeFields(Atom &value, const Number *fields)
+{
+    Value &v = value.value;
+    switch (value.type) {
+        case PointType:
+            v.point_value = Point{fields[0], fields[1]};
+            break;
+        case LineType:
+            v.line_value.first = Point{fields[0], fields[1]};
+            v.line_value.second = Point{fields[2], fields[3]};
+            break;
+        case ArcType:
+            v.arc_value.center = Point{fields[0], fields[1]};
+            v.arc_value.start = Point{fields[2], fields[3]};
+            v.arc_value.span = fields[4];
+            break;
+        case RectType:
+        case EllipseType: {
+            Rect &rect = value.type == RectType ? v.rect_value : v.ellipse_value.rect;
+            rect.x1 = fields[0];
+            rect.y1 = fields[1];
+            rect.x2 = fields[2];
+            rect.y2 = fields[3];
+            break;
+        }
+        case FillRectType:
+            v.fillRect_value.rect.x1 = fields[0];
+            v.fillRect_value.rect.y1 = fields[1];
+            v.fillRect_value.rect.x2 = fields[2];
+            v.fillRect_value.rect.y2 = fields[3];
+            v.fillRect_value.r = fields[4];
+            v.fillRect_value.g = fields[5];
+            v.fillRect_value.b = fields[6];
+            break;
+        default:
+            break;
+    }
+}
+
+// Most fields of any shape
+const std::size_t MAX_SHAPE_FIELDS = 7;
+
+// Whether every element of a non-numeric list is a shape of one type
+bool isShapeList(const List &list)
+{
+    if (list.items.empty() || shapeWidth(list.items.front().type) == 0) {
+        return false;
+    }
+    for (const auto &item : list.items) {
+        if (item.type != list.items.front().type) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads a file whole; false if it cannot be read
+bool readFile(const std::string &path, std::string &contents)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return !file.bad();
+}
+
+// Creates directory and any missing parents
+bool makeDirectories(const std::string &directory)
+{
+    for (std::size_t slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1)) {
+        std::string prefix = directory.substr(0, slash);
+        if (!prefix.empty() && mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        if (slash == std::string::npos) {
+            return true;
+        }
+    }
+}
+
+}
+
+/* Encodes value as its type followed by its fields. A list of shapes of one type is stored
+   column by column, so a reader can take each field of every shape as an array. */
+bool encodeAtom(const Atom &value, std::string &out)
+{
+    out += static_cast<char>(value.type);
+    switch (value.type) {
+        case NoneType:
+            return true;
+        case BooleanType:
+            out += static_cast<char>(value.value.bool_value ? 1 : 0);
+            return true;
+        case NumberType:
+            putRaw(out, value.value.num_value);
+            return true;
+        case SymbolType:
+            putString(out, value.value.sym_value);
+            return true;
+        case PointType:
+            putPoint(out, value.value.point_value);
+            return true;
+        case LineType:
+            putPoint(out, value.value.line_value.first);
+            putPoint(out, value.value.line_value.second);
+            return true;
+        case ArcType:
+            putPoint(out, value.value.arc_value.center);
+            putPoint(out, value.value.arc_value.start);
+            putRaw(out, value.value.arc_value.span);
+            return true;
+        case RectType:
+            putRect(out, value.value.rect_value);
+            return true;
+        case FillRectType:
+            putRect(out, value.value.fillRect_value.rect);
+            putRaw(out, value.value.fillRect_value.r);
+            putRaw(out, value.value.fillRect_value.g);
+            putRaw(out, value.value.fillRect_value.b);
+            return true;
+        case EllipseType:
+            putRect(out, value.value.ellipse_value.rect);
+            return true;
+        case ListType: {
+            const List &list = *value.value.list_value;
+            if (list.numeric) {
+                out += static_cast<char>(NumberLayout);
+                putRaw(out, static_cast<std::uint64_t>(list.size()));
+                out.append(reinterpret_cast<const char *>(list.numbers.data()), list.numbers.size() * sizeof(Number));
+                return true;
+            }
+            if (isShapeList(list)) {
+                out += static_cast<char>(ShapeLayout);
+                putRaw(out, static_cast<std::uint64_t>(list.size()));
+                out += static_cast<char>(list.items.front().type);
+                Number fields[MAX_SHAPE_FIELDS];
+                std::size_t width = shapeWidth(list.items.front().type);
+                std::size_t column_bytes = list.size() * sizeof(Number);
+                std::size_t start = out.size();
+                out.resize(start + width * column_bytes);
+                char *columns = &out[start];
+                for (std::size_t i = 0; i < list.size(); ++i) {
+                    shapeFields(list.items[i], fields);
+                    for (std::size_t field = 0; field < width; ++field) {
+                        std::memcpy(columns + field * column_bytes + i * sizeof(Number), &fields[field], sizeof(Number));
+                    }
+                }
+                return true;
+            }
+            out += static_cast<char>(ItemLayout);
+            putRaw(out, static_cast<std::uint64_t>(list.size()));
+            for (const auto &item : list.items) {
+                if (!encodeAtom(item, out)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+/* Decodes what encodeAtom wrote */
+bool decodeAtom(const char *&pos, const char *end, Atom &value)
+{
+    if (pos == end) {
+        return false;
+    }
+    value = Atom();
+    value.type = static_cast<Type>(static_cast<unsigned char>(*pos++));
+    switch (value.type) {
+        case NoneType:
+            return true;
+        case BooleanType:
+            if (pos == end) {
+                return false;
+            }
+            value.value.bool_value = *pos++ != 0;
+            return true;
+        case NumberType:
+            return getRaw(pos, end, value.value.num_value);
+        case SymbolType:
+            return getString(pos, end, value.value.sym_value);
+        case PointType:
+            return getPoint(pos, end, value.value.point_value);
+        case LineType:
+            return getPoint(pos, end, value.value.line_value.first) && getPoint(pos, end, value.value.line_value.second);
+        case ArcType:
+            return getPoint(pos, end, value.value.arc_value.center) && getPoint(pos, end, value.value.arc_value.start) &&
+                   getRaw(pos, end, value.value.arc_value.span);
+        case RectType:
+            return getRect(pos, end, value.value.rect_value);
+        case FillRectType:
+            return getRect(pos, end, value.value.fillRect_value.rect) && getRaw(pos, end, value.value.fillRect_value.r) &&
+                   getRaw(pos, end, value.value.fillRect_value.g) && getRaw(pos, end, value.value.fillRect_value.b);
+        case EllipseType:
+            return getRect(pos, end, value.value.ellipse_value.rect);
+        case ListType: {
+            std::uint64_t count;
+            if (pos == end) {
+                return false;
+            }
+            char layout = *pos++;
+            if (!getRaw(pos, end, count) || count > static_cast<std::uint64_t>(end - pos)) {
+                return false;
+            }
+            std::shared_ptr<List> list = std::make_shared<List>();
+            list->numeric = layout == NumberLayout;
+            if (layout == ShapeLayout) {
+                Atom shape;
+                Number fields[MAX_SHAPE_FIELDS];
+                if (pos == end) {
+                    return false;
+                }
+                shape.type = static_cast<Type>(static_cast<unsigned char>(*pos++));
+                std::size_t width = shapeWidth(shape.type);
+                std::uint64_t column_bytes = count * sizeof(Number);
+                if (width == 0 || count == 0 || width * column_bytes > static_cast<std::uint64_t>(end - pos)) {
+                    return false;
+                }
+                list->items.resize(static_cast<std::size_t>(count), shape);
+                for (std::size_t i = 0; i < list->items.size(); ++i) {
+                    for (std::size_t field = 0; field < width; ++field) {
+                        std::memcpy(&fields[field], pos + field * column_bytes + i * sizeof(Number), sizeof(Number));
+                    }
+                    setShapeFields(list->items[i], fields);
+                }
+                pos += width * column_bytes;
+            } else if (layout == NumberLayout) {
+                if (count * sizeof(Number) > static_cast<std::uint64_t>(end - pos)) {
+                    return false;
+                }
+                list->numbers.resize(static_cast<std::size_t>(count));
+                std::memcpy(list->numbers.data(), pos, list->numbers.size() * sizeof(Number));
+                pos += list->numbers.size() * sizeof(Number);
+            } else if (layout == ItemLayout) {
+                list->items.resize(static_cast<std::size_t>(count));
+                for (auto &item : list->items) {
+                    if (!decodeAtom(pos, end, item)) {
+                        return false;
+                    }
+                }
+            } else {
+                return false;
+            }
+            value.value.list_value = list;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+/* FNV-1a over the bytes */
+std::uint64_t hashBytes(const std::string &bytes)
+{
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : bytes) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Indexes the entries in directory, oldest use first */
+ResultCache::ResultCache(const std::string &directory, std::uint64_t max_bytes, std::size_t max_entries)
+    : dir(directory), max_bytes(max_bytes), max_entries(max_entries)
+{
+    if (!makeDirectories(dir)) {
+        return;
+    }
+    DIR *listing = opendir(dir.c_str());
+    if (!listing) {
+        return;
+    }
+    std::vector<std::pair<long long, std::pair<std::uint64_t, std::uint64_t>>> found; // mtime, hash, size
+    while (dirent *item = readdir(listing)) {
+        std::string name = item->d_name;
+        std::size_t suffix = std::strlen(ENTRY_SUFFIX);
+        if (name.size() != 16 + suffix || name.compare(16, suffix, ENTRY_SUFFIX) != 0 ||
+            name.find_first_not_of("0123456789abcdef") != 16) {
+            continue;
+        }
+        struct stat info;
+        if (stat((dir + "/" + name).c_str(), &info) == 0) {
+            std::uint64_t hash = std::strtoull(name.substr(0, 16).c_str(), nullptr, 16);
+            found.emplace_back(static_cast<long long>(info.st_mtime),
+                               std::make_pair(hash, static_cast<std::uint64_t>(info.st_size)));
+        }
+    }
+    closedir(listing);
+
+    std::sort(found.begin(), found.end());
+    for (const auto &file : found) {
+        entries[file.second.first] = Entry{file.second.second, ++clock};
+        total_bytes += file.second.second;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    evict();
+}
+
+std::string ResultCache::path(std::uint64_t hash) const
+{
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return dir + "/" + name + ENTRY_SUFFIX;
+}
+
+/* Looks the key up on disk, where another process may have stored it since the index was built */
+bool ResultCache::find(const std::string &key, CachedForm &form)
+{
+    std::uint64_t hash = hashBytes(key);
+    std::string file_path = path(hash);
+    std::string contents;
+    bool loaded = readFile(file_path, contents);
+
+    const char *pos = contents.data();
+    const char *end = pos + contents.size();
+    std::string stored_key;
+    std::uint64_t define_count = 0;
+    std::uint64_t graphic_count = 0;
+    bool valid = loaded && contents.size() >= sizeof(MAGIC) && std::memcmp(pos, MAGIC, sizeof(MAGIC)) == 0;
+    if (valid) {
+        pos += sizeof(MAGIC);
+        valid = getString(pos, end, stored_key) && stored_key == key && getRaw(pos, end, define_count) &&
+                define_count <= static_cast<std::uint64_t>(end - pos);
+    }
+    form.defines.clear();
+    for (std::uint64_t i = 0; valid && i < define_count; ++i) {
+        Symbol name;
+        Atom value;
+        valid = getString(pos, end, name) && decodeAtom(pos, end, value);
+        form.defines.emplace_back(name, Expression(value));
+    }
+    Atom result;
+    valid = valid && decodeAtom(pos, end, result) && getRaw(pos, end, graphic_count) &&
+            graphic_count <= static_cast<std::uint64_t>(end - pos);
+    form.result = Expression(result);
+    form.graphics.clear();
+    if (valid) {
+        form.graphics.reserve(static_cast<std::size_t>(graphic_count));
+    }
+    for (std::uint64_t i = 0; valid && i < graphic_count; ++i) {
+        Atom shape;
+        valid = decodeAtom(pos, end, shape);
+        form.graphics.emplace_back(shape);
+    }
+    valid = valid && pos == end;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!valid) {
+        ++counters.misses;
+        return false;
+    }
+    ++counters.hits;
+    Entry &entry = entries[hash];
+    if (entry.bytes == 0) {
+        entry.bytes = contents.size();
+        total_bytes += contents.size();
+    }
+    entry.last_used = ++clock;
+    utime(file_path.c_str(), nullptr); // other processes evict by modification time
+    return true;
+}
+
+/* Writes the entry to a temporary file first, so readers never see it half written */
+void ResultCache::insert(const std::string &key, const CachedForm &form)
+{
+    std::string contents(MAGIC, sizeof(MAGIC));
+    putString(contents, key);
+    putRaw(contents, static_cast<std::uint64_t>(form.defines.size()));
+    bool encodable = true;
+    for (const auto &binding : form.defines) {
+        putString(contents, binding.first);
+        encodable = encodable && encodeAtom(binding.second.head, contents);
+    }
+    encodable = encodable && encodeAtom(form.result.head, contents);
+    putRaw(contents, static_cast<std::uint64_t>(form.graphics.size()));
+    for (const auto &shape : form.graphics) {
+        encodable = encodable && encodeAtom(shape.head, contents);
+    }
+    if (!encodable || contents.size() > max_bytes) {
+        return;
+    }
+
+    std::uint64_t hash = hashBytes(key);
+    std::string file_path = path(hash);
+    std::string temporary = file_path + ".tmp" + std::to_string(getpid()) + "." + std::to_string(++temporary_files);
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.write(contents.data(), contents.size())) {
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    if (std::rename(temporary.c_str(), file_path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto existing = entries.find(hash);
+    if (existing != entries.end()) {
+        total_bytes -= existing->second.bytes;
+    }
+    entries[hash] = Entry{contents.size(), ++clock};
+    total_bytes += contents.size();
+    ++counters.stores;
+    evict();
+}
+
+void ResultCache::evict()
+{
+    while (!entries.empty() && (total_bytes > max_bytes || entries.size() > max_entries)) {
+        auto oldest = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->second.last_used < oldest->second.last_used) {
+                oldest = it;
+            }
+        }
+        std::remove(path(oldest->first).c_str());
+        total_bytes -= oldest->second.bytes;
+        entries.erase(oldest);
+        ++counters.evictions;
+    }
+}
+
+ResultCacheStats ResultCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ResultCacheStats result = counters;
+    result.entries = entries.size();
+    result.bytes = total_bytes;
+    return result;
+}
+
+const std::string &ResultCache::directory() const noexcept
+{
+    return dir;
+}
+
+/* The per-user cache directory, following the XDG base directory convention */
+std::string ResultCache::default_directory()
+{
+    if (const char *configured = std::getenv("SLISP_CACHE_DIR")) {
+        return configured;
+    }
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME")) {
+        return std::string(xdg) + "/slisp";
+    }
+    const char *home = std::getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/.cache/slisp";
+}
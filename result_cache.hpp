@@ -0,0 +1,95 @@
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include "expression.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// What evaluating a top-level form did: the globals it defined, its value and the graphics it drew
+struct CachedForm {
+    std::vector<std::pair<Symbol, Expression>> defines;
+    Expression result;
+    std::vector<Expression> graphics;
+};
+
+// Counters of a ResultCache
+struct ResultCacheStats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t stores = 0;
+    std::uint64_t evictions = 0;
+    std::size_t entries = 0;
+    std::uint64_t bytes = 0;
+};
+
+// Results of top-level forms persisted in a directory, one file per form, shared by every
+// interpreter that holds the cache and by every process using the same directory.
+// Entries are keyed on a byte string naming the form and everything its value depends on
+// (see Interpreter::set_result_cache); each file keeps its full key, so a hash collision
+// is a miss. When over either cap the least recently used entries are deleted, recency
+// being tracked across processes through the files' modification times. Disk errors are
+// never reported: a cache that cannot read or write just misses.
+class ResultCache {
+public:
+    static const std::uint64_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024;
+    static const std::size_t DEFAULT_MAX_ENTRIES = 4096;
+
+    // Opens the cache in directory, creating it if needed and indexing the entries already there
+    explicit ResultCache(const std::string &directory, std::uint64_t max_bytes = DEFAULT_MAX_BYTES,
+                         std::size_t max_entries = DEFAULT_MAX_ENTRIES);
+
+    // Loads the entry stored under key into form; false on a miss
+    bool find(const std::string &key, CachedForm &form);
+
+    // Stores form under key, evicting entries over the caps; forms holding procedures are not stored
+    void insert(const std::string &key, const CachedForm &form);
+
+    // Hit, miss, store and eviction counts of this process, and the entries indexed
+    ResultCacheStats stats() const;
+
+    // The directory entries are kept in
+    const std::string &directory() const noexcept;
+
+    // $SLISP_CACHE_DIR if set, else slisp under $XDG_CACHE_HOME or ~/.cache
+    static std::string default_directory();
+
+private:
+    struct Entry {
+        std::uint64_t bytes;
+        std::uint64_t last_used;
+    };
+
+    std::string dir;
+    std::uint64_t max_bytes;
+    std::size_t max_entries;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::uint64_t, Entry> entries; // by hash of the key
+    std::uint64_t total_bytes = 0;
+    std::uint64_t clock = 0; // last_used of the most recent use
+    ResultCacheStats counters;
+
+    // File holding the entry for a key hash
+    std::string path(std::uint64_t hash) const;
+
+    // Deletes least recently used entries until both caps hold
+    void evict();
+};
+
+// Appends a self-delimiting binary encoding of value to out, in the host's byte order; false
+// if value is or holds a procedure, which cannot be encoded. Numbers are raw doubles; a list
+// of numbers is one packed array and a list of shapes of one type one array per field.
+bool encodeAtom(const Atom &value, std::string &out);
+
+// Decodes an Atom written by encodeAtom at pos, advancing pos; false if the bytes are malformed
+bool decodeAtom(const char *&pos, const char *end, Atom &value);
+
+// 64-bit FNV-1a hash of bytes
+std::uint64_t hashBytes(const std::string &bytes);
+
+#endif
@@ -0,0 +1,175 @@
+#include "result_writer.hpp"
+#include "number_format.hpp"
+#include "result_cache.hpp"
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+
+namespace {
+
+void appendNumber(Number value, std::string &out)
+{
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    char text[MAX_NUMBER_CHARS];
+    out.append(text, formatNumber(value, text));
+}
+
+void appendString(const std::string &text, std::string &out)
+{
+    static const char HEX[] = "0123456789abcdef";
+    out += '"';
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (byte < 0x20) {
+            out += "\\u00";
+            out += HEX[byte >> 4];
+            out += HEX[byte & 0xF];
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// Appends {"name":[fields...]}
+void appendShape(const char *name, std::initializer_list<Number> fields, std::string &out)
+{
+    out += "{\"";
+    out += name;
+    out += "\":[";
+    bool first = true;
+    for (Number field : fields) {
+        if (!first) {
+            out += ',';
+        }
+        first = false;
+        appendNumber(field, out);
+    }
+    out += "]}";
+}
+
+// Starts a binary record, leaving room for its length
+std::size_t startRecord(std::string &out, char status)
+{
+    std::size_t start = out.size();
+    out.append(4, '\0');
+    out += status;
+    return start;
+}
+
+// Writes the length of the record that starts at start
+void sealRecord(std::string &out, std::size_t start)
+{
+    std::uint32_t size = static_cast<std::uint32_t>(out.size() - start - 4);
+    for (int i = 0; i < 4; ++i) {
+        out[start + i] = static_cast<char>((size >> (8 * i)) & 0xFF);
+    }
+}
+
+}
+
+/* Writes lists as arrays of their elements */
+void appendJson(const Atom &value, std::string &out)
+{
+    const Value &v = value.value;
+    switch (value.type) {
+        case NoneType:
+            out += "null";
+            break;
+        case BooleanType:
+            out += v.bool_value ? "true" : "false";
+            break;
+        case NumberType:
+            appendNumber(v.num_value, out);
+            break;
+        case SymbolType:
+            appendString(v.sym_value, out);
+            break;
+        case ListType: {
+            const List &list = *v.list_value;
+            out += '[';
+            for (std::size_t i = 0; i < list.size(); ++i) {
+                if (i != 0) {
+                    out += ',';
+                }
+                if (list.numeric) {
+                    appendNumber(list.numbers[i], out);
+                } else {
+                    appendJson(list.items[i], out);
+                }
+            }
+            out += ']';
+            break;
+        }
+        case PointType:
+            appendShape("point", {v.point_value.x, v.point_value.y}, out);
+            break;
+        case LineType:
+            appendShape("line", {v.line_value.first.x, v.line_value.first.y, v.line_value.second.x,
+                                 v.line_value.second.y}, out);
+            break;
+        case ArcType:
+            appendShape("arc", {v.arc_value.center.x, v.arc_value.center.y, v.arc_value.start.x, v.arc_value.start.y,
+                                v.arc_value.span}, out);
+            break;
+        case RectType:
+            appendShape("rect", {v.rect_value.x1, v.rect_value.y1, v.rect_value.x2, v.rect_value.y2}, out);
+            break;
+        case FillRectType:
+            appendShape("fill_rect", {v.fillRect_value.rect.x1, v.fillRect_value.rect.y1, v.fillRect_value.rect.x2,
+                                      v.fillRect_value.rect.y2, v.fillRect_value.r, v.fillRect_value.g,
+                                      v.fillRect_value.b}, out);
+            break;
+        case EllipseType:
+            appendShape("ellipse", {v.ellipse_value.rect.x1, v.ellipse_value.rect.y1, v.ellipse_value.rect.x2,
+                                    v.ellipse_value.rect.y2}, out);
+            break;
+        default:
+            out += "{\"lambda\":null}";
+            break;
+    }
+}
+
+/* A result that has no binary encoding becomes an error record */
+void appendResult(OutputFormat format, const Expression &result, std::string &out)
+{
+    if (format == OutputFormat::Ndjson) {
+        out += "{\"value\":";
+        appendJson(result.head, out);
+        out += "}\n";
+    } else if (format == OutputFormat::Binary) {
+        std::size_t start = startRecord(out, 'O');
+        if (!encodeAtom(result.head, out)) {
+            out.resize(start);
+            appendError(format, "A procedure has no binary encoding", out);
+            return;
+        }
+        sealRecord(out, start);
+    } else {
+        appendExpression(result, out);
+        out += '\n';
+    }
+}
+
+void appendError(OutputFormat format, const std::string &message, std::string &out)
+{
+    if (format == OutputFormat::Ndjson) {
+        out += "{\"error\":";
+        appendString(message, out);
+        out += "}\n";
+    } else if (format == OutputFormat::Binary) {
+        std::size_t start = startRecord(out, 'E');
+        out += message;
+        sealRecord(out, start);
+    } else {
+        out += "Error: ";
+        out += message;
+        out += '\n';
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef RESULT_WRITER_HPP
+#define RESULT_WRITER_HPP
+
+#include "expression.hpp"
+#include <string>
+
+// How slisp writes each result
+enum class OutputFormat {
+    Text,   // a line as operator<< prints the value, or "Error: message"
+    Ndjson, // a line holding {"value":...} or {"error":"message"}
+    Binary  // a record framed like a --serve reply: the value as encodeAtom writes it, or the message
+};
+
+// Appends value to out as JSON. Numbers are written with formatNumber, non-finite ones as
+// null; symbols are strings; a shape is an object naming its type, with its fields in an
+// array: {"point":[x,y]}, {"line":[x1,y1,x2,y2]}, {"arc":[cx,cy,sx,sy,span]},
+// {"rect":[x1,y1,x2,y2]}, {"fill_rect":[x1,y1,x2,y2,r,g,b]}, {"ellipse":[x1,y1,x2,y2]};
+// a procedure is {"lambda":null}.
+void appendJson(const Atom &value, std::string &out);
+
+// Appends the record of a result to out
+void appendResult(OutputFormat format, const Expression &result, std::string &out);
+
+// Appends the record of an error to out
+void appendError(OutputFormat format, const std::string &message, std::string &out);
+
+#endif
@@ -2,10 +2,14 @@ import pexpect
 import pexpect.replwrap as replwrap
 import unittest
 import os
+import tempfile
 	
 # the slisp executable
 cmd = './slisp'
 
+# keep the result cache of the slisp under test out of the user's own
+os.environ.setdefault('SLISP_CACHE_DIR', tempfile.mkdtemp(prefix='slisp-cache-'))
+
 # the prompt to expect
 prompt = u'slisp>'
 
@@ -0,0 +1,539 @@
+#include "server.hpp"
+#include "interpreter_semantic_error.hpp"
+#include "result_cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Served interpreters forget what programs draw after each request, as replies carry only
+// values; live mode keeps its graphics, which it edits by position
+class ServedInterpreter : public Interpreter {
+public:
+    void forget_graphics()
+    {
+        if (!live()) {
+            graphics.clear();
+        }
+    }
+};
+
+namespace {
+
+const std::size_t FRAME_HEADER_BYTES = 4;
+const std::size_t READ_CHUNK_BYTES = 64 * 1024;
+
+void putLength(std::string &out, std::size_t at, std::uint32_t length)
+{
+    for (int i = 0; i < 4; ++i) {
+        out[at + i] = static_cast<char>((length >> (8 * i)) & 0xff);
+    }
+}
+
+std::uint32_t getLength(const char *bytes, int width)
+{
+    std::uint32_t length = 0;
+    for (int i = 0; i < width; ++i) {
+        length |= static_cast<std::uint32_t>(static_cast<unsigned char>(bytes[i])) << (8 * i);
+    }
+    return length;
+}
+
+// A frame holding the bytes appended to it after construction; finished by sealFrame
+std::string startFrame()
+{
+    return std::string(FRAME_HEADER_BYTES, '\0');
+}
+
+std::string &sealFrame(std::string &frame)
+{
+    putLength(frame, 0, static_cast<std::uint32_t>(frame.size() - FRAME_HEADER_BYTES));
+    return frame;
+}
+
+std::string errorReply(const std::string &message)
+{
+    std::string frame = startFrame();
+    frame += 'E';
+    frame += message;
+    return sealFrame(frame);
+}
+
+bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Fills address for path; false with errno set if path does not fit
+bool socketAddress(const std::string &path, sockaddr_un &address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+}
+
+/* Frames a request */
+std::string encodeRequest(const Request &request)
+{
+    std::string frame = startFrame();
+    frame += static_cast<char>(request.kind);
+    frame += static_cast<char>(request.format);
+    std::size_t id_length = std::min<std::size_t>(request.session.size(), 0xffff);
+    frame += static_cast<char>(id_length & 0xff);
+    frame += static_cast<char>(id_length >> 8);
+    frame.append(request.session, 0, id_length);
+    frame += request.body;
+    return sealFrame(frame);
+}
+
+/* Reads a request from a frame's payload; false if it is malformed */
+bool decodeRequest(const std::string &payload, Request &request)
+{
+    if (payload.size() < 4) {
+        return false;
+    }
+    char kind = payload[0];
+    char format = payload[1];
+    if (kind != 'E' && kind != 'F' && kind != 'R' && kind != 'D') {
+        return false;
+    }
+    if (format != 'T' && format != 'B') {
+        return false;
+    }
+    std::size_t id_length = getLength(payload.data() + 2, 2);
+    if (payload.size() < 4 + id_length) {
+        return false;
+    }
+    request.kind = static_cast<RequestKind>(kind);
+    request.format = static_cast<ReplyFormat>(format);
+    request.session.assign(payload, 4, id_length);
+    request.body.assign(payload, 4 + id_length, std::string::npos);
+    return true;
+}
+
+/* Frames a reply */
+std::string encodeReply(const Reply &reply)
+{
+    std::string frame = startFrame();
+    frame += reply.ok ? 'O' : 'E';
+    frame += reply.body;
+    return sealFrame(frame);
+}
+
+/* Reads a reply from a frame's payload; false if it is malformed */
+bool decodeReply(const std::string &payload, Reply &reply)
+{
+    if (payload.empty() || (payload[0] != 'O' && payload[0] != 'E')) {
+        return false;
+    }
+    reply.ok = payload[0] == 'O';
+    reply.body.assign(payload, 1, std::string::npos);
+    return true;
+}
+
+/* Connects to a server's socket */
+int connectServer(const std::string &socket_path)
+{
+    sockaddr_un address;
+    if (!socketAddress(socket_path, address)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+/* Reads one frame, blocking */
+bool readFrame(int fd, std::string &payload)
+{
+    char header[FRAME_HEADER_BYTES];
+    std::size_t got = 0;
+    while (got < FRAME_HEADER_BYTES) {
+        ssize_t n = read(fd, header + got, FRAME_HEADER_BYTES - got);
+        if (n <= 0 && !(n < 0 && errno == EINTR)) {
+            return false;
+        }
+        got += n > 0 ? n : 0;
+    }
+    payload.resize(getLength(header, 4));
+    got = 0;
+    while (got < payload.size()) {
+        ssize_t n = read(fd, &payload[got], payload.size() - got);
+        if (n <= 0 && !(n < 0 && errno == EINTR)) {
+            return false;
+        }
+        got += n > 0 ? n : 0;
+    }
+    return true;
+}
+
+/* Writes every byte, blocking */
+bool writeAll(int fd, const std::string &bytes)
+{
+    std::size_t sent = 0;
+    while (sent < bytes.size()) {
+        ssize_t n = send(fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+Server::Server(const std::string &socket_path, std::size_t threads, std::function<void(Interpreter &)> configure)
+    : path(socket_path), thread_count(threads), configure(std::move(configure)), stop_requested(false)
+{
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+Server::~Server()
+{
+    shut_down();
+}
+
+/* Binds and listens on the socket, replacing a socket left by an earlier server */
+bool Server::listen()
+{
+    sockaddr_un address;
+    if (!socketAddress(path, address)) {
+        return false;
+    }
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path.c_str());
+    }
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    bound = listen_fd >= 0 && bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+    if (!bound || ::listen(listen_fd, SOMAXCONN) != 0 || !setNonBlocking(listen_fd) || pipe(wake_fds) != 0 ||
+        !setNonBlocking(wake_fds[0]) || !setNonBlocking(wake_fds[1])) {
+        int error = errno;
+        shut_down();
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+/* Wakes run() from a worker or stop() */
+void Server::wake() noexcept
+{
+    char byte = 0;
+    ssize_t ignored = write(wake_fds[1], &byte, 1); // a full pipe already wakes run()
+    (void)ignored;
+}
+
+/* Asks run() to return */
+void Server::stop() noexcept
+{
+    stop_requested = true;
+    if (wake_fds[1] >= 0) {
+        wake();
+    }
+}
+
+/* The I/O loop: accepts connections, reads requests into session queues and writes the
+   replies the workers finish, each connection's in the order its requests arrived */
+void Server::run()
+{
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        workers.emplace_back(&Server::work, this);
+    }
+
+    std::vector<pollfd> polled;
+    std::vector<std::uint64_t> polled_ids;
+    char chunk[READ_CHUNK_BYTES];
+    while (!stop_requested) {
+        polled.clear();
+        polled_ids.clear();
+        polled.push_back(pollfd{wake_fds[0], POLLIN, 0});
+        polled.push_back(pollfd{listen_fd, POLLIN, 0});
+        for (const auto &entry : connections) {
+            const Connection &connection = *entry.second;
+            short events = (connection.reading ? POLLIN : 0) | (connection.output.empty() ? 0 : POLLOUT);
+            polled.push_back(pollfd{connection.fd, events, 0});
+            polled_ids.push_back(entry.first);
+        }
+        if (poll(polled.data(), polled.size(), -1) < 0 && errno != EINTR) {
+            break;
+        }
+        while (read(wake_fds[0], chunk, sizeof(chunk)) > 0) {
+        }
+
+        if (polled[1].revents & POLLIN) {
+            int fd;
+            while ((fd = accept(listen_fd, nullptr, nullptr)) >= 0) {
+                setNonBlocking(fd);
+                std::unique_ptr<Connection> connection(new Connection);
+                connection->fd = fd;
+                std::lock_guard<std::mutex> lock(mutex);
+                connections.emplace(next_connection++, std::move(connection));
+            }
+        }
+
+        std::vector<std::uint64_t> closed;
+        for (std::size_t i = 0; i < polled_ids.size(); ++i) {
+            Connection &connection = *connections.find(polled_ids[i])->second;
+            short revents = polled[i + 2].revents;
+            if (connection.reading && (revents & (POLLIN | POLLHUP | POLLERR))) {
+                ssize_t n;
+                while ((n = read(connection.fd, chunk, sizeof(chunk))) > 0) {
+                    connection.input.append(chunk, n);
+                }
+                bool failed = n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+                connection.reading = n < 0;
+                if (failed || !take_requests(polled_ids[i], connection)) {
+                    closed.push_back(polled_ids[i]);
+                }
+            } else if (revents & (POLLHUP | POLLERR)) {
+                closed.push_back(polled_ids[i]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &entry : connections) {
+            Connection &connection = *entry.second;
+            auto reply = connection.finished.begin();
+            while (reply != connection.finished.end() && reply->first == connection.next_reply) {
+                connection.output += reply->second;
+                reply = connection.finished.erase(reply);
+                ++connection.next_reply;
+            }
+            if (!connection.output.empty()) {
+                ssize_t n = send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+                if (n > 0) {
+                    connection.output.erase(0, n);
+                } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    closed.push_back(entry.first);
+                }
+            }
+            bool answered = connection.output.empty() && connection.next_reply == connection.next_request;
+            if (!connection.reading && answered) {
+                closed.push_back(entry.first);
+            }
+        }
+        for (std::uint64_t id : closed) {
+            auto entry = connections.find(id);
+            if (entry != connections.end()) {
+                close(entry->second->fd);
+                connections.erase(entry);
+            }
+        }
+    }
+    stop_workers();
+}
+
+/* Queues the requests complete in a connection's input on their sessions */
+bool Server::take_requests(std::uint64_t id, Connection &connection)
+{
+    std::size_t used = 0;
+    std::lock_guard<std::mutex> lock(mutex);
+    while (connection.input.size() - used >= FRAME_HEADER_BYTES) {
+        std::uint32_t length = getLength(connection.input.data() + used, 4);
+        if (length > MAX_FRAME_BYTES) {
+            return false;
+        }
+        if (connection.input.size() - used - FRAME_HEADER_BYTES < length) {
+            break;
+        }
+        Job job;
+        job.connection = id;
+        job.sequence = connection.next_request++;
+        bool valid = decodeRequest(connection.input.substr(used + FRAME_HEADER_BYTES, length), job.request);
+        used += FRAME_HEADER_BYTES + length;
+        if (!valid) {
+            connection.finished.emplace(job.sequence, errorReply("Malformed request"));
+            continue;
+        }
+        std::unique_ptr<Session> &session = sessions[job.request.session];
+        if (!session) {
+            session.reset(new Session);
+            session->id = job.request.session;
+        }
+        session->jobs.push_back(std::move(job));
+        if (!session->busy) {
+            session->busy = true;
+            ready.push_back(session.get());
+            work_ready.notify_one();
+        }
+    }
+    connection.input.erase(0, used);
+    return true;
+}
+
+/* A worker: runs the next request of a ready session, then requeues the session if more wait */
+void Server::work()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        work_ready.wait(lock, [this]() { return stopping || !ready.empty(); });
+        if (stopping) {
+            return;
+        }
+        Session *session = ready.front();
+        ready.pop_front();
+        Job job = std::move(session->jobs.front());
+        session->jobs.pop_front();
+        if (!session->interpreter && !spares.empty()) {
+            session->interpreter = std::move(spares.back());
+            spares.pop_back();
+        }
+        lock.unlock();
+
+        if (!session->interpreter) {
+            session->interpreter.reset(new ServedInterpreter);
+            configure(*session->interpreter);
+        }
+        std::string reply;
+        try {
+            reply = serve(*session->interpreter, job.request);
+        } catch (const std::exception &e) {
+            // an exception escaping a worker would terminate the server and drop every client
+            reply = errorReply(std::string("Request failed: ") + e.what());
+        } catch (...) {
+            reply = errorReply("Request failed");
+        }
+
+        lock.lock();
+        finish(job.connection, job.sequence, std::move(reply));
+        if (job.request.kind == RequestKind::Drop && session->jobs.empty()) {
+            spares.push_back(std::move(session->interpreter));
+            sessions.erase(session->id);
+        } else if (!session->jobs.empty()) {
+            ready.push_back(session);
+        } else {
+            session->busy = false;
+        }
+    }
+}
+
+/* Evaluates one request, writing the value straight into its reply frame */
+std::string Server::serve(ServedInterpreter &interpreter, const Request &request)
+{
+    if (request.kind == RequestKind::Reset || request.kind == RequestKind::Drop) {
+        interpreter.reset();
+        Reply done;
+        done.ok = true;
+        return encodeReply(done);
+    }
+
+    bool parsed;
+    if (request.kind == RequestKind::File) {
+        std::ifstream file(request.body);
+        if (!file) {
+            return errorReply("Unable to open file " + request.body);
+        }
+        parsed = interpreter.parse(file);
+    } else {
+        std::istringstream expression(request.body);
+        parsed = interpreter.parse(expression);
+    }
+    if (!parsed) {
+        return errorReply(interpreter.parse_error().empty() ? "Invalid expression"
+                                                            : "Invalid expression: " + interpreter.parse_error());
+    }
+
+    Expression value;
+    try {
+        value = interpreter.eval();
+    } catch (const InterpreterSemanticError &e) {
+        interpreter.forget_graphics();
+        return errorReply(e.what());
+    } catch (const std::exception &e) {
+        // such as std::bad_alloc: the request fails, the session and the server carry on
+        interpreter.forget_graphics();
+        return errorReply(std::string("Evaluation failed: ") + e.what());
+    } catch (...) {
+        interpreter.forget_graphics();
+        return errorReply("Evaluation failed");
+    }
+    interpreter.forget_graphics();
+
+    std::string frame = startFrame();
+    frame += 'O';
+    if (request.format == ReplyFormat::Binary) {
+        if (!encodeAtom(value.head, frame)) {
+            return errorReply("A procedure has no binary encoding");
+        }
+    } else {
+        appendExpression(value, frame);
+    }
+    return sealFrame(frame);
+}
+
+/* Hands a reply to the I/O loop; the caller holds the mutex */
+void Server::finish(std::uint64_t connection, std::uint64_t sequence, std::string reply)
+{
+    auto entry = connections.find(connection);
+    if (entry != connections.end()) {
+        entry->second->finished.emplace(sequence, std::move(reply));
+        wake();
+    }
+}
+
+/* Stops the workers and closes the connections; safe to call more than once */
+void Server::stop_workers()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    for (auto &entry : connections) {
+        close(entry.second->fd);
+    }
+    connections.clear();
+}
+
+/* Closes every descriptor */
+void Server::shut_down()
+{
+    stop_workers();
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    if (bound) {
+        unlink(path.c_str());
+        bound = false;
+    }
+    for (int &fd : wake_fds) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include "interpreter.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// What a request asks of its session
+enum class RequestKind : char {
+    Expression = 'E', // evaluate the body
+    File = 'F',       // evaluate the script whose path is the body
+    Reset = 'R',      // forget the session's globals
+    Drop = 'D'        // end the session
+};
+
+// How a reply carries a value: printed as slisp prints it, or as encodeAtom writes it
+enum class ReplyFormat : char {
+    Text = 'T',
+    Binary = 'B'
+};
+
+// A request to a Server. On the wire a frame is a 4-byte little-endian length followed by
+// that many bytes: the kind, the format, a 2-byte little-endian length and the session id,
+// then the body.
+struct Request {
+    RequestKind kind = RequestKind::Expression;
+    ReplyFormat format = ReplyFormat::Text;
+    std::string session;
+    std::string body;
+};
+
+// A Server's answer to one request, framed like a request: a status byte, 'O' if ok or 'E'
+// if the body is an error message, then the body. Replies come in the order the requests
+// were sent on the connection.
+struct Reply {
+    bool ok = false;
+    std::string body;
+};
+
+// Framed encodings of requests and replies, and the decoders of a frame's payload
+std::string encodeRequest(const Request &request);
+bool decodeRequest(const std::string &payload, Request &request);
+std::string encodeReply(const Reply &reply);
+bool decodeReply(const std::string &payload, Reply &reply);
+
+// Connects to the socket a Server listens on; -1 on failure, with errno set
+int connectServer(const std::string &socket_path);
+
+// Blocking frame I/O for clients: false when the connection closes or fails
+bool readFrame(int fd, std::string &payload);
+bool writeAll(int fd, const std::string &bytes);
+
+// An interpreter kept by a Server, defined in server.cpp
+class ServedInterpreter;
+
+// Serves requests over a Unix domain socket, keeping one interpreter per session id alive
+// between requests. One thread does all socket I/O, so a connection may pipeline any number
+// of requests; a fixed set of worker threads evaluates them, each session's requests in turn
+// and different sessions' in parallel. Interpreters of dropped sessions are reset and kept
+// for new ones.
+class Server {
+public:
+    // Largest request accepted; a longer frame closes its connection
+    static const std::uint32_t MAX_FRAME_BYTES = 64 * 1024 * 1024;
+
+    // threads of 0 selects the hardware concurrency; configure sets up every new interpreter
+    Server(const std::string &socket_path, std::size_t threads, std::function<void(Interpreter &)> configure);
+
+    // Stops serving and removes the socket
+    ~Server();
+
+    Server(const Server &) = delete;
+    Server &operator=(const Server &) = delete;
+
+    // Creates the socket, replacing a stale one; false with errno set on failure
+    bool listen();
+
+    // Serves connections until stop() is called
+    void run();
+
+    // Makes run() return; safe to call from any thread and from a signal handler
+    void stop() noexcept;
+
+private:
+    struct Job {
+        std::uint64_t connection;
+        std::uint64_t sequence; // position of the request on its connection
+        Request request;
+    };
+
+    struct Session {
+        std::string id;
+        std::unique_ptr<ServedInterpreter> interpreter; // created by the first worker to need it
+        std::deque<Job> jobs;
+        bool busy = false; // queued for or running on a worker
+    };
+
+    struct Connection {
+        int fd;
+        std::string input;  // bytes read but not yet framed
+        std::string output; // replies framed but not yet written
+        std::uint64_t next_request = 0;
+        std::uint64_t next_reply = 0;
+        std::map<std::uint64_t, std::string> finished; // replies waiting for earlier ones
+        bool reading = true; // false once the client has sent everything; closed when answered
+    };
+
+    std::string path;
+    std::size_t thread_count;
+    std::function<void(Interpreter &)> configure;
+
+    int listen_fd = -1;
+    bool bound = false; // the socket file at path is ours to remove
+    int wake_fds[2] = {-1, -1}; // written to make run() look at its state
+    std::atomic<bool> stop_requested;
+
+    // Guards everything below, shared by the I/O thread and the workers
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    bool stopping = false;
+    std::unordered_map<std::string, std::unique_ptr<Session>> sessions;
+    std::deque<Session *> ready; // sessions with jobs and no worker
+    std::vector<std::unique_ptr<ServedInterpreter>> spares;
+    std::map<std::uint64_t, std::unique_ptr<Connection>> connections;
+    std::uint64_t next_connection = 0;
+
+    std::vector<std::thread> workers;
+
+    void work();
+    void wake() noexcept;
+
+    // Evaluates request in interpreter, returning the framed reply
+    std::string serve(ServedInterpreter &interpreter, const Request &request);
+
+    // Takes the complete frames off a connection's input; false if one is too long
+    bool take_requests(std::uint64_t id, Connection &connection);
+
+    // Records a framed reply for the request at sequence on a connection, if still open
+    void finish(std::uint64_t connection, std::uint64_t sequence, std::string reply);
+
+    // Joins the workers and closes the connections, when run() returns
+    void stop_workers();
+
+    // Also closes the socket and the wake pipe, which stop() may write to until then
+    void shut_down();
+};
+
+#endif
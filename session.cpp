@@ -0,0 +1,81 @@
+#include "session.hpp"
+#include "interpreter_semantic_error.hpp"
+#include "memory_buffer.hpp"
+
+#include <istream>
+
+Session::Session() = default;
+
+/* Parses and evaluates one program */
+const SessionResult &Session::eval(const std::string &program)
+{
+    return eval(program.data(), program.size());
+}
+
+/* Parses and evaluates a program held in a buffer, without copying it */
+const SessionResult &Session::eval(const char *data, std::size_t size)
+{
+    MemoryBuffer buffer(data, size);
+    std::istream input(&buffer);
+    evaluate(input, last);
+    return last;
+}
+
+/* Evaluates each program in order, continuing past failures */
+const std::vector<SessionResult> &Session::eval_batch(const std::vector<std::string> &programs)
+{
+    batch.resize(programs.size());
+    for (std::size_t i = 0; i < programs.size(); ++i) {
+        MemoryBuffer buffer(programs[i].data(), programs[i].size());
+        std::istream input(&buffer);
+        evaluate(input, batch[i]);
+    }
+    return batch;
+}
+
+/* Every shape drawn since the last clear_shapes() */
+ShapeView Session::shapes() const noexcept
+{
+    return ShapeView(graphics.data(), graphics.size());
+}
+
+/* The shapes one evaluation drew */
+ShapeView Session::shapes(const SessionResult &result) const noexcept
+{
+    return ShapeView(graphics.data() + result.first_shape, result.shape_count);
+}
+
+/* Drops the shapes drawn so far */
+void Session::clear_shapes() noexcept
+{
+    graphics.clear();
+}
+
+/* Evaluates a program into result, which reports the error instead of throwing it */
+void Session::evaluate(std::istream &input, SessionResult &result)
+{
+    result.first_shape = graphics.size();
+    result.error.clear();
+    result.ok = false;
+    if (!parse(input)) {
+        result.value = Expression();
+        result.error = parse_error().empty() ? "Invalid expression" : parse_error();
+    } else {
+        try {
+            result.value = Interpreter::eval();
+            result.ok = true;
+        } catch (const InterpreterSemanticError &e) {
+            result.value = Expression();
+            result.error = e.what();
+        } catch (const std::exception &e) {
+            // such as std::bad_alloc, which must not escape into the embedding program
+            result.value = Expression();
+            result.error = std::string("Evaluation failed: ") + e.what();
+        } catch (...) {
+            result.value = Expression();
+            result.error = "Evaluation failed";
+        }
+    }
+    // a program that fails keeps what it drew before the error, unless it ran out of budget
+    result.shape_count = graphics.size() - result.first_shape;
+}
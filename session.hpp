@@ -0,0 +1,82 @@
+#ifndef SESSION_HPP
+#define SESSION_HPP
+
+#include "interpreter.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only view of consecutive shapes a Session drew; valid until the session's next
+// evaluation or clear_shapes()
+class ShapeView {
+public:
+    ShapeView() = default;
+    ShapeView(const Expression *data, std::size_t size) : first(data), count(size) {}
+
+    const Expression *begin() const noexcept { return first; }
+    const Expression *end() const noexcept { return first + count; }
+    std::size_t size() const noexcept { return count; }
+    bool empty() const noexcept { return count == 0; }
+    const Expression &operator[](std::size_t i) const noexcept { return first[i]; }
+
+private:
+    const Expression *first = nullptr;
+    std::size_t count = 0;
+};
+
+// Outcome of evaluating one program in a Session
+struct SessionResult {
+    bool ok = false;
+    Expression value;             // the program's value, if ok
+    std::string error;            // why it failed, if not
+    std::size_t first_shape = 0;  // the shapes it drew, as a range of Session::shapes()
+    std::size_t shape_count = 0;
+};
+
+// In-process interpreter for programs embedding slisp, the API of the slisp library.
+// Globals defined by one evaluation are visible to the next; errors, parse errors included,
+// are reported in the SessionResult rather than thrown or printed. Like an Interpreter, a
+// session is used by one thread at a time and separate sessions run in parallel freely.
+// Shapes accumulate until clear_shapes() and are handed out as views into the session
+// rather than copied.
+class Session : private Interpreter {
+public:
+    Session();
+
+    using Interpreter::set_limits;
+    using Interpreter::usage;
+    using Interpreter::cancel;
+    using Interpreter::set_threads;
+    using Interpreter::set_memo_capacity;
+    using Interpreter::set_math_mode;
+    using Interpreter::set_type_inference;
+    using Interpreter::set_result_cache;
+
+    // Parses and evaluates one program; the result stays valid until the next evaluation
+    const SessionResult &eval(const std::string &program);
+
+    // Parses and evaluates the program in size bytes at data, which are read in place
+    const SessionResult &eval(const char *data, std::size_t size);
+
+    // Evaluates programs in order, one result per program; a failing program does not stop
+    // the ones after it. The results stay valid until the next evaluation.
+    const std::vector<SessionResult> &eval_batch(const std::vector<std::string> &programs);
+
+    // Every shape drawn since the session started or clear_shapes() was last called
+    ShapeView shapes() const noexcept;
+
+    // The shapes result's program drew
+    ShapeView shapes(const SessionResult &result) const noexcept;
+
+    // Forgets the shapes drawn so far, keeping the globals
+    void clear_shapes() noexcept;
+
+private:
+    SessionResult last;
+    std::vector<SessionResult> batch;
+
+    // Evaluates the program readable from input into result
+    void evaluate(std::istream &input, SessionResult &result);
+};
+
+#endif
@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <string>
 #include <iostream>
 
@@ -5,21 +6,79 @@
 #include <QDebug>
 
 #include "main_window.hpp"
+#include "command_line.hpp"
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
 
     std::string filename;
+    EvalLimits limits;
+    std::size_t threads = 0;
+    MathMode math = MathMode::Precise;
+    bool live = false;
+    bool cache = true;
+    std::string snapshot;
 
-    if (argc == 2) {
-        filename = argv[1];
+    int i = 1;
+    for (; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--live") {
+            live = true;
+            continue;
+        }
+        if (arg == "--no-cache") {
+            cache = false;
+            continue;
+        }
+        if (arg.compare(0, 7, "--math=") == 0) {
+            math = parseMathMode(arg.substr(7));
+            continue;
+        }
+        if (i + 1 >= argc) {
+            break;
+        }
+        if (arg == "--timeout") {
+            limits.max_time_ms = parseCount(arg, argv[++i]);
+        } else if (arg == "--max-steps") {
+            limits.max_steps = parseCount(arg, argv[++i]);
+        } else if (arg == "--threads") {
+            threads = parseCount(arg, argv[++i]);
+        } else if (arg == "--math") {
+            math = parseMathMode(argv[++i]);
+        } else if (arg == "--snapshot") {
+            snapshot = argv[++i];
+        } else {
+            break;
+        }
     }
-    if (argc > 2) {
+
+    if (argc - i == 1) {
+        filename = argv[i];
+    }
+    if (argc - i > 1) {
         std::cerr << "Error: invalid number of arguments to sldraw" << std::endl;
         return EXIT_FAILURE;
     }
 
+    std::shared_ptr<const Snapshot> prelude;
+    if (!snapshot.empty()) {
+        std::string error;
+        prelude = Snapshot::open(snapshot, error);
+        if (!prelude) {
+            std::cerr << "Error: " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
     MainWindow w(filename);
+    w.setEvalLimits(limits);
+    w.setThreads(threads);
+    w.setMathMode(math);
+    w.setLive(live);
+    if (cache) {
+        w.setResultCache(std::make_shared<ResultCache>(ResultCache::default_directory()));
+    }
+    w.setPrelude(prelude);
     w.setMinimumSize(800, 600);
     w.show();
 
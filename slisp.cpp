@@ -1,19 +1,154 @@
+#include <cerrno>
+#include <chrono>
+#include <csignal>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <unistd.h>
 #include "interpreter.hpp"
+#include "cpp_emitter.hpp"
+#include "batch_runner.hpp"
+#include "server.hpp"
+#include "form_reader.hpp"
+#include "form_scanner.hpp"
+#include "memory_buffer.hpp"
+#include "result_writer.hpp"
+#include "number_format.hpp"
+#include "command_line.hpp"
 
-// Runs the Read-Eval-Print Loop (REPL)
-void runREPL() {
+// Command-line options shared by every run mode
+struct SlispOptions {
+    EvalLimits limits;
+    std::size_t threads = 0; // threads used by pmap; 0 selects the hardware concurrency
+    bool threads_given = false; // --threads was passed, so it applies to --batch and --serve workers too
+    bool dataflow = false;   // run independent defines of begin blocks concurrently
+    std::size_t memo = 0;    // results of pure calls to cache; 0 disables the memo cache
+    MathMode math = MathMode::Precise;
+    bool live = false;       // let define rebind names, re-evaluating what depends on them
+    bool emit_cpp = false;   // write the script's C++ translation instead of running it
+    bool cache = true;       // reuse the results of expensive top-level forms across runs
+    std::string cache_dir;   // empty selects ResultCache::default_directory()
+    std::uint64_t cache_bytes = ResultCache::DEFAULT_MAX_BYTES;
+    std::string batch;       // directory or list file of scripts to evaluate in this process
+    std::size_t jobs = 0;    // threads evaluating batch scripts or served requests; 0 selects the hardware concurrency
+    std::string serve;       // socket to serve requests on
+    bool stdin_forms = false; // evaluate the forms piped to stdin without prompts
+    OutputFormat output = OutputFormat::Text; // how -e, script files and --stdin write results
+    NumberStyle numbers = NumberStyle::Shortest; // how printed results write numbers
+    std::string snapshot;      // snapshot of prelude globals every program starts with
+    std::string make_snapshot; // where to save the globals of the script instead of printing its value
+};
+
+// Prints the memo cache counters to stderr when the cache is enabled
+static void reportMemo(const Interpreter &interpreter) {
+    MemoStats stats = interpreter.memo_stats();
+    if (stats.capacity != 0) {
+        std::cerr << "memo: " << stats.hits << " hits, " << stats.misses << " misses, "
+                  << stats.evictions << " evictions" << std::endl;
+    }
+}
+
+// Prints why the last parse failed, when the interpreter found a malformed expression
+static void reportParseError(const Interpreter &interpreter) {
+    if (!interpreter.parse_error().empty()) {
+        std::cerr << "Error: " << interpreter.parse_error() << std::endl;
+    }
+}
+
+// Opens the result cache the options select, once per process; nullptr if disabled
+
+static std::shared_ptr<ResultCache> openResultCache(const SlispOptions &options) {
+    if (!options.cache) {
+        return nullptr;
+    }
+    static std::shared_ptr<ResultCache> cache = std::make_shared<ResultCache>(
+        options.cache_dir.empty() ? ResultCache::default_directory() : options.cache_dir, options.cache_bytes);
+    return cache;
+}
+
+// Maps the snapshot the options select, once per process; nullptr if none. Exits if it is unreadable.
+static std::shared_ptr<const Snapshot> openPrelude(const SlispOptions &options) {
+    if (options.snapshot.empty()) {
+        return nullptr;
+    }
+    static std::shared_ptr<const Snapshot> snapshot = [&options]() {
+        std::string error;
+        std::shared_ptr<const Snapshot> opened = Snapshot::open(options.snapshot, error);
+        if (!opened) {
+            std::cerr << "Error: " << error << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        return opened;
+    }();
+    return snapshot;
+}
+
+// Applies the evaluation options to an interpreter
+static void configureInterpreter(Interpreter &interpreter, const SlispOptions &options) {
+    interpreter.set_limits(options.limits);
+    interpreter.set_threads(options.threads);
+    interpreter.set_dataflow(options.dataflow);
+    interpreter.set_memo_capacity(options.memo);
+    interpreter.set_math_mode(options.math);
+    interpreter.set_live(options.live);
+    interpreter.set_result_cache(openResultCache(options));
+    interpreter.set_prelude(openPrelude(options));
+}
+
+// Applies the evaluation options to the interpreter of one of several --jobs workers. Unless
+// --threads says otherwise, its pmap and concurrent arguments run on the worker's own thread,
+// since the other workers already keep the cores busy.
+static void configureWorker(Interpreter &interpreter, const SlispOptions &options) {
+    configureInterpreter(interpreter, options);
+    if (!options.threads_given) {
+        interpreter.set_threads(1);
+    }
+}
+
+// Parses and evaluates what input holds, appending its --output record to out; false on error.
+// invalid is the message for input that does not parse.
+static bool evaluateRecord(Interpreter &interpreter, std::istream &input, OutputFormat format,
+                           const std::string &invalid, std::string &out) {
+    if (!interpreter.parse(input)) {
+        appendError(format, interpreter.parse_error().empty() ? invalid : invalid + ": " + interpreter.parse_error(), out);
+        return false;
+    }
+    try {
+        appendResult(format, interpreter.eval(), out);
+        return true;
+    } catch (const InterpreterSemanticError &e) {
+        appendError(format, e.what(), out);
+        return false;
+    }
+}
+
+// Writes the single --output record of a script or expression to stdout and exits
+static void writeRecordAndExit(Interpreter &interpreter, std::istream &input, const SlispOptions &options,
+                               const std::string &invalid) {
+    std::string record;
+    bool ok = evaluateRecord(interpreter, input, options.output, invalid, record);
+    std::cout.write(record.data(), record.size());
+    std::cout.flush();
+    reportMemo(interpreter);
+    std::exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+// Runs the Read-Eval-Print Loop (REPL). A form may span lines: each line is scanned once and
+// every form is evaluated as soon as it closes, with a continuation prompt while one is open.
+void runREPL(const SlispOptions &options) {
     Interpreter interpreter;
+    configureInterpreter(interpreter, options);
+    FormScanner scanner;
     std::string input;
-    std::cout << "slisp> ";
-    // Continuously read user input
-    while (std::getline(std::cin, input)) {
-        std::istringstream iss(input);
-        // Parse the input
-        if (interpreter.parse(iss)) {
+    const char *form;
+    std::size_t size;
+    auto evaluate = [&]() {
+        MemoryBuffer buffer(form, size);
+        std::istream stream(&buffer);
+        // Parse the form
+        if (interpreter.parse(stream)) {
             try {
                 // Evaluate and print the result
                 Expression result = interpreter.eval();
@@ -25,14 +160,28 @@ void runREPL() {
             }
         } else {
             // Handle invalid expressions
+            reportParseError(interpreter);
             std::cerr << "Error: Invalid expression" << std::endl;
         }
-        std::cout << "slisp> ";
+    };
+    std::cout << "slisp> ";
+    // Continuously read user input
+    while (std::getline(std::cin, input)) {
+        input += '\n';
+        scanner.append(input.data(), input.size());
+        while (scanner.next(form, size)) {
+            evaluate();
+        }
+        std::cout << (scanner.pending() ? "  ...> " : "slisp> ");
+    }
+    // Input ended inside a form
+    if (scanner.finish(form, size)) {
+        evaluate();
     }
 }
 
 // Executes expressions from a file
-void runFromFile(const std::string &filename) {
+void runFromFile(const std::string &filename, const SlispOptions &options) {
     std::ifstream file(filename);
     // Check if the file can be opened
     if (!file) {
@@ -40,12 +189,17 @@ void runFromFile(const std::string &filename) {
         std::exit(EXIT_FAILURE);
     }
     Interpreter interpreter;
+    configureInterpreter(interpreter, options);
+    if (options.output != OutputFormat::Text) {
+        writeRecordAndExit(interpreter, file, options, "Invalid expression in file");
+    }
     // Parse the file contents
     if (interpreter.parse(file)) {
         try {
             // Evaluate and print the result
             Expression result = interpreter.eval();
             std::cout << result << std::endl;
+            reportMemo(interpreter);
         } catch (const InterpreterSemanticError &e) {
             // Handle semantic errors
             std::cerr << "Error: " << e.what() << std::endl;
@@ -53,21 +207,27 @@ void runFromFile(const std::string &filename) {
         }
     } else {
         // Handle invalid expressions in the file
+        reportParseError(interpreter);
         std::cerr << "Error: Invalid expression in file" << std::endl;
         std::exit(EXIT_FAILURE);
     }
 }
 
 // Evaluates a single expression from a string
-void runExpression(const std::string &expression) {
+void runExpression(const std::string &expression, const SlispOptions &options) {
     std::istringstream iss(expression);
     Interpreter interpreter;
+    configureInterpreter(interpreter, options);
+    if (options.output != OutputFormat::Text) {
+        writeRecordAndExit(interpreter, iss, options, "Invalid expression");
+    }
     // Parse the expression
     if (interpreter.parse(iss)) {
         try {
             // Evaluate and print the result
             Expression result = interpreter.eval();
             std::cout << result << std::endl;
+            reportMemo(interpreter);
         } catch (const InterpreterSemanticError &e) {
             // Handle semantic errors
             std::cerr << "Error: " << e.what() << std::endl;
@@ -75,28 +235,336 @@ void runExpression(const std::string &expression) {
         }
     } else {
         // Handle invalid expressions
+        reportParseError(interpreter);
         std::cerr << "Error: Invalid expression" << std::endl;
         std::exit(EXIT_FAILURE);
     }
 }
 
+// Evaluates a prelude script and saves the globals it leaves, with those of any --snapshot
+// it ran on, to a snapshot file
+void makeSnapshot(const std::string &filename, const SlispOptions &options) {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Error: Unable to open file " << filename << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    Interpreter interpreter;
+    configureInterpreter(interpreter, options);
+    if (!interpreter.parse(file)) {
+        reportParseError(interpreter);
+        std::cerr << "Error: Invalid expression in file" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    std::string error;
+    try {
+        interpreter.eval();
+    } catch (const InterpreterSemanticError &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    if (!interpreter.save_snapshot(options.make_snapshot, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// Writes the C++ translation of a script file to stdout
+void emitFromFile(const std::string &filename, const SlispOptions &options) {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Error: Unable to open file " << filename << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    Interpreter interpreter;
+    if (!interpreter.parse(file)) {
+        reportParseError(interpreter);
+        std::cerr << "Error: Invalid expression in file" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    try {
+        // the translation registers the script under its file name, without the directory
+        std::string source = filename.substr(filename.find_last_of("/\\") + 1);
+        emitCpp(interpreter.syntax_tree(), source, options.math, std::cout);
+    } catch (const InterpreterSemanticError &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// Output --stdin buffers before writing it out
+static const std::size_t STDIN_OUTPUT_BYTES = 1 << 20;
+
+// Evaluates every form piped to stdin in one interpreter, without prompts. Forms may span
+// lines; each writes one --output record, by default a line with the value or "Error: message". Output is written in large
+// blocks, and also whenever stdin has nothing more to read yet, so an interactive producer
+// sees the results of what it has sent. A summary of the throughput goes to stderr.
+int runStdin(const SlispOptions &options) {
+    Interpreter interpreter;
+    configureInterpreter(interpreter, options);
+    std::string output;
+    output.reserve(STDIN_OUTPUT_BYTES + 4096);
+    auto flush = [&output]() {
+        std::cout.write(output.data(), output.size());
+        std::cout.flush();
+        output.clear();
+    };
+    FormReader reader(STDIN_FILENO, flush);
+    std::uint64_t forms = 0;
+    std::uint64_t errors = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    const char *form;
+    std::size_t size;
+    while (reader.next(form, size)) {
+        ++forms;
+        MemoryBuffer buffer(form, size);
+        std::istream input(&buffer);
+        if (!evaluateRecord(interpreter, input, options.output, "Invalid expression", output)) {
+            ++errors;
+        }
+        if (output.size() >= STDIN_OUTPUT_BYTES) {
+            flush();
+        }
+    }
+    flush();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double rate = seconds > 0 ? forms / seconds : 0;
+    std::cerr << "stdin: " << forms << " forms, " << reader.bytes_read() << " bytes in "
+              << static_cast<std::uint64_t>(seconds * 1000) << " ms (" << static_cast<std::uint64_t>(rate)
+              << " forms/s), " << errors << " errors" << std::endl;
+    reportMemo(interpreter);
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Evaluates every script --batch names on --jobs threads, printing "script: value" or
+// "script: Error: message" for each in the order listed; fails if any script failed
+int runBatchScripts(const SlispOptions &options) {
+    std::vector<std::string> scripts;
+    if (!listBatchScripts(options.batch, scripts)) {
+        std::cerr << "Error: Unable to read batch " << options.batch << std::endl;
+        return EXIT_FAILURE;
+    }
+    BatchSummary summary = runBatch(scripts, options.jobs,
+        [&](Interpreter &interpreter) {
+            configureWorker(interpreter, options);
+        },
+        [](const BatchResult &result) {
+            std::cout << result.script << (result.ok ? ": " : ": Error: ") << result.output << '\n';
+        });
+    std::cout.flush();
+    if (summary.failed > 0) {
+        std::cerr << "Error: " << summary.failed << " of " << summary.scripts << " scripts failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// The server --serve runs, stopped by SIGINT and SIGTERM
+static Server *running_server = nullptr;
+
+static void stopServer(int) {
+    if (running_server) {
+        running_server->stop();
+    }
+}
+
+// Serves requests on the --serve socket with --jobs worker threads until interrupted
+int runServer(const SlispOptions &options) {
+    Server server(options.serve, options.jobs, [&](Interpreter &interpreter) {
+        configureWorker(interpreter, options);
+    });
+    if (!server.listen()) {
+        std::cerr << "Error: Unable to listen on " << options.serve << ": " << std::strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    running_server = &server;
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+    server.run();
+    running_server = nullptr;
+    return EXIT_SUCCESS;
+}
+
+// Parses the value of --output, exiting with usage on failure
+static OutputFormat parseOutputFormat(const std::string &value) {
+    if (value == "text") {
+        return OutputFormat::Text;
+    } else if (value == "ndjson") {
+        return OutputFormat::Ndjson;
+    } else if (value == "binary") {
+        return OutputFormat::Binary;
+    }
+    std::cerr << "Error: --output expects text, ndjson or binary" << std::endl;
+    std::exit(EXIT_FAILURE);
+}
+
+// Parses the value of --numbers, exiting with usage on failure
+static NumberStyle parseNumberStyle(const std::string &value) {
+    if (value == "shortest") {
+        return NumberStyle::Shortest;
+    } else if (value == "compat") {
+        return NumberStyle::Compatible;
+    }
+    std::cerr << "Error: --numbers expects shortest or compat" << std::endl;
+    std::exit(EXIT_FAILURE);
+}
+
+// Consumes leading --option arguments into options; returns the index of the first other argument
+static int parseOptions(int argc, char **argv, SlispOptions &options) {
+    int i = 1;
+    for (; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            break;
+        }
+        if (arg == "--dataflow") {
+            options.dataflow = true;
+            continue;
+        }
+        if (arg == "--live") {
+            options.live = true;
+            continue;
+        }
+        if (arg == "--no-cache") {
+            options.cache = false;
+            continue;
+        }
+        if (arg == "--stdin") {
+            options.stdin_forms = true;
+            continue;
+        }
+        if (arg == "--emit-cpp") {
+            options.emit_cpp = true;
+            continue;
+        }
+        if (arg.compare(0, 7, "--math=") == 0) {
+            options.math = parseMathMode(arg.substr(7));
+            continue;
+        }
+        if (arg.compare(0, 9, "--output=") == 0) {
+            options.output = parseOutputFormat(arg.substr(9));
+            continue;
+        }
+        if (arg.compare(0, 10, "--numbers=") == 0) {
+            options.numbers = parseNumberStyle(arg.substr(10));
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Error: " << arg << " expects a value" << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        if (arg == "--max-steps") {
+            options.limits.max_steps = parseCount(arg, argv[++i]);
+        } else if (arg == "--max-nodes") {
+            options.limits.max_nodes = parseCount(arg, argv[++i]);
+        } else if (arg == "--max-bytes") {
+            options.limits.max_bytes = parseCount(arg, argv[++i]);
+        } else if (arg == "--timeout") {
+            options.limits.max_time_ms = parseCount(arg, argv[++i]);
+        } else if (arg == "--threads") {
+            options.threads = parseCount(arg, argv[++i]);
+            options.threads_given = true;
+        } else if (arg == "--memo") {
+            options.memo = parseCount(arg, argv[++i]);
+        } else if (arg == "--math") {
+            options.math = parseMathMode(argv[++i]);
+        } else if (arg == "--numbers") {
+            options.numbers = parseNumberStyle(argv[++i]);
+        } else if (arg == "--output") {
+            options.output = parseOutputFormat(argv[++i]);
+        } else if (arg == "--cache-dir") {
+            options.cache_dir = argv[++i];
+        } else if (arg == "--cache-size") {
+            options.cache_bytes = parseCount(arg, argv[++i]);
+        } else if (arg == "--batch") {
+            options.batch = argv[++i];
+        } else if (arg == "--jobs") {
+            options.jobs = parseCount(arg, argv[++i]);
+        } else if (arg == "--serve") {
+            options.serve = argv[++i];
+        } else if (arg == "--snapshot") {
+            options.snapshot = argv[++i];
+        } else if (arg == "--make-snapshot") {
+            options.make_snapshot = argv[++i];
+        } else {
+            std::cerr << "Error: unknown option " << arg << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    return i;
+}
+
 // Main function to handle command-line arguments
 int main(int argc, char **argv) {
-    if (argc == 1) {
+    SlispOptions options;
+    int first = parseOptions(argc, argv, options);
+    int remaining = argc - first;
+    setNumberStyle(options.numbers);
+
+    if (options.output != OutputFormat::Text && (!options.serve.empty() || !options.batch.empty() ||
+                                                 options.emit_cpp || !options.make_snapshot.empty() ||
+                                                 (remaining == 0 && !options.stdin_forms))) {
+        std::cerr << "Error: --output applies to -e, script files and --stdin" << std::endl;
+        return EXIT_FAILURE;
+    }
+    else if (!options.make_snapshot.empty() && remaining == 1 && options.serve.empty() &&
+             options.batch.empty() && !options.stdin_forms && !options.emit_cpp) {
+        // Save the globals a prelude script defines
+        makeSnapshot(argv[first], options);
+    }
+    else if (!options.make_snapshot.empty()) {
+        std::cerr << "Error: --make-snapshot expects a script file and no other mode" << std::endl;
+        return EXIT_FAILURE;
+    }
+    else if (!options.serve.empty() && remaining == 0 && options.batch.empty() && !options.emit_cpp) {
+        // Serve requests until interrupted
+        return runServer(options);
+    }
+    else if (!options.serve.empty()) {
+        std::cerr << "Error: --serve takes no scripts, expressions or --batch" << std::endl;
+        return EXIT_FAILURE;
+    }
+    else if (!options.batch.empty() && remaining == 0 && !options.emit_cpp) {
+        // Evaluate a batch of scripts in this process
+        return runBatchScripts(options);
+    }
+    else if (!options.batch.empty()) {
+        std::cerr << "Error: --batch takes no other scripts or expressions" << std::endl;
+        return EXIT_FAILURE;
+    }
+    else if (options.stdin_forms && remaining == 0 && !options.emit_cpp) {
+        // Evaluate the forms piped to stdin
+        return runStdin(options);
+    }
+    else if (options.stdin_forms) {
+        std::cerr << "Error: --stdin takes no other scripts or expressions" << std::endl;
+        return EXIT_FAILURE;
+    }
+    else if (options.emit_cpp && remaining == 1) {
+        // Translate a file to C++
+        emitFromFile(argv[first], options);
+    }
+    else if (options.emit_cpp) {
+        std::cerr << "Error: --emit-cpp expects a filename" << std::endl;
+        return EXIT_FAILURE;
+    }
+    else if (remaining == 0) {
         // No arguments: Run REPL
-        runREPL();
+        runREPL(options);
     } 
-    else if (argc == 3 && std::string(argv[1]) == "-e") {
+    else if (remaining == 2 && std::string(argv[first]) == "-e") {
         // Evaluate a single expression
-        runExpression(argv[2]);
+        runExpression(argv[first + 1], options);
     } 
-    else if (argc == 2) {
+    else if (remaining == 1) {
         // Read and evaluate from a file
-        runFromFile(argv[1]);
+        runFromFile(argv[first], options);
     } 
     else {
         // Display usage information for invalid arguments
-        std::cerr << "Usage: slisp [-e expression] [filename]" << std::endl;
+        std::cerr << "Usage: slisp [--max-steps N] [--max-nodes N] [--max-bytes N] [--timeout MS] [--threads N] [--dataflow] [--memo N] [--math=precise|fast] [--output=text|ndjson|binary] [--numbers=shortest|compat] [--live] [--no-cache] [--cache-dir DIR] [--cache-size BYTES] [--batch DIR|LIST] [--serve SOCKET] [--jobs N] [--stdin] [--snapshot FILE] [--make-snapshot FILE] [--emit-cpp] [-e expression] [filename]" << std::endl;
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
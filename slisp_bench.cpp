@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "interpreter.hpp"
+#include "tokenize.hpp"
+#include "builtin_procedures.hpp"
+#include "list_procedures.hpp"
+#include "number_format.hpp"
+
+// A benchmark: run(n) performs n iterations of the operation measured. The iteration count
+// is fixed per benchmark, not calibrated, so two runs time exactly the same work.
+struct Benchmark {
+    std::string name;
+    std::uint64_t iterations;
+    std::function<void(std::uint64_t)> run;
+};
+
+// Nanoseconds per iteration over the samples of one benchmark
+struct Stats {
+    std::string name;
+    std::uint64_t iterations = 0;
+    std::size_t samples = 0;
+    double median = 0;
+    double mean = 0;
+    double stddev = 0;
+    double mad = 0; // median absolute deviation from the median
+    double min = 0;
+    double max = 0;
+};
+
+// Written by every benchmark so the compiler cannot drop the work measured
+static volatile std::uint64_t sink;
+
+// Median of values, which it reorders
+static double median(std::vector<double> &values) {
+    std::sort(values.begin(), values.end());
+    std::size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+// Times one sample of a benchmark, in nanoseconds per iteration
+static double sample(const Benchmark &benchmark) {
+    auto start = std::chrono::steady_clock::now();
+    benchmark.run(benchmark.iterations);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / benchmark.iterations;
+}
+
+// Summarizes the samples of a benchmark
+static Stats summarize(const Benchmark &benchmark, std::vector<double> times) {
+    Stats stats;
+    stats.name = benchmark.name;
+    stats.iterations = benchmark.iterations;
+    stats.samples = times.size();
+    for (double t : times) {
+        stats.mean += t;
+    }
+    stats.mean /= times.size();
+    for (double t : times) {
+        stats.stddev += (t - stats.mean) * (t - stats.mean);
+    }
+    stats.stddev = times.size() > 1 ? std::sqrt(stats.stddev / (times.size() - 1)) : 0;
+    stats.median = median(times);
+    stats.min = times.front();
+    stats.max = times.back();
+    std::vector<double> deviations;
+    for (double t : times) {
+        deviations.push_back(std::fabs(t - stats.median));
+    }
+    stats.mad = median(deviations);
+    return stats;
+}
+
+// Runs a warm-up round and then rounds of one sample of every benchmark each. Interleaving
+// spreads each benchmark's samples over the whole run, so a slow drift of the machine, such
+// as a change of clock speed, widens their spread instead of shifting the benchmarks
+// measured while it lasted.
+static std::vector<Stats> measure(const std::vector<Benchmark> &benchmarks, std::size_t rounds) {
+    std::vector<std::vector<double>> times(benchmarks.size());
+    for (std::size_t round = 0; round <= rounds; ++round) {
+        for (std::size_t i = 0; i < benchmarks.size(); ++i) {
+            double t = sample(benchmarks[i]);
+            if (round > 0) {
+                times[i].push_back(t);
+            }
+        }
+        std::cerr << "round " << round << " of " << rounds << " done" << std::endl;
+    }
+    std::vector<Stats> results;
+    for (std::size_t i = 0; i < benchmarks.size(); ++i) {
+        results.push_back(summarize(benchmarks[i], times[i]));
+    }
+    return results;
+}
+
+// Parses program, failing loudly since a benchmark of a broken program measures nothing
+static void parseOrExit(Interpreter &interpreter, const std::string &program) {
+    std::istringstream iss(program);
+    if (!interpreter.parse(iss)) {
+        std::cerr << "Error: benchmark program does not parse: " << program << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// The atoms program's list evaluates to, used as the arguments of a builtin
+static std::vector<Atom> arguments(const std::string &program) {
+    Interpreter interpreter;
+    parseOrExit(interpreter, "(list " + program + ")");
+    Expression list = interpreter.eval();
+    std::vector<Atom> args;
+    for (std::size_t i = 0; i < list.head.value.list_value->size(); ++i) {
+        args.push_back(list.head.value.list_value->at(i));
+    }
+    return args;
+}
+
+// A script of count top-level style defines, mixing numbers, symbols, shapes and comments
+static std::string sampleScript(int count) {
+    std::string script = "(begin\n";
+    for (int i = 0; i < count; ++i) {
+        std::string n = std::to_string(i);
+        script += "  ; shape " + n + "\n  (define s" + n + " (line (point " + n + " -" + n + ".5) (point (* " + n +
+                  " pi) 1e-3)))\n";
+    }
+    return script + ")\n";
+}
+
+static void addFrontEnd(std::vector<Benchmark> &benchmarks) {
+    static const std::string script = sampleScript(1000);
+    benchmarks.push_back({"tokenize/script_1000_defines", 20, [](std::uint64_t n) {
+        for (std::uint64_t i = 0; i < n; ++i) {
+            std::istringstream iss(script);
+            sink = tokenize(iss).size();
+        }
+    }});
+
+    static const std::vector<std::string> numbers = {"0", "42", "-3.5", "1e-3", "6.02e23", "123456.789"};
+    static const std::vector<std::string> symbols = {"define", "s999", "fill_rect", "+", "<=", "True", "False"};
+    for (const auto *tokens : {&numbers, &symbols}) {
+        std::string kind = tokens == &numbers ? "numbers" : "symbols";
+        benchmarks.push_back({"token_to_atom/" + kind, 300000, [tokens](std::uint64_t n) {
+            Atom atom;
+            std::uint64_t ok = 0;
+            for (std::uint64_t i = 0; i < n; ++i) {
+                ok += token_to_atom((*tokens)[i % tokens->size()], atom);
+            }
+            sink = ok;
+        }});
+    }
+
+    // parse() tokenizes and then builds the tree, so parse_expression's share is the
+    // difference from the tokenize benchmark of the same script
+    benchmarks.push_back({"parse/script_1000_defines", 10, [](std::uint64_t n) {
+        Interpreter interpreter;
+        for (std::uint64_t i = 0; i < n; ++i) {
+            parseOrExit(interpreter, script);
+        }
+    }});
+    static const std::string nested = std::string(500, '(') + "+ 1 2" + std::string(500, ')');
+    benchmarks.push_back({"parse/nested_500_deep", 500, [](std::uint64_t n) {
+        Interpreter interpreter;
+        for (std::uint64_t i = 0; i < n; ++i) {
+            std::istringstream iss(nested);
+            sink = interpreter.parse(iss);
+        }
+    }});
+}
+
+static void addEnvironment(std::vector<Benchmark> &benchmarks) {
+    static std::vector<std::string> names;
+    static Environment env;
+    for (int i = 0; i < 1000; ++i) {
+        names.push_back("symbol" + std::to_string(i));
+        env.add(names.back(), Expression(static_cast<double>(i)));
+    }
+    env.add_procedure("+", procAdd, true);
+    benchmarks.push_back({"environment/find_1000_symbols", 300000, [](std::uint64_t n) {
+        std::uint64_t found = 0;
+        for (std::uint64_t i = 0; i < n; ++i) {
+            found += env.find(names[i % names.size()]) != nullptr;
+        }
+        sink = found;
+    }});
+    benchmarks.push_back({"environment/find_missing", 300000, [](std::uint64_t n) {
+        static const std::string missing = "symbol_missing";
+        std::uint64_t found = 0;
+        for (std::uint64_t i = 0; i < n; ++i) {
+            found += env.find(missing) != nullptr;
+        }
+        sink = found;
+    }});
+    benchmarks.push_back({"environment/find_procedure", 300000, [](std::uint64_t n) {
+        static const std::string plus = "+";
+        std::uint64_t found = 0;
+        for (std::uint64_t i = 0; i < n; ++i) {
+            found += env.find_procedure(plus) != nullptr;
+        }
+        sink = found;
+    }});
+}
+
+static void addBuiltins(std::vector<Benchmark> &benchmarks) {
+    typedef void (*Procedure)(const std::vector<Atom> &, Expression &);
+    struct Call {
+        const char *name;
+        Procedure proc;
+        const char *args;
+    };
+    const char *shapes = "(point 1 2) (point 3 4)";
+    static const Call calls[] = {
+        {"not", procNot, "False"},
+        {"and", procAnd, "True True False"},
+        {"or", procOr, "False False True"},
+        {"<", procLessThan, "1 2"},
+        {"<=", procLessThanOrEqual, "1 2"},
+        {">", procGreaterThan, "1 2"},
+        {">=", procGreaterThanOrEqual, "1 2"},
+        {"=", procEqual, "1 2"},
+        {"+", procAdd, "1 2 3 4"},
+        {"-", procSubtract, "5 3"},
+        {"*", procMultiply, "1 2 3 4"},
+        {"/", procDivide, "5 3"},
+        {"log10", procLog10, "1234.5"},
+        {"pow", procPow, "1.5 2.5"},
+        {"point", procPoint, "1 2"},
+        {"line", procLine, shapes},
+        {"arc", procArc, "(point 0 0) (point 1 1) 1.5"},
+        {"rect", procRect, "1 2 3 4"},
+        {"fill_rect", procFillRect, "(rect 1 2 3 4) 10 20 30"},
+        {"ellipse", procEllipse, "(rect 1 2 3 4)"},
+        {"sin", procSine, "0.7"},
+        {"cos", procCosine, "0.7"},
+        {"arctan", procArctan, "1 2"},
+        {"fast/sin", procFastSine, "0.7"},
+        {"fast/cos", procFastCosine, "0.7"},
+        {"fast/arctan", procFastArctan, "1 2"},
+        {"fast/log10", procFastLog10, "1234.5"},
+        {"fast/pow", procFastPow, "1.5 2.5"},
+        {"unchecked/not", procNotUnchecked, "False"},
+        {"unchecked/and", procAndUnchecked, "True True False"},
+        {"unchecked/or", procOrUnchecked, "False False True"},
+        {"unchecked/<", procLessThanUnchecked, "1 2"},
+        {"unchecked/<=", procLessThanOrEqualUnchecked, "1 2"},
+        {"unchecked/>", procGreaterThanUnchecked, "1 2"},
+        {"unchecked/>=", procGreaterThanOrEqualUnchecked, "1 2"},
+        {"unchecked/=", procEqualUnchecked, "1 2"},
+        {"unchecked/+", procAddUnchecked, "1 2 3 4"},
+        {"unchecked/-", procSubtractUnchecked, "5 3"},
+        {"unchecked/*", procMultiplyUnchecked, "1 2 3 4"},
+        {"unchecked//", procDivideUnchecked, "5 3"},
+        {"unchecked/log10", procLog10Unchecked, "1234.5"},
+        {"unchecked/pow", procPowUnchecked, "1.5 2.5"},
+        {"unchecked/point", procPointUnchecked, "1 2"},
+        {"unchecked/line", procLineUnchecked, shapes},
+        {"unchecked/arc", procArcUnchecked, "(point 0 0) (point 1 1) 1.5"},
+        {"unchecked/rect", procRectUnchecked, "1 2 3 4"},
+        {"unchecked/fill_rect", procFillRectUnchecked, "(rect 1 2 3 4) 10 20 30"},
+        {"unchecked/ellipse", procEllipseUnchecked, "(rect 1 2 3 4)"},
+        {"unchecked/sin", procSineUnchecked, "0.7"},
+        {"unchecked/cos", procCosineUnchecked, "0.7"},
+        {"unchecked/arctan", procArctanUnchecked, "1 2"},
+        {"list", procList, "1 2 3 4"},
+        {"range", procRange, "0 100 1"},
+        {"length", procLength, "(range 0 100 1)"},
+        {"nth", procNth, "(range 0 100 1) 50"},
+        {"sum", procSum, "(range 0 100 1)"},
+        {"min", procMin, "(range 0 100 1)"},
+        {"max", procMax, "(range 0 100 1)"},
+        {"+/list_1000", procAdd, "(range 0 1000 1) 1"},
+        {"sin/list_1000", procSine, "(range 0 1000 1)"},
+        {"point/list_1000", procPoint, "(range 0 1000 1) 2"},
+    };
+    for (const auto &call : calls) {
+        std::vector<Atom> args = arguments(call.args);
+        Procedure proc = call.proc;
+        bool large = std::strstr(call.name, "list_1000") != nullptr;
+        benchmarks.push_back({std::string("builtin/") + call.name, large ? 2000u : 1000000u,
+                              [proc, args](std::uint64_t n) {
+            // a fresh output per call, as the interpreter passes them
+            for (std::uint64_t i = 0; i < n; ++i) {
+                Expression output;
+                proc(args, output);
+                sink = output.head.type;
+            }
+        }});
+    }
+}
+
+static void addEval(std::vector<Benchmark> &benchmarks) {
+    struct Program {
+        const char *name;
+        const char *setup; // defines evaluated once, before the timed form
+        const char *form;
+        std::uint64_t iterations;
+    };
+    static const Program programs[] = {
+        {"arithmetic", nullptr, "(+ (* 2 3) (- 10 4) (/ 8 2) (pow 2 10))", 10000},
+        {"conditionals", nullptr, "(if (< 1 2) (if (and True (not False)) 1 2) 3)", 20000},
+        {"for_loop_1000", nullptr, "(for i 0 1000 1 (* i 2))", 100},
+        {"shapes_100", nullptr, "(for i 0 100 1 (line (point i 0) (point 0 (sin i))))", 300},
+        {"list_kernels_1000", nullptr, "(sum (* (sin (range 0 1000 1)) 2))", 2000},
+        {"recursion_fib_15", "(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))",
+         "(fib 15)", 15},
+        {"tail_calls_1000", "(define loop (lambda (n acc) (if (= n 0) acc (loop (- n 1) (+ acc n)))))",
+         "(loop 1000 0)", 30},
+    };
+    for (const auto &program : programs) {
+        std::shared_ptr<Interpreter> interpreter = std::make_shared<Interpreter>();
+        if (program.setup) {
+            parseOrExit(*interpreter, program.setup);
+            interpreter->eval();
+        }
+        parseOrExit(*interpreter, program.form);
+        benchmarks.push_back({std::string("eval/") + program.name, program.iterations,
+                              [interpreter](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; ++i) {
+                sink = interpreter->eval().head.type;
+            }
+        }});
+    }
+}
+
+static void addOutput(std::vector<Benchmark> &benchmarks) {
+    struct Printed {
+        const char *name;
+        const char *program;
+        std::uint64_t iterations;
+    };
+    static const Printed values[] = {
+        {"number", "(/ 1 3)", 300000},
+        {"point", "(point 1.5 -2.25)", 200000},
+        {"fill_rect", "(fill_rect (rect 1 2 3 4) 10 20 30)", 100000},
+        {"numbers_1000", "(/ (range 0 1000 1) 7)", 400},
+        {"lines_1000", "(line (point (range 0 1000 1) 0) (point 0 (sin (range 0 1000 1))))", 200},
+    };
+    for (const auto &value : values) {
+        Interpreter interpreter;
+        parseOrExit(interpreter, value.program);
+        Expression result = interpreter.eval();
+        benchmarks.push_back({std::string("output/") + value.name, value.iterations, [result](std::uint64_t n) {
+            std::ostringstream out;
+            for (std::uint64_t i = 0; i < n; ++i) {
+                out.str(std::string());
+                out << result;
+            }
+            sink = out.tellp();
+        }});
+    }
+}
+
+// Every benchmark, stage by stage
+static std::vector<Benchmark> allBenchmarks() {
+    std::vector<Benchmark> benchmarks;
+    addFrontEnd(benchmarks);
+    addEnvironment(benchmarks);
+    addBuiltins(benchmarks);
+    addEval(benchmarks);
+    addOutput(benchmarks);
+    return benchmarks;
+}
+
+// Appends text as a JSON string
+static void appendQuoted(const std::string &text, std::string &out) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+static void appendField(const char *key, double value, std::string &out) {
+    char digits[MAX_NUMBER_CHARS];
+    out += ", \"";
+    out += key;
+    out += "\": ";
+    out.append(digits, formatNumber(value, digits));
+}
+
+// One object per line, so runs diff well and --compare can read them back line by line
+static std::string toJson(const std::vector<Stats> &results) {
+    std::string out = "{\"benchmarks\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Stats &stats = results[i];
+        out += "  {\"name\": ";
+        appendQuoted(stats.name, out);
+        appendField("iterations", static_cast<double>(stats.iterations), out);
+        appendField("samples", static_cast<double>(stats.samples), out);
+        appendField("median_ns", stats.median, out);
+        appendField("mean_ns", stats.mean, out);
+        appendField("stddev_ns", stats.stddev, out);
+        appendField("mad_ns", stats.mad, out);
+        appendField("min_ns", stats.min, out);
+        appendField("max_ns", stats.max, out);
+        out += i + 1 < results.size() ? "},\n" : "}\n";
+    }
+    return out + "]}\n";
+}
+
+// The number after "key": in line, or 0 if it has none
+static double numberField(const std::string &line, const std::string &key) {
+    std::size_t at = line.find("\"" + key + "\":");
+    return at == std::string::npos ? 0 : std::strtod(line.c_str() + at + key.size() + 3, nullptr);
+}
+
+// Reads back the results toJson wrote; exits if path cannot be read
+static std::map<std::string, Stats> readJson(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Error: Unable to open file " << path << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    std::map<std::string, Stats> results;
+    std::string line;
+    while (std::getline(file, line)) {
+        static const std::string name_key = "{\"name\": \"";
+        std::size_t at = line.find(name_key);
+        if (at == std::string::npos) {
+            continue;
+        }
+        Stats stats;
+        for (std::size_t i = at + name_key.size(); i < line.size() && line[i] != '"'; ++i) {
+            if (line[i] == '\\' && i + 1 < line.size()) {
+                ++i;
+            }
+            stats.name += line[i];
+        }
+        stats.median = numberField(line, "median_ns");
+        stats.mad = numberField(line, "mad_ns");
+        results[stats.name] = stats;
+    }
+    return results;
+}
+
+// Scales a median absolute deviation to the standard deviation it estimates for normal noise
+static const double MAD_TO_SIGMA = 1.4826;
+
+// Prints each benchmark of both runs with the ratio of its medians. A change counts when the
+// medians differ by more than threshold (a fraction) and by more than three times the two
+// runs' noise, estimated from their median absolute deviations, which outliers do not
+// inflate as they do the standard deviation. Fails if any got slower.
+static int compareRuns(const std::string &before_path, const std::string &after_path, double threshold) {
+    std::map<std::string, Stats> before = readJson(before_path);
+    std::map<std::string, Stats> after = readJson(after_path);
+    int regressions = 0;
+    std::cout << std::left << std::setw(36) << "benchmark" << std::right << std::setw(14) << "before ns"
+              << std::setw(14) << "after ns" << std::setw(9) << "ratio" << std::endl;
+    for (const auto &entry : after) {
+        auto old = before.find(entry.first);
+        if (old == before.end()) {
+            std::cout << std::left << std::setw(36) << entry.first << "  new" << std::endl;
+            continue;
+        }
+        const Stats &a = old->second;
+        const Stats &b = entry.second;
+        double ratio = a.median > 0 ? b.median / a.median : 1;
+        bool changed = std::fabs(b.median - a.median) > threshold * a.median &&
+                       std::fabs(b.median - a.median) > 3 * MAD_TO_SIGMA * (a.mad + b.mad);
+        const char *verdict = !changed ? "" : ratio > 1 ? "  slower" : "  faster";
+        regressions += changed && ratio > 1;
+        std::cout << std::left << std::setw(36) << entry.first << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(14) << a.median << std::setw(14) << b.median << std::setprecision(3) << std::setw(9)
+                  << ratio << verdict << std::endl;
+    }
+    for (const auto &entry : before) {
+        if (after.find(entry.first) == after.end()) {
+            std::cout << std::left << std::setw(36) << entry.first << "  removed" << std::endl;
+        }
+    }
+    std::cout << regressions << " regression" << (regressions == 1 ? "" : "s") << std::endl;
+    return regressions == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int usage() {
+    std::cerr << "Usage: slisp_bench [--list] [--filter TEXT] [--samples N] [--out FILE]\n"
+                 "       slisp_bench --compare BEFORE.json AFTER.json [--threshold PERCENT]"
+              << std::endl;
+    return EXIT_FAILURE;
+}
+
+// Times every stage of the interpreter, writing the results as JSON, or compares two such runs
+int main(int argc, char **argv) {
+    std::string filter;
+    std::string out_path;
+    std::size_t samples = 10;
+    double threshold = 5;
+    bool list = false;
+    std::vector<std::string> compare;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--list") {
+            list = true;
+        } else if (arg == "--compare" && i + 2 < argc) {
+            compare = {argv[i + 1], argv[i + 2]};
+            i += 2;
+        } else if (i + 1 >= argc) {
+            return usage();
+        } else if (arg == "--filter") {
+            filter = argv[++i];
+        } else if (arg == "--out") {
+            out_path = argv[++i];
+        } else if (arg == "--samples") {
+            samples = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--threshold") {
+            threshold = std::strtod(argv[++i], nullptr);
+        } else {
+            return usage();
+        }
+    }
+    if (!compare.empty()) {
+        return compareRuns(compare[0], compare[1], threshold / 100);
+    }
+    if (samples == 0) {
+        return usage();
+    }
+
+    std::vector<Benchmark> selected;
+    for (auto &benchmark : allBenchmarks()) {
+        if (benchmark.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        if (list) {
+            std::cout << benchmark.name << std::endl;
+        }
+        selected.push_back(std::move(benchmark));
+    }
+    if (list) {
+        return EXIT_SUCCESS;
+    }
+    std::string json = toJson(measure(selected, samples));
+    if (out_path.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream file(out_path);
+        if (!(file << json)) {
+            std::cerr << "Error: Unable to write " << out_path << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
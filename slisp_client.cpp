@@ -0,0 +1,88 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "result_cache.hpp"
+#include "server.hpp"
+
+// Prints how to run the client
+static int usage() {
+    std::cerr << "Usage: slisp_client SOCKET [--session ID] [--binary] (-e expression | -f file | --reset | --drop)..."
+              << std::endl;
+    return EXIT_FAILURE;
+}
+
+// Sends every request on the command line to slisp --serve at once, then prints each reply in
+// order as slisp prints results and errors; --session and --binary apply to the requests after them
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        return usage();
+    }
+    std::vector<Request> requests;
+    Request next;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--binary") {
+            next.format = ReplyFormat::Binary;
+        } else if (arg == "--reset" || arg == "--drop") {
+            next.kind = arg == "--reset" ? RequestKind::Reset : RequestKind::Drop;
+            next.body.clear();
+            requests.push_back(next);
+        } else if (i + 1 >= argc) {
+            return usage();
+        } else if (arg == "--session") {
+            next.session = argv[++i];
+        } else if (arg == "-e" || arg == "-f") {
+            next.kind = arg == "-e" ? RequestKind::Expression : RequestKind::File;
+            next.body = argv[++i];
+            requests.push_back(next);
+        } else {
+            return usage();
+        }
+    }
+
+    int fd = connectServer(argv[1]);
+    if (fd < 0) {
+        std::cerr << "Error: Unable to connect to " << argv[1] << ": " << std::strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::string frames;
+    for (const auto &request : requests) {
+        frames += encodeRequest(request);
+    }
+    if (!writeAll(fd, frames)) {
+        std::cerr << "Error: Unable to send requests" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    for (const auto &request : requests) {
+        std::string payload;
+        Reply reply;
+        if (!readFrame(fd, payload) || !decodeReply(payload, reply)) {
+            std::cerr << "Error: Connection closed" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (!reply.ok) {
+            std::cerr << "Error: " << reply.body << std::endl;
+            status = EXIT_FAILURE;
+        } else if (request.kind == RequestKind::Reset || request.kind == RequestKind::Drop) {
+            continue;
+        } else if (request.format == ReplyFormat::Binary) {
+            const char *pos = reply.body.data();
+            Atom value;
+            if (!decodeAtom(pos, reply.body.data() + reply.body.size(), value)) {
+                std::cerr << "Error: Malformed value" << std::endl;
+                return EXIT_FAILURE;
+            }
+            std::cout << Expression(value) << std::endl;
+        } else {
+            std::cout << reply.body << std::endl;
+        }
+    }
+    close(fd);
+    return status;
+}
@@ -0,0 +1,541 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/statvfs.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "interpreter.hpp"
+#include "workload.hpp"
+
+// Time and peak resident memory of one stage of a run
+struct StageResult {
+    std::string stage;
+    double ms = 0;
+    long peak_kb = 0; // of the process running the stage, over that stage and the ones before it
+    bool ok = true;
+};
+
+static StageResult stageResult(const std::string &stage, double ms, long peak_kb, bool ok) {
+    StageResult result;
+    result.stage = stage;
+    result.ms = ms;
+    result.peak_kb = peak_kb;
+    result.ok = ok;
+    return result;
+}
+
+// Reads the next argument as a count, accepting forms such as 1e6
+static std::uint64_t parseSize(const std::string &option, const char *value) {
+    char *end;
+    double parsed = std::strtod(value, &end);
+    if (*value == '\0' || *end != '\0' || !(parsed >= 0) || parsed > 1e15) {
+        std::cerr << "Error: " << option << " expects a count" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    return static_cast<std::uint64_t>(parsed);
+}
+
+static double parseRatio(const std::string &option, const char *value) {
+    char *end;
+    double parsed = std::strtod(value, &end);
+    if (*value == '\0' || *end != '\0' || !(parsed >= 0 && parsed <= 1)) {
+        std::cerr << "Error: " << option << " expects a ratio between 0 and 1" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    return parsed;
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static long peakKilobytes() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Keeps the drawn graphics for the headless render stage
+class HeadlessRenderer : public Interpreter {
+public:
+    using Interpreter::graphics;
+};
+
+// Extent of the scene the graphics cover, computed from each shape the way the canvas
+// computes the bounds of the item it draws for it
+struct SceneBounds {
+    double left = INFINITY;
+    double top = INFINITY;
+    double right = -INFINITY;
+    double bottom = -INFINITY;
+
+    void add(double x1, double y1, double x2, double y2) {
+        left = std::min(left, std::min(x1, x2));
+        right = std::max(right, std::max(x1, x2));
+        top = std::min(top, std::min(y1, y2));
+        bottom = std::max(bottom, std::max(y1, y2));
+    }
+
+    void add(const Expression &shape) {
+        const Value &value = shape.head.value;
+        switch (shape.head.type) {
+        case PointType:
+            add(value.point_value.x - 2.5, value.point_value.y - 2.5, value.point_value.x + 2.5,
+                value.point_value.y + 2.5);
+            break;
+        case LineType:
+            add(value.line_value.first.x, value.line_value.first.y, value.line_value.second.x,
+                value.line_value.second.y);
+            break;
+        case ArcType: {
+            const Point &center = value.arc_value.center;
+            double radius = std::hypot(value.arc_value.start.x - center.x, value.arc_value.start.y - center.y);
+            add(center.x - radius, center.y - radius, center.x + radius, center.y + radius);
+            break;
+        }
+        case RectType:
+            add(value.rect_value.x1, value.rect_value.y1, value.rect_value.x2, value.rect_value.y2);
+            break;
+        case FillRectType:
+            add(value.fillRect_value.rect.x1, value.fillRect_value.rect.y1, value.fillRect_value.rect.x2,
+                value.fillRect_value.rect.y2);
+            break;
+        case EllipseType:
+            add(value.ellipse_value.rect.x1, value.ellipse_value.rect.y1, value.ellipse_value.rect.x2,
+                value.ellipse_value.rect.y2);
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+// Runs fn in a child process, which reports its stages through a pipe, so each run starts
+// with a fresh heap and its peak memory is its own
+template <typename Fn>
+static std::vector<StageResult> inChild(Fn fn) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return {};
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        std::string report;
+        for (const StageResult &result : fn()) {
+            report += result.stage + ' ' + std::to_string(result.ms) + ' ' + std::to_string(result.peak_kb) + ' ' +
+                      (result.ok ? "1" : "0") + '\n';
+        }
+        ssize_t written = write(fds[1], report.data(), report.size());
+        _exit(written == static_cast<ssize_t>(report.size()) ? 0 : 1);
+    }
+    close(fds[1]);
+    std::string report;
+    char block[4096];
+    ssize_t n;
+    while ((n = read(fds[0], block, sizeof(block))) > 0 || (n < 0 && errno == EINTR)) {
+        report.append(block, n > 0 ? static_cast<std::size_t>(n) : 0);
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    std::vector<StageResult> results;
+    std::istringstream lines(report);
+    StageResult result;
+    int ok;
+    while (lines >> result.stage >> result.ms >> result.peak_kb >> ok) {
+        result.ok = ok == 1;
+        results.push_back(result);
+    }
+    return results;
+}
+
+// Runs a program with stdin and stdout redirected to files, /dev/null when empty, timing it
+// and reading its peak memory; ok if it exits with status 0
+static StageResult runProgram(const std::string &stage, const std::vector<std::string> &args,
+                              const std::string &input, const std::string &output) {
+    StageResult result;
+    result.stage = stage;
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(input.empty() ? "/dev/null" : input.c_str(), O_RDONLY);
+        int out = open(output.empty() ? "/dev/null" : output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int null = open("/dev/null", O_WRONLY);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        std::vector<char *> argv;
+        for (const auto &arg : args) {
+            argv.push_back(const_cast<char *>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    rusage usage;
+    wait4(pid, &status, 0, &usage);
+    result.ms = millisecondsSince(start);
+    result.peak_kb = usage.ru_maxrss;
+    result.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+        result.stage = "exec"; // the program could not be started
+    }
+    return result;
+}
+
+// Runs slisp on the script with its output discarded
+static StageResult runSlisp(const std::string &slisp, const std::string &script) {
+    return runProgram("slisp", {slisp, "--no-cache", script}, "", "");
+}
+
+// The stages of the headless render path: parse, eval, and the scene bounds of the graphics
+static std::vector<StageResult> renderHeadless(const std::string &script) {
+    std::vector<StageResult> results;
+    HeadlessRenderer interpreter;
+    interpreter.set_threads(1);
+
+    auto start = std::chrono::steady_clock::now();
+    std::ifstream file(script);
+    bool parsed = interpreter.parse(file);
+    results.push_back(stageResult("parse", millisecondsSince(start), peakKilobytes(), parsed));
+    if (!parsed) {
+        return results;
+    }
+
+    start = std::chrono::steady_clock::now();
+    bool evaluated = true;
+    try {
+        interpreter.eval();
+    } catch (const InterpreterSemanticError &) {
+        evaluated = false;
+    }
+    results.push_back(stageResult("eval", millisecondsSince(start), peakKilobytes(), evaluated));
+
+    start = std::chrono::steady_clock::now();
+    SceneBounds bounds;
+    for (const auto &shape : interpreter.graphics) {
+        bounds.add(shape);
+    }
+    results.push_back(stageResult("render", millisecondsSince(start), peakKilobytes(), bounds.left <= bounds.right));
+    return results;
+}
+
+// Megabytes the system could still give a process, from /proc/meminfo; 0 if unknown
+static double availableMegabytes() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    double kilobytes;
+    std::string unit;
+    while (meminfo >> key >> kilobytes >> unit) {
+        if (key == "MemAvailable:") {
+            return kilobytes / 1024;
+        }
+    }
+    return 0;
+}
+
+// Generates workloads of each size and times every stage on them, printing a row per stage
+// with its growth exponent from the previous size, t ~ size^exponent, so super-linear stages
+// stand out. A size is skipped when the last one's peak memory or script size, scaled up,
+// would not fit.
+static int runScaling(const WorkloadSpec &base, const std::vector<std::uint64_t> &sizes, const std::string &slisp,
+                      const std::string &directory) {
+    std::cout << std::left << std::setw(10) << "size" << std::setw(8) << "stage" << std::right << std::setw(12) << "ms"
+              << std::setw(12) << "ns/shape" << std::setw(11) << "peak MB" << std::setw(9) << "growth" << std::endl;
+    std::map<std::string, StageResult> previous;
+    std::uint64_t previous_size = 0;
+    double previous_peak_mb = 0;
+    double previous_file_mb = 0;
+    int failures = 0;
+    for (std::uint64_t size : sizes) {
+        if (previous_size > 0) {
+            double scale = static_cast<double>(size) / previous_size;
+            struct statvfs disk;
+            double disk_mb = statvfs(directory.c_str(), &disk) == 0 ? double(disk.f_bavail) * disk.f_frsize / 1048576 : 0;
+            double memory_mb = availableMegabytes();
+            if ((memory_mb > 0 && previous_peak_mb * scale > 0.8 * memory_mb) ||
+                (disk_mb > 0 && previous_file_mb * scale > 0.8 * disk_mb)) {
+                std::cout << std::left << std::setw(10) << size << "skipped: needs about " << std::fixed
+                          << std::setprecision(0) << previous_peak_mb * scale << " MB of memory and "
+                          << previous_file_mb * scale << " MB of disk, " << memory_mb << " and " << disk_mb
+                          << " MB available" << std::endl;
+                continue;
+            }
+        }
+
+        WorkloadSpec spec = base;
+        spec.shapes = size;
+        std::string script = directory + "/workload_" + std::to_string(size) + ".slp";
+        std::vector<StageResult> stages = inChild([&]() {
+            auto start = std::chrono::steady_clock::now();
+            std::ofstream file(script, std::ios::binary);
+            writeWorkload(spec, file);
+            file.flush();
+            return std::vector<StageResult>{stageResult("generate", millisecondsSince(start), peakKilobytes(), file.good())};
+        });
+        std::ifstream written(script, std::ios::binary | std::ios::ate);
+        double file_mb = written ? double(written.tellg()) / 1048576 : 0;
+        stages.push_back(runSlisp(slisp, script));
+        for (const StageResult &stage : inChild([&]() { return renderHeadless(script); })) {
+            stages.push_back(stage);
+        }
+        std::remove(script.c_str());
+
+        double peak_mb = 0;
+        for (const StageResult &stage : stages) {
+            peak_mb = std::max(peak_mb, stage.peak_kb / 1024.0);
+            std::cout << std::left << std::setw(10) << size << std::setw(8) << stage.stage << std::right << std::fixed
+                      << std::setprecision(1) << std::setw(12) << stage.ms << std::setw(12)
+                      << stage.ms * 1e6 / size << std::setw(11) << stage.peak_kb / 1024.0;
+            auto before = previous.find(stage.stage);
+            if (before != previous.end() && before->second.ms > 0 && stage.ms > 0) {
+                double growth = std::log(stage.ms / before->second.ms) / std::log(double(size) / previous_size);
+                std::cout << std::setprecision(2) << std::setw(9) << growth;
+                // below 10 ms, timer and startup noise swamp the growth
+                if (growth > 1.15 && stage.ms > 10) {
+                    std::cout << "  super-linear";
+                }
+            }
+            if (!stage.ok) {
+                std::cout << "  failed";
+                ++failures;
+            }
+            std::cout << std::endl;
+            previous[stage.stage] = stage;
+        }
+        if (stages.size() < 5) {
+            std::cout << std::left << std::setw(10) << size << "a stage did not report" << std::endl;
+            ++failures;
+        }
+        previous_size = size;
+        previous_peak_mb = peak_mb;
+        previous_file_mb = file_mb;
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// A family of workloads the differential run covers
+struct WorkloadClass {
+    const char *name;
+    unsigned depth;
+    std::uint64_t defines;
+    double symbol_ratio;
+    double comment_ratio;
+    bool crlf;
+};
+
+static const WorkloadClass WORKLOAD_CLASSES[] = {
+    {"flat", 0, 10, 0.5, 0.1, false},
+    {"nested", 8, 10, 0.5, 0.1, false},
+    {"symbols", 1, 1000, 0.9, 0.1, false},
+    {"literals", 1, 0, 0, 0.1, false},
+    {"comments", 1, 10, 0.5, 0.9, false},
+    {"crlf", 1, 10, 0.5, 0.1, true},
+};
+
+// Line at which two files first differ, counting from 1; 0 if they are identical
+static std::uint64_t firstDifference(const std::string &first, const std::string &second) {
+    std::ifstream a(first, std::ios::binary);
+    std::ifstream b(second, std::ios::binary);
+    std::string line_a;
+    std::string line_b;
+    for (std::uint64_t line = 1;; ++line) {
+        bool more_a = static_cast<bool>(std::getline(a, line_a));
+        bool more_b = static_cast<bool>(std::getline(b, line_b));
+        if (more_a != more_b || line_a != line_b) {
+            return line;
+        }
+        if (!more_a) {
+            return 0;
+        }
+    }
+}
+
+// Types every class of workload at each size into both REPLs, ours printing numbers in the
+// reference's format, and checks that they print the same; prints the throughput and peak
+// memory of each and their ratios, then each class's geometric means. reference runs
+// through runner, if given, such as an emulator for a binary of another architecture.
+static int runDifferential(const WorkloadSpec &base, const std::vector<std::uint64_t> &sizes,
+                           const std::string &slisp, const std::vector<std::string> &runner,
+                           const std::string &reference, const std::string &directory) {
+    std::cout << std::left << std::setw(10) << "class" << std::setw(10) << "size" << std::setw(10) << "output"
+              << std::right << std::setw(14) << "shapes/s" << std::setw(14) << "ref shapes/s" << std::setw(8)
+              << "time x" << std::setw(10) << "MB" << std::setw(10) << "ref MB" << std::setw(8) << "mem x"
+              << std::endl;
+    std::string ours_output = directory + "/differential_ours.txt";
+    std::string reference_output = directory + "/differential_reference.txt";
+    int mismatches = 0;
+    for (const WorkloadClass &workload : WORKLOAD_CLASSES) {
+        double log_time = 0;
+        double log_memory = 0;
+        int runs = 0;
+        for (std::uint64_t size : sizes) {
+            WorkloadSpec spec = base;
+            spec.shapes = size;
+            spec.depth = workload.depth;
+            spec.defines = workload.defines;
+            spec.symbol_ratio = workload.symbol_ratio;
+            spec.comment_ratio = workload.comment_ratio;
+            spec.crlf = workload.crlf;
+            spec.repl = true;
+            std::string script = directory + "/differential_" + workload.name + ".slp";
+            {
+                std::ofstream file(script, std::ios::binary);
+                writeWorkload(spec, file);
+            }
+
+            std::vector<std::string> reference_args = runner;
+            reference_args.push_back(reference);
+            StageResult theirs = runProgram("reference", reference_args, script, reference_output);
+            if (theirs.stage == "exec") {
+                std::cerr << "Error: Unable to run " << reference
+                          << "; a binary for another architecture needs --runner, such as qemu-aarch64" << std::endl;
+                return EXIT_FAILURE;
+            }
+            StageResult ours = runProgram("slisp", {slisp, "--no-cache", "--numbers=compat"}, script, ours_output);
+            std::uint64_t difference = firstDifference(ours_output, reference_output);
+            std::string verdict = difference == 0 ? "same" : "line " + std::to_string(difference);
+            mismatches += difference != 0;
+
+            double time_ratio = ours.ms / theirs.ms;
+            double memory_ratio = double(ours.peak_kb) / theirs.peak_kb;
+            log_time += std::log(time_ratio);
+            log_memory += std::log(memory_ratio);
+            ++runs;
+            std::cout << std::left << std::setw(10) << workload.name << std::setw(10) << size << std::setw(10)
+                      << verdict << std::right << std::fixed << std::setprecision(0) << std::setw(14)
+                      << size / ours.ms * 1000 << std::setw(14) << size / theirs.ms * 1000 << std::setprecision(2)
+                      << std::setw(8) << time_ratio << std::setprecision(1) << std::setw(10) << ours.peak_kb / 1024.0
+                      << std::setw(10) << theirs.peak_kb / 1024.0 << std::setprecision(2) << std::setw(8)
+                      << memory_ratio << std::endl;
+            std::remove(script.c_str());
+        }
+        if (runs > 0) {
+            std::cout << std::left << std::setw(10) << workload.name << "geometric mean: time x " << std::fixed
+                      << std::setprecision(2) << std::exp(log_time / runs) << ", mem x "
+                      << std::exp(log_memory / runs) << std::endl;
+        }
+    }
+    std::remove(ours_output.c_str());
+    std::remove(reference_output.c_str());
+    std::cout << mismatches << " workload" << (mismatches == 1 ? "" : "s") << " with different output" << std::endl;
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int usage() {
+    std::cerr << "Usage: slisp_workload [--shapes N] [--depth D] [--defines K] [--symbols RATIO] [--comments RATIO]"
+                 " [--crlf] [--repl] [--seed S] [-o FILE]\n"
+                 "       slisp_workload --scale [--sizes N,N,...] [--slisp PATH] [--dir DIR] [generator options]\n"
+                 "       slisp_workload --differential [--reference PATH] [--runner COMMAND] [--sizes N,N,...]"
+                 " [--slisp PATH] [--dir DIR] [--seed S]"
+              << std::endl;
+    return EXIT_FAILURE;
+}
+
+// Writes a synthetic script, or with --scale times slisp and the headless render path on a
+// range of script sizes, or with --differential checks slisp against a reference build
+int main(int argc, char **argv) {
+    WorkloadSpec spec;
+    std::string output;
+    bool scale = false;
+    bool differential = false;
+    std::vector<std::uint64_t> sizes;
+    std::string reference = "ref-binary/slisp";
+    std::vector<std::string> runner;
+    std::string program = argv[0];
+    std::string slisp = program.substr(0, program.find_last_of('/') + 1) + "slisp";
+    std::string directory = "/tmp";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--crlf") {
+            spec.crlf = true;
+        } else if (arg == "--repl") {
+            spec.repl = true;
+        } else if (arg == "--scale") {
+            scale = true;
+        } else if (arg == "--differential") {
+            differential = true;
+        } else if (i + 1 >= argc) {
+            return usage();
+        } else if (arg == "--shapes") {
+            spec.shapes = parseSize(arg, argv[++i]);
+        } else if (arg == "--depth") {
+            spec.depth = static_cast<unsigned>(parseSize(arg, argv[++i]));
+        } else if (arg == "--defines") {
+            spec.defines = parseSize(arg, argv[++i]);
+        } else if (arg == "--symbols") {
+            spec.symbol_ratio = parseRatio(arg, argv[++i]);
+        } else if (arg == "--comments") {
+            spec.comment_ratio = parseRatio(arg, argv[++i]);
+        } else if (arg == "--seed") {
+            spec.seed = parseSize(arg, argv[++i]);
+        } else if (arg == "-o") {
+            output = argv[++i];
+        } else if (arg == "--slisp") {
+            slisp = argv[++i];
+        } else if (arg == "--reference") {
+            reference = argv[++i];
+        } else if (arg == "--runner") {
+            std::istringstream words(argv[++i]);
+            std::string word;
+            while (words >> word) {
+                runner.push_back(word);
+            }
+        } else if (arg == "--dir") {
+            directory = argv[++i];
+        } else if (arg == "--sizes") {
+            std::string list = argv[++i];
+            for (std::size_t start = 0; start <= list.size();) {
+                std::size_t comma = std::min(list.find(',', start), list.size());
+                sizes.push_back(parseSize(arg, list.substr(start, comma - start).c_str()));
+                start = comma + 1;
+            }
+        } else {
+            return usage();
+        }
+    }
+
+    if (scale && differential) {
+        return usage();
+    }
+    if (scale) {
+        if (sizes.empty()) {
+            sizes = {1000, 10000, 100000, 1000000, 10000000};
+        }
+        return runScaling(spec, sizes, slisp, directory);
+    }
+    if (differential) {
+        if (sizes.empty()) {
+            sizes = {1000, 10000, 100000};
+        }
+        return runDifferential(spec, sizes, slisp, runner, reference, directory);
+    }
+    if (output.empty()) {
+        writeWorkload(spec, std::cout);
+        return std::cout.flush() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    std::ofstream file(output, std::ios::binary);
+    writeWorkload(spec, file);
+    if (!file.flush()) {
+        std::cerr << "Error: Unable to write " << output << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,389 @@
+#include "snapshot.hpp"
+#include "environment.hpp"
+#include "result_cache.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Where a symbol's name and value are in the file
+struct Snapshot::Entry {
+    std::uint64_t name_offset;
+    std::uint64_t name_size;
+    std::uint64_t value_offset;
+    std::uint64_t value_size;
+};
+
+namespace {
+
+// Start of every snapshot; bump the digit when the format changes
+const char MAGIC[8] = {'S', 'L', 'S', 'N', 'A', 'P', '0', '1'};
+
+// The magic, then the number of entries, then the entries sorted by name, then the names
+// and values they point to
+const std::size_t HEADER_BYTES = sizeof(MAGIC) + sizeof(std::uint64_t);
+const std::size_t ENTRY_BYTES = 4 * sizeof(std::uint64_t);
+
+// Tags of the ways an atom is written
+const char ATOM_TAG = 'A';      // as encodeAtom writes it
+const char LIST_TAG = 'L';      // a list holding procedures, element by element
+const char PROCEDURE_TAG = 'P'; // a lambda: its parameters, body and closure
+
+template <typename T>
+void putRaw(std::string &out, const T &value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool getRaw(const char *&pos, const char *end, T &value)
+{
+    if (static_cast<std::size_t>(end - pos) < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&value, pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+void putString(std::string &out, const std::string &text)
+{
+    putRaw(out, static_cast<std::uint64_t>(text.size()));
+    out += text;
+}
+
+bool getString(const char *&pos, const char *end, std::string &text)
+{
+    std::uint64_t size;
+    if (!getRaw(pos, end, size) || size > static_cast<std::uint64_t>(end - pos)) {
+        return false;
+    }
+    text.assign(pos, static_cast<std::size_t>(size));
+    pos += size;
+    return true;
+}
+
+// Whether an atom is or holds a procedure
+bool holdsProcedure(const Atom &atom)
+{
+    if (atom.type == ProcedureType) {
+        return true;
+    }
+    if (atom.type != ListType || atom.value.list_value->numeric) {
+        return false;
+    }
+    for (const auto &item : atom.value.list_value->items) {
+        if (holdsProcedure(item)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool putExpression(std::string &out, const Expression &expr);
+
+// Writes a closure and the frames it is nested in, copying a frame shared by several
+// closures into each
+bool putFrame(std::string &out, const Frame *frame);
+
+bool putAtom(std::string &out, const Atom &atom)
+{
+    if (atom.type == ProcedureType) {
+        const Lambda *lambda = atom.value.proc_value.get();
+        if (!lambda) {
+            return false;
+        }
+        out += PROCEDURE_TAG;
+        putRaw(out, static_cast<std::uint64_t>(lambda->params.size()));
+        for (const auto &param : lambda->params) {
+            putString(out, param);
+        }
+        return putExpression(out, lambda->body) && putFrame(out, lambda->closure.get());
+    }
+    if (holdsProcedure(atom)) {
+        const List &list = *atom.value.list_value;
+        out += LIST_TAG;
+        putRaw(out, static_cast<std::uint64_t>(list.items.size()));
+        for (const auto &item : list.items) {
+            if (!putAtom(out, item)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    out += ATOM_TAG;
+    return encodeAtom(atom, out);
+}
+
+bool putFrame(std::string &out, const Frame *frame)
+{
+    if (!frame) {
+        out += '\0';
+        return true;
+    }
+    out += '\1';
+    putRaw(out, static_cast<std::uint64_t>(frame->names.size()));
+    for (std::size_t i = 0; i < frame->names.size(); ++i) {
+        putString(out, frame->names[i]);
+        if (!putAtom(out, frame->values[i])) {
+            return false;
+        }
+    }
+    return putFrame(out, frame->parent.get());
+}
+
+bool putExpression(std::string &out, const Expression &expr)
+{
+    if (!putAtom(out, expr.head)) {
+        return false;
+    }
+    putRaw(out, static_cast<std::uint64_t>(expr.tail.size()));
+    for (const auto &sub_expr : expr.tail) {
+        if (!putExpression(out, sub_expr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool getExpression(const char *&pos, const char *end, Expression &expr);
+
+bool getFrame(const char *&pos, const char *end, std::shared_ptr<Frame> &frame);
+
+// Reads a count of items that take at least one byte each
+bool getCount(const char *&pos, const char *end, std::uint64_t &count)
+{
+    return getRaw(pos, end, count) && count <= static_cast<std::uint64_t>(end - pos);
+}
+
+bool getAtom(const char *&pos, const char *end, Atom &atom)
+{
+    if (pos == end) {
+        return false;
+    }
+    char tag = *pos++;
+    if (tag == ATOM_TAG) {
+        return decodeAtom(pos, end, atom);
+    }
+    std::uint64_t count;
+    if (!getCount(pos, end, count)) {
+        return false;
+    }
+    atom = Atom();
+    if (tag == LIST_TAG) {
+        std::shared_ptr<List> list = std::make_shared<List>();
+        list->numeric = false;
+        list->items.resize(static_cast<std::size_t>(count));
+        for (auto &item : list->items) {
+            if (!getAtom(pos, end, item)) {
+                return false;
+            }
+        }
+        atom.type = ListType;
+        atom.value.list_value = list;
+        return true;
+    }
+    if (tag != PROCEDURE_TAG) {
+        return false;
+    }
+    std::shared_ptr<Lambda> lambda = std::make_shared<Lambda>();
+    lambda->params.resize(static_cast<std::size_t>(count));
+    for (auto &param : lambda->params) {
+        if (!getString(pos, end, param)) {
+            return false;
+        }
+    }
+    if (!getExpression(pos, end, lambda->body) || !getFrame(pos, end, lambda->closure)) {
+        return false;
+    }
+    atom.type = ProcedureType;
+    atom.value.proc_value = lambda;
+    return true;
+}
+
+bool getFrame(const char *&pos, const char *end, std::shared_ptr<Frame> &frame)
+{
+    if (pos == end) {
+        return false;
+    }
+    if (*pos++ == '\0') {
+        frame.reset();
+        return true;
+    }
+    std::uint64_t count;
+    if (!getCount(pos, end, count)) {
+        return false;
+    }
+    frame = std::make_shared<Frame>();
+    frame->names.resize(static_cast<std::size_t>(count));
+    frame->values.resize(static_cast<std::size_t>(count));
+    for (std::size_t i = 0; i < frame->names.size(); ++i) {
+        if (!getString(pos, end, frame->names[i]) || !getAtom(pos, end, frame->values[i])) {
+            return false;
+        }
+    }
+    return getFrame(pos, end, frame->parent);
+}
+
+bool getExpression(const char *&pos, const char *end, Expression &expr)
+{
+    std::uint64_t count;
+    if (!getAtom(pos, end, expr.head) || !getCount(pos, end, count)) {
+        return false;
+    }
+    expr.tail.resize(static_cast<std::size_t>(count));
+    for (auto &sub_expr : expr.tail) {
+        if (!getExpression(pos, end, sub_expr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+const std::size_t Snapshot::npos;
+
+/* Checks the header and that the entries fit; the entries themselves are checked when used */
+std::shared_ptr<const Snapshot> Snapshot::open(const std::string &path, std::string &error)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "Unable to open snapshot " + path + ": " + std::strerror(errno);
+        return nullptr;
+    }
+    struct stat info;
+    void *mapped = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && static_cast<std::size_t>(info.st_size) >= HEADER_BYTES) {
+        mapped = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        error = "Unable to read snapshot " + path;
+        return nullptr;
+    }
+
+    std::shared_ptr<Snapshot> snapshot(new Snapshot());
+    snapshot->data = static_cast<const char *>(mapped);
+    snapshot->length = static_cast<std::size_t>(info.st_size);
+    std::uint64_t count;
+    std::memcpy(&count, snapshot->data + sizeof(MAGIC), sizeof(count));
+    if (std::memcmp(snapshot->data, MAGIC, sizeof(MAGIC)) != 0 ||
+        count > (snapshot->length - HEADER_BYTES) / ENTRY_BYTES) {
+        error = path + " is not a snapshot";
+        return nullptr;
+    }
+    snapshot->count = static_cast<std::size_t>(count);
+    return snapshot;
+}
+
+Snapshot::~Snapshot()
+{
+    if (data) {
+        munmap(const_cast<char *>(data), length);
+    }
+}
+
+std::size_t Snapshot::size() const noexcept
+{
+    return count;
+}
+
+/* Binary search over the sorted entries; a damaged name simply never matches */
+std::size_t Snapshot::find(const std::string &symbol) const noexcept
+{
+    std::size_t low = 0;
+    std::size_t high = count;
+    while (low < high) {
+        std::size_t middle = low + (high - low) / 2;
+        const Entry &candidate = entry(middle);
+        if (candidate.name_offset > length || candidate.name_size > length - candidate.name_offset) {
+            return npos;
+        }
+        std::size_t common = std::min(symbol.size(), static_cast<std::size_t>(candidate.name_size));
+        int order = std::memcmp(data + candidate.name_offset, symbol.data(), common);
+        if (order == 0 && candidate.name_size != symbol.size()) {
+            order = candidate.name_size < symbol.size() ? -1 : 1;
+        }
+        if (order == 0) {
+            return middle;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return npos;
+}
+
+std::string Snapshot::name(std::size_t index) const
+{
+    const Entry &named = entry(index);
+    if (named.name_offset > length || named.name_size > length - named.name_offset) {
+        return std::string();
+    }
+    return std::string(data + named.name_offset, static_cast<std::size_t>(named.name_size));
+}
+
+bool Snapshot::decode(std::size_t index, Expression &value) const
+{
+    const Entry &stored = entry(index);
+    if (stored.value_offset > length || stored.value_size > length - stored.value_offset) {
+        return false;
+    }
+    const char *pos = data + stored.value_offset;
+    const char *end = pos + stored.value_size;
+    return getExpression(pos, end, value) && pos == end;
+}
+
+const Snapshot::Entry &Snapshot::entry(std::size_t index) const noexcept
+{
+    return reinterpret_cast<const Entry *>(data + HEADER_BYTES)[index];
+}
+
+/* Writes to a temporary file first and renames it over path */
+bool writeSnapshot(const std::string &path, const std::map<std::string, Expression> &symbols, std::string &error)
+{
+    std::string index;
+    std::string blob;
+    std::uint64_t blob_start = HEADER_BYTES + symbols.size() * ENTRY_BYTES;
+    for (const auto &symbol : symbols) {
+        std::uint64_t name_offset = blob_start + blob.size();
+        blob += symbol.first;
+        std::uint64_t value_offset = blob_start + blob.size();
+        if (!putExpression(blob, symbol.second)) {
+            error = "The value of " + symbol.first + " cannot be saved in a snapshot";
+            return false;
+        }
+        putRaw(index, name_offset);
+        putRaw(index, static_cast<std::uint64_t>(symbol.first.size()));
+        putRaw(index, value_offset);
+        putRaw(index, static_cast<std::uint64_t>(blob_start + blob.size() - value_offset));
+    }
+
+    std::string temporary = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        std::uint64_t count = symbols.size();
+        file.write(MAGIC, sizeof(MAGIC));
+        file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+        file << index << blob;
+        if (!file.flush()) {
+            error = "Unable to write snapshot " + path;
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        error = "Unable to write snapshot " + path + ": " + std::strerror(errno);
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include "expression.hpp"
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+
+// Global symbols and their values saved from an evaluated prelude. Opening a snapshot maps
+// the file read-only and checks its header; a value is decoded only when its symbol is first
+// looked up, so loading costs the same however large the prelude is. The file holds the
+// host's byte order, like the result cache.
+class Snapshot {
+public:
+    static const std::size_t npos = static_cast<std::size_t>(-1);
+
+    // Maps the snapshot at path; nullptr with error set if it cannot be read or is not a snapshot
+    static std::shared_ptr<const Snapshot> open(const std::string &path, std::string &error);
+
+    ~Snapshot();
+
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+
+    // Number of symbols
+    std::size_t size() const noexcept;
+
+    // Position of symbol among the symbols, which are sorted by name; npos if absent
+    std::size_t find(const std::string &symbol) const noexcept;
+
+    // Name of the symbol at index
+    std::string name(std::size_t index) const;
+
+    // Decodes the value of the symbol at index; false if its entry is damaged
+    bool decode(std::size_t index, Expression &value) const;
+
+private:
+    struct Entry;
+
+    const char *data = nullptr; // the mapped file
+    std::size_t length = 0;
+    std::size_t count = 0;
+
+    Snapshot() = default;
+
+    const Entry &entry(std::size_t index) const noexcept;
+};
+
+// Writes symbols and their values, procedures included, to a snapshot at path, replacing
+// any file there at once; false with error set on failure
+bool writeSnapshot(const std::string &path, const std::map<std::string, Expression> &symbols, std::string &error);
+
+#endif
@@ -0,0 +1,128 @@
+#define CATCH_CONFIG_MAIN  // Define the main function for Catch2 framework
+#define CATCH_CONFIG_COLOUR_NONE // Disable colored output for Catch2 tests
+#include "catch.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "compiled_program.hpp"
+#include "interpreter.hpp"
+#include "test_config.hpp"
+
+class DrawRecorder : public Interpreter {
+public:
+    using Interpreter::graphics;
+};
+
+// What a run of a script returned or the error it stopped with, and what it drew
+struct Outcome {
+    Expression result;
+    std::string error;
+    std::vector<Expression> graphics;
+};
+
+static std::string readScript(const std::string &source) {
+    std::ifstream file(TEST_FILE_DIR + "/" + source);
+    REQUIRE(file.good());
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+static Outcome interpret(const std::string &script) {
+    DrawRecorder interpreter;
+    std::istringstream iss(script);
+    REQUIRE(interpreter.parse(iss));
+    Outcome outcome;
+    try {
+        outcome.result = interpreter.eval();
+    } catch (const InterpreterSemanticError &e) {
+        outcome.error = e.what();
+    }
+    outcome.graphics = interpreter.graphics;
+    return outcome;
+}
+
+static Outcome runCompiled(const CompiledScript &script) {
+    Outcome outcome;
+    CompiledRun run(outcome.graphics);
+    try {
+        outcome.result = script.run(run);
+    } catch (const InterpreterSemanticError &e) {
+        outcome.error = e.what();
+    }
+    return outcome;
+}
+
+static const CompiledScript &findScript(const std::string &source) {
+    for (const auto &script : compiledScripts()) {
+        if (script.source == source) {
+            return script;
+        }
+    }
+    FAIL("no translation of " << source << " is linked in");
+    throw std::logic_error("unreachable");
+}
+
+// Every script under tests/ that CMakeLists.txt translates with slisp --emit-cpp is linked in
+TEST_CASE("Test translated scripts return and draw what the interpreter does", "[emit-cpp]") {
+    REQUIRE(!compiledScripts().empty());
+    for (const auto &script : compiledScripts()) {
+        INFO(script.source);
+        Outcome expected = interpret(readScript(script.source));
+        Outcome actual = runCompiled(script);
+        REQUIRE(actual.error == expected.error);
+        REQUIRE(actual.result == expected.result);
+        REQUIRE(actual.graphics.size() == expected.graphics.size());
+        for (std::size_t i = 0; i < expected.graphics.size(); ++i) {
+            REQUIRE(actual.graphics[i] == expected.graphics[i]);
+        }
+    }
+}
+
+TEST_CASE("Test a translated script can run repeatedly", "[emit-cpp]") {
+    const CompiledScript &script = findScript("test_loops.slp");
+    Outcome first = runCompiled(script);
+    Outcome second = runCompiled(script);
+    REQUIRE(first.error.empty());
+    REQUIRE(second.result == first.result);
+    REQUIRE(second.graphics == first.graphics);
+}
+
+TEST_CASE("Benchmark translated vs interpreted scripts", "[.][benchmark]") {
+    const int runs = 200;
+    for (const char *source : {"test_loops.slp", "test_airplane.slp"}) {
+        std::string text = readScript(source);
+        const CompiledScript &script = findScript(source);
+
+        // parsing is left out of the interpreter's time, as a service would parse once
+        std::vector<std::unique_ptr<DrawRecorder>> interpreters;
+        for (int i = 0; i < runs; ++i) {
+            interpreters.emplace_back(new DrawRecorder);
+            std::istringstream iss(text);
+            REQUIRE(interpreters.back()->parse(iss));
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (auto &interpreter : interpreters) {
+            interpreter->eval();
+        }
+        std::chrono::duration<double, std::micro> interpreted = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < runs; ++i) {
+            std::vector<Expression> graphics;
+            CompiledRun run(graphics);
+            script.run(run);
+        }
+        std::chrono::duration<double, std::micro> compiled = std::chrono::steady_clock::now() - start;
+
+        std::cout << source << ": interpreted " << interpreted.count() / runs << " us/run, translated "
+                  << compiled.count() / runs << " us/run (" << interpreted.count() / compiled.count() << "x)"
+                  << std::endl;
+    }
+}
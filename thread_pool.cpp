@@ -0,0 +1,137 @@
+#include "thread_pool.hpp"
+
+namespace {
+
+// Ranges dealt per worker, so there is something left to steal when costs are uneven
+const std::size_t RANGES_PER_WORKER = 8;
+
+}
+
+/* Starts workers - 1 threads; the caller of run() is worker 0 */
+ThreadPool::ThreadPool(std::size_t workers) : pending(0)
+{
+    if (workers == 0) {
+        workers = 1;
+    }
+    for (std::size_t i = 0; i < workers; ++i) {
+        queues.emplace_back(new Queue());
+    }
+    for (std::size_t i = 1; i < workers; ++i) {
+        threads.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+/* Stops and joins the worker threads */
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+/* Number of workers, including the calling thread */
+std::size_t ThreadPool::size() const noexcept
+{
+    return queues.size();
+}
+
+/* Deals [0, count) across the worker queues, works alongside the pool and waits for the batch */
+void ThreadPool::run(std::size_t count, const std::function<void(std::size_t, std::size_t)> &task)
+{
+    if (count == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> run_lock(run_mutex);
+
+    std::size_t workers = queues.size();
+    std::size_t grain = count / (workers * RANGES_PER_WORKER);
+    if (grain == 0) {
+        grain = 1;
+    }
+    std::size_t ranges = (count + grain - 1) / grain;
+
+    current = &task;
+    pending.store(ranges);
+    // deal contiguous blocks so each worker starts on neighbouring indices
+    std::size_t per_worker = (ranges + workers - 1) / workers;
+    for (std::size_t r = 0; r < ranges; ++r) {
+        Queue &queue = *queues[r / per_worker];
+        std::size_t first = r * grain;
+        std::size_t last = first + grain < count ? first + grain : count;
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.ranges.push_back(Range(first, last));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        ++generation;
+    }
+    wake.notify_all();
+
+    drain(0);
+
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done.wait(lock, [this]() { return pending.load() == 0; });
+    current = nullptr;
+}
+
+/* Sleeps until a batch is dealt, then helps drain it */
+void ThreadPool::worker_loop(std::size_t worker)
+{
+    std::size_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        drain(worker);
+    }
+}
+
+/* Runs ranges until every queue is empty */
+void ThreadPool::drain(std::size_t worker)
+{
+    Range range;
+    while (take(worker, range)) {
+        for (std::size_t i = range.first; i < range.second; ++i) {
+            (*current)(worker, i);
+        }
+        if (pending.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(done_mutex);
+            done.notify_all();
+        }
+    }
+}
+
+/* Pops from the back of the worker's own queue, else steals from the front of the others */
+bool ThreadPool::take(std::size_t worker, Range &range)
+{
+    {
+        Queue &own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.ranges.empty()) {
+            range = own.ranges.back();
+            own.ranges.pop_back();
+            return true;
+        }
+    }
+    for (std::size_t offset = 1; offset < queues.size(); ++offset) {
+        Queue &victim = *queues[(worker + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.ranges.empty()) {
+            range = victim.ranges.front();
+            victim.ranges.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,74 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A fixed set of worker threads that run index ranges with work stealing.
+// Each worker owns a queue of ranges; a worker whose queue runs dry steals
+// from the front of another worker's queue, so uneven per-task costs balance out.
+class ThreadPool {
+public:
+    // Starts workers - 1 threads; the thread calling run() acts as worker 0
+    explicit ThreadPool(std::size_t workers);
+
+    // Stops and joins the worker threads
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Number of workers, including the calling thread
+    std::size_t size() const noexcept;
+
+    // Calls task(worker, index) for every index in [0, count) and returns once all have run.
+    // worker identifies the calling worker in [0, size()). task must not throw.
+    void run(std::size_t count, const std::function<void(std::size_t, std::size_t)> &task);
+
+private:
+    typedef std::pair<std::size_t, std::size_t> Range; // [first, last)
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Range> ranges;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    // Serializes calls to run()
+    std::mutex run_mutex;
+
+    // Wakes sleeping workers when a new batch is dealt or the pool stops
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::size_t generation = 0;
+    bool stopping = false;
+
+    // Signals run() when the last range of a batch completes
+    std::mutex done_mutex;
+    std::condition_variable done;
+    std::atomic<std::size_t> pending;
+
+    // Task of the current batch; only read by a worker holding one of its ranges
+    const std::function<void(std::size_t, std::size_t)> *current = nullptr;
+
+    // Body of each worker thread
+    void worker_loop(std::size_t worker);
+
+    // Runs ranges from the worker's own queue, then stolen ones, until none remain
+    void drain(std::size_t worker);
+
+    // Takes the next range for worker: the back of its own queue, else the front of another's
+    bool take(std::size_t worker, Range &range);
+};
+
+#endif
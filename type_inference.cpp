@@ -0,0 +1,328 @@
+#include "type_inference.hpp"
+#include "interpreter_semantic_error.hpp"
+#include <map>
+#include <set>
+#include <utility>
+
+namespace {
+
+// The types an expression may evaluate to, one bit per Type
+typedef unsigned TypeSet;
+const TypeSet ANY_TYPE = ~0u;
+
+TypeSet typeBit(Type type)
+{
+    return 1u << type;
+}
+
+// Argument and result types of a builtin that has an unchecked variant
+struct Signature {
+    const char *name;
+    std::size_t min_args;
+    std::size_t max_args; // 0 for any number, each of type params[0]
+    Type params[4];
+    Type result;
+};
+
+const Signature SIGNATURES[] = {
+    {"not", 1, 1, {BooleanType}, BooleanType},
+    {"and", 1, 0, {BooleanType}, BooleanType},
+    {"or", 1, 0, {BooleanType}, BooleanType},
+    {"<", 2, 2, {NumberType, NumberType}, BooleanType},
+    {"<=", 2, 2, {NumberType, NumberType}, BooleanType},
+    {">", 2, 2, {NumberType, NumberType}, BooleanType},
+    {">=", 2, 2, {NumberType, NumberType}, BooleanType},
+    {"=", 2, 2, {NumberType, NumberType}, BooleanType},
+    {"+", 1, 0, {NumberType}, NumberType},
+    {"-", 1, 2, {NumberType, NumberType}, NumberType},
+    {"*", 1, 0, {NumberType}, NumberType},
+    {"/", 2, 2, {NumberType, NumberType}, NumberType},
+    {"log10", 1, 1, {NumberType}, NumberType},
+    {"pow", 2, 2, {NumberType, NumberType}, NumberType},
+    {"sin", 1, 1, {NumberType}, NumberType},
+    {"cos", 1, 1, {NumberType}, NumberType},
+    {"arctan", 2, 2, {NumberType, NumberType}, NumberType},
+    {"point", 2, 2, {NumberType, NumberType}, PointType},
+    {"line", 2, 2, {PointType, PointType}, LineType},
+    {"arc", 3, 3, {PointType, PointType, NumberType}, ArcType},
+    {"rect", 4, 4, {NumberType, NumberType, NumberType, NumberType}, RectType},
+    {"fill_rect", 4, 4, {RectType, NumberType, NumberType, NumberType}, FillRectType},
+    {"ellipse", 1, 1, {RectType}, EllipseType},
+};
+
+const Signature *findSignature(const Symbol &name)
+{
+    for (const auto &signature : SIGNATURES) {
+        if (name == signature.name) {
+            return &signature;
+        }
+    }
+    return nullptr;
+}
+
+// The single type in types if it is a plain value, which can stand in for an argument when
+// confirming a type error with the checked builtin; SymbolType (never a value) otherwise
+Type plainType(TypeSet types)
+{
+    for (Type type : {NoneType, BooleanType, NumberType, PointType, LineType, ArcType, RectType, FillRectType, EllipseType}) {
+        if (types == typeBit(type)) {
+            return type;
+        }
+    }
+    return SymbolType;
+}
+
+// Counts the defines of each name anywhere in expr
+void countDefines(const Expression &expr, std::map<Symbol, int> &counts)
+{
+    if (expr.head.type == SymbolType && expr.head.value.sym_value == "define" && expr.tail.size() == 2 &&
+        expr.tail[0].head.type == SymbolType) {
+        ++counts[expr.tail[0].head.value.sym_value];
+    }
+    for (const auto &sub_expr : expr.tail) {
+        countDefines(sub_expr, counts);
+    }
+}
+
+// One pass over a parsed expression
+class TypeInference {
+public:
+    TypeInference(const Environment &env, bool stable_globals, const Expression &root)
+        : env(env), stable_globals(stable_globals)
+    {
+        if (stable_globals) {
+            countDefines(root, define_counts);
+        }
+    }
+
+    // Types expr may evaluate to; sure if expr is evaluated whenever the whole expression is
+    TypeSet infer(Expression &expr, bool sure);
+
+private:
+    const Environment &env;
+    bool stable_globals;
+
+    // Lambda parameters and loop variables in scope, innermost last
+    std::vector<std::pair<Symbol, TypeSet>> scope;
+
+    // Defines of each name in the expression, and the types of those defined once, once seen
+    std::map<Symbol, int> define_counts;
+    std::map<Symbol, TypeSet> defined_types;
+
+    // Sets types to those of the variable a name refers to; false if it names no variable
+    bool lookup(const Symbol &name, TypeSet &types) const;
+
+    TypeSet inferCall(Expression &expr, const Symbol &op, bool sure);
+    TypeSet inferBuiltin(Expression &expr, const Symbol &name, bool sure);
+};
+
+bool TypeInference::lookup(const Symbol &name, TypeSet &types) const
+{
+    for (auto it = scope.rbegin(); it != scope.rend(); ++it) {
+        if (it->first == name) {
+            types = it->second;
+            return true;
+        }
+    }
+    if (const Expression *global = env.find(name)) {
+        types = stable_globals ? typeBit(global->head.type) : ANY_TYPE;
+        return true;
+    }
+    auto defined = define_counts.find(name);
+    if (defined != define_counts.end()) {
+        auto known = defined_types.find(name);
+        types = known != defined_types.end() ? known->second : ANY_TYPE;
+        return true;
+    }
+    return false;
+}
+
+TypeSet TypeInference::infer(Expression &expr, bool sure)
+{
+    switch (expr.head.type) {
+        case NumberType:
+        case BooleanType:
+        case ProcedureType:
+            return typeBit(expr.head.type);
+        case SymbolType:
+            break;
+        default:
+            return ANY_TYPE;
+    }
+
+    expr.head.unchecked = false;
+    const Symbol &op = expr.head.value.sym_value;
+    if (expr.tail.empty()) {
+        TypeSet types;
+        return lookup(op, types) ? types : ANY_TYPE;
+    }
+    return inferCall(expr, op, sure);
+}
+
+TypeSet TypeInference::inferCall(Expression &expr, const Symbol &op, bool sure)
+{
+    std::vector<Expression> &tail = expr.tail;
+    if (op == "begin") {
+        TypeSet last = ANY_TYPE;
+        for (auto &form : tail) {
+            last = infer(form, sure);
+        }
+        return last;
+    } else if (op == "define") {
+        if (tail.size() != 2 || tail[0].head.type != SymbolType) {
+            return ANY_TYPE;
+        }
+        TypeSet value = infer(tail[1], sure);
+        const Symbol &name = tail[0].head.value.sym_value;
+        if (stable_globals && define_counts[name] == 1 && !env.is_symbol_defined(name)) {
+            defined_types[name] = value;
+        }
+        return value;
+    } else if (op == "if") {
+        if (tail.size() != 3) {
+            return ANY_TYPE;
+        }
+        infer(tail[0], sure);
+        return infer(tail[1], false) | infer(tail[2], false);
+    } else if (op == "lambda") {
+        if (tail.size() != 2 || tail[0].head.type != SymbolType) {
+            return typeBit(ProcedureType);
+        }
+        std::size_t outer = scope.size();
+        scope.emplace_back(tail[0].head.value.sym_value, ANY_TYPE);
+        for (const auto &param : tail[0].tail) {
+            if (param.head.type == SymbolType) {
+                scope.emplace_back(param.head.value.sym_value, ANY_TYPE);
+            }
+        }
+        infer(tail[1], false);
+        scope.resize(outer);
+        return typeBit(ProcedureType);
+    } else if (op == "for" || op == "repeat") {
+        std::size_t bounds = op == "for" ? 4 : 1;
+        std::size_t first = op == "for" ? 1 : 0;
+        for (std::size_t i = first; i < bounds && i < tail.size(); ++i) {
+            infer(tail[i], sure);
+        }
+        std::size_t outer = scope.size();
+        if (op == "for" && tail[0].head.type == SymbolType) {
+            scope.emplace_back(tail[0].head.value.sym_value, typeBit(NumberType));
+        }
+        for (std::size_t i = bounds; i < tail.size(); ++i) {
+            infer(tail[i], false);
+        }
+        scope.resize(outer);
+        return ANY_TYPE;
+    } else if (op == "pmap" || op == "parallel-map") {
+        for (auto &arg : tail) {
+            infer(arg, sure);
+        }
+        return typeBit(ListType);
+    } else if (op == "draw") {
+        for (auto &arg : tail) {
+            infer(arg, sure);
+        }
+        return typeBit(NoneType);
+    }
+
+    TypeSet types;
+    if (lookup(op, types) || !env.is_procedure_defined(op)) {
+        // a call of a procedure value, or of an unknown name
+        for (auto &arg : tail) {
+            infer(arg, sure);
+        }
+        return ANY_TYPE;
+    }
+    return inferBuiltin(expr, op, sure);
+}
+
+TypeSet TypeInference::inferBuiltin(Expression &expr, const Symbol &name, bool sure)
+{
+    std::vector<TypeSet> args;
+    for (auto &arg : expr.tail) {
+        args.push_back(infer(arg, sure));
+    }
+
+    const Signature *signature = findSignature(name);
+    bool proven = signature && args.size() >= signature->min_args &&
+                  (signature->max_args == 0 || args.size() <= signature->max_args);
+    for (std::size_t i = 0; proven && i < args.size(); ++i) {
+        proven = args[i] == typeBit(signature->params[signature->max_args == 0 ? 0 : i]);
+    }
+    if (proven) {
+        expr.head.unchecked = true;
+        return typeBit(signature->result);
+    }
+
+    if (signature && sure) {
+        // every argument is known: the checked builtin decides whether the call must fail,
+        // throwing the same error it would have thrown when the call was reached
+        std::vector<Atom> stand_ins;
+        for (TypeSet types : args) {
+            Atom atom = Atom();
+            atom.type = plainType(types);
+            if (atom.type == SymbolType) {
+                return ANY_TYPE;
+            }
+            stand_ins.push_back(atom);
+        }
+        Expression unused;
+        env.find_procedure(name)->proc(stand_ins, unused);
+    }
+    return ANY_TYPE;
+}
+
+// Clears the unchecked flags in expr and in the lambdas its atoms hold
+void clearProvenExpression(Expression &expr, std::set<const void *> &seen);
+
+// Clears the unchecked flags in the lambdas value holds, directly or through lists and closures;
+// seen holds the lambdas and frames already visited, which closures may reach again
+void clearProvenValue(const Atom &value, std::set<const void *> &seen)
+{
+    if (value.type == ListType && !value.value.list_value->numeric) {
+        for (const auto &item : value.value.list_value->items) {
+            clearProvenValue(item, seen);
+        }
+    }
+    if (value.type != ProcedureType || !seen.insert(value.value.proc_value.get()).second) {
+        return;
+    }
+    clearProvenExpression(value.value.proc_value->body, seen);
+    for (const Frame *frame = value.value.proc_value->closure.get(); frame && seen.insert(frame).second;
+         frame = frame->parent.get()) {
+        for (const auto &bound : frame->values) {
+            clearProvenValue(bound, seen);
+        }
+    }
+}
+
+void clearProvenExpression(Expression &expr, std::set<const void *> &seen)
+{
+    // lambdas shared with other interpreters are only written where a flag is set
+    if (expr.head.unchecked) {
+        expr.head.unchecked = false;
+    }
+    clearProvenValue(expr.head, seen);
+    for (auto &operand : expr.tail) {
+        clearProvenExpression(operand, seen);
+    }
+}
+
+}
+
+/* Infers types over expr, flagging proven builtin calls to use their unchecked variants */
+void inferTypes(Expression &expr, const Environment &env, bool stable_globals)
+{
+    TypeInference inference(env, stable_globals, expr);
+    inference.infer(expr, true);
+}
+
+/* Clears the unchecked flags of lambdas bound, however deeply, to the globals of env */
+void clearProvenLambdas(const Environment &env)
+{
+    std::set<const void *> seen;
+    std::map<std::string, Expression> globals = env.symbols();
+    for (auto &global : globals) {
+        clearProvenExpression(global.second, seen);
+    }
+}
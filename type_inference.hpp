@@ -0,0 +1,22 @@
+#ifndef TYPE_INFERENCE_HPP
+#define TYPE_INFERENCE_HPP
+
+#include "expression.hpp"
+#include "environment.hpp"
+
+// Works out the types of expr's subexpressions from literals, shape constructors, loop
+// variables and the globals of env, and flags the head of every builtin call whose argument
+// types it proves as unchecked (see Atom), clearing the flag of calls it no longer proves.
+// Symbols are left as parsed. Lambda parameters are of unknown type, and so are the globals
+// of env unless stable_globals is set, which it may only be when define cannot rebind a name.
+//
+// Throws the builtin's own InterpreterSemanticError for a call that is certain to be
+// evaluated and certain to fail its type checks, before any of expr runs.
+void inferTypes(Expression &expr, const Environment &env, bool stable_globals);
+
+// Clears the unchecked flags in the body of every lambda reachable from the globals of env,
+// directly or through lists and closures, since they may have been proven with stable_globals.
+// Called before define may rebind a name.
+void clearProvenLambdas(const Environment &env);
+
+#endif
@@ -4,7 +4,40 @@
 #include "interpreter.hpp"
 #include "tokenize.hpp"
 #include "environment.hpp"
+#include "fast_math.hpp"
+#include "vector_kernels.hpp"
+#include "type_inference.hpp"
+#include "builtin_procedures.hpp"
+#include "cpp_emitter.hpp"
+#include "compiled_program.hpp"
+#include "result_cache.hpp"
+#include "session.hpp"
+#include "batch_runner.hpp"
+#include "server.hpp"
+#include "form_reader.hpp"
+#include "form_scanner.hpp"
+#include "number_format.hpp"
+#include "result_writer.hpp"
+#include "workload.hpp"
+#include "test_config.hpp"
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <cmath>
 #include <sstream> // For handling input stream manipulations
+#include <cstring>
+#include <thread>
+#include <fstream>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Points the slisp processes the tests start at the test cache, unless one is configured
+static const bool testCacheSelected = setenv("SLISP_CACHE_DIR", TEST_CACHE_DIR.c_str(), 0) == 0;
 
 // ------------------------------- Interpreter Tests -------------------------------
 
@@ -420,4 +453,2169 @@ TEST_CASE("Expression assignment operator: default/fallback case", "[expression]
 
     REQUIRE(a == b);
     REQUIRE(a.head.type == PointType);
-}
\ No newline at end of file
+}
+// ------------------------------- Evaluation Budget Tests -------------------------------
+
+TEST_CASE("Step limit stops evaluation and rolls back defines", "[budget]") {
+    Interpreter interpreter;
+    EvalLimits limits;
+    limits.max_steps = 5;
+    interpreter.set_limits(limits);
+
+    std::istringstream iss("(begin (define a 1) (+ 1 2 3 4 5 6))");
+    REQUIRE(interpreter.parse(iss));
+    try {
+        interpreter.eval();
+        FAIL("expected the step limit to trip");
+    } catch (const InterpreterLimitError &e) {
+        REQUIRE(e.kind() == LimitKind::Steps);
+        REQUIRE(e.limit() == 5);
+        REQUIRE(e.used() == 6);
+    }
+
+    // 'a' was rolled back, so defining it again is allowed
+    interpreter.set_limits(EvalLimits());
+    std::istringstream again("(define a 2)");
+    REQUIRE(interpreter.parse(again));
+    REQUIRE(interpreter.eval() == Expression(2.0));
+}
+
+TEST_CASE("Node and byte limits count produced values", "[budget]") {
+    Interpreter interpreter;
+    EvalLimits limits;
+    limits.max_nodes = 2;
+    interpreter.set_limits(limits);
+
+    std::istringstream iss("(+ (+ 1 2) (+ 3 4))");
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE_THROWS_AS(interpreter.eval(), InterpreterLimitError);
+
+    limits.max_nodes = 0;
+    limits.max_bytes = sizeof(Expression);
+    interpreter.set_limits(limits);
+    REQUIRE_THROWS_AS(interpreter.eval(), InterpreterLimitError);
+
+    interpreter.set_limits(EvalLimits());
+    REQUIRE(interpreter.eval() == Expression(10.0));
+    REQUIRE(interpreter.usage().nodes == 3);
+}
+
+TEST_CASE("Byte limit stops range before it allocates", "[budget]") {
+    Interpreter interpreter;
+    EvalLimits limits;
+    limits.max_bytes = 1000000;
+    interpreter.set_limits(limits);
+
+    std::istringstream iss("(length (range 4e9))");
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE_THROWS_AS(interpreter.eval(), InterpreterLimitError);
+    REQUIRE(interpreter.usage().bytes > limits.max_bytes);
+}
+
+TEST_CASE("Time limit stops a long evaluation", "[budget]") {
+    std::string program = "(+";
+    for (int i = 0; i < 300000; ++i) {
+        program += " (+ 1 1)";
+    }
+    program += ")";
+
+    Interpreter interpreter;
+    EvalLimits limits;
+    limits.max_time_ms = 1;
+    interpreter.set_limits(limits);
+
+    std::istringstream iss(program);
+    REQUIRE(interpreter.parse(iss));
+    try {
+        interpreter.eval();
+        FAIL("expected the time limit to trip");
+    } catch (const InterpreterLimitError &e) {
+        REQUIRE(e.kind() == LimitKind::Time);
+    }
+}
+
+TEST_CASE("Cancel stops the next evaluation only", "[budget]") {
+    Interpreter interpreter;
+    std::istringstream iss("(+ 1 2)");
+    REQUIRE(interpreter.parse(iss));
+
+    interpreter.cancel();
+    try {
+        interpreter.eval();
+        FAIL("expected the evaluation to be cancelled");
+    } catch (const InterpreterLimitError &e) {
+        REQUIRE(e.kind() == LimitKind::Cancelled);
+    }
+    REQUIRE(interpreter.eval() == Expression(3.0));
+}
+
+// ------------------------------- Lambda Tests -------------------------------
+
+// Parses and evaluates a program with an interpreter the caller has configured
+static Expression evalIn(Interpreter &interpreter, const std::string &program) {
+    std::istringstream iss(program);
+    REQUIRE(interpreter.parse(iss));
+    return interpreter.eval();
+}
+
+// Parses and evaluates a program with a fresh interpreter
+static Expression evalProgram(const std::string &program) {
+    Interpreter interpreter;
+    return evalIn(interpreter, program);
+}
+
+TEST_CASE("Test lambda application", "[lambda]") {
+    REQUIRE(evalProgram("(begin (define sq (lambda (x) (* x x))) (sq 7))") == Expression(49.0));
+    REQUIRE(evalProgram("(begin (define add (lambda (a b) (+ a b))) (add 2 3))") == Expression(5.0));
+
+    Expression proc = evalProgram("(lambda (x) x)");
+    REQUIRE(proc.head.type == ProcedureType);
+}
+
+TEST_CASE("Test lambda closures capture their defining scope", "[lambda]") {
+    std::string program =
+        "(begin"
+        " (define make_adder (lambda (n) (lambda (x) (+ x n))))"
+        " (define add5 (make_adder 5))"
+        " (define add10 (make_adder 10))"
+        " (+ (add5 1) (add10 1)))";
+    REQUIRE(evalProgram(program) == Expression(17.0));
+}
+
+TEST_CASE("Test tail recursion runs in constant stack", "[lambda]") {
+    std::string program =
+        "(begin"
+        " (define loop (lambda (i acc) (if (= i 0) acc (loop (- i 1) (+ acc 1)))))"
+        " (loop 200000 0))";
+    REQUIRE(evalProgram(program) == Expression(200000.0));
+}
+
+TEST_CASE("Test mutual tail calls", "[lambda]") {
+    std::string program =
+        "(begin"
+        " (define is_even (lambda (n) (if (= n 0) True (is_odd (- n 1)))))"
+        " (define is_odd (lambda (n) (if (= n 0) False (is_even (- n 1)))))"
+        " (is_even 100001))";
+    REQUIRE(evalProgram(program) == Expression(false));
+}
+
+TEST_CASE("Test lambda errors", "[lambda]") {
+    REQUIRE_THROWS_AS(evalProgram("(begin (define f (lambda (x) x)) (f 1 2))"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalProgram("(lambda (x x) x)"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalProgram("(lambda (if) 1)"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalProgram("(define lambda 1)"), InterpreterSemanticError);
+
+    // deep non-tail recursion is reported instead of overflowing the native stack
+    std::string program =
+        "(begin"
+        " (define count (lambda (n) (if (= n 0) 0 (+ 1 (count (- n 1))))))"
+        " (count 1000000))";
+    REQUIRE_THROWS_AS(evalProgram(program), InterpreterSemanticError);
+}
+
+// Exposes the shapes recorded by draw
+class DrawRecorder : public Interpreter {
+public:
+    using Interpreter::graphics;
+};
+
+TEST_CASE("Test draw inside a recursive lambda", "[lambda]") {
+    DrawRecorder interpreter;
+    std::istringstream iss(
+        "(begin"
+        " (define row (lambda (i n) (if (< i n) (begin (draw (point i (* 2 i))) (row (+ i 1) n)) n)))"
+        " (row 0 50))");
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE(interpreter.eval() == Expression(50.0));
+    REQUIRE(interpreter.graphics.size() == 50);
+    REQUIRE(interpreter.graphics[49] == Expression(std::make_tuple(49.0, 98.0)));
+}
+
+// ------------------------------- Loop Tests -------------------------------
+
+TEST_CASE("Test for loop", "[loop]") {
+    REQUIRE(evalProgram("(for i 0 10 1 i)") == Expression(9.0));
+    REQUIRE(evalProgram("(for i 10 0 -2 i)") == Expression(2.0));
+    REQUIRE(evalProgram("(for i 0 1 0.25 (* i 4))") == Expression(3.0));
+    REQUIRE(evalProgram("(for i 0 0 1 i)") == Expression());
+
+    // closures capturing the loop variable keep the value of their own iteration
+    std::string program =
+        "(begin"
+        " (define first (for i 0 3 1 (lambda (x) (+ x i))))"
+        " (first 10))";
+    REQUIRE(evalProgram(program) == Expression(12.0));
+}
+
+TEST_CASE("Test repeat", "[loop]") {
+    REQUIRE(evalProgram("(repeat 3 (+ 1 2))") == Expression(3.0));
+    REQUIRE(evalProgram("(repeat 0 1)") == Expression());
+}
+
+TEST_CASE("Test loop errors", "[loop]") {
+    REQUIRE_THROWS_AS(evalProgram("(for i 0 10 0 i)"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalProgram("(for i 0 True 1 i)"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalProgram("(for i 0 10 1)"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalProgram("(repeat -1 1)"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalProgram("(define for 1)"), InterpreterSemanticError);
+
+    // the loop variable is not visible after the loop
+    REQUIRE_THROWS_AS(evalProgram("(begin (for i 0 2 1 i) (+ i 1))"), InterpreterSemanticError);
+}
+
+TEST_CASE("Test nested loops draw a grid", "[loop]") {
+    DrawRecorder interpreter;
+    std::istringstream iss("(for x 0 20 1 (for y 0 30 1 (draw (point x y))))");
+    REQUIRE(interpreter.parse(iss));
+    interpreter.eval();
+    REQUIRE(interpreter.graphics.size() == 600);
+    REQUIRE(interpreter.graphics.back() == Expression(std::make_tuple(19.0, 29.0)));
+}
+
+TEST_CASE("Test a huge drawing loop reserves within its budget", "[loop]") {
+    DrawRecorder interpreter;
+    EvalLimits limits;
+    limits.max_steps = 10000;
+    interpreter.set_limits(limits);
+    std::istringstream iss("(for i 0 1e9 1 (draw (point i i)))");
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE_THROWS_AS(interpreter.eval(), InterpreterLimitError);
+    REQUIRE(interpreter.graphics.capacity() <= 65536);
+
+    DrawRecorder small;
+    limits = EvalLimits();
+    limits.max_bytes = 100 * sizeof(Expression);
+    small.set_limits(limits);
+    std::istringstream again("(for i 0 1e9 1 (draw (point i i)))");
+    REQUIRE(small.parse(again));
+    REQUIRE_THROWS_AS(small.eval(), InterpreterLimitError);
+    REQUIRE(small.graphics.capacity() <= 100);
+}
+
+// ------------------------------- List Tests -------------------------------
+
+// Builds a numeric list expression from numbers
+static Expression numbers(std::vector<Number> values) {
+    std::shared_ptr<List> list = std::make_shared<List>();
+    list->numbers = std::move(values);
+    return Expression(std::shared_ptr<const List>(std::move(list)));
+}
+
+TEST_CASE("Test list construction", "[list]") {
+    REQUIRE(evalProgram("(list 1 2 3)") == numbers({1, 2, 3}));
+    REQUIRE(evalProgram("(list)") == numbers({}));
+    REQUIRE(evalProgram("(range 4)") == numbers({0, 1, 2, 3}));
+    REQUIRE(evalProgram("(range 1 2 0.25)") == numbers({1, 1.25, 1.5, 1.75}));
+    REQUIRE(evalProgram("(range 3 0 -1)") == numbers({3, 2, 1}));
+    REQUIRE(evalProgram("(range 5 1)") == numbers({}));
+    REQUIRE(evalProgram("(length (range 10))") == Expression(10.0));
+    REQUIRE(evalProgram("(nth (list 4 5 6) 2)") == Expression(6.0));
+    REQUIRE(evalProgram("(nth (list True False) 1)") == Expression(false));
+
+    std::ostringstream out;
+    out << evalProgram("(list 1 2)");
+    REQUIRE(out.str() == "((1) (2))");
+}
+
+TEST_CASE("Test element-wise list arithmetic", "[list]") {
+    REQUIRE(evalProgram("(+ (range 5) 1)") == numbers({1, 2, 3, 4, 5}));
+    REQUIRE(evalProgram("(+ 1 (range 5) (range 5))") == numbers({1, 3, 5, 7, 9}));
+    REQUIRE(evalProgram("(- (list 1 2))") == numbers({-1, -2}));
+    REQUIRE(evalProgram("(- 10 (list 1 2))") == numbers({9, 8}));
+    REQUIRE(evalProgram("(* (list 1 2 3) (list 4 5 6))") == numbers({4, 10, 18}));
+    REQUIRE(evalProgram("(/ (list 2 4) 2)") == numbers({1, 2}));
+    REQUIRE(evalProgram("(pow (list 2 3) 2)") == numbers({4, 9}));
+    REQUIRE(evalProgram("(cos (list 0))") == numbers({1}));
+    REQUIRE(evalProgram("(log10 (list 1 100))") == numbers({0, 2}));
+
+    // lengths not a multiple of the SIMD width exercise the scalar tail
+    Expression odd = evalProgram("(* (range 7) 2)");
+    REQUIRE(odd == numbers({0, 2, 4, 6, 8, 10, 12}));
+
+    std::ostringstream out;
+    out << evalProgram("(< (list 1 2 3) 2)");
+    REQUIRE(out.str() == "((True) (False) (False))");
+}
+
+TEST_CASE("Test list reductions", "[list]") {
+    REQUIRE(evalProgram("(sum (range 101))") == Expression(5050.0));
+    REQUIRE(evalProgram("(sum (list))") == Expression(0.0));
+    REQUIRE(evalProgram("(min (list 3 -1 7 2 9))") == Expression(-1.0));
+    REQUIRE(evalProgram("(max (list 3 -1 7 2 9))") == Expression(9.0));
+    REQUIRE(evalProgram("(min 4 2 8)") == Expression(2.0));
+    REQUIRE(evalProgram("(max 4 2 8)") == Expression(8.0));
+}
+
+TEST_CASE("Test list reductions match the scalar builtins exactly", "[list]") {
+    // each 1 added to 1e16 is rounded away; summing in lanes would keep some of them
+    std::string values = "1e16 1 1 1 1 1 1 1 -1e16";
+    REQUIRE(evalProgram("(= (sum (list " + values + ")) (+ " + values + "))") == Expression(true));
+    REQUIRE(evalProgram("(sum (list " + values + "))") == Expression(0.0));
+
+    // the first of equal elements wins, which arctan tells apart for 0 and -0
+    std::vector<std::pair<std::string, std::string>> ties = {
+        {"min", "5 0 -0 5 7 3"}, {"min", "5 -0 0 5 7 3"}, {"max", "-5 0 -0 -5 -7 -3"}, {"max", "-5 -0 0 -5 -7 -3"}};
+    for (const auto &tie : ties) {
+        std::string list = "(arctan (" + tie.first + " (list " + tie.second + ")) -1)";
+        std::string scalar = "(arctan (" + tie.first + " " + tie.second + ") -1)";
+        INFO(list);
+        REQUIRE(evalProgram("(= " + list + " " + scalar + ")") == Expression(true));
+    }
+
+    // a NaN is kept only when it comes first, as with the scalar comparisons
+    std::string nan = "(- (* 1e300 1e300) (* 1e300 1e300))";
+    REQUIRE(evalProgram("(min (list 4 " + nan + " 2 3 1 6))") == Expression(1.0));
+    REQUIRE(evalProgram("(max (list 4 " + nan + " 2 3 1 6))") == Expression(6.0));
+    REQUIRE(evalProgram("(begin (define m (min (list " + nan + " 2 3 1 6))) (= m m))") == Expression(false));
+}
+
+TEST_CASE("Test list errors", "[list]") {
+    REQUIRE_THROWS_AS(evalProgram("(+ (list 1 2) (list 1 2 3))"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalProgram("(/ (list 1 2) (list 1 0))"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalProgram("(+ (list True) 1)"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalProgram("(nth (list 1 2) 2)"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalProgram("(range 0 1 0)"), InterpreterSemanticError);
+    REQUIRE_THROWS_WITH(evalProgram("(range 0 (* 1e300 1e300))"), "range must be finite");
+    REQUIRE_THROWS_WITH(evalProgram("(range 1e10)"), "range is too long");
+    REQUIRE_THROWS_AS(evalProgram("(min (list))"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalProgram("(- 1 True)"), InterpreterSemanticError);
+}
+
+TEST_CASE("Test drawing a list of shapes", "[list]") {
+    DrawRecorder interpreter;
+    std::istringstream iss("(draw (point (range 100) (* (range 100) 2)))");
+    REQUIRE(interpreter.parse(iss));
+    interpreter.eval();
+    REQUIRE(interpreter.graphics.size() == 100);
+    REQUIRE(interpreter.graphics.back() == Expression(std::make_tuple(99.0, 198.0)));
+
+    std::istringstream bad("(draw (list 1 2))");
+    REQUIRE(interpreter.parse(bad));
+    REQUIRE_THROWS_AS(interpreter.eval(), InterpreterSemanticError);
+}
+
+// ------------------------------- Parallel Map Tests -------------------------------
+
+TEST_CASE("Test pmap", "[pmap]") {
+    Interpreter sequential;
+    sequential.set_threads(1);
+    Interpreter parallel;
+    parallel.set_threads(4);
+
+    std::string square = "(pmap (lambda (x) (* x x)) (range 1000))";
+    Expression expected = evalProgram("(* (range 1000) (range 1000))");
+    REQUIRE(evalIn(sequential, square) == expected);
+    REQUIRE(evalIn(parallel, square) == expected);
+
+    REQUIRE(evalIn(parallel, "(parallel-map (lambda (a b) (- a b)) (list 5 6) (list 1 2))") == numbers({4, 4}));
+    REQUIRE(evalIn(parallel, "(pmap cos (list 0 0 0))") == numbers({1, 1, 1}));
+    REQUIRE(evalIn(parallel, "(begin (define k 3) (pmap (lambda (x) (* x k)) (range 4)))") == numbers({0, 3, 6, 9}));
+    REQUIRE(evalIn(parallel, "(pmap (lambda (x) x) (list))") == numbers({}));
+
+    Expression points = evalIn(parallel, "(pmap point (range 100) (range 100))");
+    REQUIRE(points.head.type == ListType);
+    REQUIRE(points.head.value.list_value->size() == 100);
+    REQUIRE(Expression(points.head.value.list_value->at(42)) == Expression(std::make_tuple(42.0, 42.0)));
+
+    // nested pmap runs sequentially inside the workers
+    std::string nested = "(pmap (lambda (n) (sum (pmap (lambda (x) (* x 2)) (range n)))) (range 50))";
+    REQUIRE(evalIn(parallel, nested) == evalIn(sequential, nested));
+}
+
+TEST_CASE("Test pmap rejects impure procedures before running", "[pmap]") {
+    DrawRecorder interpreter;
+    interpreter.set_threads(4);
+    std::istringstream iss("(begin (define shape (lambda (x) (draw (point x x)))) "
+                           "(pmap (lambda (x) (shape x)) (range 10)))");
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE_THROWS_WITH(interpreter.eval(), "pmap requires a pure procedure, but it uses draw");
+    REQUIRE(interpreter.graphics.empty());
+
+    REQUIRE_THROWS_AS(evalIn(interpreter, "(pmap (lambda (x) (define y x)) (range 3))"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalIn(interpreter, "(pmap 1 (range 3))"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalIn(interpreter, "(pmap (lambda (x) x) 3)"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalIn(interpreter, "(pmap (lambda (x) x) (range 2) (range 3))"), InterpreterSemanticError);
+    REQUIRE_THROWS_AS(evalIn(interpreter, "(define pmap 1)"), InterpreterSemanticError);
+}
+
+TEST_CASE("Test pmap reports the leftmost failing element", "[pmap]") {
+    // element 3 fails with one message and every later element with another
+    std::string program =
+        "(pmap (lambda (x) (if (= x 3) (+ True 1) (if (> x 3) (nth (list) 0) x))) (range 2000))";
+    Interpreter interpreter;
+    interpreter.set_threads(4);
+    for (int run = 0; run < 10; ++run) {
+        REQUIRE_THROWS_WITH(evalIn(interpreter, program), "+ expects numeric arguments");
+    }
+}
+
+TEST_CASE("Test pmap respects the step budget", "[pmap]") {
+    Interpreter interpreter;
+    interpreter.set_threads(4);
+    EvalLimits limits;
+    limits.max_steps = 5000;
+    interpreter.set_limits(limits);
+    std::istringstream iss("(pmap (lambda (x) (for i 0 1000 1 i)) (range 100))");
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE_THROWS_AS(interpreter.eval(), InterpreterLimitError);
+}
+
+// ------------------------------- Concurrent Argument Tests -------------------------------
+
+static const std::string fibDefinition =
+    "(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))";
+
+TEST_CASE("Test large pure arguments evaluate concurrently with the same result", "[parallel]") {
+    std::string program = "(begin " + fibDefinition + " (+ (fib 15) (fib 16) (fib 17)))";
+    for (int threads : {1, 4}) {
+        Interpreter interpreter;
+        interpreter.set_threads(threads);
+        REQUIRE(evalIn(interpreter, program) == Expression(3194.0));
+    }
+
+    // an argument that defines is evaluated in order alongside the concurrent ones
+    Interpreter interpreter;
+    interpreter.set_threads(4);
+    std::string mixed = "(begin " + fibDefinition + " (+ (begin (define a 1) a) (fib 15) (fib 16) a))";
+    REQUIRE(evalIn(interpreter, mixed) == Expression(1599.0));
+}
+
+TEST_CASE("Test concurrent arguments report the leftmost error", "[parallel]") {
+    std::string program =
+        "(begin " + fibDefinition +
+        " (define bad (lambda (n) (if (< n 1) (+ True 1) (bad (- n 1)))))"
+        " (+ (fib 15) (bad 50) (nth (list) (fib 12))))";
+    for (int run = 0; run < 10; ++run) {
+        Interpreter interpreter;
+        interpreter.set_threads(4);
+        REQUIRE_THROWS_WITH(evalIn(interpreter, program), "+ expects numeric arguments");
+    }
+}
+
+TEST_CASE("Test an earlier error wins over a concurrent argument out of budget", "[parallel]") {
+    std::string program = "(begin " + fibDefinition + " (+ (nth (list) 0) (fib 12) (fib 25)))";
+    for (int threads : {1, 4}) {
+        Interpreter interpreter;
+        interpreter.set_threads(threads);
+        EvalLimits limits;
+        limits.max_steps = 50000;
+        interpreter.set_limits(limits);
+        REQUIRE_THROWS_WITH(evalIn(interpreter, program), "nth index out of range");
+    }
+}
+
+TEST_CASE("Test concurrent draw arguments keep their order", "[parallel]") {
+    DrawRecorder interpreter;
+    interpreter.set_threads(4);
+    std::istringstream iss("(begin " + fibDefinition +
+                           " (draw (point (fib 15) 0) (point (fib 16) 0) (point 1 1)))");
+    REQUIRE(interpreter.parse(iss));
+    interpreter.eval();
+    REQUIRE(interpreter.graphics.size() == 3);
+    REQUIRE(interpreter.graphics[0] == Expression(std::make_tuple(610.0, 0.0)));
+    REQUIRE(interpreter.graphics[1] == Expression(std::make_tuple(987.0, 0.0)));
+    REQUIRE(interpreter.graphics[2] == Expression(std::make_tuple(1.0, 1.0)));
+}
+
+TEST_CASE("Test concurrent arguments count against the step budget", "[parallel]") {
+    Interpreter interpreter;
+    interpreter.set_threads(4);
+    EvalLimits limits;
+    limits.max_steps = 20000;
+    interpreter.set_limits(limits);
+    std::istringstream iss("(begin " + fibDefinition + " (+ (fib 20) (fib 20)))");
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE_THROWS_AS(interpreter.eval(), InterpreterLimitError);
+}
+
+// ------------------------------- Dataflow Tests -------------------------------
+
+TEST_CASE("Test dataflow begin gives the sequential result", "[dataflow]") {
+    std::string program =
+        "(begin " + fibDefinition +
+        " (define a (fib 15)) (define b (fib 16)) (define c (+ a b)) (define d (fib 14)) (define e (- c d))"
+        " (+ a b c d e))";
+    Interpreter interpreter;
+    interpreter.set_threads(4);
+    interpreter.set_dataflow(true);
+    REQUIRE(evalIn(interpreter, program) == evalProgram(program));
+
+    // a procedure defined before the run reads a symbol defined within it
+    std::string through_procedure =
+        "(begin (define f (lambda (x) (+ x g))) (define g 1) (define y (f 1)) (define z (f 2)) (+ y z))";
+    REQUIRE(evalIn(interpreter, through_procedure) == Expression(5.0));
+}
+
+TEST_CASE("Test dataflow keeps draws in order", "[dataflow]") {
+    DrawRecorder interpreter;
+    interpreter.set_threads(4);
+    interpreter.set_dataflow(true);
+    std::istringstream iss("(begin " + fibDefinition +
+                           " (define a (fib 15)) (define b (fib 16)) (draw (point a 0))"
+                           " (define c (fib 14)) (define d (fib 13)) (draw (point b c) (point d 0)) d)");
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE(interpreter.eval() == Expression(233.0));
+    REQUIRE(interpreter.graphics.size() == 3);
+    REQUIRE(interpreter.graphics[0] == Expression(std::make_tuple(610.0, 0.0)));
+    REQUIRE(interpreter.graphics[1] == Expression(std::make_tuple(987.0, 377.0)));
+    REQUIRE(interpreter.graphics[2] == Expression(std::make_tuple(233.0, 0.0)));
+}
+
+TEST_CASE("Test dataflow reports the first failing define", "[dataflow]") {
+    // b fails in a later wave than d, but comes first in the block
+    std::string program =
+        "(begin " + fibDefinition +
+        " (define a (fib 15)) (define b (+ a True)) (define d (nth (list) (fib 12))) (define e (fib 14)) 1)";
+    for (int run = 0; run < 5; ++run) {
+        Interpreter interpreter;
+        interpreter.set_threads(4);
+        interpreter.set_dataflow(true);
+        REQUIRE_THROWS_WITH(evalIn(interpreter, program), "+ expects numeric arguments");
+    }
+    Interpreter interpreter;
+    interpreter.set_threads(4);
+    interpreter.set_dataflow(true);
+    REQUIRE_THROWS_WITH(evalIn(interpreter, "(begin (define pi 3) (define x (range 10000)) 1)"), "pi already defined");
+}
+
+// ------------------------------- Memo Cache Tests -------------------------------
+
+TEST_CASE("Test memo cache reuses pure builtin results", "[memo]") {
+    Interpreter interpreter;
+    interpreter.set_memo_capacity(16);
+    std::string program = "(begin (define a (sin (/ pi 8))) (define b (sin (/ pi 8))) (+ a b))";
+    std::istringstream iss(program);
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE(interpreter.eval() == evalProgram(program));
+
+    MemoStats stats = interpreter.memo_stats();
+    REQUIRE(stats.hits == 2);   // the second / and sin
+    REQUIRE(stats.misses == 3); // the first / and sin, and +
+    REQUIRE(stats.entries == 3);
+    REQUIRE(stats.capacity == 16);
+
+    Interpreter disabled;
+    std::istringstream again(program);
+    REQUIRE(disabled.parse(again));
+    disabled.eval();
+    REQUIRE(disabled.memo_stats().hits == 0);
+    REQUIRE(disabled.memo_stats().misses == 0);
+}
+
+TEST_CASE("Test memo cache reuses pure procedure results", "[memo]") {
+    std::string program = "(begin " + fibDefinition + " (fib 25))";
+    Interpreter interpreter;
+    interpreter.set_memo_capacity(64);
+    std::istringstream iss(program);
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE(interpreter.eval() == Expression(75025.0));
+    REQUIRE(interpreter.memo_stats().hits > 0);
+    REQUIRE(interpreter.usage().steps < 2000);
+}
+
+TEST_CASE("Test memo cache stays within its capacity", "[memo]") {
+    Interpreter interpreter;
+    interpreter.set_memo_capacity(4);
+    std::istringstream iss("(for i 0 100 1 (sin i))");
+    REQUIRE(interpreter.parse(iss));
+    interpreter.eval();
+    MemoStats stats = interpreter.memo_stats();
+    REQUIRE(stats.entries == 4);
+    REQUIRE(stats.hits == 0);
+    REQUIRE(stats.evictions == stats.misses - 4);
+
+    // changing the capacity discards the entries but keeps the counts
+    interpreter.set_memo_capacity(8);
+    REQUIRE(interpreter.memo_stats().entries == 0);
+    REQUIRE(interpreter.memo_stats().misses == stats.misses);
+}
+
+TEST_CASE("Test memo cache skips impure calls", "[memo]") {
+    DrawRecorder interpreter;
+    interpreter.set_memo_capacity(16);
+    std::istringstream iss(
+        "(begin"
+        " (define mark (lambda (x) (begin (draw (point x 0)) x)))"
+        " (define twice (lambda (p x) (p x)))"
+        " (define id (lambda (x) x))"
+        " (mark 1) (mark 1) (twice mark 2) (twice mark 2) (twice id 3) (twice id 3))");
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE(interpreter.eval() == Expression(3.0));
+    REQUIRE(interpreter.graphics.size() == 4);
+    REQUIRE(interpreter.memo_stats().hits == 2); // only the point inside mark, which is pure
+}
+
+// Error of got in units in the last place of the exact result want
+static double ulpError(double got, long double want) {
+    double rounded = static_cast<double>(want);
+    if (got == rounded) {
+        return 0;
+    }
+    double ulp = std::nextafter(std::fabs(rounded), HUGE_VAL) - std::fabs(rounded);
+    return static_cast<double>(std::fabs(static_cast<long double>(got) - want) / ulp);
+}
+
+TEST_CASE("Test precise math matches the C library bit for bit", "[math]") {
+    Interpreter interpreter;
+    REQUIRE(interpreter.math_mode() == MathMode::Precise);
+    std::istringstream iss("(list (sin 1.3) (cos 1.3) (arctan 2 -7) (pow 1.7 2.9) (log10 0.3))");
+    REQUIRE(interpreter.parse(iss));
+    Expression result = interpreter.eval();
+    const std::vector<Number> &numbers = result.head.value.list_value->numbers;
+    REQUIRE(numbers.size() == 5);
+    REQUIRE(numbers[0] == std::sin(1.3));
+    REQUIRE(numbers[1] == std::cos(1.3));
+    REQUIRE(numbers[2] == std::atan2(2.0, -7.0));
+    REQUIRE(numbers[3] == std::pow(1.7, 2.9));
+    REQUIRE(numbers[4] == std::log10(0.3));
+}
+
+TEST_CASE("Test fast math kernels stay within their error bounds", "[math]") {
+    double sin_cos = 0, atan2 = 0, log10 = 0, pow = 0;
+    for (int i = -2000; i <= 2000; ++i) {
+        double x = i * 0.0137 + std::ldexp(static_cast<double>(i), -40);
+        sin_cos = std::max(sin_cos, ulpError(fastSin(x), sinl(x)));
+        sin_cos = std::max(sin_cos, ulpError(fastCos(x), cosl(x)));
+        double far = x * 97.0;
+        sin_cos = std::max(sin_cos, ulpError(fastSin(far), sinl(far)));
+        double y = std::ldexp(1.0 + (i + 2000) / 4001.0, i % 60);
+        atan2 = std::max(atan2, ulpError(fastAtan2(x, y), atan2l(x, y)));
+        atan2 = std::max(atan2, ulpError(fastAtan2(y, -x), atan2l(y, -x)));
+        log10 = std::max(log10, ulpError(fastLog10(y), log10l(y)));
+        double near_one = 1.0 + x * 1e-3;
+        log10 = std::max(log10, ulpError(fastLog10(near_one), log10l(near_one)));
+        pow = std::max(pow, ulpError(fastPow(y, -2), powl(y, -2)));
+        pow = std::max(pow, ulpError(fastPow(y, 3), powl(y, 3)));
+    }
+    REQUIRE(sin_cos <= FAST_SIN_COS_MAX_ULP);
+    REQUIRE(atan2 <= FAST_ATAN2_MAX_ULP);
+    REQUIRE(log10 <= FAST_LOG10_MAX_ULP);
+    REQUIRE(pow <= FAST_POW_MAX_ULP);
+
+    // special values follow the C library
+    REQUIRE(std::isnan(fastSin(NAN)));
+    REQUIRE(std::signbit(fastSin(-0.0)));
+    REQUIRE(fastSin(1e300) == std::sin(1e300));
+    REQUIRE(fastAtan2(0.0, -1.0) == std::atan2(0.0, -1.0));
+    REQUIRE(fastLog10(0.0) == -HUGE_VAL);
+    REQUIRE(std::isnan(fastLog10(-1.0)));
+    REQUIRE(fastPow(-2.0, 3) == -8.0);
+}
+
+// FNV-1a hash of the bit patterns of values
+static std::uint64_t hashBits(const std::vector<double> &values) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (double value : values) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int byte = 0; byte < 8; ++byte) {
+            hash = (hash ^ ((bits >> (8 * byte)) & 0xff)) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+TEST_CASE("Test fast math kernels give the same bits on every target", "[math]") {
+    // arguments on the kernels' own paths; libm, which the rest go to, varies between platforms
+    std::vector<double> angles, positives, signed_positives;
+    for (int i = 1; i <= 100000; ++i) {
+        angles.push_back((i - 50000.5) * 5.2137 + std::ldexp(static_cast<double>(i), -31));
+        positives.push_back(std::ldexp(1.0 + i / 100001.0, i % 200 - 100));
+        signed_positives.push_back(i % 2 ? positives.back() : -positives.back());
+    }
+    std::vector<double> sines, cosines, arctans, outputs;
+    for (std::size_t i = 0; i < angles.size(); ++i) {
+        sines.push_back(fastSin(angles[i]));
+        cosines.push_back(fastCos(angles[i]));
+        arctans.push_back(fastAtan2(angles[i], signed_positives[i]));
+        outputs.push_back(fastLog10(positives[i]));
+        outputs.push_back(fastPow(positives[i], 3));
+        outputs.push_back(fastPow(positives[i], -2));
+    }
+    // a compiler fusing multiplies and adds into FMA instructions changes these
+    REQUIRE(hashBits(sines) == 0xdd6273745fd4b83eULL);
+    REQUIRE(hashBits(cosines) == 0x15dad18f6c444d7bULL);
+    REQUIRE(hashBits(arctans) == 0x5972fc1008f4f440ULL);
+    REQUIRE(hashBits(outputs) == 0x198e4e0d136c8cb4ULL);
+
+    // and the list kernels give the same bits as the scalar ones
+    std::vector<double> list(angles.size());
+    kernelUnary(KernelUnary::FastSine, angles.data(), list.data(), list.size());
+    REQUIRE(list == sines);
+    kernelUnary(KernelUnary::FastCosine, angles.data(), list.data(), list.size());
+    REQUIRE(list == cosines);
+    kernelBinary(KernelOp::FastArctan, angles.data(), true, signed_positives.data(), true, list.data(), list.size());
+    REQUIRE(list == arctans);
+}
+
+TEST_CASE("Test the list sin and cos kernels match the scalar ones on special values", "[math]") {
+    // zeros, quadrant boundaries and the values the scalar kernels hand to libm, at every offset
+    // within a SIMD register and with a scalar tail
+    std::vector<double> values = {0.0, -0.0, 1.0, -2.5, 3.0 * std::atan(1.0), -std::atan(1.0), 2e5, -FAST_TRIG_LIMIT,
+                                  NAN, HUGE_VAL, -1e300, std::nextafter(FAST_TRIG_LIMIT, HUGE_VAL), 1e-310, 7.0, -0.0};
+    for (std::size_t offset = 0; offset < 4; ++offset) {
+        std::vector<double> angles(values.begin() + offset, values.end());
+        std::vector<double> sines(angles.size());
+        std::vector<double> cosines(angles.size());
+        kernelFastSinCos(angles.data(), sines.data(), cosines.data(), angles.size());
+        for (std::size_t i = 0; i < angles.size(); ++i) {
+            INFO("angle " << angles[i]);
+            double sine = fastSin(angles[i]);
+            double cosine = fastCos(angles[i]);
+            REQUIRE(std::memcmp(&sines[i], &sine, sizeof(double)) == 0);
+            REQUIRE(std::memcmp(&cosines[i], &cosine, sizeof(double)) == 0);
+        }
+    }
+}
+
+TEST_CASE("Test fast math mode computes builtins with the fast kernels", "[math]") {
+    Interpreter interpreter;
+    interpreter.set_math_mode(MathMode::Fast);
+    REQUIRE(interpreter.math_mode() == MathMode::Fast);
+    std::istringstream iss(
+        "(begin (define a 2.5) (define l (range 0 12 0.25))"
+        " (list (cos a) (sin a) (arctan a -1) (log10 a) (pow a 2) (sum (sin l)) (sum (cos l))))");
+    REQUIRE(interpreter.parse(iss));
+    Expression result = interpreter.eval();
+    const std::vector<Number> &numbers = result.head.value.list_value->numbers;
+    REQUIRE(numbers.size() == 7);
+    REQUIRE(numbers[0] == fastCos(2.5));
+    REQUIRE(numbers[1] == fastSin(2.5));
+    REQUIRE(numbers[2] == fastAtan2(2.5, -1));
+    REQUIRE(numbers[3] == fastLog10(2.5));
+    REQUIRE(numbers[4] == 6.25);
+    Number sin_sum = 0, cos_sum = 0;
+    for (int i = 0; i < 48; ++i) {
+        sin_sum += fastSin(i * 0.25);
+        cos_sum += fastCos(i * 0.25);
+    }
+    REQUIRE(numbers[5] == Approx(sin_sum));
+    REQUIRE(numbers[6] == Approx(cos_sum));
+
+    // switching back restores the C library
+    interpreter.set_math_mode(MathMode::Precise);
+    std::istringstream precise("(sin 0.7)");
+    REQUIRE(interpreter.parse(precise));
+    REQUIRE(interpreter.eval().head.value.num_value == std::sin(0.7));
+}
+
+TEST_CASE("Test live mode re-evaluates what a redefinition affects", "[live]") {
+    DrawRecorder interpreter;
+    interpreter.set_live(true);
+    std::istringstream script(
+        "(begin (define r 10) (define s (* r 2)) (draw (point r s)) (draw (point 0 0)) (draw (point 1 1)))");
+    REQUIRE(interpreter.parse(script));
+    interpreter.eval();
+    REQUIRE(interpreter.graphics.size() == 3);
+
+    std::istringstream edit("(define r 3)");
+    REQUIRE(interpreter.parse(edit));
+    REQUIRE(interpreter.eval() == Expression(3.0));
+    REQUIRE(interpreter.reevaluated_forms() == 2); // s and the first draw
+    REQUIRE(interpreter.graphics.size() == 3);
+    REQUIRE(interpreter.graphics[0] == Expression(std::make_tuple(3.0, 6.0)));
+    REQUIRE(interpreter.graphics[1] == Expression(std::make_tuple(0.0, 0.0)));
+    REQUIRE(interpreter.graphics_edits().size() == 1);
+    REQUIRE(interpreter.graphics_edits()[0].first == 0);
+    REQUIRE(interpreter.graphics_edits()[0].removed == 1);
+    REQUIRE(interpreter.graphics_edits()[0].inserted == 1);
+}
+
+TEST_CASE("Test live mode follows dependencies through procedures", "[live]") {
+    DrawRecorder interpreter;
+    interpreter.set_live(true);
+    std::istringstream script(
+        "(begin (define n 3) (define k 2) (define f (lambda (x) (* k x)))"
+        " (draw (point -1 -1)) (for i 0 n 1 (draw (point (f i) 0))) (draw (point 9 9)))");
+    REQUIRE(interpreter.parse(script));
+    interpreter.eval();
+    REQUIRE(interpreter.graphics.size() == 5);
+
+    // more shapes from the loop, in place, with the later draw kept after them
+    std::istringstream more("(define n 5)");
+    REQUIRE(interpreter.parse(more));
+    interpreter.eval();
+    REQUIRE(interpreter.graphics.size() == 7);
+    REQUIRE(interpreter.graphics[5] == Expression(std::make_tuple(8.0, 0.0)));
+    REQUIRE(interpreter.graphics[6] == Expression(std::make_tuple(9.0, 9.0)));
+    REQUIRE(interpreter.graphics_edits()[0].first == 1);
+    REQUIRE(interpreter.graphics_edits()[0].removed == 3);
+    REQUIRE(interpreter.graphics_edits()[0].inserted == 5);
+
+    // k reaches the loop only through f
+    std::istringstream scale("(define k 10)");
+    REQUIRE(interpreter.parse(scale));
+    interpreter.eval();
+    REQUIRE(interpreter.reevaluated_forms() == 2);
+    REQUIRE(interpreter.graphics[5] == Expression(std::make_tuple(40.0, 0.0)));
+    REQUIRE(interpreter.graphics[0] == Expression(std::make_tuple(-1.0, -1.0)));
+}
+
+TEST_CASE("Test live mode reports dependents a redefinition breaks", "[live]") {
+    DrawRecorder interpreter;
+    interpreter.set_live(true);
+    std::istringstream script("(begin (define a 1) (draw (point a a)) (draw (point 5 5)))");
+    REQUIRE(interpreter.parse(script));
+    interpreter.eval();
+
+    std::istringstream broken("(define a (< 1 2))");
+    REQUIRE(interpreter.parse(broken));
+    REQUIRE_THROWS_AS(interpreter.eval(), InterpreterSemanticError);
+    REQUIRE(interpreter.graphics.size() == 1);
+    REQUIRE(interpreter.graphics[0] == Expression(std::make_tuple(5.0, 5.0)));
+
+    std::istringstream fixed("(define a 2)");
+    REQUIRE(interpreter.parse(fixed));
+    interpreter.eval();
+    REQUIRE(interpreter.graphics.size() == 2);
+    REQUIRE(interpreter.graphics[0] == Expression(std::make_tuple(2.0, 2.0)));
+}
+
+TEST_CASE("Test redefinition outside live mode is an error", "[live]") {
+    Interpreter interpreter;
+    std::istringstream first("(define a 1)");
+    REQUIRE(interpreter.parse(first));
+    interpreter.eval();
+    std::istringstream second("(define a 2)");
+    REQUIRE(interpreter.parse(second));
+    REQUIRE_THROWS_AS(interpreter.eval(), InterpreterSemanticError);
+
+    interpreter.set_live(true);
+    std::istringstream builtin("(define sin 2)");
+    REQUIRE(interpreter.parse(builtin));
+    REQUIRE_THROWS_AS(interpreter.eval(), InterpreterSemanticError);
+}
+
+TEST_CASE("Test switching to live mode checks calls proven before", "[live]") {
+    Interpreter interpreter;
+    evalIn(interpreter, "(begin (define a 1) (define g (lambda (x) (+ a 1))))");
+
+    // a was a number for good when (+ a 1) was proven, but live mode may rebind it
+    interpreter.set_live(true);
+    evalIn(interpreter, "(define a True)");
+    REQUIRE_THROWS_WITH(evalIn(interpreter, "(g 1)"), "+ expects numeric arguments");
+}
+
+TEST_CASE("Test type inference renames only the calls it proves", "[types]") {
+    auto sym = [](const std::string &name) { return Expression(name); };
+    Environment env;
+    env.add_procedure("point", procPoint, true);
+    env.add_procedure("line", procLine, true);
+    env.add("origin", Expression(std::make_tuple(0.0, 0.0)));
+
+    // (line (point 1 2) origin), (line p origin) inside (lambda (p) ...), and (point i i) in a for loop
+    Expression proven = sym("line");
+    proven.tail = {sym("point"), sym("origin")};
+    proven.tail[0].tail = {Expression(1.0), Expression(2.0)};
+    Expression param = sym("lambda");
+    param.tail = {sym("p"), sym("line")};
+    param.tail[1].tail = {sym("p"), sym("origin")};
+    Expression loop = sym("for");
+    loop.tail = {sym("i"), Expression(0.0), Expression(3.0), Expression(1.0), sym("point")};
+    loop.tail[4].tail = {sym("i"), sym("i")};
+
+    inferTypes(proven, env, true);
+    inferTypes(param, env, true);
+    inferTypes(loop, env, true);
+    REQUIRE(proven.head.unchecked);
+    REQUIRE(proven.tail[0].head.unchecked);
+    REQUIRE_FALSE(param.tail[1].head.unchecked);
+    REQUIRE(loop.tail[4].head.unchecked);
+    // the symbols stay as parsed
+    REQUIRE(proven.head.value.sym_value == "line");
+    REQUIRE(loop.tail[4].head.value.sym_value == "point");
+
+    // globals may change type once define can rebind them
+    inferTypes(proven, env, false);
+    REQUIRE_FALSE(proven.head.unchecked);
+    REQUIRE(proven.tail[0].head.unchecked);
+}
+
+// True if two syntax trees hold the same symbols in the same places
+static bool sameSymbols(const Expression &a, const Expression &b) {
+    if (a.head.type != b.head.type || a.tail.size() != b.tail.size() ||
+        (a.head.type == SymbolType && a.head.value.sym_value != b.head.value.sym_value)) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.tail.size(); ++i) {
+        if (!sameSymbols(a.tail[i], b.tail[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("Test type inference leaves the syntax tree's symbols as parsed", "[types]") {
+    Interpreter interpreter;
+    std::istringstream iss("(draw (line (point 1 2) (point (+ 1 2) 4)))");
+    REQUIRE(interpreter.parse(iss));
+    Expression parsed = interpreter.syntax_tree();
+    interpreter.eval();
+    REQUIRE(sameSymbols(interpreter.syntax_tree(), parsed));
+    REQUIRE(interpreter.syntax_tree().tail[0].head.value.sym_value == "line");
+    REQUIRE(interpreter.syntax_tree().tail[0].head.unchecked);
+    REQUIRE(interpreter.eval() == Expression());
+}
+
+TEST_CASE("Test proven calls give the results of checked calls", "[types]") {
+    std::string program =
+        "(begin (define r (rect 1 2 3 4)) (define p (point 1 2))"
+        " (list (+ 1 2 3) (- 5) (- 5 2) (* 2 3 4) (/ 7 2) (pow 2 10) (log10 100) (sin 1) (cos 1) (arctan 1 2)"
+        " (line p (point 3 4)) (arc p (point 0 0) 1.5) (fill_rect r 10 20 30) (ellipse r)"
+        " (< 1 2) (<= 2 2) (> 1 2) (>= 1 2) (= 3 3) (not (< 1 2)) (and (< 1 2) (> 1 2)) (or (< 1 2) (> 1 2))))";
+    Expression results[2];
+    for (int infer = 0; infer < 2; ++infer) {
+        Interpreter interpreter;
+        interpreter.set_type_inference(infer != 0);
+        std::istringstream iss(program);
+        REQUIRE(interpreter.parse(iss));
+        results[infer] = interpreter.eval();
+    }
+    REQUIRE(results[0] == results[1]);
+}
+
+TEST_CASE("Test certain type errors are reported before anything is drawn", "[types]") {
+    DrawRecorder interpreter;
+    std::istringstream bad("(begin (define p (point 1 2)) (draw p) (draw (line p 3)))");
+    REQUIRE(interpreter.parse(bad));
+    REQUIRE_THROWS_WITH(interpreter.eval(), "line expects two point arguments");
+    REQUIRE(interpreter.graphics.empty());
+
+    // a call that may not be reached, or whose argument types are unknown, fails only when evaluated
+    std::istringstream branch("(begin (draw (point 1 1)) (if (< 1 2) 0 (line 1 2)))");
+    REQUIRE(interpreter.parse(branch));
+    REQUIRE(interpreter.eval() == Expression(0.0));
+    REQUIRE(interpreter.graphics.size() == 1);
+    std::istringstream lambda("(begin (define f (lambda (q) (line q q))) (draw (point 2 2)) (f 3))");
+    REQUIRE(interpreter.parse(lambda));
+    REQUIRE_THROWS_WITH(interpreter.eval(), "line expects two point arguments");
+    REQUIRE(interpreter.graphics.size() == 2);
+}
+
+// ------------------------------- C++ Translation Tests -------------------------------
+// (translations are compiled and checked against the interpreter by test_emit_cpp)
+
+static std::string emitProgram(const std::string &program, MathMode math = MathMode::Precise) {
+    Interpreter interpreter;
+    std::istringstream iss(program);
+    REQUIRE(interpreter.parse(iss));
+    std::ostringstream out;
+    emitCpp(interpreter.syntax_tree(), "script.slp", math, out);
+    return out.str();
+}
+
+TEST_CASE("Test emitting C++ calls builtins directly", "[emit-cpp]") {
+    std::string code = emitProgram("(begin (define p (point 1 2)) (for i 0 3 1 (draw (line p (point i 0)))) (if (< 1 2) 0 (log10 p)))");
+    REQUIRE(code.find("CompiledScriptRegistration registration(\"script.slp\", script)") != std::string::npos);
+    REQUIRE(code.find("procPointUnchecked") != std::string::npos);
+    REQUIRE(code.find("procLineUnchecked") != std::string::npos);
+    REQUIRE(code.find("CompiledGlobal g0(\"p\")") != std::string::npos);
+    // the call type inference cannot prove keeps its checks; it is under if, so it is not certain to run
+    REQUIRE(code.find("CompiledRun::call(procLog10,") != std::string::npos);
+    REQUIRE(emitProgram("(sin 1)", MathMode::Fast).find("procFastSine") != std::string::npos);
+}
+
+TEST_CASE("Test emitting C++ reports what the interpreter reports before running", "[emit-cpp]") {
+    std::string code = emitProgram("(begin (draw (point 1 1)) (line 1 2))");
+    REQUIRE(code.find("return CompiledRun::fail(\"line expects two point arguments\");") != std::string::npos);
+    REQUIRE_THROWS_WITH(emitProgram("(begin (define f (lambda (x) x)) (f 1))"), "--emit-cpp does not translate lambda");
+    REQUIRE_THROWS_WITH(emitProgram("(pmap sin (list 1 2))"), "--emit-cpp does not translate pmap");
+}
+
+TEST_CASE("Test the runtime of translated scripts", "[emit-cpp]") {
+    std::vector<Expression> graphics;
+    CompiledRun run(graphics);
+    CompiledGlobal global("a");
+    REQUIRE(run.define(global, Expression(1.0)) == Expression(1.0));
+    REQUIRE_THROWS_WITH(run.define(global, Expression(2.0)), "a already defined");
+    REQUIRE_THROWS_WITH(run.redefine("pi", Expression(2.0)), "pi already defined");
+    run.draw(Expression(std::make_tuple(1.0, 2.0)));
+    REQUIRE_THROWS_WITH(run.draw(Expression(1.0)), "Invalid expression for drawing");
+    REQUIRE(graphics.size() == 1);
+    std::vector<Atom> args;
+    REQUIRE_THROWS_WITH(CompiledRun::arg(args, Expression(), "point"), "Invalid argument for procedure: point");
+    CompiledRun::arg(CompiledRun::start(args), Expression(3.0), "point");
+    CompiledRun::arg(args, Expression(4.0), "point");
+    REQUIRE(CompiledRun::call(procPoint, args) == Expression(std::make_tuple(3.0, 4.0)));
+    REQUIRE_THROWS_WITH(CompiledRun::condition(Expression(1.0)), "if condition must be a boolean");
+    REQUIRE_THROWS_WITH(CompiledRun::bound(Expression(true), "for"), "for expects numeric bounds");
+}
+
+// ------------------------------- Result Cache Tests -------------------------------
+
+// A cache directory of its own for each test, removed with everything in it
+class TemporaryDirectory {
+public:
+    TemporaryDirectory() {
+        char name[] = "/tmp/slisp-cache-XXXXXX";
+        REQUIRE(mkdtemp(name) != nullptr);
+        path = name;
+    }
+    ~TemporaryDirectory() {
+        remove(path);
+    }
+    std::string path;
+
+private:
+    static void remove(const std::string &directory) {
+        if (DIR *listing = opendir(directory.c_str())) {
+            while (dirent *item = readdir(listing)) {
+                std::string name = item->d_name;
+                if (name != "." && name != ".." && unlink((directory + "/" + name).c_str()) != 0) {
+                    remove(directory + "/" + name);
+                }
+            }
+            closedir(listing);
+        }
+        rmdir(directory.c_str());
+    }
+};
+
+// Caps the address space of the test process at its current size plus headroom, so a large
+// allocation fails with std::bad_alloc, until destroyed
+class AddressSpaceLimit {
+public:
+    explicit AddressSpaceLimit(std::size_t headroom) {
+        REQUIRE(getrlimit(RLIMIT_AS, &saved) == 0);
+        std::ifstream statm("/proc/self/statm");
+        unsigned long pages = 0;
+        REQUIRE(statm >> pages);
+        rlimit limit = saved;
+        limit.rlim_cur = pages * sysconf(_SC_PAGESIZE) + headroom;
+        REQUIRE(setrlimit(RLIMIT_AS, &limit) == 0);
+    }
+    ~AddressSpaceLimit() {
+        setrlimit(RLIMIT_AS, &saved);
+    }
+
+private:
+    rlimit saved;
+};
+
+TEST_CASE("Test the result cache replays expensive forms", "[cache]") {
+    TemporaryDirectory dir;
+    std::string program =
+        "(begin (define shapes (for i 0 5000 1 (draw (point i (sin i))))) (for i 0 5000 1 (+ i 1)))";
+    DrawRecorder first;
+    first.set_result_cache(std::make_shared<ResultCache>(dir.path));
+    Expression expected = evalIn(first, program);
+
+    // another process, as far as the cache can tell
+    auto cache = std::make_shared<ResultCache>(dir.path);
+    REQUIRE(cache->stats().entries == 2);
+    DrawRecorder second;
+    second.set_result_cache(cache);
+    REQUIRE(evalIn(second, program) == expected);
+    REQUIRE(second.graphics == first.graphics);
+    REQUIRE(cache->stats().hits == 2);
+
+    // the replayed define binds the global, so forms after it see it
+    std::istringstream iss("(begin shapes)");
+    REQUIRE(second.parse(iss));
+    REQUIRE(second.eval() == Expression());
+}
+
+TEST_CASE("Test the result cache misses when what a form reads changes", "[cache]") {
+    TemporaryDirectory dir;
+    auto cache = std::make_shared<ResultCache>(dir.path);
+    auto program = [](int scale, const std::string &body) {
+        return "(begin (define scale " + std::to_string(scale) + ") (define f (lambda (i) " + body +
+               ")) (for i 0 5000 1 (draw (point (f i) i))))";
+    };
+    DrawRecorder a, b, c, d;
+    for (DrawRecorder *interpreter : {&a, &b, &c, &d}) {
+        interpreter->set_result_cache(cache);
+    }
+    evalIn(a, program(2, "(* scale i)"));
+    evalIn(b, program(3, "(* scale i)"));
+    evalIn(c, program(3, "(+ scale i)"));
+    REQUIRE(cache->stats().hits == 0);
+    REQUIRE(b.graphics.back() == Expression(std::make_tuple(3.0 * 4999, 4999.0)));
+    REQUIRE(c.graphics.back() == Expression(std::make_tuple(3.0 + 4999, 4999.0)));
+    evalIn(d, program(2, "(* scale i)"));
+    REQUIRE(cache->stats().hits == 1);
+    REQUIRE(d.graphics == a.graphics);
+
+    // fast math gives other results, so it keys other entries
+    DrawRecorder fast;
+    fast.set_math_mode(MathMode::Fast);
+    fast.set_result_cache(cache);
+    evalIn(fast, program(2, "(* scale i)"));
+    REQUIRE(cache->stats().hits == 1);
+}
+
+TEST_CASE("Test the result cache evicts the least recently used entries", "[cache]") {
+    TemporaryDirectory dir;
+    auto cache = std::make_shared<ResultCache>(dir.path, ResultCache::DEFAULT_MAX_BYTES, 2);
+    for (int n = 1; n <= 3; ++n) {
+        DrawRecorder interpreter;
+        interpreter.set_result_cache(cache);
+        evalIn(interpreter, "(for i 0 " + std::to_string(n * 10000) + " 1 i)");
+    }
+    ResultCacheStats stats = cache->stats();
+    REQUIRE(stats.entries == 2);
+    REQUIRE(stats.evictions == 1);
+
+    DrawRecorder oldest;
+    oldest.set_result_cache(cache);
+    evalIn(oldest, "(for i 0 10000 1 i)");
+    REQUIRE(cache->stats().hits == 0);
+    DrawRecorder newest;
+    newest.set_result_cache(cache);
+    evalIn(newest, "(for i 0 30000 1 i)");
+    REQUIRE(cache->stats().hits == 1);
+
+    // an entry larger than the byte cap is never stored
+    TemporaryDirectory small_dir;
+    auto small = std::make_shared<ResultCache>(small_dir.path, 256);
+    DrawRecorder interpreter;
+    interpreter.set_result_cache(small);
+    evalIn(interpreter, "(for i 0 10000 1 (draw (point i i)))");
+    REQUIRE(small->stats().entries == 0);
+}
+
+TEST_CASE("Test the result cache ignores damaged entries", "[cache]") {
+    TemporaryDirectory dir;
+    std::string program = "(for i 0 10000 1 (draw (point i i)))";
+    DrawRecorder first;
+    first.set_result_cache(std::make_shared<ResultCache>(dir.path));
+    evalIn(first, program);
+    if (DIR *listing = opendir(dir.path.c_str())) {
+        while (dirent *item = readdir(listing)) {
+            if (item->d_name[0] != '.') {
+                std::ofstream(dir.path + "/" + item->d_name, std::ios::trunc) << "SLC1 truncated";
+            }
+        }
+        closedir(listing);
+    }
+    auto cache = std::make_shared<ResultCache>(dir.path);
+    DrawRecorder second;
+    second.set_result_cache(cache);
+    evalIn(second, program);
+    REQUIRE(cache->stats().hits == 0);
+    REQUIRE(second.graphics == first.graphics);
+}
+
+TEST_CASE("Test threads storing the same entry do not damage it", "[cache]") {
+    TemporaryDirectory dir;
+    auto cache = std::make_shared<ResultCache>(dir.path);
+    CachedForm form;
+    form.result = Expression(1.0);
+    for (int i = 0; i < 20000; ++i) {
+        form.graphics.push_back(Expression(std::make_tuple(double(i), double(i))));
+    }
+    std::atomic<int> damaged(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 20; ++i) {
+                cache->insert("shared key", form);
+                CachedForm found;
+                if (cache->find("shared key", found) && found.graphics.size() != form.graphics.size()) {
+                    ++damaged;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    REQUIRE(damaged == 0);
+    CachedForm found;
+    REQUIRE(cache->find("shared key", found));
+    REQUIRE(found.graphics == form.graphics);
+}
+
+TEST_CASE("Test encoding values for the result cache", "[cache]") {
+    Interpreter interpreter;
+    std::istringstream iss("(list 1 True (point 1 2) (line (point 1 2) (point 3 4)) (arc (point 0 0) (point 1 1) 2)"
+                           " (fill_rect (rect 1 2 3 4) 5 6 7) (ellipse (rect 1 2 3 4)) (range 0 5 1))");
+    REQUIRE(interpreter.parse(iss));
+    Expression value = interpreter.eval();
+    std::string encoded;
+    REQUIRE(encodeAtom(value.head, encoded));
+    const char *pos = encoded.data();
+    Atom decoded;
+    REQUIRE(decodeAtom(pos, encoded.data() + encoded.size(), decoded));
+    REQUIRE(pos == encoded.data() + encoded.size());
+    REQUIRE(Expression(decoded) == value);
+    pos = encoded.data();
+    REQUIRE_FALSE(decodeAtom(pos, encoded.data() + encoded.size() - 1, decoded));
+
+    std::istringstream lambda("(lambda (x) x)");
+    REQUIRE(interpreter.parse(lambda));
+    REQUIRE_FALSE(encodeAtom(interpreter.eval().head, encoded));
+}
+
+// ------------------------------- Session Tests -------------------------------
+
+TEST_CASE("Test a session keeps globals and shapes across evaluations", "[session]") {
+    Session session;
+    const SessionResult &first = session.eval("(begin (define a (point 1 2)) (draw a) 3)");
+    REQUIRE(first.ok);
+    REQUIRE(first.value == Expression(3.0));
+    REQUIRE(session.shapes(first).size() == 1);
+
+    const char buffer[] = "(begin (draw (line a (point 0 0))) (draw a) a)trailing bytes not read";
+    const SessionResult &second = session.eval(buffer, sizeof(buffer) - 1 - std::strlen("trailing bytes not read"));
+    REQUIRE(second.ok);
+    REQUIRE(second.value == Expression(std::make_tuple(1.0, 2.0)));
+    ShapeView drawn = session.shapes(second);
+    REQUIRE(drawn.size() == 2);
+    REQUIRE(drawn[0] == Expression(std::make_tuple(1.0, 2.0), std::make_tuple(0.0, 0.0)));
+    REQUIRE(drawn.begin() == session.shapes().begin() + 1);
+    REQUIRE(session.shapes().size() == 3);
+
+    session.clear_shapes();
+    REQUIRE(session.shapes().empty());
+    REQUIRE(session.eval("(begin a)").ok);
+}
+
+TEST_CASE("Test a session reports errors instead of throwing them", "[session]") {
+    Session session;
+    const SessionResult &bad = session.eval("(begin (draw (point 1 1)) (undefined_name 1))");
+    REQUIRE_FALSE(bad.ok);
+    REQUIRE(bad.error == "Unknown symbol: undefined_name");
+    REQUIRE(bad.shape_count == 1);
+
+    REQUIRE(session.eval("(+ 1").error == "Invalid expression");
+
+    EvalLimits limits;
+    limits.max_steps = 100;
+    session.set_limits(limits);
+    const SessionResult &limited = session.eval("(for i 0 1000 1 (draw (point i i)))");
+    REQUIRE_FALSE(limited.ok);
+    REQUIRE(limited.shape_count == 0);
+    REQUIRE(session.shapes().size() == 1);
+
+    session.set_limits(EvalLimits());
+    std::string failed;
+    {
+        AddressSpaceLimit limit(512 * 1024 * 1024);
+        REQUIRE_NOTHROW(failed = session.eval("(length (range 1e9))").error);
+    }
+    REQUIRE(failed.find("Evaluation failed") == 0);
+    REQUIRE(session.eval("(+ 1 2)").value == Expression(3.0));
+}
+
+TEST_CASE("Test a session evaluates a batch in order", "[session]") {
+    Session session;
+    std::vector<std::string> programs = {
+        "(define x 2)", "(draw (point x x))", "(/ x 0 1)", "(begin (draw (point 0 0)) (draw (point 1 1)) (* x 3))"};
+    const std::vector<SessionResult> &results = session.eval_batch(programs);
+    REQUIRE(results.size() == 4);
+    REQUIRE(results[0].value == Expression(2.0));
+    REQUIRE(session.shapes(results[1]).size() == 1);
+    REQUIRE_FALSE(results[2].ok);
+    REQUIRE(results[3].ok);
+    REQUIRE(results[3].value == Expression(6.0));
+    REQUIRE(results[3].first_shape == 1);
+    REQUIRE(session.shapes(results[3])[1] == Expression(std::make_tuple(1.0, 1.0)));
+}
+
+// ------------------------------- Concurrency Tests -------------------------------
+
+// What one program evaluated to: its printed value or error, and what it drew
+struct ConcurrentOutcome {
+    std::string printed;
+    std::vector<Expression> graphics;
+
+    bool operator==(const ConcurrentOutcome &other) const {
+        return printed == other.printed && graphics == other.graphics;
+    }
+};
+
+// Evaluates program in a fresh interpreter configured by variant, exercising a different
+// subsystem for each: memoization, pmap's own thread pool, fast math and a result cache
+static ConcurrentOutcome evalVariant(const std::string &program, int variant, std::shared_ptr<ResultCache> cache) {
+    DrawRecorder interpreter;
+    interpreter.set_threads(variant == 1 ? 2 : 1);
+    interpreter.set_memo_capacity(variant == 0 ? 64 : 0);
+    interpreter.set_math_mode(variant == 2 ? MathMode::Fast : MathMode::Precise);
+    interpreter.set_result_cache(variant == 3 ? cache : nullptr);
+    EvalLimits limits;
+    limits.max_steps = 100000;
+    interpreter.set_limits(limits);
+
+    ConcurrentOutcome outcome;
+    std::istringstream iss(program);
+    if (!interpreter.parse(iss)) {
+        outcome.printed = "parse error: " + interpreter.parse_error();
+        return outcome;
+    }
+    std::ostringstream printed;
+    try {
+        printed << interpreter.eval();
+    } catch (const InterpreterSemanticError &e) {
+        printed << "error: " << e.what();
+    }
+    outcome.printed = printed.str();
+    outcome.graphics = interpreter.graphics;
+    return outcome;
+}
+
+// Run under ThreadSanitizer with cmake -DTSAN=TRUE
+TEST_CASE("Test independent interpreters evaluate concurrently", "[concurrency]") {
+    TemporaryDirectory dir;
+    auto cache = std::make_shared<ResultCache>(dir.path);
+    const std::vector<std::string> programs = {
+        "(begin (define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))) (fib 16))",
+        "(begin (define xs (range 0 200 1)) (define ys (* xs 2)) (sum (+ xs ys)))",
+        "(begin (define r (rect 0 0 5 5)) (for i 0 300 1 (draw (fill_rect r i (* i 2) 3))) (ellipse r))",
+        "(pmap (lambda (x) (sin (* x x))) (range 0 400 1))",
+        "(for i 0 5000 1 (draw (arc (point i 0) (point 0 i) (cos i))))",
+        "(begin (define a 1) (define a 2))",
+        "(for i 0 10000000 1 i)",
+        "(begin (draw (point 1 2)) (+ 1",
+        "(repeat 200 (draw (line (point 0 0) (point (arctan 1 2) (pow 2 0.5)))))",
+    };
+
+    const int variants = 4;
+    std::vector<ConcurrentOutcome> expected;
+    for (int variant = 0; variant < variants; ++variant) {
+        for (const auto &program : programs) {
+            expected.push_back(evalVariant(program, variant, cache));
+        }
+    }
+
+    const unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+    const int rounds = 3;
+    std::vector<int> mismatches(threads, 0);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            for (int round = 0; round < rounds; ++round) {
+                // each thread walks the programs from its own starting point
+                for (std::size_t k = 0; k < expected.size(); ++k) {
+                    std::size_t i = (k + t) % expected.size();
+                    ConcurrentOutcome actual =
+                        evalVariant(programs[i % programs.size()], static_cast<int>(i / programs.size()), cache);
+                    if (!(actual == expected[i])) {
+                        ++mismatches[t];
+                    }
+                }
+            }
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    for (unsigned t = 0; t < threads; ++t) {
+        INFO("thread " << t);
+        REQUIRE(mismatches[t] == 0);
+    }
+    REQUIRE(cache->stats().hits > 0);
+}
+
+TEST_CASE("Test parse errors are reported by the interpreter that found them", "[concurrency]") {
+    Interpreter interpreter;
+    std::istringstream unclosed("(+ 1 (* 2 3)");
+    REQUIRE_FALSE(interpreter.parse(unclosed));
+    REQUIRE(interpreter.parse_error() == "Expected ')'");
+    std::istringstream fine("(+ 1 2)");
+    REQUIRE(interpreter.parse(fine));
+    REQUIRE(interpreter.parse_error().empty());
+}
+
+// ------------------------------- Batch Tests -------------------------------
+
+static void writeFile(const std::string &path, const std::string &contents) {
+    std::ofstream file(path);
+    REQUIRE(file.good());
+    file << contents;
+}
+
+TEST_CASE("Test reset forgets globals and keeps settings", "[batch]") {
+    DrawRecorder interpreter;
+    interpreter.set_math_mode(MathMode::Fast);
+    std::istringstream iss("(begin (define x 2) (draw (point x x)) x)");
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE(interpreter.eval() == Expression(2.0));
+
+    interpreter.reset();
+    REQUIRE(interpreter.graphics.empty());
+    REQUIRE(interpreter.math_mode() == MathMode::Fast);
+    std::istringstream redefine("(begin (define x 3) (* x pi))");
+    REQUIRE(interpreter.parse(redefine));
+    REQUIRE(interpreter.eval() == Expression(3 * std::atan2(0, -1)));
+}
+
+TEST_CASE("Test listing the scripts of a batch", "[batch]") {
+    TemporaryDirectory dir;
+    REQUIRE(mkdir((dir.path + "/nested").c_str(), 0700) == 0);
+    writeFile(dir.path + "/b.slp", "(+ 1 2)");
+    writeFile(dir.path + "/a.slp", "(+ 1 2)");
+    writeFile(dir.path + "/notes.txt", "not a script");
+    writeFile(dir.path + "/nested/c.slp", "(+ 1 2)");
+
+    std::vector<std::string> scripts;
+    REQUIRE(listBatchScripts(dir.path + "/", scripts));
+    std::vector<std::string> found = {dir.path + "/a.slp", dir.path + "/b.slp", dir.path + "/nested/c.slp"};
+    REQUIRE(scripts == found);
+
+    writeFile(dir.path + "/list", "first.slp\r\n\n  \nsecond.slp\n");
+    std::vector<std::string> listed;
+    REQUIRE(listBatchScripts(dir.path + "/list", listed));
+    std::vector<std::string> in_list = {"first.slp", "second.slp"};
+    REQUIRE(listed == in_list);
+
+    REQUIRE_FALSE(listBatchScripts(dir.path + "/missing", listed));
+}
+
+TEST_CASE("Test a batch reports every script in order without sharing globals", "[batch]") {
+    TemporaryDirectory dir;
+    std::vector<std::string> scripts;
+    std::vector<std::string> expected;
+    for (int i = 0; i < 40; ++i) {
+        std::string path = dir.path + "/script" + std::to_string(i) + ".slp";
+        scripts.push_back(path);
+        if (i % 10 == 3) {
+            writeFile(path, "(begin shared)");
+            expected.push_back("Unknown symbol: shared");
+        } else if (i % 10 == 7) {
+            writeFile(path, "(begin (define shared 1)");
+            expected.push_back("Invalid expression in file: Expected ')'");
+        } else {
+            // uneven costs, so the threads finish out of order
+            writeFile(path, "(begin (define shared " + std::to_string(i) + ") (for j 0 " + std::to_string((i % 4) * 3000) +
+                            " 1 (draw (point j j))) shared)");
+            expected.push_back("(" + std::to_string(i) + ")");
+        }
+    }
+    scripts.push_back(dir.path + "/missing.slp");
+    expected.push_back("Unable to open file " + dir.path + "/missing.slp");
+
+    std::vector<std::string> reported;
+    std::vector<std::string> order;
+    BatchSummary summary = runBatch(scripts, 4, [](Interpreter &interpreter) { interpreter.set_threads(1); },
+                                    [&](const BatchResult &result) {
+                                        order.push_back(result.script);
+                                        reported.push_back(result.output);
+                                    });
+    REQUIRE(order == scripts);
+    REQUIRE(reported == expected);
+    REQUIRE(summary.scripts == 41);
+    REQUIRE(summary.failed == 9);
+}
+
+TEST_CASE("Test a batch goes on after a script runs out of memory", "[batch]") {
+    TemporaryDirectory dir;
+    std::vector<std::string> scripts = {dir.path + "/huge.slp", dir.path + "/small.slp"};
+    writeFile(scripts[0], "(length (range 1e9))");
+    writeFile(scripts[1], "(+ 1 2)");
+
+    std::vector<std::string> reported;
+    BatchSummary summary;
+    {
+        AddressSpaceLimit limit(512 * 1024 * 1024);
+        summary = runBatch(scripts, 1, [](Interpreter &interpreter) { interpreter.set_threads(1); },
+                           [&](const BatchResult &result) { reported.push_back(result.output); });
+    }
+    REQUIRE(reported.size() == 2);
+    REQUIRE(reported[0].find("Evaluation failed") == 0);
+    REQUIRE(reported[1] == "(3)");
+    REQUIRE(summary.failed == 1);
+}
+
+// ------------------------------- Server Tests -------------------------------
+
+// A Server listening in a temporary directory, run on its own thread until destroyed
+class RunningServer {
+public:
+    explicit RunningServer(std::size_t threads)
+        : socket(dir.path + "/slisp.sock"), server(socket, threads, [](Interpreter &interpreter) {
+              interpreter.set_threads(1);
+          }) {
+        REQUIRE(server.listen());
+        thread = std::thread([this]() { server.run(); });
+    }
+    ~RunningServer() {
+        server.stop();
+        thread.join();
+    }
+
+    TemporaryDirectory dir;
+    std::string socket;
+    Server server;
+    std::thread thread;
+};
+
+static Request makeRequest(const std::string &session, const std::string &body,
+                           RequestKind kind = RequestKind::Expression) {
+    Request request;
+    request.kind = kind;
+    request.session = session;
+    request.body = body;
+    return request;
+}
+
+static Reply readReply(int fd) {
+    std::string payload;
+    Reply reply;
+    REQUIRE(readFrame(fd, payload));
+    REQUIRE(decodeReply(payload, reply));
+    return reply;
+}
+
+TEST_CASE("Test the server answers pipelined requests in order", "[server]") {
+    RunningServer running(2);
+    int fd = connectServer(running.socket);
+    REQUIRE(fd >= 0);
+    std::vector<Request> requests = {
+        makeRequest("a", "(define x 2)"),
+        makeRequest("b", "(define x 10)"),
+        makeRequest("a", "(for i 0 20000 1 (draw (point x i)))"),
+        makeRequest("b", "(* x x)"),
+        makeRequest("a", "(+ x 1"),
+        makeRequest("a", "", RequestKind::Reset),
+        makeRequest("a", "(begin x)"),
+        makeRequest("b", TEST_FILE_DIR + "/test_loops.slp", RequestKind::File),
+        makeRequest("b", "(list x (point 1 2))"),
+    };
+    requests.back().format = ReplyFormat::Binary;
+    std::string frames;
+    for (const auto &request : requests) {
+        frames += encodeRequest(request);
+    }
+    frames += std::string("\x03\0\0\0XYZ", 7); // malformed, answered in its turn
+    REQUIRE(writeAll(fd, frames));
+    // the server still answers a client that has finished sending
+    REQUIRE(shutdown(fd, SHUT_WR) == 0);
+
+    std::vector<std::string> expected = {"(2)", "(10)", "(None)", "(100)", "Invalid expression", "", "Unknown symbol: x",
+                                         "(2470)"};
+    for (const auto &text : expected) {
+        Reply reply = readReply(fd);
+        INFO(reply.body);
+        REQUIRE(reply.ok == (text.empty() || text[0] == '('));
+        REQUIRE(reply.body == text);
+    }
+    Reply binary = readReply(fd);
+    REQUIRE(binary.ok);
+    const char *pos = binary.body.data();
+    Atom value;
+    REQUIRE(decodeAtom(pos, binary.body.data() + binary.body.size(), value));
+    std::ostringstream printed;
+    printed << Expression(value);
+    REQUIRE(printed.str() == "((10) (1,2))");
+    Reply malformed = readReply(fd);
+    REQUIRE_FALSE(malformed.ok);
+    REQUIRE(malformed.body == "Malformed request");
+    std::string payload;
+    REQUIRE_FALSE(readFrame(fd, payload));
+    close(fd);
+}
+
+TEST_CASE("Test the server keeps concurrent sessions apart", "[server]") {
+    RunningServer running(4);
+    const int clients = 8;
+    const int requests = 50;
+    std::vector<int> mismatches(clients, 0);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c]() {
+            int fd = connectServer(running.socket);
+            if (fd < 0) {
+                mismatches[c] = -1;
+                return;
+            }
+            std::string session = "client" + std::to_string(c);
+            std::string frames = encodeRequest(makeRequest(session, "(define n " + std::to_string(c) + ")"));
+            for (int i = 0; i < requests; ++i) {
+                frames += encodeRequest(makeRequest(session, "(+ n " + std::to_string(i) + ")"));
+            }
+            frames += encodeRequest(makeRequest(session, "", RequestKind::Drop));
+            writeAll(fd, frames);
+            std::string payload;
+            Reply reply;
+            for (int i = -1; i <= requests; ++i) {
+                std::string expected = i < 0 ? "(" + std::to_string(c) + ")"
+                                     : i == requests ? "" : "(" + std::to_string(c + i) + ")";
+                if (!readFrame(fd, payload) || !decodeReply(payload, reply) || reply.body != expected) {
+                    ++mismatches[c];
+                }
+            }
+            close(fd);
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (int c = 0; c < clients; ++c) {
+        INFO("client " << c);
+        REQUIRE(mismatches[c] == 0);
+    }
+}
+
+TEST_CASE("Test the server does not replace a file that is not a socket", "[server]") {
+    TemporaryDirectory dir;
+    std::string path = dir.path + "/taken";
+    writeFile(path, "keep");
+    {
+        Server server(path, 1, [](Interpreter &) {});
+        REQUIRE_FALSE(server.listen());
+    }
+    std::ifstream file(path);
+    std::string contents;
+    file >> contents;
+    REQUIRE(contents == "keep");
+}
+
+TEST_CASE("Test the server survives a request that runs out of memory", "[server]") {
+    RunningServer running(1);
+    int fd = connectServer(running.socket);
+    REQUIRE(fd >= 0);
+    REQUIRE(writeAll(fd, encodeRequest(makeRequest("a", "(define x 1)"))));
+    REQUIRE(readReply(fd).body == "(1)");
+
+    Reply failed;
+    {
+        AddressSpaceLimit limit(512 * 1024 * 1024);
+        REQUIRE(writeAll(fd, encodeRequest(makeRequest("a", "(length (range 1e9))"))));
+        failed = readReply(fd);
+    }
+    REQUIRE_FALSE(failed.ok);
+    REQUIRE(failed.body.find("Evaluation failed") == 0);
+
+    // the session and the server carry on
+    REQUIRE(writeAll(fd, encodeRequest(makeRequest("a", "(+ x 1)"))));
+    REQUIRE(readReply(fd).body == "(2)");
+    close(fd);
+    fd = connectServer(running.socket);
+    REQUIRE(fd >= 0);
+    REQUIRE(writeAll(fd, encodeRequest(makeRequest("b", "(+ 2 3)"))));
+    REQUIRE(readReply(fd).body == "(5)");
+    close(fd);
+}
+
+// ------------------------------- Stdin Tests -------------------------------
+
+// Every form a FormReader finds in fd
+static std::vector<std::string> readForms(int fd, std::function<void()> before_wait = nullptr) {
+    FormReader reader(fd, before_wait);
+    std::vector<std::string> forms;
+    const char *form;
+    std::size_t size;
+    while (reader.next(form, size)) {
+        forms.push_back(std::string(form, size));
+    }
+    return forms;
+}
+
+TEST_CASE("Test reading forms across lines and comments", "[stdin]") {
+    TemporaryDirectory dir;
+    std::string path = dir.path + "/forms.slp";
+    writeFile(path, "; leading comment\n(define a\n  1) (+ a ; a ) in a comment\n 2)\n\n"
+                    "(list(+ 1 2)\"x\")stray (begin\n) ) (begin (define b 3)");
+    int fd = open(path.c_str(), O_RDONLY);
+    REQUIRE(fd >= 0);
+    std::vector<std::string> forms = readForms(fd);
+    close(fd);
+    std::vector<std::string> expected = {"(define a\n  1)", "(+ a ; a ) in a comment\n 2)", "(list(+ 1 2)\"x\")",
+                                         "stray", "(begin\n)", ")", "(begin (define b 3)"};
+    REQUIRE(forms == expected);
+}
+
+TEST_CASE("Test reading forms larger than a block from a pipe", "[stdin]") {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    std::string big = "(list";
+    while (big.size() < FormReader::BLOCK_BYTES + 1000) {
+        big += "\n 12345";
+    }
+    big += ")";
+    std::string text;
+    for (int i = 0; i < 3; ++i) {
+        text += big + " (+ 1 " + std::to_string(i) + ")\n";
+    }
+    std::thread writer([&]() {
+        for (std::size_t sent = 0; sent < text.size();) {
+            ssize_t n = write(fds[1], text.data() + sent, text.size() - sent);
+            if (n <= 0) {
+                break;
+            }
+            sent += n;
+        }
+        close(fds[1]);
+    });
+    std::size_t waits = 0;
+    std::vector<std::string> forms = readForms(fds[0], [&]() { ++waits; });
+    writer.join();
+    close(fds[0]);
+
+    REQUIRE(forms.size() == 6);
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(forms[2 * i] == big);
+        REQUIRE(forms[2 * i + 1] == "(+ 1 " + std::to_string(i) + ")");
+    }
+    // the reader waits on the pipe at least once before the writer has filled it
+    REQUIRE(waits >= 1);
+}
+
+TEST_CASE("Test slisp --stdin evaluates every form and summarizes", "[stdin]") {
+    TemporaryDirectory dir;
+    writeFile(dir.path + "/in.slp", "(define a\n  2)\n(* a 3) (begin b)\n) ; stray\n(list a a)\n(+ a\n 1");
+    std::string command = std::string(SLISP_BINARY) + " --no-cache --stdin < " + dir.path + "/in.slp > " +
+                          dir.path + "/out.txt 2> " + dir.path + "/err.txt";
+    REQUIRE(std::system(command.c_str()) != 0);
+
+    std::ifstream out(dir.path + "/out.txt");
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(out, line)) {
+        lines.push_back(line);
+    }
+    std::vector<std::string> expected = {"(2)", "(6)", "Error: Unknown symbol: b", "Error: Invalid expression",
+                                         "((2) (2))", "Error: Invalid expression"};
+    REQUIRE(lines == expected);
+
+    std::ifstream err(dir.path + "/err.txt");
+    std::getline(err, line);
+    REQUIRE(line.compare(0, 28, "stdin: 6 forms, 61 bytes in ") == 0);
+    REQUIRE(line.find(", 3 errors") != std::string::npos);
+}
+
+// ------------------------------- Output Tests -------------------------------
+
+static std::string formatted(double value) {
+    char text[MAX_NUMBER_CHARS];
+    return std::string(text, formatNumber(value, text));
+}
+
+TEST_CASE("Test formatting numbers", "[output]") {
+    REQUIRE(formatted(2) == "2");
+    REQUIRE(formatted(-1.5) == "-1.5");
+    REQUIRE(formatted(0.1) == "0.1");
+    REQUIRE(formatted(0) == "0");
+    REQUIRE(formatted(-0.0) == "-0");
+    REQUIRE(formatted(2.0 / 3) == "0.6666666666666666");
+    REQUIRE(formatted(123456789012345678.0) == "123456789012345680");
+    REQUIRE(formatted(1e20) == "100000000000000000000");
+    REQUIRE(formatted(1e21) == "1e+21");
+    REQUIRE(formatted(1e-6) == "0.000001");
+    REQUIRE(formatted(1e-7) == "1e-7");
+    REQUIRE(formatted(5e-324) == "5e-324");
+    REQUIRE(formatted(1.7976931348623157e308) == "1.7976931348623157e+308");
+    REQUIRE(formatted(std::atan2(0, -1)) == "3.141592653589793");
+    REQUIRE(formatted(-std::numeric_limits<double>::infinity()) == "-inf");
+    REQUIRE(formatted(std::numeric_limits<double>::quiet_NaN()) == "nan");
+}
+
+TEST_CASE("Test formatted numbers read back exactly", "[output]") {
+    std::mt19937_64 random(7);
+    std::uniform_real_distribution<double> nearby(-1e6, 1e6);
+    for (int i = 0; i < 200000; ++i) {
+        std::uint64_t bits = random();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        if (i % 2 == 0) {
+            value = nearby(random);
+        }
+        if (!std::isfinite(value)) {
+            continue;
+        }
+        std::string text = formatted(value);
+        double back = std::strtod(text.c_str(), nullptr);
+        if (std::memcmp(&back, &value, sizeof(value)) != 0) {
+            FAIL(text << " does not read back as " << std::setprecision(17) << value);
+        }
+    }
+}
+
+TEST_CASE("Test writing results as NDJSON", "[output]") {
+    DrawRecorder interpreter;
+    auto record = [&](const std::string &program) {
+        std::istringstream iss(program);
+        REQUIRE(interpreter.parse(iss));
+        std::string out;
+        appendResult(OutputFormat::Ndjson, interpreter.eval(), out);
+        return out;
+    };
+    REQUIRE(record("(/ 1 3)") == "{\"value\":0.3333333333333333}\n");
+    REQUIRE(record("(list 1 2.5 (< 1 2))") == "{\"value\":[1,2.5,true]}\n");
+    REQUIRE(record("(list (point 1 2) (line (point 0 0) (point 3 4)) (rect 0 0 1 1))") ==
+            "{\"value\":[{\"point\":[1,2]},{\"line\":[0,0,3,4]},{\"rect\":[0,0,1,1]}]}\n");
+    REQUIRE(record("(fill_rect (rect 0 0 1 1) 0.25 0.5 1)") == "{\"value\":{\"fill_rect\":[0,0,1,1,0.25,0.5,1]}}\n");
+    REQUIRE(record("(ellipse (rect 1 2 3 4))") == "{\"value\":{\"ellipse\":[1,2,3,4]}}\n");
+    REQUIRE(record("(arc (point 0 0) (point 1 0) pi)") == "{\"value\":{\"arc\":[0,0,1,0,3.141592653589793]}}\n");
+    REQUIRE(record("(define f (lambda (x) x))") == "{\"value\":{\"lambda\":null}}\n");
+    std::string infinite;
+    appendJson(Expression(std::numeric_limits<double>::infinity()).head, infinite);
+    REQUIRE(infinite == "null");
+
+    std::string out;
+    appendError(OutputFormat::Ndjson, "Unknown symbol: \"q\"\n", out);
+    REQUIRE(out == "{\"error\":\"Unknown symbol: \\\"q\\\"\\u000a\"}\n");
+}
+
+TEST_CASE("Test binary records keep shape lists in columns", "[output]") {
+    std::shared_ptr<List> shapes = std::make_shared<List>();
+    shapes->numeric = false;
+    for (int i = 0; i < 5; ++i) {
+        Atom shape;
+        shape.type = FillRectType;
+        shape.value.fillRect_value = FillRect{Rect{i * 0.1, 1.0 / (i + 1), 2.0, -3.0}, 0.25, 0.5, i * 1.0};
+        shapes->items.push_back(shape);
+    }
+    Atom list;
+    list.type = ListType;
+    list.value.list_value = shapes;
+
+    std::string out;
+    appendResult(OutputFormat::Binary, Expression(list), out);
+    appendError(OutputFormat::Binary, "Unknown symbol: q", out);
+    // a list of 5 fill_rects is its type, layout, count, shape type and 7 columns of 5 numbers
+    REQUIRE(out.size() == 4 + 1 + 1 + 1 + 8 + 1 + 7 * 5 * 8 + 4 + 1 + 17);
+
+    std::uint32_t size = static_cast<unsigned char>(out[0]) | static_cast<unsigned char>(out[1]) << 8;
+    Reply reply;
+    REQUIRE(decodeReply(out.substr(4, size), reply));
+    REQUIRE(reply.ok);
+    const char *pos = reply.body.data();
+    Atom decoded;
+    REQUIRE(decodeAtom(pos, reply.body.data() + reply.body.size(), decoded));
+    REQUIRE(pos == reply.body.data() + reply.body.size());
+    REQUIRE(decoded.value.list_value->items.size() == 5);
+    REQUIRE(decoded.value.list_value->items[2].value.fillRect_value.rect.y1 == 1.0 / 3);
+    std::string reencoded;
+    REQUIRE(encodeAtom(decoded, reencoded));
+    REQUIRE(reencoded == reply.body);
+
+    REQUIRE(decodeReply(out.substr(8 + size), reply));
+    REQUIRE_FALSE(reply.ok);
+    REQUIRE(reply.body == "Unknown symbol: q");
+}
+
+TEST_CASE("Test slisp --output writes records for -e, files and --stdin", "[output]") {
+    TemporaryDirectory dir;
+    writeFile(dir.path + "/in.slp", "(list (point 0.1 2) 3)\n(begin q)");
+    std::string out = dir.path + "/out.txt";
+    std::string slisp = std::string(SLISP_BINARY) + " --no-cache --output=ndjson ";
+    REQUIRE(std::system((slisp + "-e '(/ 1 3)' > " + out).c_str()) == 0);
+    std::ifstream expression(out);
+    std::string line;
+    std::getline(expression, line);
+    REQUIRE(line == "{\"value\":0.3333333333333333}");
+
+    REQUIRE(std::system((slisp + "--stdin < " + dir.path + "/in.slp > " + out + " 2> /dev/null").c_str()) != 0);
+    std::ifstream piped(out);
+    std::getline(piped, line);
+    REQUIRE(line == "{\"value\":[{\"point\":[0.1,2]},3]}");
+    std::getline(piped, line);
+    REQUIRE(line == "{\"error\":\"Unknown symbol: q\"}");
+
+    REQUIRE(std::system((slisp + dir.path + "/in.slp > " + out + " 2> /dev/null").c_str()) != 0);
+    std::ifstream file(out);
+    std::getline(file, line);
+    REQUIRE(line == "{\"error\":\"Invalid expression in file\"}");
+
+    REQUIRE(std::system((slisp + "> /dev/null 2>&1 < /dev/null").c_str()) != 0);
+}
+
+// Selects a number style until destroyed
+class NumberStyleScope {
+public:
+    explicit NumberStyleScope(NumberStyle style) : previous(numberStyle()) { setNumberStyle(style); }
+    ~NumberStyleScope() { setNumberStyle(previous); }
+
+private:
+    NumberStyle previous;
+};
+
+TEST_CASE("Test printing expressions in both number styles", "[output]") {
+    DrawRecorder interpreter;
+    auto printed = [&](const std::string &program) {
+        std::istringstream iss(program);
+        REQUIRE(interpreter.parse(iss));
+        std::ostringstream out;
+        out << interpreter.eval();
+        return out.str();
+    };
+    const std::string program =
+        "(list (/ 1 3) (point pi 2) (line (point 0 0) (point 1e7 -0.5)) (arc (point 0 0) (point 1 0) pi) "
+        "(rect 0 0 1 1) (fill_rect (rect 0 0 1 1) 0.25 0.5 1) (ellipse (rect 1 2 3 4)) (list) (< 1 2) (list 1 2))";
+    {
+        NumberStyleScope compatible(NumberStyle::Compatible);
+        REQUIRE(printed(program) == "((0.333333) (3.14159,2) ((0,0),(1e+07,-0.5)) ((0,0),(1,0) 3.14159)) "
+                                    "(0,0,1,1) ((0,0,1,1),0.25,0.5,1) (1,2,3,4)) () (True) ((1) (2)))");
+    }
+    REQUIRE(printed(program) == "((0.3333333333333333) (3.141592653589793,2) ((0,0),(10000000,-0.5)) "
+                                "((0,0),(1,0) 3.141592653589793)) (0,0,1,1) ((0,0,1,1),0.25,0.5,1) (1,2,3,4)) () "
+                                "(True) ((1) (2)))");
+}
+
+// ------------------------------- REPL Tests -------------------------------
+
+TEST_CASE("Test scanning forms chunk by chunk", "[repl]") {
+    const std::string text = "; setup\n(define a\n  1) (+ a ; a ) in a comment\n 2)\nstray (list(+ 1 2)a) ) (begin";
+    std::vector<std::string> expected = {"(define a\n  1)", "(+ a ; a ) in a comment\n 2)", "stray",
+                                         "(list(+ 1 2)a)", ")"};
+    // every split of the text into chunks gives the same forms
+    for (std::size_t chunk : {std::size_t(1), std::size_t(3), std::size_t(7), text.size()}) {
+        FormScanner scanner;
+        std::vector<std::string> forms;
+        const char *form;
+        std::size_t size;
+        for (std::size_t i = 0; i < text.size(); i += chunk) {
+            scanner.append(text.data() + i, std::min(chunk, text.size() - i));
+            while (scanner.next(form, size)) {
+                forms.push_back(std::string(form, size));
+            }
+        }
+        REQUIRE(forms == expected);
+        REQUIRE(scanner.pending());
+        REQUIRE(scanner.finish(form, size));
+        REQUIRE(std::string(form, size) == "(begin");
+        REQUIRE_FALSE(scanner.pending());
+        REQUIRE_FALSE(scanner.finish(form, size));
+    }
+}
+
+TEST_CASE("Test the scanner reports an open form until it closes", "[repl]") {
+    FormScanner scanner;
+    const char *form;
+    std::size_t size;
+    for (int i = 0; i < 10000; ++i) {
+        std::string line = i == 0 ? "(list\n" : " " + std::to_string(i) + "\n";
+        scanner.append(line.data(), line.size());
+        REQUIRE_FALSE(scanner.next(form, size));
+        REQUIRE(scanner.pending());
+    }
+    scanner.append(")\n", 2);
+    REQUIRE(scanner.next(form, size));
+    REQUIRE_FALSE(scanner.pending());
+
+    DrawRecorder interpreter;
+    std::istringstream iss(std::string(form, size));
+    REQUIRE(interpreter.parse(iss));
+    REQUIRE(interpreter.eval().head.value.list_value->size() == 9999);
+
+    scanner.append("(+ 1", 4);
+    REQUIRE_FALSE(scanner.next(form, size));
+    REQUIRE(scanner.pending());
+    scanner.clear();
+    REQUIRE_FALSE(scanner.pending());
+    REQUIRE_FALSE(scanner.next(form, size));
+}
+
+TEST_CASE("Test the slisp REPL evaluates forms that span lines", "[repl]") {
+    TemporaryDirectory dir;
+    writeFile(dir.path + "/in.slp", "(define a\n  2)\n(* a\n\n 3) (+ a 1)\n(list a\n");
+    std::string command = std::string(SLISP_BINARY) + " --no-cache < " + dir.path + "/in.slp > " + dir.path +
+                          "/out.txt 2> " + dir.path + "/err.txt";
+    REQUIRE(std::system(command.c_str()) == 0);
+    std::ifstream out(dir.path + "/out.txt");
+    std::stringstream printed;
+    printed << out.rdbuf();
+    REQUIRE(printed.str() == "slisp>   ...> (2)\nslisp>   ...>   ...> (6)\n(3)\nslisp>   ...> ");
+    std::ifstream err(dir.path + "/err.txt");
+    std::string line;
+    std::getline(err, line);
+    REQUIRE(line == "Error: Invalid expression");
+}
+
+// ------------------------------- Snapshot Tests -------------------------------
+
+static const char *SNAPSHOT_PRELUDE =
+    "(begin (define n 2.5) (define flag True) (define p (point 1 2))"
+    " (define shapes (list (line (point 0 0) (point 1 1)) (fill_rect (rect 1 2 3 4) 5 6 7) (ellipse (rect 0 0 2 1))))"
+    " (define nums (range 0 5 1))"
+    " (define adder (lambda (x) (lambda (y) (+ x y))))"
+    " (define add2 (adder 2))"
+    " (define fact (lambda (k) (if (< k 2) 1 (* k (fact (- k 1))))))"
+    " (define procs (list add2 fact)))";
+
+TEST_CASE("Test a snapshot restores the globals of a prelude", "[snapshot]") {
+    TemporaryDirectory dir;
+    std::string path = dir.path + "/prelude.snap";
+    Interpreter original;
+    evalIn(original, SNAPSHOT_PRELUDE);
+    std::string error;
+    REQUIRE(original.save_snapshot(path, error));
+
+    std::shared_ptr<const Snapshot> snapshot = Snapshot::open(path, error);
+    REQUIRE(snapshot != nullptr);
+    REQUIRE(snapshot->size() == 10); // the prelude's globals and pi
+    REQUIRE(snapshot->find("fact") != Snapshot::npos);
+    REQUIRE(snapshot->name(snapshot->find("fact")) == "fact");
+    REQUIRE(snapshot->find("fac") == Snapshot::npos);
+    REQUIRE(snapshot->find("zzz") == Snapshot::npos);
+
+    Interpreter restored;
+    restored.set_prelude(snapshot);
+    for (std::string program : {"(begin n)", "(begin flag)", "(begin p)", "(begin nums)", "(begin pi)", "(add2 40)", "(fact 10)", "(begin (define inc (adder 1)) (inc 2))"}) {
+        REQUIRE(evalIn(restored, program) == evalIn(original, program));
+    }
+    std::string expected;
+    std::string actual;
+    REQUIRE(encodeAtom(evalIn(original, "(begin shapes)").head, expected));
+    REQUIRE(encodeAtom(evalIn(restored, "(begin shapes)").head, actual));
+    REQUIRE(actual == expected);
+    REQUIRE(evalIn(restored, "(pmap fact (range 1 9 1))") == evalIn(original, "(pmap fact (range 1 9 1))"));
+
+    // a snapshot made on top of another keeps both sets of globals
+    evalIn(restored, "(define m (add2 n))");
+    std::string layered = dir.path + "/layered.snap";
+    REQUIRE(restored.save_snapshot(layered, error));
+    Interpreter again;
+    again.set_prelude(Snapshot::open(layered, error));
+    REQUIRE(evalIn(again, "(+ m (fact 3))") == Expression(10.5));
+}
+
+TEST_CASE("Test snapshot globals behave like defined ones", "[snapshot]") {
+    TemporaryDirectory dir;
+    std::string path = dir.path + "/prelude.snap";
+    Interpreter original;
+    evalIn(original, SNAPSHOT_PRELUDE);
+    std::string error;
+    REQUIRE(original.save_snapshot(path, error));
+
+    DrawRecorder interpreter;
+    interpreter.set_prelude(Snapshot::open(path, error));
+    REQUIRE_THROWS_WITH(evalIn(interpreter, "(define n 3)"), "n already defined");
+    evalIn(interpreter, "(begin (define x (+ n 1)) (draw p))");
+    REQUIRE(interpreter.graphics.size() == 1);
+
+    interpreter.reset();
+    REQUIRE(evalIn(interpreter, "(* n 2)") == Expression(5.0));
+    REQUIRE_THROWS_WITH(evalIn(interpreter, "(begin x)"), "Unknown symbol: x");
+
+    interpreter.set_live(true);
+    evalIn(interpreter, "(define n 4)");
+    REQUIRE(evalIn(interpreter, "(add2 n)") == Expression(6.0));
+
+    interpreter.set_prelude(nullptr);
+    interpreter.reset();
+    REQUIRE_THROWS_WITH(evalIn(interpreter, "(begin n)"), "Unknown symbol: n");
+}
+
+TEST_CASE("Test damaged snapshots are rejected", "[snapshot]") {
+    TemporaryDirectory dir;
+    std::string path = dir.path + "/prelude.snap";
+    std::string error;
+    REQUIRE(Snapshot::open(path, error) == nullptr);
+    writeFile(path, "SLC2 not a snapshot at all");
+    REQUIRE(Snapshot::open(path, error) == nullptr);
+    REQUIRE(error == path + " is not a snapshot");
+
+    Interpreter original;
+    evalIn(original, "(begin (define a 1) (define z (list 1 2 3)))");
+    REQUIRE(original.save_snapshot(path, error));
+    std::string contents;
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        contents = buffer.str();
+    }
+    writeFile(path, contents.substr(0, 20)); // the header promises more entries than follow
+    REQUIRE(Snapshot::open(path, error) == nullptr);
+    writeFile(path, contents.substr(0, contents.size() - 1)); // z's value, the last, is cut short
+    Interpreter restored;
+    restored.set_prelude(Snapshot::open(path, error));
+    REQUIRE(evalIn(restored, "(begin a)") == Expression(1.0));
+    REQUIRE_THROWS_WITH(evalIn(restored, "(begin z)"), "The snapshot's value of 'z' is damaged");
+}
+
+TEST_CASE("Test slisp saves and loads snapshots", "[snapshot]") {
+    TemporaryDirectory dir;
+    writeFile(dir.path + "/prelude.slp", SNAPSHOT_PRELUDE);
+    std::string slisp = std::string(SLISP_BINARY) + " --no-cache ";
+    std::string snap = dir.path + "/prelude.snap";
+    REQUIRE(std::system((slisp + "--make-snapshot " + snap + " " + dir.path + "/prelude.slp").c_str()) == 0);
+    std::string out = dir.path + "/out.txt";
+    REQUIRE(std::system((slisp + "--snapshot " + snap + " -e '(add2 (fact 5))' > " + out).c_str()) == 0);
+    std::ifstream printed(out);
+    std::string line;
+    std::getline(printed, line);
+    REQUIRE(line == "(122)");
+    REQUIRE(std::system((slisp + "--snapshot " + dir.path + "/missing.snap -e 1 2> /dev/null").c_str()) != 0);
+}
+
+// ------------------------------- Workload Tests -------------------------------
+
+static std::string workload(const WorkloadSpec &spec) {
+    std::ostringstream out;
+    writeWorkload(spec, out);
+    return out.str();
+}
+
+TEST_CASE("Test generated workloads evaluate and draw every shape", "[workload]") {
+    WorkloadSpec spec;
+    spec.shapes = 60;
+    for (unsigned depth : {0u, 1u, 4u, 30u}) {
+        for (std::uint64_t defines : {0u, 1u, 20u}) {
+            spec.depth = depth;
+            spec.defines = defines;
+            DrawRecorder interpreter;
+            std::istringstream iss(workload(spec));
+            REQUIRE(interpreter.parse(iss));
+            REQUIRE_NOTHROW(interpreter.eval());
+            REQUIRE(interpreter.graphics.size() == 60);
+            for (const auto &shape : interpreter.graphics) {
+                std::string encoded;
+                REQUIRE(encodeAtom(shape.head, encoded)); // every shape type, none of them empty
+            }
+        }
+    }
+}
+
+TEST_CASE("Test workload parameters shape the script", "[workload]") {
+    WorkloadSpec spec;
+    spec.shapes = 200;
+    REQUIRE(workload(spec) == workload(spec));
+    WorkloadSpec reseeded = spec;
+    reseeded.seed = 2;
+    REQUIRE(workload(reseeded) != workload(spec));
+
+    spec.comment_ratio = 0;
+    std::string text = workload(spec);
+    REQUIRE(std::count(text.begin(), text.end(), ';') == 1); // the header only
+    spec.comment_ratio = 1;
+    text = workload(spec);
+    REQUIRE(std::count(text.begin(), text.end(), ';') == 201);
+
+    spec.symbol_ratio = 0;
+    text = workload(spec);
+    REQUIRE(text.find(" g", text.find("(draw")) == std::string::npos);
+    spec.symbol_ratio = 1;
+    spec.depth = 0;
+    text = workload(spec);
+    std::size_t draws = text.find("(draw");
+    REQUIRE(text.find("(point g", draws) != std::string::npos);
+    REQUIRE(text.find("(point -", draws) == std::string::npos);
+
+    spec.crlf = true;
+    text = workload(spec);
+    REQUIRE(std::count(text.begin(), text.end(), '\n') == std::count(text.begin(), text.end(), '\r'));
+    REQUIRE(text.find("\r\n") != std::string::npos);
+    DrawRecorder interpreter;
+    std::istringstream iss(text);
+    REQUIRE(interpreter.parse(iss));
+    interpreter.eval();
+    REQUIRE(interpreter.graphics.size() == 200);
+}
+
+TEST_CASE("Test REPL workloads put one printable form on each line", "[workload]") {
+    WorkloadSpec spec;
+    spec.shapes = 120;
+    spec.defines = 15;
+    spec.comment_ratio = 0.5;
+    spec.crlf = true;
+    spec.repl = true;
+    std::istringstream lines(workload(spec));
+    Interpreter interpreter;
+    std::string line;
+    std::size_t shapes = 0;
+    while (std::getline(lines, line)) {
+        REQUIRE(line.back() == '\r');
+        if (line[0] == ';') {
+            continue;
+        }
+        std::istringstream form(line);
+        REQUIRE(interpreter.parse(form));
+        Expression value = interpreter.eval();
+        shapes += value.head.type != NumberType;
+    }
+    REQUIRE(shapes == 120);
+}
@@ -0,0 +1,324 @@
+#include "vector_kernels.hpp"
+#include "fast_math.hpp"
+#include "fast_math_kernels.hpp"
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// A portable view of one SIMD register of doubles, and of a mask selecting some of its lanes
+// (all bits of a lane set or clear). SIMD_LANES is 0 when the target has none, in which case
+// only the scalar tails below run.
+#if defined(__AVX__)
+typedef __m256d Lanes;
+const std::size_t SIMD_LANES = 4;
+inline Lanes lanesLoad(const Number *p) { return _mm256_loadu_pd(p); }
+inline Lanes lanesSplat(Number x) { return _mm256_set1_pd(x); }
+inline void lanesStore(Number *p, Lanes v) { _mm256_storeu_pd(p, v); }
+inline Lanes lanesAdd(Lanes a, Lanes b) { return _mm256_add_pd(a, b); }
+inline Lanes lanesSub(Lanes a, Lanes b) { return _mm256_sub_pd(a, b); }
+inline Lanes lanesMul(Lanes a, Lanes b) { return _mm256_mul_pd(a, b); }
+inline Lanes lanesDiv(Lanes a, Lanes b) { return _mm256_div_pd(a, b); }
+typedef __m256d LaneMask;
+inline LaneMask lanesEqual(Lanes a, Lanes b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+inline LaneMask lanesLessEqual(Lanes a, Lanes b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+inline LaneMask lanesOr(LaneMask a, LaneMask b) { return _mm256_or_pd(a, b); }
+inline bool lanesAll(LaneMask m) { return _mm256_movemask_pd(m) == 0xf; }
+inline Lanes lanesSelect(LaneMask m, Lanes a, Lanes b) { return _mm256_blendv_pd(b, a, m); }
+inline Lanes lanesAbs(Lanes a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+inline Lanes lanesNegateWhere(LaneMask m, Lanes a) { return _mm256_xor_pd(a, _mm256_and_pd(m, _mm256_set1_pd(-0.0))); }
+#elif defined(__SSE2__)
+typedef __m128d Lanes;
+const std::size_t SIMD_LANES = 2;
+inline Lanes lanesLoad(const Number *p) { return _mm_loadu_pd(p); }
+inline Lanes lanesSplat(Number x) { return _mm_set1_pd(x); }
+inline void lanesStore(Number *p, Lanes v) { _mm_storeu_pd(p, v); }
+inline Lanes lanesAdd(Lanes a, Lanes b) { return _mm_add_pd(a, b); }
+inline Lanes lanesSub(Lanes a, Lanes b) { return _mm_sub_pd(a, b); }
+inline Lanes lanesMul(Lanes a, Lanes b) { return _mm_mul_pd(a, b); }
+inline Lanes lanesDiv(Lanes a, Lanes b) { return _mm_div_pd(a, b); }
+typedef __m128d LaneMask;
+inline LaneMask lanesEqual(Lanes a, Lanes b) { return _mm_cmpeq_pd(a, b); }
+inline LaneMask lanesLessEqual(Lanes a, Lanes b) { return _mm_cmple_pd(a, b); }
+inline LaneMask lanesOr(LaneMask a, LaneMask b) { return _mm_or_pd(a, b); }
+inline bool lanesAll(LaneMask m) { return _mm_movemask_pd(m) == 0x3; }
+inline Lanes lanesSelect(LaneMask m, Lanes a, Lanes b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+inline Lanes lanesAbs(Lanes a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+inline Lanes lanesNegateWhere(LaneMask m, Lanes a) { return _mm_xor_pd(a, _mm_and_pd(m, _mm_set1_pd(-0.0))); }
+#elif defined(__aarch64__)
+typedef float64x2_t Lanes;
+const std::size_t SIMD_LANES = 2;
+inline Lanes lanesLoad(const Number *p) { return vld1q_f64(p); }
+inline Lanes lanesSplat(Number x) { return vdupq_n_f64(x); }
+inline void lanesStore(Number *p, Lanes v) { vst1q_f64(p, v); }
+inline Lanes lanesAdd(Lanes a, Lanes b) { return vaddq_f64(a, b); }
+inline Lanes lanesSub(Lanes a, Lanes b) { return vsubq_f64(a, b); }
+inline Lanes lanesMul(Lanes a, Lanes b) { return vmulq_f64(a, b); }
+inline Lanes lanesDiv(Lanes a, Lanes b) { return vdivq_f64(a, b); }
+typedef uint64x2_t LaneMask;
+inline LaneMask lanesEqual(Lanes a, Lanes b) { return vceqq_f64(a, b); }
+inline LaneMask lanesLessEqual(Lanes a, Lanes b) { return vcleq_f64(a, b); }
+inline LaneMask lanesOr(LaneMask a, LaneMask b) { return vorrq_u64(a, b); }
+inline bool lanesAll(LaneMask m) { return (vgetq_lane_u64(m, 0) & vgetq_lane_u64(m, 1)) != 0; }
+inline Lanes lanesSelect(LaneMask m, Lanes a, Lanes b) { return vbslq_f64(m, a, b); }
+inline Lanes lanesAbs(Lanes a) { return vabsq_f64(a); }
+inline Lanes lanesNegateWhere(LaneMask m, Lanes a)
+{
+    return vreinterpretq_f64_u64(veorq_u64(vreinterpretq_u64_f64(a), vandq_u64(m, vdupq_n_u64(1ULL << 63))));
+}
+#else
+const std::size_t SIMD_LANES = 0;
+#endif
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(__aarch64__)
+#define HAVE_SIMD_LANES 1
+#endif
+
+struct AddOp {
+    static Number apply(Number a, Number b) { return a + b; }
+#ifdef HAVE_SIMD_LANES
+    static Lanes apply(Lanes a, Lanes b) { return lanesAdd(a, b); }
+#endif
+};
+
+struct SubOp {
+    static Number apply(Number a, Number b) { return a - b; }
+#ifdef HAVE_SIMD_LANES
+    static Lanes apply(Lanes a, Lanes b) { return lanesSub(a, b); }
+#endif
+};
+
+struct MulOp {
+    static Number apply(Number a, Number b) { return a * b; }
+#ifdef HAVE_SIMD_LANES
+    static Lanes apply(Lanes a, Lanes b) { return lanesMul(a, b); }
+#endif
+};
+
+struct DivOp {
+    static Number apply(Number a, Number b) { return a / b; }
+#ifdef HAVE_SIMD_LANES
+    static Lanes apply(Lanes a, Lanes b) { return lanesDiv(a, b); }
+#endif
+};
+
+#ifdef HAVE_SIMD_LANES
+// A SIMD register with the arithmetic operators the fast_math_kernels.hpp templates use
+struct LaneNumbers {
+    Lanes v;
+    LaneNumbers(Lanes v) : v(v) {}
+    LaneNumbers(Number x) : v(lanesSplat(x)) {}
+};
+
+inline LaneNumbers operator+(LaneNumbers a, LaneNumbers b) { return lanesAdd(a.v, b.v); }
+inline LaneNumbers operator-(LaneNumbers a, LaneNumbers b) { return lanesSub(a.v, b.v); }
+inline LaneNumbers operator*(LaneNumbers a, LaneNumbers b) { return lanesMul(a.v, b.v); }
+
+// fastSin and fastCos of the lanes of x, all nonzero ones within FAST_TRIG_LIMIT. Both
+// polynomials are evaluated and the quadrant picks between them with masks, so no lane
+// branches. k mod 4 is the fraction of k / 4, which stays exact since |k| < 2^20.
+inline void lanesFastSinCos(Lanes x, Lanes &sin_x, Lanes &cos_x)
+{
+    LaneNumbers r = 0.0;
+    LaneNumbers rr = 0.0;
+    LaneNumbers quarter = fastReduce(LaneNumbers(x), r, rr) * 0.25;
+    // rounding quarter - 3/8 to the nearest integer gives its floor whichever quarter it ends in
+    LaneNumbers floor = ((quarter - 0.375) + FAST_ROUNDING_SHIFT) - FAST_ROUNDING_SHIFT;
+    Lanes quadrant = (quarter - floor).v;
+    LaneMask q1 = lanesEqual(quadrant, lanesSplat(0.25));
+    LaneMask q2 = lanesEqual(quadrant, lanesSplat(0.5));
+    LaneMask q3 = lanesEqual(quadrant, lanesSplat(0.75));
+    LaneMask odd = lanesOr(q1, q3);
+
+    Lanes s = fastKernelSin(r, rr).v;
+    Lanes c = fastKernelCos(r, rr).v;
+    LaneMask zero = lanesEqual(x, lanesSplat(0.0));
+    // sin(+-0) is +-0 and cos(+-0) is 1, as from libm
+    sin_x = lanesSelect(zero, x, lanesNegateWhere(lanesOr(q2, q3), lanesSelect(odd, c, s)));
+    cos_x = lanesSelect(zero, lanesSplat(1.0), lanesNegateWhere(lanesOr(q1, q2), lanesSelect(odd, s, c)));
+}
+#endif
+
+// Applies a lane-wise operation with scalar broadcasting and a scalar tail
+template <typename Op>
+void binaryLanes(const Number *a, bool a_is_list, const Number *b, bool b_is_list, Number *out, std::size_t n)
+{
+    std::size_t i = 0;
+#ifdef HAVE_SIMD_LANES
+    const Lanes a_splat = lanesSplat(*a);
+    const Lanes b_splat = lanesSplat(*b);
+    for (; i + SIMD_LANES <= n; i += SIMD_LANES) {
+        Lanes x = a_is_list ? lanesLoad(a + i) : a_splat;
+        Lanes y = b_is_list ? lanesLoad(b + i) : b_splat;
+        lanesStore(out + i, Op::apply(x, y));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = Op::apply(a_is_list ? a[i] : *a, b_is_list ? b[i] : *b);
+    }
+}
+
+}
+
+/* Applies a binary operation element-wise with scalar broadcasting */
+void kernelBinary(KernelOp op, const Number *a, bool a_is_list, const Number *b, bool b_is_list,
+                  Number *out, std::size_t n)
+{
+    if (n == 0) {
+        return;
+    }
+    switch (op) {
+        case KernelOp::Add:
+            binaryLanes<AddOp>(a, a_is_list, b, b_is_list, out, n);
+            break;
+        case KernelOp::Subtract:
+            binaryLanes<SubOp>(a, a_is_list, b, b_is_list, out, n);
+            break;
+        case KernelOp::Multiply:
+            binaryLanes<MulOp>(a, a_is_list, b, b_is_list, out, n);
+            break;
+        case KernelOp::Divide:
+            binaryLanes<DivOp>(a, a_is_list, b, b_is_list, out, n);
+            break;
+        case KernelOp::Pow:
+            for (std::size_t i = 0; i < n; ++i) {
+                out[i] = std::pow(a_is_list ? a[i] : *a, b_is_list ? b[i] : *b);
+            }
+            break;
+        case KernelOp::Arctan:
+            for (std::size_t i = 0; i < n; ++i) {
+                out[i] = std::atan2(a_is_list ? a[i] : *a, b_is_list ? b[i] : *b);
+            }
+            break;
+        case KernelOp::FastPow:
+            for (std::size_t i = 0; i < n; ++i) {
+                out[i] = fastPow(a_is_list ? a[i] : *a, b_is_list ? b[i] : *b);
+            }
+            break;
+        case KernelOp::FastArctan:
+            for (std::size_t i = 0; i < n; ++i) {
+                out[i] = fastAtan2(a_is_list ? a[i] : *a, b_is_list ? b[i] : *b);
+            }
+            break;
+    }
+}
+
+/* Applies a unary operation element-wise */
+void kernelUnary(KernelUnary op, const Number *a, Number *out, std::size_t n)
+{
+    switch (op) {
+        case KernelUnary::Negate: {
+            // multiply rather than subtract from zero so that -0 matches scalar negation
+            const Number minus_one = -1;
+            binaryLanes<MulOp>(&minus_one, false, a, true, out, n);
+            break;
+        }
+        case KernelUnary::Sine:
+            for (std::size_t i = 0; i < n; ++i) {
+                out[i] = std::sin(a[i]);
+            }
+            break;
+        case KernelUnary::Cosine:
+            for (std::size_t i = 0; i < n; ++i) {
+                out[i] = std::cos(a[i]);
+            }
+            break;
+        case KernelUnary::Log10:
+            for (std::size_t i = 0; i < n; ++i) {
+                out[i] = std::log10(a[i]);
+            }
+            break;
+        case KernelUnary::FastSine:
+            kernelFastSinCos(a, out, nullptr, n);
+            break;
+        case KernelUnary::FastCosine:
+            kernelFastSinCos(a, nullptr, out, n);
+            break;
+        case KernelUnary::FastLog10:
+            for (std::size_t i = 0; i < n; ++i) {
+                out[i] = fastLog10(a[i]);
+            }
+            break;
+    }
+}
+
+/* fastSin and fastCos element-wise, in SIMD lanes wherever a register's worth of elements are all
+   on the kernels' fast path; a register with a huge or non-finite element takes the scalar kernels */
+void kernelFastSinCos(const Number *a, Number *sin_out, Number *cos_out, std::size_t n)
+{
+    std::size_t i = 0;
+#ifdef HAVE_SIMD_LANES
+    const Lanes limit = lanesSplat(FAST_TRIG_LIMIT);
+    for (; i + SIMD_LANES <= n; i += SIMD_LANES) {
+        Lanes x = lanesLoad(a + i);
+        if (!lanesAll(lanesLessEqual(lanesAbs(x), limit))) {
+            for (std::size_t j = i; j < i + SIMD_LANES; ++j) {
+                Number element = a[j];
+                if (sin_out) {
+                    sin_out[j] = fastSin(element);
+                }
+                if (cos_out) {
+                    cos_out[j] = fastCos(element);
+                }
+            }
+            continue;
+        }
+        Lanes s;
+        Lanes c;
+        lanesFastSinCos(x, s, c);
+        if (sin_out) {
+            lanesStore(sin_out + i, s);
+        }
+        if (cos_out) {
+            lanesStore(cos_out + i, c);
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        Number element = a[i];
+        if (sin_out) {
+            sin_out[i] = fastSin(element);
+        }
+        if (cos_out) {
+            cos_out[i] = fastCos(element);
+        }
+    }
+}
+
+/* Sum of n elements, added in order from zero as the scalar + does, so the result is the
+   same to the last bit; summing in SIMD lanes would reassociate the additions */
+Number kernelSum(const Number *a, std::size_t n)
+{
+    Number total = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        total += a[i];
+    }
+    return total;
+}
+
+/* Smallest of n > 0 elements, compared in order as the scalar min does: the first of equal
+   elements wins (0 before -0, say) and a NaN is skipped unless it comes first. SIMD min
+   instructions break ties and treat NaN by operand position instead, so none are used. */
+Number kernelMin(const Number *a, std::size_t n)
+{
+    Number best = a[0];
+    for (std::size_t i = 1; i < n; ++i) {
+        best = a[i] < best ? a[i] : best;
+    }
+    return best;
+}
+
+/* Largest of n > 0 elements, compared in order as the scalar max does */
+Number kernelMax(const Number *a, std::size_t n)
+{
+    Number best = a[0];
+    for (std::size_t i = 1; i < n; ++i) {
+        best = a[i] > best ? a[i] : best;
+    }
+    return best;
+}
@@ -0,0 +1,34 @@
+#ifndef VECTOR_KERNELS_HPP
+#define VECTOR_KERNELS_HPP
+
+#include <cstddef>
+#include "expression.hpp"
+
+// Element-wise binary operations over contiguous doubles
+// (the Fast operations are the fast_math.hpp kernels of MathMode::Fast)
+enum class KernelOp { Add, Subtract, Multiply, Divide, Pow, Arctan, FastPow, FastArctan };
+
+// Element-wise unary operations over contiguous doubles
+enum class KernelUnary { Negate, Sine, Cosine, Log10, FastSine, FastCosine, FastLog10 };
+
+// out[i] = a[i] op b[i] for i < n. When a_is_list (or b_is_list) is false that operand
+// is the single scalar *a (or *b) broadcast to every element. out may alias a or b.
+// Add, Subtract, Multiply and Divide use SIMD lanes where the target supports them.
+void kernelBinary(KernelOp op, const Number *a, bool a_is_list, const Number *b, bool b_is_list,
+                  Number *out, std::size_t n);
+
+// out[i] = op(a[i]) for i < n; out may alias a
+void kernelUnary(KernelUnary op, const Number *a, Number *out, std::size_t n);
+
+// sin_out[i] = fastSin(a[i]) and cos_out[i] = fastCos(a[i]) for i < n, bit for bit, with one
+// range reduction per element for both; either output may be null, and either may alias a.
+// FastSine and FastCosine use it, computing in SIMD lanes where the target has them.
+void kernelFastSinCos(const Number *a, Number *sin_out, Number *cos_out, std::size_t n);
+
+// Reductions over n > 0 elements, in element order, so each gives exactly the result of the
+// scalar builtin applied to the elements as arguments
+Number kernelSum(const Number *a, std::size_t n);
+Number kernelMin(const Number *a, std::size_t n);
+Number kernelMax(const Number *a, std::size_t n);
+
+#endif
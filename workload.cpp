@@ -0,0 +1,178 @@
+#include "workload.hpp"
+#include <random>
+#include <string>
+
+namespace {
+
+// Writes a script piece by piece into a buffer flushed to the stream when large
+class WorkloadWriter {
+public:
+    WorkloadWriter(const WorkloadSpec &spec, std::ostream &out) : spec(spec), out(out), random(spec.seed) {
+        buffer.reserve(FLUSH_BYTES + 4096);
+    }
+
+    ~WorkloadWriter() { flush(); }
+
+    void write() {
+        buffer += "; generated workload: shapes=" + std::to_string(spec.shapes) +
+                  " depth=" + std::to_string(spec.depth) + " defines=" + std::to_string(spec.defines);
+        newline();
+        const char *indent = spec.repl ? "" : "  ";
+        if (!spec.repl) {
+            buffer += "(begin";
+            newline();
+        }
+        for (std::uint64_t i = 0; i < spec.defines; ++i) {
+            buffer += indent;
+            buffer += "(define g" + std::to_string(i) + ' ';
+            literal();
+            buffer += ')';
+            newline();
+        }
+        for (std::uint64_t i = 0; i < spec.shapes; ++i) {
+            if (chance(spec.comment_ratio)) {
+                buffer += indent;
+                buffer += "; shape " + std::to_string(i);
+                newline();
+            }
+            buffer += spec.repl ? "" : "  (draw ";
+            shape(i % 6);
+            buffer += spec.repl ? "" : ")";
+            newline();
+            if (buffer.size() >= FLUSH_BYTES) {
+                flush();
+            }
+        }
+        if (!spec.repl) {
+            buffer += ')';
+            newline();
+        }
+    }
+
+private:
+    static const std::size_t FLUSH_BYTES = 1 << 20;
+
+    const WorkloadSpec &spec;
+    std::ostream &out;
+    std::mt19937_64 random; // its sequence is fixed by the standard, unlike the distributions'
+    std::string buffer;
+
+    void flush() {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+    void newline() { buffer += spec.crlf ? "\r\n" : "\n"; }
+
+    // True with the given probability
+    bool chance(double probability) { return (random() >> 11) * (1.0 / 9007199254740992.0) < probability; }
+
+    // A number with up to three decimals in [-100, 100)
+    void literal() {
+        long thousandths = static_cast<long>(random() % 200000) - 100000;
+        if (thousandths < 0) {
+            buffer += '-';
+            thousandths = -thousandths;
+        }
+        buffer += std::to_string(thousandths / 1000);
+        if (thousandths % 1000 != 0) {
+            std::string decimals = std::to_string(1000 + thousandths % 1000);
+            buffer += '.';
+            buffer.append(decimals, 1, std::string::npos);
+        }
+    }
+
+    // A literal or a global
+    void leaf() {
+        if (spec.defines > 0 && chance(spec.symbol_ratio)) {
+            buffer += 'g' + std::to_string(random() % spec.defines);
+        } else {
+            literal();
+        }
+    }
+
+    // A coordinate computed by arithmetic nested depth levels deep
+    void operand(unsigned depth) {
+        if (depth == 0) {
+            leaf();
+            return;
+        }
+        // halving rather than multiplying by a leaf keeps deep coordinates finite
+        std::uint64_t operation = random() % 3;
+        if (operation == 2) {
+            buffer += "(* 0.5 ";
+        } else {
+            buffer += operation == 0 ? "(+ " : "(- ";
+            leaf();
+            buffer += ' ';
+        }
+        operand(depth - 1);
+        buffer += ')';
+    }
+
+    void point() {
+        buffer += "(point ";
+        operand(spec.depth);
+        buffer += ' ';
+        operand(spec.depth);
+        buffer += ')';
+    }
+
+    void rect() {
+        buffer += "(rect";
+        for (int i = 0; i < 4; ++i) {
+            buffer += ' ';
+            operand(spec.depth);
+        }
+        buffer += ')';
+    }
+
+    void shape(std::uint64_t kind) {
+        switch (kind) {
+        case 0:
+            point();
+            break;
+        case 1:
+            buffer += "(line ";
+            point();
+            buffer += ' ';
+            point();
+            buffer += ')';
+            break;
+        case 2:
+            rect();
+            break;
+        case 3:
+            buffer += "(ellipse ";
+            rect();
+            buffer += ')';
+            break;
+        case 4:
+            buffer += "(arc ";
+            point();
+            buffer += ' ';
+            point();
+            buffer += ' ';
+            operand(spec.depth);
+            buffer += ')';
+            break;
+        default:
+            buffer += "(fill_rect ";
+            rect();
+            for (int i = 0; i < 3; ++i) {
+                buffer += ' ' + std::to_string(random() % 256);
+            }
+            buffer += ')';
+            break;
+        }
+    }
+};
+
+}
+
+/* Streams the script out a block at a time */
+void writeWorkload(const WorkloadSpec &spec, std::ostream &out)
+{
+    WorkloadWriter writer(spec, out);
+    writer.write();
+}
@@ -0,0 +1,25 @@
+#ifndef WORKLOAD_HPP
+#define WORKLOAD_HPP
+
+#include <cstdint>
+#include <ostream>
+
+// Parameters of a synthetic script: a begin block of defines followed by draws, or the same
+// forms at top level, line by line
+struct WorkloadSpec {
+    std::uint64_t shapes = 1000;  // draw forms, cycling through the six shape types
+    unsigned depth = 1;           // nesting of the arithmetic computing each coordinate
+    std::uint64_t defines = 100;  // globals defined before the draws
+    double symbol_ratio = 0.5;    // share of operands that read a global rather than a literal
+    double comment_ratio = 0.1;   // share of draws preceded by a comment line
+    bool crlf = false;            // end lines with CR LF rather than LF
+    bool repl = false;            // one top-level form per line, as typed into a REPL, with each
+                                  // shape left for the REPL to print rather than drawn
+    std::uint64_t seed = 1;       // the same spec and seed always write the same script
+};
+
+// Writes the script spec describes to out as it goes, so its size is not bounded by memory.
+// Every draw is valid, so the script evaluates without errors whatever the parameters.
+void writeWorkload(const WorkloadSpec &spec, std::ostream &out);
+
+#endif